@@ -0,0 +1,13 @@
+in vec4 vColor;
+in vec2 vUV;
+out vec4 ocol;
+layout(push_constant) uniform Draw
+{
+	vec4 UVTransform;
+	uint TextureIndex;
+	uint TextureLayer;
+};
+void main()
+{
+	ocol = vColor * SAMPLE_TEXTURE_LAYER(TextureIndex, vUV * UVTransform.xy + UVTransform.zw, TextureLayer);
+}
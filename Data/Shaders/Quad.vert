@@ -0,0 +1,17 @@
+layout(location = 0) in vec3 aVertex;
+layout(location = 1) in vec4 aColor;
+layout(location = 2) in mat4 aModel;
+layout(std140, binding = 0) uniform Block
+{
+	mat4 projectionMatrix;
+	mat4 modelMatrix;
+	mat4 viewMatrix;
+};
+out vec4 vColor;
+out vec2 vUV;
+void main()
+{
+    vColor = aColor;
+    vUV = aVertex.xy * 0.5 + 0.5;
+    gl_Position = projectionMatrix * viewMatrix * modelMatrix * aModel * vec4(aVertex, 1.0);
+}
@@ -0,0 +1,254 @@
+#include "AssetPack.h"
+#include "Profiler.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Vulkan
+{
+namespace
+{
+	const uint32_t PACK_MAGIC = 0x304B5041; // APK0
+	const uint32_t PACK_VERSION = 1;
+
+	// Every asset starts on a page so prefetching and releasing one never touches its neighbours
+	const uint64_t PACK_ALIGNMENT = 4096;
+
+	struct PackHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t Count;
+		uint32_t NamesSize; // Names come straight after the entries
+		uint64_t Size;      // Of the whole pack
+		uint8_t Padding[40];
+	};
+	static_assert(sizeof(PackHeader) == 64, "Pack header needs to stay 64 bytes");
+
+	struct PackEntry
+	{
+		uint32_t NameOffset; // In to the names
+		uint32_t NameSize;
+		uint32_t Type;
+		uint32_t Format;
+		uint32_t Width, Height;
+		uint32_t Levels;
+		uint32_t Padding;
+		uint64_t Offset;     // From the start of the pack
+		uint64_t Size;
+	};
+	static_assert(sizeof(PackEntry) == 48, "Pack entries need to stay 48 bytes");
+
+	uint64_t AlignUp(uint64_t Value, uint64_t Alignment)
+	{
+		return (Value + Alignment - 1) & ~(Alignment - 1);
+	}
+}
+
+AssetPack::AssetPack(std::string Filename)
+	: mFilename(Filename)
+{
+	PROFILE_SCOPE("AssetPack");
+
+	int fd = open(mFilename.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		printf("Couldn't open asset pack '%s'\n", mFilename.c_str());
+		return;
+	}
+
+	struct stat Info;
+	void* Mapping = MAP_FAILED;
+	if (!fstat(fd, &Info) && (size_t)Info.st_size >= sizeof(PackHeader))
+		Mapping = mmap(nullptr, Info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (Mapping == MAP_FAILED)
+	{
+		printf("Couldn't map asset pack '%s'\n", mFilename.c_str());
+		return;
+	}
+
+	// Assets get prefetched as they're needed, left alone the kernel would read around every fault
+	madvise(Mapping, Info.st_size, MADV_RANDOM);
+
+	const uint8_t* Base = (const uint8_t*)Mapping;
+	const PackHeader* Header = (const PackHeader*)Base;
+	const uint64_t TOCSize = sizeof(PackHeader) + (uint64_t)Header->Count * sizeof(PackEntry) + Header->NamesSize;
+	if (Header->Magic != PACK_MAGIC ||
+	    Header->Version != PACK_VERSION ||
+	    Header->Size != (uint64_t)Info.st_size ||
+	    TOCSize > Header->Size)
+	{
+		printf("'%s' isn't an asset pack we can read\n", mFilename.c_str());
+		munmap(Mapping, Info.st_size);
+		return;
+	}
+
+	const PackEntry* Entries = (const PackEntry*)(Base + sizeof(PackHeader));
+	const char* Names = (const char*)(Entries + Header->Count);
+	for (uint32_t i = 0; i < Header->Count; ++i)
+	{
+		const PackEntry& Entry = Entries[i];
+		if ((uint64_t)Entry.NameOffset + Entry.NameSize > Header->NamesSize ||
+		    Entry.Offset > Header->Size || Entry.Size > Header->Size - Entry.Offset)
+		{
+			printf("Asset pack '%s' is broken\n", mFilename.c_str());
+			mAssets.clear();
+			munmap(Mapping, Info.st_size);
+			return;
+		}
+
+		mAssets[std::string(Names + Entry.NameOffset, Entry.NameSize)] = Asset
+		{
+			.Type = (AssetType)Entry.Type,
+			.Width = Entry.Width,
+			.Height = Entry.Height,
+			.Levels = Entry.Levels,
+			.Format = (VkFormat)Entry.Format,
+			.Data = Base + Entry.Offset,
+			.Size = Entry.Size,
+		};
+	}
+
+	mMapping = Mapping;
+	mSize = Info.st_size;
+	printf("Asset pack '%s': %d assets, %.1fMB\n", mFilename.c_str(), (uint32_t)mAssets.size(), mSize / (1024.0 * 1024.0));
+}
+
+AssetPack::~AssetPack()
+{
+	if (mMapping)
+		munmap(mMapping, mSize);
+}
+
+const AssetPack::Asset* AssetPack::Find(const std::string& Name) const
+{
+	auto It = mAssets.find(Name);
+	return It != mAssets.end() ? &It->second : nullptr;
+}
+
+void AssetPack::Prefetch(const Asset& Loading) const
+{
+	// Assets start on a page, the end doesn't need to be aligned
+	madvise((void*)Loading.Data, Loading.Size, MADV_WILLNEED);
+}
+
+void AssetPack::Release(const Asset& Loaded) const
+{
+	// Clean file backed pages, they just get read back in if they're touched again
+	madvise((void*)Loaded.Data, Loaded.Size, MADV_DONTNEED);
+}
+
+void AssetPackWriter::Add(const std::string& Name, const AssetPack::Asset& Info, const uint8_t* Data, uint64_t Size)
+{
+	mPending.push_back({Name, Info, std::vector<uint8_t>(Data, Data + Size)});
+	mPending.back().Info.Size = Size;
+}
+
+void AssetPackWriter::AddTexture(const std::string& Name, uint32_t Width, uint32_t Height, uint32_t Levels,
+                                 VkFormat Format, const uint8_t* Data, uint64_t Size)
+{
+	AssetPack::Asset Info{};
+	Info.Type = AssetPack::AssetType::Texture;
+	Info.Width = Width;
+	Info.Height = Height;
+	Info.Levels = Levels;
+	Info.Format = Format;
+	Add(Name, Info, Data, Size);
+}
+
+void AssetPackWriter::AddShader(const std::string& Name, const std::string& Source)
+{
+	AssetPack::Asset Info{};
+	Info.Type = AssetPack::AssetType::Shader;
+	Add(Name, Info, (const uint8_t*)Source.data(), Source.size());
+}
+
+void AssetPackWriter::AddBuffer(const std::string& Name, const uint8_t* Data, uint64_t Size)
+{
+	AssetPack::Asset Info{};
+	Info.Type = AssetPack::AssetType::Buffer;
+	Add(Name, Info, Data, Size);
+}
+
+bool AssetPackWriter::Write(const std::string& Filename) const
+{
+	std::vector<PackEntry> Entries;
+	std::string Names;
+	for (auto& Asset : mPending)
+	{
+		PackEntry Entry{};
+		Entry.NameOffset = Names.size();
+		Entry.NameSize = Asset.Name.size();
+		Entry.Type = (uint32_t)Asset.Info.Type;
+		Entry.Format = Asset.Info.Format;
+		Entry.Width = Asset.Info.Width;
+		Entry.Height = Asset.Info.Height;
+		Entry.Levels = Asset.Info.Levels;
+		Entry.Size = Asset.Data.size();
+		Entries.push_back(Entry);
+		Names += Asset.Name;
+	}
+
+	// Lay the data out after the table of contents in the order it was added
+	uint64_t Offset = AlignUp(sizeof(PackHeader) + Entries.size() * sizeof(PackEntry) + Names.size(), PACK_ALIGNMENT);
+	for (auto& Entry : Entries)
+	{
+		Entry.Offset = Offset;
+		Offset = AlignUp(Offset + Entry.Size, PACK_ALIGNMENT);
+	}
+
+	PackHeader Header{};
+	Header.Magic = PACK_MAGIC;
+	Header.Version = PACK_VERSION;
+	Header.Count = Entries.size();
+	Header.NamesSize = Names.size();
+	Header.Size = Offset;
+
+	// Same as the cache, written to the side and renamed over so a half written pack never gets opened
+	const std::string Temporary = Filename + ".tmp";
+	FILE* fp = fopen(Temporary.c_str(), "wb");
+	if (!fp)
+	{
+		printf("Couldn't write asset pack '%s'\n", Filename.c_str());
+		return false;
+	}
+
+	const std::vector<uint8_t> Zeroes(PACK_ALIGNMENT, 0);
+	uint64_t Written = 0;
+	auto WriteData = [&](const void* Data, uint64_t Size)
+	{
+		Written += fwrite(Data, 1, Size, fp);
+	};
+	auto PadTo = [&](uint64_t Target)
+	{
+		WriteData(Zeroes.data(), Target - Written);
+	};
+
+	WriteData(&Header, sizeof(Header));
+	WriteData(Entries.data(), Entries.size() * sizeof(PackEntry));
+	WriteData(Names.data(), Names.size());
+	for (uint32_t i = 0; i < Entries.size(); ++i)
+	{
+		PadTo(Entries[i].Offset);
+		WriteData(mPending[i].Data.data(), Entries[i].Size);
+	}
+	PadTo(Header.Size);
+
+	bool Success = !fclose(fp) && Written == Header.Size;
+	if (!Success || rename(Temporary.c_str(), Filename.c_str()))
+	{
+		printf("Couldn't write asset pack '%s'\n", Filename.c_str());
+		unlink(Temporary.c_str());
+		return false;
+	}
+
+	printf("Wrote asset pack '%s': %d assets, %.1fMB\n", Filename.c_str(), Header.Count, Header.Size / (1024.0 * 1024.0));
+	return true;
+}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Vulkan
+{
+// Single file of assets, mapped in to memory and used in place
+// A small table of contents up front is followed by every asset on its own page aligned
+// range, in the order they were added, so loading them in that order is one sequential read
+// Textures are stored ready to upload with their whole mip chain, in the same layout as
+// the texture cache, so nothing gets parsed or decoded on the way to staging
+class AssetPack
+{
+public:
+	enum class AssetType : uint32_t
+	{
+		Texture,
+		Shader,
+		Buffer, // Vertex, index or anything else copied as is
+	};
+
+	struct Asset
+	{
+		AssetType Type;
+		uint32_t Width, Height, Levels; // Textures only
+		VkFormat Format;
+		const uint8_t* Data;
+		uint64_t Size;
+	};
+
+	AssetPack(std::string Filename);
+	~AssetPack();
+
+	static std::unique_ptr<AssetPack> Create(std::string Filename)
+	{
+		return std::make_unique<AssetPack>(Filename);
+	}
+
+	// Names are whatever the asset was added under, usually the path it was loaded from
+	const Asset* Find(const std::string& Name) const;
+
+	// Starts reading an asset in the background ahead of it being needed
+	void Prefetch(const Asset& Loading) const;
+
+	// Done with it, the pages can go
+	void Release(const Asset& Loaded) const;
+
+	// Information
+	bool IsOpen() const { return mMapping != nullptr; }
+	size_t GetAssets() const { return mAssets.size(); }
+	size_t GetSize() const { return mSize; }
+
+private:
+	std::string mFilename;
+	void* mMapping = nullptr;
+	size_t mSize = 0;
+
+	std::unordered_map<std::string, Asset> mAssets;
+};
+
+// Puts together a pack, everything is held in memory until it gets written
+class AssetPackWriter
+{
+public:
+	void AddTexture(const std::string& Name, uint32_t Width, uint32_t Height, uint32_t Levels, VkFormat Format,
+	                const uint8_t* Data, uint64_t Size);
+	void AddShader(const std::string& Name, const std::string& Source);
+	void AddBuffer(const std::string& Name, const uint8_t* Data, uint64_t Size);
+
+	bool Write(const std::string& Filename) const;
+
+private:
+	struct Pending
+	{
+		std::string Name;
+		AssetPack::Asset Info;
+		std::vector<uint8_t> Data;
+	};
+
+	void Add(const std::string& Name, const AssetPack::Asset& Info, const uint8_t* Data, uint64_t Size);
+
+	std::vector<Pending> mPending;
+};
+}
@@ -0,0 +1,240 @@
+#include "AtlasPacker.h"
+
+#include <algorithm>
+#include <assert.h>
+
+namespace Vulkan
+{
+namespace
+{
+	bool Overlaps(const AtlasPacker::Rect& A, const AtlasPacker::Rect& B)
+	{
+		return A.X < B.X + B.Width && B.X < A.X + A.Width &&
+		       A.Y < B.Y + B.Height && B.Y < A.Y + A.Height;
+	}
+
+	bool Contains(const AtlasPacker::Rect& Outer, const AtlasPacker::Rect& Inner)
+	{
+		return Inner.X >= Outer.X && Inner.Y >= Outer.Y &&
+		       Inner.X + Inner.Width <= Outer.X + Outer.Width &&
+		       Inner.Y + Inner.Height <= Outer.Y + Outer.Height;
+	}
+}
+
+AtlasPacker::AtlasPacker(uint32_t Width, uint32_t Height)
+	: mWidth(Width)
+	, mHeight(Height)
+{
+	mFree.push_back({0, 0, Width, Height});
+}
+
+bool AtlasPacker::Insert(uint32_t Width, uint32_t Height, Rect* Placed)
+{
+	assert(Width && Height);
+
+	auto FindBest = [&]()
+	{
+		// Best short side fit, ties go to the long side
+		uint32_t BestShort = ~0U, BestLong = ~0U;
+		size_t Best = mFree.size();
+		for (size_t i = 0; i < mFree.size(); ++i)
+		{
+			const Rect& Free = mFree[i];
+			if (Free.Width < Width || Free.Height < Height)
+				continue;
+
+			const uint32_t LeftoverX = Free.Width - Width;
+			const uint32_t LeftoverY = Free.Height - Height;
+			const uint32_t Short = std::min(LeftoverX, LeftoverY);
+			const uint32_t Long = std::max(LeftoverX, LeftoverY);
+			if (Short < BestShort || (Short == BestShort && Long < BestLong))
+			{
+				Best = i;
+				BestShort = Short;
+				BestLong = Long;
+			}
+		}
+		return Best;
+	};
+
+	size_t Best = FindBest();
+	if (Best == mFree.size() && mFragmented)
+	{
+		Rebuild();
+		Best = FindBest();
+	}
+	if (Best == mFree.size())
+		return false;
+
+	*Placed = {mFree[Best].X, mFree[Best].Y, Width, Height};
+	mPlaced.push_back(*Placed);
+	mUsed += (uint64_t)Width * Height;
+
+	const size_t First = mFree.size();
+	Split(*Placed);
+	Prune(First);
+	return true;
+}
+
+void AtlasPacker::Remove(const Rect& Placed)
+{
+	auto It = std::find_if(mPlaced.begin(), mPlaced.end(), [&](const Rect& Used)
+	{
+		return Used.X == Placed.X && Used.Y == Placed.Y;
+	});
+	assert(It != mPlaced.end() && It->Width == Placed.Width && It->Height == Placed.Height);
+	*It = mPlaced.back();
+	mPlaced.pop_back();
+	mUsed -= (uint64_t)Placed.Width * Placed.Height;
+
+	// Free space touching it on a side can now stretch across it
+	// Only one step out though, anything further waits for a rebuild
+	const size_t First = mFree.size();
+	for (size_t i = 0; i < First; ++i)
+	{
+		const Rect Free = mFree[i];
+		const uint32_t Top = std::max(Free.Y, Placed.Y);
+		const uint32_t Bottom = std::min(Free.Y + Free.Height, Placed.Y + Placed.Height);
+		if (Top < Bottom && (Free.X + Free.Width == Placed.X || Placed.X + Placed.Width == Free.X))
+		{
+			const uint32_t Left = std::min(Free.X, Placed.X);
+			mFree.push_back({Left, Top, std::max(Free.X + Free.Width, Placed.X + Placed.Width) - Left, Bottom - Top});
+		}
+
+		const uint32_t Left = std::max(Free.X, Placed.X);
+		const uint32_t Right = std::min(Free.X + Free.Width, Placed.X + Placed.Width);
+		if (Left < Right && (Free.Y + Free.Height == Placed.Y || Placed.Y + Placed.Height == Free.Y))
+		{
+			const uint32_t Top = std::min(Free.Y, Placed.Y);
+			mFree.push_back({Left, Top, Right - Left, std::max(Free.Y + Free.Height, Placed.Y + Placed.Height) - Top});
+		}
+	}
+
+	mFree.push_back(Placed);
+	Prune(First);
+	mFragmented = true;
+}
+
+void AtlasPacker::Rebuild()
+{
+	mFree.clear();
+	mFree.push_back({0, 0, mWidth, mHeight});
+	for (const Rect& Used : mPlaced)
+	{
+		const size_t First = mFree.size();
+		Split(Used);
+		Prune(First);
+	}
+
+	mFragmented = false;
+	++mRebuilds;
+}
+
+void AtlasPacker::Split(const Rect& Used)
+{
+	const size_t Count = mFree.size();
+	for (size_t i = 0; i < Count; ++i)
+	{
+		const Rect Free = mFree[i];
+		if (!Overlaps(Free, Used))
+			continue;
+
+		// Whatever's left on each side is still free, the pieces overlap at the corners
+		if (Used.X > Free.X)
+			mFree.push_back({Free.X, Free.Y, Used.X - Free.X, Free.Height});
+		if (Used.X + Used.Width < Free.X + Free.Width)
+			mFree.push_back({Used.X + Used.Width, Free.Y, Free.X + Free.Width - Used.X - Used.Width, Free.Height});
+		if (Used.Y > Free.Y)
+			mFree.push_back({Free.X, Free.Y, Free.Width, Used.Y - Free.Y});
+		if (Used.Y + Used.Height < Free.Y + Free.Height)
+			mFree.push_back({Free.X, Used.Y + Used.Height, Free.Width, Free.Y + Free.Height - Used.Y - Used.Height});
+
+		// Marked for Prune
+		mFree[i].Width = 0;
+	}
+}
+
+void AtlasPacker::Prune(size_t First)
+{
+	auto Dead = [](const Rect& Free) { return !Free.Width; };
+
+	// New ones inside anything else go, then old ones inside something new
+	// Identical rectangles only ever lose one of the two
+	for (size_t i = First; i < mFree.size(); ++i)
+	{
+		for (size_t j = 0; j < mFree.size() && !Dead(mFree[i]); ++j)
+			if (j != i && !Dead(mFree[j]) && Contains(mFree[j], mFree[i]))
+				mFree[i].Width = 0;
+	}
+
+	for (size_t i = 0; i < First; ++i)
+	{
+		for (size_t j = First; j < mFree.size() && !Dead(mFree[i]); ++j)
+			if (!Dead(mFree[j]) && Contains(mFree[j], mFree[i]))
+				mFree[i].Width = 0;
+	}
+
+	mFree.erase(std::remove_if(mFree.begin(), mFree.end(), Dead), mFree.end());
+}
+
+AtlasLayout::AtlasLayout(uint32_t Size, uint32_t Unit)
+	: mUnit(Unit)
+	, mPacker(Size / Unit, Size / Unit)
+{
+	assert(Size % Unit == 0);
+}
+
+uint32_t AtlasLayout::Add(uint32_t Width, uint32_t Height, uint64_t Offset)
+{
+	assert(Width % mUnit == 0 && Height % mUnit == 0);
+
+	AtlasPacker::Rect Rect;
+	if (!mPacker.Insert(Width / mUnit, Height / mUnit, &Rect))
+		return ~0U;
+
+	Rect.X *= mUnit;
+	Rect.Y *= mUnit;
+	Rect.Width *= mUnit;
+	Rect.Height *= mUnit;
+
+	uint32_t Handle;
+	if (!mFreeHandles.empty())
+	{
+		Handle = mFreeHandles.back();
+		mFreeHandles.pop_back();
+	}
+	else
+	{
+		Handle = mEntries.size();
+		mEntries.emplace_back();
+	}
+
+	mEntries[Handle] = {Rect, true};
+	mCopies.push_back({Offset, Rect, Handle});
+	++mCount;
+	return Handle;
+}
+
+void AtlasLayout::Remove(uint32_t Handle)
+{
+	Entry& Removed = mEntries[Handle];
+	assert(Removed.Used);
+
+	// The texels stay where they are until something else gets put there
+	mPacker.Remove(
+	{
+		Removed.Rect.X / mUnit, Removed.Rect.Y / mUnit,
+		Removed.Rect.Width / mUnit, Removed.Rect.Height / mUnit,
+	});
+
+	// Handles get reused, so only the copy from before the remove can still be pending
+	mCopies.erase(std::remove_if(mCopies.begin(), mCopies.end(), [Handle](const Copy& Pending)
+	{
+		return Pending.Handle == Handle;
+	}), mCopies.end());
+
+	Removed.Used = false;
+	mFreeHandles.push_back(Handle);
+	--mCount;
+}
+}
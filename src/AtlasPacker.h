@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Vulkan
+{
+// Packs rectangles in to a fixed size area, only the placement lives here
+// MaxRects: the free space is kept as every maximal free rectangle, overlapping each other,
+// and each insert goes where it leaves the shortest leftover side. Removing gives the
+// rectangle back to the free list, so an atlas can keep going for as long as the program runs
+// Removes only patch the free list up, it gets rebuilt from what's placed once it's too
+// split up to find room
+class AtlasPacker
+{
+public:
+	struct Rect
+	{
+		uint32_t X, Y;
+		uint32_t Width, Height;
+	};
+
+	AtlasPacker(uint32_t Width, uint32_t Height);
+
+	// False when there's nowhere left it fits
+	bool Insert(uint32_t Width, uint32_t Height, Rect* Placed);
+
+	// Placed has to have come from Insert and not been removed since
+	void Remove(const Rect& Placed);
+
+	// Information
+	uint32_t GetWidth() const { return mWidth; }
+	uint32_t GetHeight() const { return mHeight; }
+	uint64_t GetUsed() const { return mUsed; }
+	size_t GetFreeRects() const { return mFree.size(); }
+	uint32_t GetRebuilds() const { return mRebuilds; }
+
+private:
+	// Cuts Used out of every free rectangle it overlaps
+	void Split(const Rect& Used);
+
+	// Drops free rectangles that sit entirely inside another
+	// The ones before First can't be inside each other already
+	void Prune(size_t First);
+
+	// Works the free rectangles out again from scratch
+	void Rebuild();
+
+	uint32_t mWidth, mHeight;
+	uint64_t mUsed = 0;
+	std::vector<Rect> mFree;
+	std::vector<Rect> mPlaced;
+
+	// Removed since the last rebuild, the free list might not be maximal
+	bool mFragmented = false;
+	uint32_t mRebuilds = 0;
+};
+
+// Which texture has which part of an atlas, and which of them still need uploading
+// Only the bookkeeping, TextureAtlas does the uploads, so it can be checked without a GPU
+// Everything's in texels, packed in Unit sized blocks
+class AtlasLayout
+{
+public:
+	AtlasLayout(uint32_t Size, uint32_t Unit);
+
+	struct Copy
+	{
+		uint64_t Offset; // In to the uploader's staging
+		AtlasPacker::Rect Rect;
+		uint32_t Handle;
+	};
+
+	// Width and Height have to be multiples of Unit
+	// Returns the handle, or ~0U when there's no room left for it
+	uint32_t Add(uint32_t Width, uint32_t Height, uint64_t Offset);
+
+	// Its space can be reused straight away, and a copy it still had pending is dropped
+	// so it can't land on top of whatever goes there next
+	void Remove(uint32_t Handle);
+
+	// Everything added since the last ClearCopies and not removed since
+	const std::vector<Copy>& GetCopies() const { return mCopies; }
+	void ClearCopies() { mCopies.clear(); }
+
+	// Information
+	const AtlasPacker::Rect& GetRect(uint32_t Handle) const { return mEntries[Handle].Rect; }
+	uint32_t GetCount() const { return mCount; }
+	const AtlasPacker& GetPacker() const { return mPacker; } // In Unit sized blocks
+
+private:
+	struct Entry
+	{
+		AtlasPacker::Rect Rect;
+		bool Used;
+	};
+
+	uint32_t mUnit;
+	AtlasPacker mPacker;
+
+	std::vector<Entry> mEntries;
+	std::vector<uint32_t> mFreeHandles;
+	std::vector<Copy> mCopies;
+	uint32_t mCount = 0;
+};
+}
@@ -0,0 +1,834 @@
+#include "Bench.h"
+#include "AtlasPacker.h"
+#include "CPUCulling.h"
+#include "JobSystem.h"
+#include "PixelConvert.h"
+#include "PNGLoader.h"
+#include "TextureCache.h"
+#include "TextureResidency.h"
+#include "TransformSystem.h"
+#include "TransientLayout.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <png.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace Bench
+{
+	// Runs Func Iterations times and returns the average in nanoseconds
+	template<typename T>
+	static double TimeNS(uint32_t Iterations, T Func)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < Iterations; ++i)
+			Func();
+		auto Diff = std::chrono::high_resolution_clock::now() - Start;
+		return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Diff).count() / Iterations;
+	}
+
+	// Encodes a PNG in to memory with libpng so the decoders have something to chew on
+	static std::vector<uint8_t> EncodePNG(const std::vector<uint8_t>& Pixels, uint32_t Width, uint32_t Height,
+	                                      bool Alpha, int Filters, int Level)
+	{
+		std::vector<uint8_t> File;
+		png_structp WriteStruct = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+		png_infop InfoStruct = png_create_info_struct(WriteStruct);
+		if (setjmp(png_jmpbuf(WriteStruct)))
+		{
+			png_destroy_write_struct(&WriteStruct, &InfoStruct);
+			return {};
+		}
+
+		png_set_write_fn(WriteStruct, &File,
+			[](png_structp WriteStruct, png_bytep Data, png_size_t Size)
+			{
+				auto Out = (std::vector<uint8_t>*)png_get_io_ptr(WriteStruct);
+				Out->insert(Out->end(), Data, Data + Size);
+			}, nullptr);
+		png_set_IHDR(WriteStruct, InfoStruct, Width, Height, 8,
+		             Alpha ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB,
+		             PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+		png_set_filter(WriteStruct, 0, Filters);
+		png_set_compression_level(WriteStruct, Level);
+		png_write_info(WriteStruct, InfoStruct);
+
+		const size_t Pitch = Width * (Alpha ? 4 : 3);
+		for (uint32_t y = 0; y < Height; ++y)
+			png_write_row(WriteStruct, &Pixels[y * Pitch]);
+		png_write_end(WriteStruct, InfoStruct);
+		png_destroy_write_struct(&WriteStruct, &InfoStruct);
+		return File;
+	}
+
+	void CPUCulling()
+	{
+		const uint32_t Counts[] = { 1000, 100000, 1000000 };
+		const uint32_t Iterations = 20;
+		const SIMDLevel Kernels[] =
+		{
+			SIMDLevel::Scalar,
+			SIMDLevel::SSE,
+			SIMDLevel::AVX2,
+		};
+
+		// Same sort of view the renderer sets up
+		const glm::mat4 Projection = glm::perspective(glm::radians(60.0f), 640.0f / 480.0f, 0.1f, 256.0f);
+		const glm::mat4 View = glm::translate(glm::mat4(), glm::vec3(0.0f, 0.0f, -2.5f));
+		const Vulkan::Frustum Frustum = Vulkan::ExtractFrustum(Projection * View);
+
+		std::mt19937 Rand(1234);
+		std::uniform_real_distribution<float> Position(-20.0f, 20.0f);
+		std::uniform_real_distribution<float> Radius(0.01f, 1.0f);
+
+		printf("CPU frustum culling\n");
+		printf("----------------------\n");
+		for (uint32_t Count : Counts)
+		{
+			Vulkan::SphereBounds Bounds;
+			Bounds.Resize(Count);
+			for (uint32_t i = 0; i < Count; ++i)
+				Bounds.Set(i, Position(Rand), Position(Rand), Position(Rand) - 20.0f, Radius(Rand));
+
+			// Scalar single threaded is the reference everything gets checked against
+			std::vector<uint32_t> Reference(Count);
+			uint32_t ReferenceCount = Vulkan::CPUCuller::CullRange(SIMDLevel::Scalar,
+				Frustum, Bounds, 0, Count, &Reference[0]);
+
+			printf("%d objects, %d visible\n", Count, ReferenceCount);
+
+			for (auto Kernel : Kernels)
+			{
+				if (!SIMDSupported(Kernel))
+				{
+					printf("\t%-6s unsupported\n", SIMDName(Kernel));
+					continue;
+				}
+
+				const uint32_t MaxThreads = std::max(1U, std::thread::hardware_concurrency());
+				for (uint32_t Threads : { 1U, MaxThreads })
+				{
+					Vulkan::JobSystem Jobs(Threads);
+					Vulkan::CPUCuller Culler(Kernel, &Jobs);
+
+					std::vector<uint32_t> Visible;
+					uint32_t VisibleCount = 0;
+					double NS = TimeNS(Iterations, [&]()
+					{
+						VisibleCount = Culler.Cull(Frustum, Bounds, &Visible);
+					});
+
+					bool Match = VisibleCount == ReferenceCount &&
+						std::equal(Reference.begin(), Reference.begin() + ReferenceCount, Visible.begin());
+
+					printf("\t%-6s %2d threads: %10.1fus, %6.2fns/object%s\n",
+					       SIMDName(Kernel), Threads,
+					       NS / 1000.0, NS / Count, Match ? "" : " MISMATCH");
+
+					if (MaxThreads == 1)
+						break;
+				}
+			}
+		}
+	}
+
+	void Transforms()
+	{
+		const uint32_t Count = 100000;
+		const uint32_t Iterations = 50;
+		const SIMDLevel Kernels[] =
+		{
+			SIMDLevel::Scalar,
+			SIMDLevel::SSE,
+			SIMDLevel::AVX2,
+		};
+
+		// Every tenth object moves for the partial runs
+		const uint32_t DirtyEvery[] = { 1, 10 };
+
+		std::mt19937 Rand(1234);
+		std::uniform_real_distribution<float> Position(-20.0f, 20.0f);
+		std::uniform_real_distribution<float> Unit(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> Scale(0.1f, 2.0f);
+
+		std::vector<glm::vec3> Positions(Count), Scales(Count);
+		std::vector<glm::quat> Rotations(Count);
+		for (uint32_t i = 0; i < Count; ++i)
+		{
+			Positions[i] = glm::vec3(Position(Rand), Position(Rand), Position(Rand));
+			Rotations[i] = glm::normalize(glm::quat(Unit(Rand), Unit(Rand), Unit(Rand), Unit(Rand)));
+			Scales[i] = glm::vec3(Scale(Rand), Scale(Rand), Scale(Rand));
+		}
+
+		auto Fill = [&](Vulkan::TransformSystem& Transforms)
+		{
+			Transforms.Resize(Count);
+			for (uint32_t i = 0; i < Count; ++i)
+				Transforms.Set(i, Positions[i], Rotations[i], Scales[i]);
+		};
+
+		// Scalar is the reference everything gets checked against
+		std::vector<glm::mat4> Reference(Count);
+		{
+			Vulkan::TransformSystem Transforms(SIMDLevel::Scalar);
+			Fill(Transforms);
+			Transforms.Update(&Reference[0], sizeof(glm::mat4));
+		}
+
+		printf("Transform update, %d objects\n", Count);
+		printf("----------------------\n");
+		for (auto Kernel : Kernels)
+		{
+			if (!SIMDSupported(Kernel))
+			{
+				printf("\t%-6s unsupported\n", SIMDName(Kernel));
+				continue;
+			}
+
+			Vulkan::TransformSystem Transforms(Kernel);
+			Fill(Transforms);
+
+			std::vector<glm::mat4> Matrices(Count);
+			Transforms.Update(&Matrices[0], sizeof(glm::mat4));
+			bool Match = !memcmp(&Reference[0], &Matrices[0], Count * sizeof(glm::mat4));
+
+			for (uint32_t Every : DirtyEvery)
+			{
+				uint32_t Written = 0;
+				double NS = TimeNS(Iterations, [&]()
+				{
+					if (Every == 1)
+						Transforms.MarkAllDirty();
+					for (uint32_t i = 0; Every != 1 && i < Count; i += Every)
+						Transforms.MarkDirty(i);
+					Written = Transforms.Update(&Matrices[0], sizeof(glm::mat4));
+				});
+
+				printf("\t%-6s %6d dirty: %10.1fus, %6.2fns/object%s\n",
+				       SIMDName(Kernel), Written,
+				       NS / 1000.0, NS / Written, Match ? "" : " MISMATCH");
+			}
+		}
+	}
+
+	void Jobs()
+	{
+		const uint32_t MaxThreads = std::max(1U, std::thread::hardware_concurrency());
+		std::vector<uint32_t> ThreadCounts;
+		for (uint32_t Threads = 1; Threads < MaxThreads; Threads *= 2)
+			ThreadCounts.push_back(Threads);
+		ThreadCounts.push_back(MaxThreads);
+
+		const uint32_t EmptyJobs = 100000;
+		const uint32_t ForCount = 1 << 23;
+		const uint32_t Stages = 1000;
+		const uint32_t FanOut = 64;
+
+		printf("Job system\n");
+		printf("----------------------\n");
+
+		double ForBase = 0.0;
+		for (uint32_t Threads : ThreadCounts)
+		{
+			Vulkan::JobSystem Jobs(Threads);
+
+			// Pure scheduling overhead
+			double EmptyNS = TimeNS(1, [&]()
+			{
+				Vulkan::JobCounter Counter;
+				for (uint32_t i = 0; i < EmptyJobs; ++i)
+					Jobs.Run([]() {}, &Counter);
+				Jobs.Wait(&Counter);
+			});
+
+			// Compute bound, should scale with cores
+			std::atomic<uint32_t> Sink{0};
+			double ForNS = TimeNS(3, [&]()
+			{
+				Jobs.ParallelFor(ForCount, 4096, [&](uint32_t Begin, uint32_t End)
+				{
+					float Acc = 0.0f;
+					for (uint32_t i = Begin; i < End; ++i)
+						Acc += sqrtf((float)i);
+					Sink += (uint32_t)Acc;
+				});
+			});
+			if (Threads == 1)
+				ForBase = ForNS;
+
+			// Fan out to a batch of jobs, then fan back in to one that depends on all of them
+			double GraphNS = TimeNS(1, [&]()
+			{
+				for (uint32_t Stage = 0; Stage < Stages; ++Stage)
+				{
+					Vulkan::JobCounter Wide, Join;
+					for (uint32_t i = 0; i < FanOut; ++i)
+						Jobs.Run([&Sink]() { ++Sink; }, &Wide);
+					Jobs.Run([&Sink]() { ++Sink; }, &Join, &Wide);
+					Jobs.Wait(&Join);
+				}
+			});
+
+			printf("\t%2d threads: %6.1fns/empty job, parallel for %8.1fus (%.2fx), %6.2fus/fan out+in stage\n",
+			       Threads, EmptyNS / EmptyJobs, ForNS / 1000.0, ForBase / ForNS, GraphNS / Stages / 1000.0);
+		}
+	}
+
+	void PixelConversion()
+	{
+		// Odd width so every kernel runs its scalar tail on each row
+		const uint32_t Width = 2047;
+		const uint32_t Height = 512;
+		const uint32_t Iterations = 20;
+		const SIMDLevel Kernels[] =
+		{
+			SIMDLevel::Scalar,
+			SIMDLevel::SSE,
+			SIMDLevel::AVX2,
+			SIMDLevel::NEON,
+		};
+		const Vulkan::PixelFormat Formats[] =
+		{
+			Vulkan::PixelFormat::Gray8,
+			Vulkan::PixelFormat::GrayAlpha8,
+			Vulkan::PixelFormat::RGB8,
+			Vulkan::PixelFormat::RGBA8,
+			Vulkan::PixelFormat::Gray16,
+			Vulkan::PixelFormat::GrayAlpha16,
+			Vulkan::PixelFormat::RGB16,
+			Vulkan::PixelFormat::RGBA16,
+		};
+
+		std::mt19937 Rand(1234);
+		std::vector<uint8_t> Source(Width * Height * 8);
+		for (auto& Byte : Source)
+			Byte = Rand();
+
+		std::vector<uint8_t> Reference(Width * Height * 4);
+		std::vector<uint8_t> Dest(Width * Height * 4);
+
+		printf("Pixel conversion to BGRA8, %dx%d\n", Width, Height);
+		printf("----------------------\n");
+		for (auto Format : Formats)
+		{
+			for (bool Premultiply : { false, true })
+			{
+				const uint32_t SrcPitch = Width * Vulkan::GetPixelSize(Format);
+				auto ConvertImage = [&](SIMDLevel Kernel, uint8_t* Out)
+				{
+					for (uint32_t y = 0; y < Height; ++y)
+						Vulkan::PixelConverter::ConvertRange(Kernel, Format, Premultiply,
+							&Source[y * SrcPitch], Out + y * Width * 4, Width);
+				};
+
+				ConvertImage(SIMDLevel::Scalar, &Reference[0]);
+
+				printf("%s%s\n", Vulkan::GetPixelFormatName(Format), Premultiply ? " premultiplied" : "");
+				for (auto Kernel : Kernels)
+				{
+					if (!SIMDSupported(Kernel))
+						continue;
+
+					memset(&Dest[0], 0, Dest.size());
+					double NS = TimeNS(Iterations, [&]() { ConvertImage(Kernel, &Dest[0]); });
+
+					// Bandwidth counts both what was read and what was written
+					double Bytes = (double)(SrcPitch + Width * 4) * Height;
+					printf("\t%-6s %8.1fus, %6.2f GB/s%s\n",
+					       SIMDName(Kernel), NS / 1000.0, Bytes / NS,
+					       Dest == Reference ? "" : " MISMATCH");
+				}
+			}
+		}
+
+		// Premultiplying has to agree with doing the maths in floats
+		uint32_t Wrong = 0;
+		for (uint32_t c = 0; c < 256; ++c)
+			for (uint32_t a = 0; a < 256; ++a)
+			{
+				const uint8_t Pixel[4] = { (uint8_t)c, (uint8_t)c, (uint8_t)c, (uint8_t)a };
+				uint8_t Out[4];
+				Vulkan::PixelConverter::ConvertRange(SIMDLevel::Scalar, Vulkan::PixelFormat::BGRA8, true, Pixel, Out, 1);
+				Wrong += Out[0] != (uint8_t)lroundf(c * a / 255.0f) || Out[3] != a;
+			}
+		printf("Premultiply rounding: %s\n", Wrong ? "MISMATCH" : "exact");
+	}
+
+	void PNGDecode()
+	{
+		struct Size
+		{
+			uint32_t Width, Height;
+		};
+		// Odd sizes catch the unfilter tails, big ones make the window slide
+		const Size Sizes[] =
+		{
+			{ 1, 1 },
+			{ 7, 3 },
+			{ 255, 17 },
+			{ 1024, 1024 },
+		};
+		const int Filters[] =
+		{
+			PNG_FILTER_NONE,
+			PNG_FILTER_SUB,
+			PNG_FILTER_UP,
+			PNG_FILTER_AVG,
+			PNG_FILTER_PAETH,
+			PNG_ALL_FILTERS,
+		};
+		const char* FilterNames[] = { "none", "sub", "up", "avg", "paeth", "all" };
+		const int Levels[] = { 0, 1, 9 };
+
+		struct Image
+		{
+			std::string Name;
+			std::vector<uint8_t> File;
+		};
+		std::vector<Image> Corpus;
+
+		std::mt19937 Rand(1234);
+		for (auto Dim : Sizes)
+			for (bool Alpha : { false, true })
+				for (bool Noise : { false, true })
+				{
+					// Noise barely compresses and gives lots of literals, gradients give long matches
+					const uint32_t BPP = Alpha ? 4 : 3;
+					std::vector<uint8_t> Pixels(Dim.Width * Dim.Height * BPP);
+					for (uint32_t y = 0; y < Dim.Height; ++y)
+						for (uint32_t x = 0; x < Dim.Width * BPP; ++x)
+							Pixels[y * Dim.Width * BPP + x] = Noise ? Rand() : (uint8_t)(x / BPP + y * (x % BPP + 1));
+
+					for (uint32_t f = 0; f < sizeof(Filters) / sizeof(Filters[0]); ++f)
+						for (int Level : Levels)
+						{
+							char Name[128];
+							snprintf(Name, sizeof(Name), "%ux%u %s %s %s z%d", Dim.Width, Dim.Height,
+							         Alpha ? "RGBA" : "RGB", Noise ? "noise" : "gradient", FilterNames[f], Level);
+							Corpus.push_back({Name, EncodePNG(Pixels, Dim.Width, Dim.Height, Alpha, Filters[f], Level)});
+						}
+				}
+
+		// A real one too if it's there
+		if (FILE* fp = fopen("../Data/Texture.png", "rb"))
+		{
+			Image Texture{"Texture.png", {}};
+			fseek(fp, 0, SEEK_END);
+			Texture.File.resize(ftell(fp));
+			fseek(fp, 0, SEEK_SET);
+			if (fread(&Texture.File[0], 1, Texture.File.size(), fp) == Texture.File.size())
+				Corpus.push_back(std::move(Texture));
+			fclose(fp);
+		}
+
+		printf("PNG decode, in-tree inflate and unfilter vs libpng\n");
+		printf("----------------------\n");
+		uint32_t Mismatches = 0;
+		for (auto& Entry : Corpus)
+		{
+			PNGLoader Loader(Entry.Name, Entry.File);
+			if (!Loader.CanDecodeFast())
+			{
+				printf("\t%-40s can't take the fast path\n", Entry.Name.c_str());
+				continue;
+			}
+
+			// Wider pitch than needed so nothing writes past a row
+			const size_t Pitch = Loader.GetWidth() * 4 + 16;
+			std::vector<uint8_t> Reference(Pitch * Loader.GetHeight());
+			std::vector<uint8_t> Dest(Reference.size());
+
+			for (bool Premultiply : { false, true })
+			{
+				bool Decoded = Loader.DecodeLibPNG(&Reference[0], Pitch, Premultiply) &&
+				               Loader.DecodeFast(&Dest[0], Pitch, Premultiply);
+				if (!Decoded || Dest != Reference)
+				{
+					printf("\t%-40s%s MISMATCH\n", Entry.Name.c_str(), Premultiply ? " premultiplied" : "");
+					++Mismatches;
+				}
+			}
+
+			// Only the big ones are worth timing
+			if (Loader.GetWidth() * Loader.GetHeight() < 512 * 512)
+				continue;
+
+			const uint32_t Iterations = 5;
+			double LibPNGNS = TimeNS(Iterations, [&]() { Loader.DecodeLibPNG(&Reference[0], Pitch); });
+			double FastNS = TimeNS(Iterations, [&]() { Loader.DecodeFast(&Dest[0], Pitch); });
+
+			// MB/s of decoded pixels
+			double Bytes = (double)Loader.GetDecodedSize();
+			printf("\t%-40s libpng %7.1f MB/s, fast %7.1f MB/s, %.2fx\n", Entry.Name.c_str(),
+			       Bytes * 1000.0 / LibPNGNS, Bytes * 1000.0 / FastNS, LibPNGNS / FastNS);
+		}
+		printf("%zu images, %u mismatches\n", Corpus.size(), Mismatches);
+	}
+
+	void TextureCache()
+	{
+		const char* Directory = "BenchTextureCache";
+		const Vulkan::TextureCache::Params Conversion =
+		{
+			.Format = VK_FORMAT_B8G8R8A8_UNORM,
+			.Premultiplied = false,
+			.Mips = true,
+		};
+
+		// Noise so the PNG is a realistic size rather than compressing away
+		const uint32_t Width = 2048, Height = 2048;
+		std::mt19937 Rand(1234);
+		std::vector<uint8_t> Pixels(Width * Height * 4);
+		for (auto& Byte : Pixels)
+			Byte = Rand() & 0xF0;
+		const std::vector<uint8_t> File = EncodePNG(Pixels, Width, Height, true, PNG_ALL_FILTERS, 6);
+
+		const uint32_t Levels = Vulkan::GetMipLevels(Width, Height);
+		const size_t Size = Vulkan::GetMipOffset(Width, Height, Levels);
+		std::vector<uint8_t> Decoded(Size);
+		std::vector<uint8_t> Dest(Size);
+
+		printf("Texture cache, %dx%d with %d mips, %.1fMB\n", Width, Height, Levels, Size / (1024.0 * 1024.0));
+		printf("----------------------\n");
+
+		const uint32_t Iterations = 5;
+		double DecodeNS = TimeNS(Iterations, [&]()
+		{
+			PNGLoader Png("Bench", File);
+			Png.Decode(&Decoded[0], Width * 4);
+			Vulkan::GenerateMips(&Decoded[0], Width, Height, Levels);
+		});
+
+		// Room for two entries and their headers
+		auto Cache = Vulkan::TextureCache::Create(Directory, (Size + 4096) * 2);
+		const uint64_t Key = Vulkan::TextureCache::GetKey(File.data(), File.size(), Conversion);
+		double StoreNS = TimeNS(1, [&]()
+		{
+			Cache->Store(Key, Width, Height, Levels, Conversion.Format, &Decoded[0], Size);
+		});
+
+		bool Matches = true;
+		double HitNS = TimeNS(Iterations, [&]()
+		{
+			// Hashing the source is part of every lookup
+			auto Hit = Cache->Find(Vulkan::TextureCache::GetKey(File.data(), File.size(), Conversion));
+			Matches &= Hit && Hit->Size == Size;
+			if (Hit)
+				memcpy(&Dest[0], Hit->Data, Size);
+		});
+		Matches &= Dest == Decoded;
+
+		printf("\tDecode and mips %8.2fms\n", DecodeNS / 1000000.0);
+		printf("\tStore           %8.2fms\n", StoreNS / 1000000.0);
+		printf("\tHash and hit    %8.2fms, %.1fx%s\n", HitNS / 1000000.0, DecodeNS / HitNS, Matches ? "" : " MISMATCH");
+
+		// Two more entries than fit, the first one in should be the one to go
+		uint64_t Other[2];
+		for (uint32_t i = 0; i < 2; ++i)
+		{
+			Other[i] = Key + i + 1;
+			Cache->Store(Other[i], Width, Height, Levels, Conversion.Format, &Decoded[0], Size);
+		}
+		bool Evicted = !Cache->Find(Key) && Cache->Find(Other[0]) && Cache->Find(Other[1]);
+		printf("\tEviction        %s, %d entries %.1fMB\n", Evicted ? "oldest first" : "WRONG ORDER",
+		       Cache->GetEntries(), Cache->GetSize() / (1024.0 * 1024.0));
+
+		Cache.reset();
+		for (uint64_t Remove : { Other[0], Other[1] })
+		{
+			char Name[64];
+			snprintf(Name, sizeof(Name), "%s/%016llx.tex", Directory, (unsigned long long)Remove);
+			unlink(Name);
+		}
+		rmdir(Directory);
+	}
+
+	void Streaming()
+	{
+		const uint32_t Textures = 4096;
+		const uint32_t Size = 1024;
+		const uint32_t Levels = 11;
+		const uint32_t Visible = 256;
+		const uint32_t Frames = 2000;
+		const uint64_t Budget = 256 * 1024 * 1024;
+
+		Vulkan::TextureResidency Residency(Budget);
+		for (uint32_t i = 0; i < Textures; ++i)
+			Residency.Add(Size, Size, Levels);
+
+		const uint64_t Full = Residency.GetSize(0, 0) * Textures;
+		printf("Texture streaming, %d %dx%d textures, %.1fMB with every mip, %.1fMB budget\n",
+		       Textures, Size, Size, Full / (1024.0 * 1024.0), Budget / (1024.0 * 1024.0));
+		printf("----------------------\n");
+
+		std::mt19937 Rand(1234);
+		std::uniform_real_distribution<float> ScreenSize(16.0f, 1024.0f);
+		std::vector<float> Sizes(Textures);
+		for (auto& OnScreen : Sizes)
+			OnScreen = ScreenSize(Rand);
+
+		uint64_t MaxCommitted = 0, Uploaded = 0;
+		uint32_t Upgrades = 0, Evictions = 0, Deferred = 0;
+		bool Consistent = true;
+		std::chrono::high_resolution_clock::duration Spent{};
+
+		for (uint32_t Frame = 0; Frame < Frames; ++Frame)
+		{
+			// The camera pans across the textures, wrapping around twice
+			const uint32_t First = (Frame * Textures * 2 / Frames) % Textures;
+			for (uint32_t i = 0; i < Visible; ++i)
+			{
+				const uint32_t Handle = (First + i) % Textures;
+				Residency.Request(Handle, Sizes[Handle]);
+			}
+
+			auto UpdateStart = std::chrono::high_resolution_clock::now();
+			Residency.Update();
+			Spent += std::chrono::high_resolution_clock::now() - UpdateStart;
+
+			const auto& Stats = Residency.GetStats();
+			Upgrades += Stats.Upgrades;
+			Evictions += Stats.Evictions;
+			Deferred += Stats.Deferred;
+			Uploaded += Stats.Uploaded;
+
+			// Committed has to match what's actually resident
+			if (Frame % 100 == 0)
+			{
+				uint64_t Resident = 0;
+				for (uint32_t i = 0; i < Textures; ++i)
+					Resident += Residency.GetSize(i, Residency.GetResident(i));
+				Consistent &= Resident == Residency.GetCommitted();
+			}
+			MaxCommitted = std::max(MaxCommitted, Residency.GetCommitted());
+		}
+
+		printf("\t%d frames, %.2fus an update\n", Frames,
+		       std::chrono::duration<double, std::micro>(Spent).count() / Frames);
+		printf("\tPeak resident %.1fMB%s, %s\n", MaxCommitted / (1024.0 * 1024.0),
+		       MaxCommitted <= Budget ? "" : " OVER BUDGET", Consistent ? "accounting matches" : "ACCOUNTING WRONG");
+		printf("\t%d upgrades, %d levels evicted, %d requests deferred, %.1fMB uploaded\n",
+		       Upgrades, Evictions, Deferred, Uploaded / (1024.0 * 1024.0));
+	}
+
+	void Atlas()
+	{
+		// Matches TextureAtlas, 2048x2048 packed in units of its 8 texel gutter
+		const uint32_t Size = 2048;
+		const uint32_t Gutter = 8;
+		const uint32_t Rounds = 8;
+
+		std::mt19937 Rand(1234);
+		std::uniform_int_distribution<uint32_t> Side(16, 256);
+		auto Padded = [&]() { return (Side(Rand) + Gutter - 1) / Gutter + 2; };
+
+		Vulkan::AtlasPacker Packer(Size / Gutter, Size / Gutter);
+		std::vector<Vulkan::AtlasPacker::Rect> Placed;
+
+		// Nothing placed overlaps anything else placed or anything still free
+		auto Check = [&]()
+		{
+			auto Overlaps = [](const Vulkan::AtlasPacker::Rect& A, const Vulkan::AtlasPacker::Rect& B)
+			{
+				return A.X < B.X + B.Width && B.X < A.X + A.Width &&
+				       A.Y < B.Y + B.Height && B.Y < A.Y + A.Height;
+			};
+
+			uint64_t Used = 0;
+			for (size_t i = 0; i < Placed.size(); ++i)
+			{
+				Used += (uint64_t)Placed[i].Width * Placed[i].Height;
+				if (Placed[i].X + Placed[i].Width > Packer.GetWidth() || Placed[i].Y + Placed[i].Height > Packer.GetHeight())
+					return false;
+				for (size_t j = i + 1; j < Placed.size(); ++j)
+					if (Overlaps(Placed[i], Placed[j]))
+						return false;
+			}
+			return Used == Packer.GetUsed();
+		};
+
+		auto Fill = [&](uint32_t* Inserted)
+		{
+			// Keeps going until a few in a row don't fit
+			uint32_t Failed = 0;
+			*Inserted = 0;
+			while (Failed < 16)
+			{
+				Vulkan::AtlasPacker::Rect Rect;
+				if (Packer.Insert(Padded(), Padded(), &Rect))
+				{
+					Placed.push_back(Rect);
+					++*Inserted;
+					Failed = 0;
+				}
+				else
+				{
+					++Failed;
+				}
+			}
+		};
+
+		printf("Atlas packing, 16 to 256 texel sprites in to %dx%d with a %d texel gutter\n", Size, Size, Gutter);
+		printf("----------------------\n");
+
+		bool Valid = true;
+		uint32_t Inserted;
+		auto Start = std::chrono::high_resolution_clock::now();
+		Fill(&Inserted);
+		double US = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - Start).count();
+		Valid &= Check();
+
+		const double Area = (double)Packer.GetWidth() * Packer.GetHeight();
+		printf("\tFirst fill: %d sprites, %.1f%% used, %.2fus an insert, %d free rects\n",
+		       Inserted, 100.0 * Packer.GetUsed() / Area, US / Inserted, (uint32_t)Packer.GetFreeRects());
+
+		// Half of them go and get replaced by others, over and over
+		for (uint32_t Round = 0; Round < Rounds; ++Round)
+		{
+			std::shuffle(Placed.begin(), Placed.end(), Rand);
+			const size_t Keep = Placed.size() / 2;
+
+			Start = std::chrono::high_resolution_clock::now();
+			for (size_t i = Keep; i < Placed.size(); ++i)
+				Packer.Remove(Placed[i]);
+			Placed.resize(Keep);
+			Fill(&Inserted);
+			US = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - Start).count();
+			Valid &= Check();
+
+			printf("\tRound %d: %d sprites, %.1f%% used, %.2fus a remove and insert, %d free rects\n",
+			       Round, (uint32_t)Placed.size(), 100.0 * Packer.GetUsed() / Area, US / Inserted, (uint32_t)Packer.GetFreeRects());
+		}
+
+		printf("\t%s, %d rebuilds\n", Valid ? "No overlaps" : "OVERLAPPING RECTS", Packer.GetRebuilds());
+
+		// Textures removed before they're flushed can't leave an upload behind for
+		// whatever takes their place, the simplest case being one straight swapped for another
+		Vulkan::AtlasLayout Layout(Size, Gutter);
+		const uint32_t First = Layout.Add(64, 64, 0);
+		Layout.Remove(First);
+		const uint32_t Second = Layout.Add(64, 64, 1);
+		bool Swapped = Layout.GetCopies().size() == 1 && Layout.GetCopies()[0].Handle == Second &&
+		               Layout.GetCopies()[0].Offset == 1;
+
+		// Then lots of them between flushes, every pending copy has to belong to something
+		// still there and no two can land on each other
+		std::vector<uint32_t> Live;
+		bool Pending = true;
+		for (uint32_t Step = 0; Step < 10000; ++Step)
+		{
+			if (Step % 100 == 0)
+				Layout.ClearCopies();
+
+			if (!Live.empty() && Rand() % 3 == 0)
+			{
+				const size_t Index = Rand() % Live.size();
+				Layout.Remove(Live[Index]);
+				Live[Index] = Live.back();
+				Live.pop_back();
+			}
+			else
+			{
+				const uint32_t Handle = Layout.Add(Padded() * Gutter, Padded() * Gutter, Step);
+				if (Handle != ~0U)
+					Live.push_back(Handle);
+			}
+
+			const auto& Copies = Layout.GetCopies();
+			for (size_t i = 0; i < Copies.size(); ++i)
+			{
+				const auto& Rect = Layout.GetRect(Copies[i].Handle);
+				Pending &= std::find(Live.begin(), Live.end(), Copies[i].Handle) != Live.end() &&
+				           Rect.X == Copies[i].Rect.X && Rect.Y == Copies[i].Rect.Y;
+				for (size_t j = i + 1; j < Copies.size(); ++j)
+				{
+					const auto& A = Copies[i].Rect;
+					const auto& B = Copies[j].Rect;
+					Pending &= !(A.X < B.X + B.Width && B.X < A.X + A.Width &&
+					             A.Y < B.Y + B.Height && B.Y < A.Y + A.Height);
+				}
+			}
+		}
+		printf("\tRemove before flush: %s, %s\n", Swapped ? "swap uploads once" : "SWAP UPLOADS STALE COPY",
+		       Pending ? "pending copies all live" : "STALE PENDING COPIES");
+	}
+
+	void Transients()
+	{
+		typedef Vulkan::TransientLayout Layout;
+		const uint64_t MB = 1024 * 1024;
+		const uint64_t Alignment = 64 * 1024;
+
+		printf("Transient placement\n");
+		printf("----------------------\n");
+
+		// A and B never overlap, C overlaps both, D comes after everything
+		Layout Placed;
+		std::vector<Layout::Block> Blocks =
+		{
+			{ 8 * MB, Alignment },
+			{ 8 * MB, Alignment },
+			{ 4 * MB + 1, Alignment },
+			{ 2 * MB, Alignment },
+		};
+		std::vector<Layout::Lifetime> Lifetimes = { {0, 1}, {2, 3}, {1, 2}, {4, 4} };
+		Placed.Place(Blocks, Lifetimes);
+
+		const bool Disjoint = Placed.Aliases(0, 1) && Placed.Aliases(0, 3);
+		const bool Overlapping = !Placed.Aliases(0, 2) && !Placed.Aliases(1, 2);
+		const bool Smaller = Placed.GetSize() < Placed.GetUnaliasedSize();
+		bool Aligned = true;
+		for (uint32_t i = 0; i < Placed.GetCount(); ++i)
+			Aligned &= Placed.GetOffset(i) % Alignment == 0;
+		printf("\tFixed: %s, %s, %.1fMB of %.1fMB unaliased, %s\n",
+		       Disjoint ? "disjoint share" : "DISJOINT DON'T SHARE",
+		       Overlapping ? "overlapping apart" : "OVERLAPPING SHARE",
+		       Placed.GetSize() / (double)MB, Placed.GetUnaliasedSize() / (double)MB,
+		       Smaller && Aligned ? "aligned" : "NOT SMALLER OR MISALIGNED");
+
+		// A and B alive together no longer fit where they are
+		const std::vector<Layout::Lifetime> Moved = { {0, 2}, {2, 3}, {1, 2}, {4, 4} };
+		const bool Refits = Placed.Fits(Lifetimes) && !Placed.Fits(Moved);
+		printf("\tFits: %s\n", Refits ? "catches the new overlap" : "MISSED THE NEW OVERLAP");
+
+		// Random graphs, nothing alive at the same time can ever share
+		std::mt19937 Rand(1234);
+		const uint32_t Graphs = 1000;
+		bool Valid = true;
+		uint64_t Size = 0, Unaliased = 0;
+		auto Start = std::chrono::high_resolution_clock::now();
+		for (uint32_t Graph = 0; Graph < Graphs; ++Graph)
+		{
+			const uint32_t Targets = 3 + Rand() % 14;
+			const uint32_t Passes = 2 + Rand() % 10;
+			Blocks.resize(Targets);
+			Lifetimes.resize(Targets);
+			for (uint32_t i = 0; i < Targets; ++i)
+			{
+				Blocks[i] = { (1 + Rand() % 64) * Alignment / 4, Alignment };
+				const uint32_t First = Rand() % Passes;
+				Lifetimes[i] = { First, First + (uint32_t)(Rand() % (Passes - First)) };
+			}
+			Placed.Place(Blocks, Lifetimes);
+
+			Valid &= Placed.Fits(Lifetimes);
+			for (uint32_t i = 0; i < Targets; ++i)
+				Valid &= Placed.GetOffset(i) % Alignment == 0;
+			Size += Placed.GetSize();
+			Unaliased += Placed.GetUnaliasedSize();
+		}
+		double US = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - Start).count();
+		printf("\t%d random graphs: %s, %.1f%% of the unaliased size, %.2fus a placement\n", Graphs,
+		       Valid ? "no live overlaps" : "LIVE TARGETS SHARE MEMORY", 100.0 * Size / Unaliased, US / Graphs);
+	}
+}
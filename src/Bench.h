@@ -0,0 +1,34 @@
+#pragma once
+
+// CPU side micro-benchmarks
+// These run before any window or Vulkan objects get created
+namespace Bench
+{
+	// Scalar vs SSE vs AVX2 frustum culling, single and multi-threaded
+	void CPUCulling();
+
+	// Scalar vs SSE vs AVX2 world matrix composition, all and some objects dirty
+	void Transforms();
+
+	// Job system overhead and how it scales from 1 thread up to one per core
+	void Jobs();
+
+	// Scalar vs SSE vs AVX2 vs NEON pixel conversion to BGRA8, checked against scalar
+	void PixelConversion();
+
+	// In-tree inflate and unfilter vs libpng, checked byte for byte across a generated corpus
+	void PNGDecode();
+
+	// Decoding and building mips vs mapping them back out of the texture cache
+	void TextureCache();
+
+	// Texture residency under a budget with a camera panning across thousands of textures
+	void Streaming();
+
+	// Packing sprites in to an atlas, then churning through removes and inserts
+	// Also checks removes before a flush drop their pending uploads
+	void Atlas();
+
+	// Placing transient targets by lifetime, checking what may and mustn't share memory
+	void Transients();
+}
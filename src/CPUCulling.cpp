@@ -0,0 +1,236 @@
+#include "CPUCulling.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CULL_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Vulkan
+{
+
+// Sphere is inside unless it is fully behind one of the planes
+// The SIMD kernels do the exact same mul/add sequence so results match bit for bit
+static uint32_t CullScalar(const Frustum& View, const SphereBounds& Bounds,
+                           uint32_t Begin, uint32_t End, uint32_t* Out)
+{
+	const float* X = &Bounds.X[0];
+	const float* Y = &Bounds.Y[0];
+	const float* Z = &Bounds.Z[0];
+	const float* R = &Bounds.Radius[0];
+
+	uint32_t Count = 0;
+	for (uint32_t i = Begin; i < End; ++i)
+	{
+		bool Inside = true;
+		for (const auto& Plane : View.Planes)
+		{
+			float Dist = Plane.x * X[i] + Plane.y * Y[i] + Plane.z * Z[i] + Plane.w;
+			Inside &= Dist >= -R[i];
+		}
+
+		// Always store, only advance when visible
+		Out[Count] = i;
+		Count += Inside;
+	}
+	return Count;
+}
+
+#ifdef CULL_X86
+static uint32_t CullSSE(const Frustum& View, const SphereBounds& Bounds,
+                        uint32_t Begin, uint32_t End, uint32_t* Out)
+{
+	const float* X = &Bounds.X[0];
+	const float* Y = &Bounds.Y[0];
+	const float* Z = &Bounds.Z[0];
+	const float* R = &Bounds.Radius[0];
+
+	// Splat the planes once up front
+	__m128 PX[Frustum::PLANE_COUNT], PY[Frustum::PLANE_COUNT];
+	__m128 PZ[Frustum::PLANE_COUNT], PW[Frustum::PLANE_COUNT];
+	for (uint32_t p = 0; p < Frustum::PLANE_COUNT; ++p)
+	{
+		PX[p] = _mm_set1_ps(View.Planes[p].x);
+		PY[p] = _mm_set1_ps(View.Planes[p].y);
+		PZ[p] = _mm_set1_ps(View.Planes[p].z);
+		PW[p] = _mm_set1_ps(View.Planes[p].w);
+	}
+
+	const __m128 SignBit = _mm_set1_ps(-0.0f);
+
+	uint32_t Count = 0;
+	uint32_t i = Begin;
+	for (; i + 4 <= End; i += 4)
+	{
+		__m128 SX = _mm_loadu_ps(X + i);
+		__m128 SY = _mm_loadu_ps(Y + i);
+		__m128 SZ = _mm_loadu_ps(Z + i);
+		__m128 NegR = _mm_xor_ps(_mm_loadu_ps(R + i), SignBit);
+
+		__m128 Inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (uint32_t p = 0; p < Frustum::PLANE_COUNT; ++p)
+		{
+			__m128 Dist = _mm_mul_ps(PX[p], SX);
+			Dist = _mm_add_ps(Dist, _mm_mul_ps(PY[p], SY));
+			Dist = _mm_add_ps(Dist, _mm_mul_ps(PZ[p], SZ));
+			Dist = _mm_add_ps(Dist, PW[p]);
+			Inside = _mm_and_ps(Inside, _mm_cmpge_ps(Dist, NegR));
+		}
+
+		uint32_t Mask = _mm_movemask_ps(Inside);
+		for (uint32_t Lane = 0; Lane < 4; ++Lane)
+		{
+			Out[Count] = i + Lane;
+			Count += (Mask >> Lane) & 1;
+		}
+	}
+
+	return Count + CullScalar(View, Bounds, i, End, Out + Count);
+}
+
+__attribute__((target("avx2")))
+static uint32_t CullAVX2(const Frustum& View, const SphereBounds& Bounds,
+                         uint32_t Begin, uint32_t End, uint32_t* Out)
+{
+	const float* X = &Bounds.X[0];
+	const float* Y = &Bounds.Y[0];
+	const float* Z = &Bounds.Z[0];
+	const float* R = &Bounds.Radius[0];
+
+	__m256 PX[Frustum::PLANE_COUNT], PY[Frustum::PLANE_COUNT];
+	__m256 PZ[Frustum::PLANE_COUNT], PW[Frustum::PLANE_COUNT];
+	for (uint32_t p = 0; p < Frustum::PLANE_COUNT; ++p)
+	{
+		PX[p] = _mm256_set1_ps(View.Planes[p].x);
+		PY[p] = _mm256_set1_ps(View.Planes[p].y);
+		PZ[p] = _mm256_set1_ps(View.Planes[p].z);
+		PW[p] = _mm256_set1_ps(View.Planes[p].w);
+	}
+
+	const __m256 SignBit = _mm256_set1_ps(-0.0f);
+
+	// Lane offsets, added to i to get the indices of all 8 spheres at once
+	const __m256i Lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	uint32_t Count = 0;
+	uint32_t i = Begin;
+	for (; i + 8 <= End; i += 8)
+	{
+		__m256 SX = _mm256_loadu_ps(X + i);
+		__m256 SY = _mm256_loadu_ps(Y + i);
+		__m256 SZ = _mm256_loadu_ps(Z + i);
+		__m256 NegR = _mm256_xor_ps(_mm256_loadu_ps(R + i), SignBit);
+
+		__m256 Inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (uint32_t p = 0; p < Frustum::PLANE_COUNT; ++p)
+		{
+			// No FMA, we want to match the scalar kernel exactly
+			__m256 Dist = _mm256_mul_ps(PX[p], SX);
+			Dist = _mm256_add_ps(Dist, _mm256_mul_ps(PY[p], SY));
+			Dist = _mm256_add_ps(Dist, _mm256_mul_ps(PZ[p], SZ));
+			Dist = _mm256_add_ps(Dist, PW[p]);
+			Inside = _mm256_and_ps(Inside, _mm256_cmp_ps(Dist, NegR, _CMP_GE_OQ));
+		}
+
+		uint32_t Mask = _mm256_movemask_ps(Inside);
+		if (Mask == 0)
+			continue;
+
+		if (Mask == 0xFF)
+		{
+			// Whole block visible, store all the indices in one go
+			__m256i Indices = _mm256_add_epi32(_mm256_set1_epi32(i), Lanes);
+			_mm256_storeu_si256((__m256i*)(Out + Count), Indices);
+			Count += 8;
+			continue;
+		}
+
+		for (uint32_t Lane = 0; Lane < 8; ++Lane)
+		{
+			Out[Count] = i + Lane;
+			Count += (Mask >> Lane) & 1;
+		}
+	}
+
+	return Count + CullSSE(View, Bounds, i, End, Out + Count);
+}
+#endif
+
+CPUCuller::CPUCuller(SIMDLevel Kernel, JobSystem* Jobs)
+	: mKernel(SIMDResolve(Kernel))
+	, mJobs(Jobs)
+{
+	assert(SIMDSupported(mKernel));
+}
+
+uint32_t CPUCuller::GetThreads() const
+{
+	return mJobs ? mJobs->GetThreads() : 1;
+}
+
+uint32_t CPUCuller::CullRange(SIMDLevel Kernel, const Frustum& View, const SphereBounds& Bounds,
+                              uint32_t Begin, uint32_t End, uint32_t* Out)
+{
+	if (Begin >= End)
+		return 0;
+
+	switch (Kernel)
+	{
+#ifdef CULL_X86
+	case SIMDLevel::SSE:
+		return CullSSE(View, Bounds, Begin, End, Out);
+	case SIMDLevel::AVX2:
+		return CullAVX2(View, Bounds, Begin, End, Out);
+#endif
+	default:
+		return CullScalar(View, Bounds, Begin, End, Out);
+	}
+}
+
+uint32_t CPUCuller::Cull(const Frustum& View, const SphereBounds& Bounds, std::vector<uint32_t>* Visible)
+{
+	const uint32_t Count = Bounds.Size();
+	if (Visible->size() < Count)
+		Visible->resize(Count);
+
+	uint32_t* Out = Visible->data();
+
+	const uint32_t Threads = GetThreads();
+	if (Count < PARALLEL_THRESHOLD || Threads <= 1)
+		return CullRange(mKernel, View, Bounds, 0, Count, Out);
+
+	// Each job culls a contiguous chunk in to the matching part of the output
+	// Chunks are kept a multiple of 8 so only the last one has a scalar tail
+	uint32_t Chunk = (Count + Threads - 1) / Threads;
+	Chunk = (Chunk + 7) & ~7U;
+
+	std::vector<uint32_t> Written(Threads, 0);
+	JobCounter Counter;
+	for (uint32_t t = 0; t < Threads; ++t)
+	{
+		uint32_t Begin = std::min(Count, Chunk * t);
+		uint32_t End = std::min(Count, Begin + Chunk);
+		mJobs->Run([&, t, Begin, End]()
+		{
+			Written[t] = CullRange(mKernel, View, Bounds, Begin, End, Out + Begin);
+		}, &Counter);
+	}
+
+	mJobs->Wait(&Counter);
+
+	// Squash the gaps between the chunks
+	uint32_t Total = Written[0];
+	for (uint32_t t = 1; t < Threads; ++t)
+	{
+		memmove(Out + Total, Out + std::min(Count, Chunk * t), Written[t] * sizeof(uint32_t));
+		Total += Written[t];
+	}
+
+	return Total;
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Frustum.h"
+#include "SIMD.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace Vulkan
+{
+class JobSystem;
+
+// Bounding spheres stored as structure of arrays
+// Lets the SIMD kernels load 4 or 8 spheres worth of a component at once
+struct SphereBounds
+{
+	std::vector<float> X, Y, Z, Radius;
+
+	void Resize(uint32_t Count)
+	{
+		X.resize(Count);
+		Y.resize(Count);
+		Z.resize(Count);
+		Radius.resize(Count);
+	}
+
+	void Set(uint32_t Index, float x, float y, float z, float r)
+	{
+		X[Index] = x;
+		Y[Index] = y;
+		Z[Index] = z;
+		Radius[Index] = r;
+	}
+
+	uint32_t Size() const { return X.size(); }
+};
+
+// Frustum culling on the CPU for when we aren't culling on the GPU
+class CPUCuller
+{
+public:
+	// Scenes smaller than this aren't worth splitting across threads
+	static const uint32_t PARALLEL_THRESHOLD = 1 << 16;
+
+	// Without a job system everything is culled on the calling thread
+	CPUCuller(SIMDLevel Kernel = SIMDLevel::Best, JobSystem* Jobs = nullptr);
+
+	// Writes the indices of the spheres inside the frustum to Visible, in order
+	// Visible is only ever grown, returns how many entries are valid
+	uint32_t Cull(const Frustum& View, const SphereBounds& Bounds, std::vector<uint32_t>* Visible);
+
+	// Culls [Begin, End), writing visible indices to Out
+	// Returns how many were written, Out needs room for End - Begin
+	static uint32_t CullRange(SIMDLevel Kernel, const Frustum& View, const SphereBounds& Bounds,
+	                          uint32_t Begin, uint32_t End, uint32_t* Out);
+
+	// Information
+	SIMDLevel GetKernel() const { return mKernel; }
+
+	uint32_t GetThreads() const;
+
+private:
+	SIMDLevel mKernel;
+	JobSystem* mJobs;
+};
+}
@@ -0,0 +1,124 @@
+#include "Vulkan.h"
+#include "CommandAllocator.h"
+#include "JobSystem.h"
+#include "Utils.h"
+
+#include <assert.h>
+
+namespace Vulkan
+{
+
+CommandAllocator::CommandAllocator(Vulkan::InstanceObject& Instance, uint32_t Frames, uint32_t Threads)
+	: mDevice(*Instance.GetDevice())
+	, mFrames(Frames)
+	, mThreads(Threads)
+{
+	VkResult err;
+
+	mPools.resize(mFrames * mThreads);
+	for (auto& CurrentPool : mPools)
+	{
+		// No RESET_COMMAND_BUFFER_BIT, buffers only ever get reset with their pool
+		const VkCommandPoolCreateInfo PoolInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = Instance.GetPresentQueueIndex(),
+		};
+
+		err = vkCreateCommandPool(*Instance.GetDevice(), &PoolInfo, nullptr, &CurrentPool.Handle);
+		CHECK_ERR(err);
+
+		CurrentPool.Used[0] = CurrentPool.Used[1] = 0;
+	}
+
+	// Start signalled so the first BeginFrame of each frame doesn't wait
+	const VkFenceCreateInfo FenceInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+	};
+
+	mFences.resize(mFrames);
+	for (auto& Fence : mFences)
+	{
+		err = vkCreateFence(*Instance.GetDevice(), &FenceInfo, nullptr, &Fence);
+		CHECK_ERR(err);
+	}
+}
+
+CommandAllocator::~CommandAllocator()
+{
+	// Every frame has been submitted since its BeginFrame, so they all get signalled
+	VkResult err;
+	err = vkWaitForFences(mDevice, mFences.size(), mFences.data(), VK_TRUE, UINT64_MAX);
+	CHECK_ERR(err);
+
+	// Takes the buffers with them
+	for (auto& CurrentPool : mPools)
+		vkDestroyCommandPool(mDevice, CurrentPool.Handle, nullptr);
+	for (auto& Fence : mFences)
+		vkDestroyFence(mDevice, Fence, nullptr);
+}
+
+void CommandAllocator::BeginFrame(Vulkan::InstanceObject& Instance, uint32_t Frame)
+{
+	VkResult err;
+	assert(Frame < mFrames);
+	mFrame = Frame;
+
+	err = vkWaitForFences(*Instance.GetDevice(), 1, &mFences[mFrame], VK_TRUE, UINT64_MAX);
+	CHECK_ERR(err);
+
+	err = vkResetFences(*Instance.GetDevice(), 1, &mFences[mFrame]);
+	CHECK_ERR(err);
+
+	for (uint32_t Thread = 0; Thread < mThreads; ++Thread)
+	{
+		Pool& CurrentPool = mPools[mFrame * mThreads + Thread];
+		if (!CurrentPool.Used[0] && !CurrentPool.Used[1])
+			continue;
+
+		err = vkResetCommandPool(*Instance.GetDevice(), CurrentPool.Handle, 0);
+		CHECK_ERR(err);
+
+		CurrentPool.Used[0] = CurrentPool.Used[1] = 0;
+	}
+}
+
+VkCommandBuffer CommandAllocator::Allocate(Vulkan::InstanceObject& Instance, VkCommandBufferLevel Level)
+{
+	const uint32_t Thread = JobSystem::GetThreadIndex();
+	assert(Thread < mThreads);
+
+	Pool& CurrentPool = mPools[mFrame * mThreads + Thread];
+	const uint32_t Index = Level == VK_COMMAND_BUFFER_LEVEL_PRIMARY ? 0 : 1;
+
+	auto& Buffers = CurrentPool.Buffers[Index];
+	uint32_t& Used = CurrentPool.Used[Index];
+
+	// Only allocate when the free list has run dry, after the first few frames it never does
+	if (Used == Buffers.size())
+	{
+		VkResult err;
+		const VkCommandBufferAllocateInfo AllocInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.pNext = nullptr,
+			.commandPool = CurrentPool.Handle,
+			.level = Level,
+			.commandBufferCount = 1,
+		};
+
+		VkCommandBuffer NewBuffer;
+		err = vkAllocateCommandBuffers(*Instance.GetDevice(), &AllocInfo, &NewBuffer);
+		CHECK_ERR(err);
+		Buffers.push_back(NewBuffer);
+	}
+
+	return Buffers[Used++];
+}
+
+}
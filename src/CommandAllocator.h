@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <vector>
+
+namespace Vulkan
+{
+class InstanceObject;
+
+// Hands out command buffers that only live for one frame
+// Every frame in flight has a transient pool per thread, and the whole lot
+// gets reset in one go when the frame comes back round instead of buffer by buffer
+class CommandAllocator
+{
+public:
+	CommandAllocator(Vulkan::InstanceObject& Instance, uint32_t Frames, uint32_t Threads);
+	~CommandAllocator();
+
+	static std::unique_ptr<CommandAllocator> Create(Vulkan::InstanceObject& Instance,
+		uint32_t Frames, uint32_t Threads)
+	{
+		return std::make_unique<CommandAllocator>(Instance, Frames, Threads);
+	}
+
+	// Waits for Frame's last submission, then resets all of its pools
+	// Every buffer handed out for it before goes back on the free lists
+	void BeginFrame(Vulkan::InstanceObject& Instance, uint32_t Frame);
+
+	// Signalled when the current frame's work is done, pass it to the frame's last submit
+	VkFence GetFence() const { return mFences[mFrame]; }
+
+	// Buffer from the calling thread's pool for the current frame
+	// Valid until BeginFrame comes back round to this frame
+	VkCommandBuffer Allocate(Vulkan::InstanceObject& Instance, VkCommandBufferLevel Level);
+
+	// Information
+	uint32_t GetFrame() const { return mFrame; }
+	uint32_t GetFrames() const { return mFrames; }
+
+private:
+	VkDevice mDevice;
+	const uint32_t mFrames;
+	const uint32_t mThreads;
+	uint32_t mFrame = 0;
+
+	// Indexed by Frame * mThreads + Thread
+	// Buffers before Used are handed out this frame, the rest are free
+	struct Pool
+	{
+		VkCommandPool Handle;
+		std::vector<VkCommandBuffer> Buffers[2]; // Primary, secondary
+		uint32_t Used[2];
+	};
+	std::vector<Pool> mPools;
+
+	std::vector<VkFence> mFences;
+};
+}
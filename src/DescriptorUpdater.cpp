@@ -0,0 +1,184 @@
+#include "Vulkan.h"
+#include "DescriptorUpdater.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace Vulkan
+{
+
+enum class InfoKind
+{
+	Image,
+	Buffer,
+	TexelBuffer,
+};
+
+static InfoKind GetInfoKind(VkDescriptorType Type)
+{
+	switch (Type)
+	{
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+		return InfoKind::Buffer;
+	case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+	case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+		return InfoKind::TexelBuffer;
+	default:
+		return InfoKind::Image;
+	}
+}
+
+static size_t GetInfoSize(InfoKind Kind)
+{
+	switch (Kind)
+	{
+	case InfoKind::Buffer:
+		return sizeof(VkDescriptorBufferInfo);
+	case InfoKind::TexelBuffer:
+		return sizeof(VkBufferView);
+	default:
+		return sizeof(VkDescriptorImageInfo);
+	}
+}
+
+DescriptorUpdater::DescriptorUpdater(Vulkan::InstanceObject& Instance,
+	VkDescriptorSetLayout Layout,
+	const std::vector<DescriptorEntry>& Entries,
+	size_t DataSize)
+	: mEntries(Entries), mDataSize(DataSize)
+{
+	if (!Instance.CreateDescriptorUpdateTemplateKHR)
+	{
+		printf("Descriptor update templates unsupported, batching writes\n");
+		return;
+	}
+
+	std::vector<VkDescriptorUpdateTemplateEntryKHR> TemplateEntries;
+	for (const auto& Entry : mEntries)
+	{
+		TemplateEntries.push_back({
+			.dstBinding = Entry.Binding,
+			.dstArrayElement = Entry.ArrayElement,
+			.descriptorCount = Entry.Count,
+			.descriptorType = Entry.Type,
+			.offset = Entry.Offset,
+			.stride = Entry.Stride,
+		});
+	}
+
+	const VkDescriptorUpdateTemplateCreateInfoKHR TemplateInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR,
+		.pNext = nullptr,
+		.flags = 0,
+		.descriptorUpdateEntryCount = (uint32_t)TemplateEntries.size(),
+		.pDescriptorUpdateEntries = &TemplateEntries[0],
+		.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR,
+		.descriptorSetLayout = Layout,
+		// Only used for push descriptor templates
+		.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+		.pipelineLayout = VK_NULL_HANDLE,
+		.set = 0,
+	};
+
+	VkResult err;
+	err = Instance.CreateDescriptorUpdateTemplateKHR(*Instance.GetDevice(), &TemplateInfo, nullptr, &mTemplate);
+	CHECK_ERR(err);
+
+	mDevice = *Instance.GetDevice();
+	mDestroyTemplate = Instance.DestroyDescriptorUpdateTemplateKHR;
+}
+
+DescriptorUpdater::~DescriptorUpdater()
+{
+	if (mTemplate != VK_NULL_HANDLE)
+		mDestroyTemplate(mDevice, mTemplate, nullptr);
+}
+
+void DescriptorUpdater::Update(Vulkan::InstanceObject& Instance, VkDescriptorSet Set, const void* Data)
+{
+	if (mTemplate != VK_NULL_HANDLE)
+	{
+		// The driver consumes the struct right here, nothing to keep around
+		Instance.UpdateDescriptorSetWithTemplateKHR(*Instance.GetDevice(), Set, mTemplate, Data);
+		return;
+	}
+
+	// Keep our own copy of the infos so the caller's struct can go away
+	size_t Base = mPayload.size();
+	mPayload.resize(Base + mDataSize);
+	memcpy(&mPayload[Base], Data, mDataSize);
+
+	for (const auto& Entry : mEntries)
+	{
+		InfoKind Kind = GetInfoKind(Entry.Type);
+		size_t InfoSize = GetInfoSize(Kind);
+
+		// Tightly packed arrays can go in a single write
+		// Anything else has to be split per element
+		bool Packed = Entry.Count == 1 || Entry.Stride == InfoSize;
+		uint32_t WriteCount = Packed ? 1 : Entry.Count;
+
+		for (uint32_t i = 0; i < WriteCount; ++i)
+		{
+			const VkWriteDescriptorSet Write =
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.pNext = nullptr,
+				.dstSet = Set,
+				.dstBinding = Entry.Binding,
+				.dstArrayElement = Entry.ArrayElement + i,
+				.descriptorCount = Packed ? Entry.Count : 1,
+				.descriptorType = Entry.Type,
+				.pImageInfo = nullptr, // Resolved in Flush
+				.pBufferInfo = nullptr,
+				.pTexelBufferView = nullptr,
+			};
+
+			mWrites.push_back({Write, Base + Entry.Offset + Entry.Stride * i});
+		}
+	}
+
+	if (++mQueuedSets >= MAX_QUEUED_SETS)
+		Flush(Instance);
+}
+
+void DescriptorUpdater::Flush(Vulkan::InstanceObject& Instance)
+{
+	if (mWrites.empty())
+		return;
+
+	mResolved.clear();
+	for (const auto& Queued : mWrites)
+	{
+		VkWriteDescriptorSet Write = Queued.Write;
+		const uint8_t* Info = &mPayload[Queued.PayloadOffset];
+
+		switch (GetInfoKind(Write.descriptorType))
+		{
+		case InfoKind::Buffer:
+			Write.pBufferInfo = reinterpret_cast<const VkDescriptorBufferInfo*>(Info);
+			break;
+		case InfoKind::TexelBuffer:
+			Write.pTexelBufferView = reinterpret_cast<const VkBufferView*>(Info);
+			break;
+		default:
+			Write.pImageInfo = reinterpret_cast<const VkDescriptorImageInfo*>(Info);
+			break;
+		}
+
+		mResolved.push_back(Write);
+	}
+
+	// One call for everything queued since the last flush
+	vkUpdateDescriptorSets(*Instance.GetDevice(), mResolved.size(), &mResolved[0], 0, nullptr);
+
+	mWrites.clear();
+	mPayload.clear();
+	mQueuedSets = 0;
+}
+
+}
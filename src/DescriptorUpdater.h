@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <vector>
+
+namespace Vulkan
+{
+class InstanceObject;
+
+// Describes where a binding's descriptor infos live inside a packed struct
+struct DescriptorEntry
+{
+	uint32_t Binding;
+	uint32_t ArrayElement;
+	uint32_t Count;
+	VkDescriptorType Type;
+	size_t Offset;
+	size_t Stride;
+};
+
+// Writes descriptor sets straight from a packed struct
+// Uses VK_KHR_descriptor_update_template when the device has it,
+// otherwise writes are queued and handed to vkUpdateDescriptorSets in batches
+class DescriptorUpdater
+{
+public:
+	DescriptorUpdater(Vulkan::InstanceObject& Instance,
+	                  VkDescriptorSetLayout Layout,
+	                  const std::vector<DescriptorEntry>& Entries,
+	                  size_t DataSize);
+	~DescriptorUpdater();
+
+	static std::unique_ptr<DescriptorUpdater> Create(Vulkan::InstanceObject& Instance,
+		VkDescriptorSetLayout Layout,
+		const std::vector<DescriptorEntry>& Entries,
+		size_t DataSize)
+	{
+		return std::make_unique<DescriptorUpdater>(Instance, Layout, Entries, DataSize);
+	}
+
+	// Data must point to DataSize bytes laid out as the entries describe
+	void Update(Vulkan::InstanceObject& Instance, VkDescriptorSet Set, const void* Data);
+
+	// Hands any queued fallback writes to the driver
+	// Must be called before the sets are bound
+	void Flush(Vulkan::InstanceObject& Instance);
+
+	// Information
+	bool UsesTemplate() const { return mTemplate != VK_NULL_HANDLE; }
+
+private:
+	// Number of sets queued before the fallback path flushes on its own
+	static const size_t MAX_QUEUED_SETS = 256;
+
+	std::vector<DescriptorEntry> mEntries;
+	const size_t mDataSize;
+
+	VkDescriptorUpdateTemplateKHR mTemplate = VK_NULL_HANDLE;
+
+	// Kept to destroy the template with, the device outlives every updater
+	VkDevice mDevice = VK_NULL_HANDLE;
+	PFN_vkDestroyDescriptorUpdateTemplateKHR mDestroyTemplate = nullptr;
+
+	// Fallback path
+	// Writes point in to mPayload, which can move while we queue,
+	// so the pointers are only resolved at flush time
+	struct QueuedWrite
+	{
+		VkWriteDescriptorSet Write;
+		size_t PayloadOffset;
+	};
+	std::vector<QueuedWrite> mWrites;
+	std::vector<VkWriteDescriptorSet> mResolved;
+	std::vector<uint8_t> mPayload;
+	size_t mQueuedSets = 0;
+};
+}
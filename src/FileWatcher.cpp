@@ -0,0 +1,94 @@
+#include "FileWatcher.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace Vulkan
+{
+namespace
+{
+	std::string GetKey(int Watch, const char* Name)
+	{
+		return std::to_string(Watch) + "/" + Name;
+	}
+}
+
+FileWatcher::FileWatcher()
+{
+	mFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (mFD < 0)
+		printf("Couldn't start watching for file changes\n");
+}
+
+FileWatcher::~FileWatcher()
+{
+	// Takes every watch with it
+	if (mFD >= 0)
+		close(mFD);
+}
+
+bool FileWatcher::Watch(const std::string& Path)
+{
+	if (mFD < 0)
+		return false;
+
+	const size_t Slash = Path.rfind('/');
+	const std::string Directory = Slash == std::string::npos ? "." : Path.substr(0, Slash + 1);
+	const std::string Name = Slash == std::string::npos ? Path : Path.substr(Slash + 1);
+
+	// The same directory always hands back the same watch, however it's spelt
+	int Watch = inotify_add_watch(mFD, Directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (Watch < 0)
+	{
+		printf("Couldn't watch '%s'\n", Path.c_str());
+		return false;
+	}
+
+	mFiles[GetKey(Watch, Name.c_str())] = Path;
+	return true;
+}
+
+std::vector<std::string> FileWatcher::Poll()
+{
+	PROFILE_SCOPE("FileWatcher::Poll");
+	std::vector<std::string> Changed;
+	if (mFD < 0)
+		return Changed;
+
+	// Aligned for the events read in to it
+	alignas(inotify_event) char Buffer[4096];
+	while (true)
+	{
+		ssize_t Read = read(mFD, Buffer, sizeof(Buffer));
+		if (Read <= 0)
+		{
+			// EAGAIN is just nothing left to read
+			if (Read < 0 && errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (ssize_t Offset = 0; Offset < Read;)
+		{
+			const inotify_event* Event = (const inotify_event*)(Buffer + Offset);
+			Offset += sizeof(inotify_event) + Event->len;
+
+			// Everything else in the directory gets reported too
+			if (!Event->len)
+				continue;
+			auto File = mFiles.find(GetKey(Event->wd, Event->name));
+			if (File == mFiles.end())
+				continue;
+
+			if (std::find(Changed.begin(), Changed.end(), File->second) == Changed.end())
+				Changed.push_back(File->second);
+		}
+	}
+
+	return Changed;
+}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Vulkan
+{
+// Finds out about files changing on disk through inotify
+// The directories get watched rather than the files, editors tend to save by writing a new
+// file and renaming it over the old one, which a watch on the old file would never see
+// Only finished writes count, so a file is never picked up halfway through being saved
+class FileWatcher
+{
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	static std::unique_ptr<FileWatcher> Create()
+	{
+		return std::make_unique<FileWatcher>();
+	}
+
+	// Changes come back from Poll as the same Path it was watched with
+	bool Watch(const std::string& Path);
+
+	// Every watched file changed since the last poll, each once however many times it changed
+	// Never blocks
+	std::vector<std::string> Poll();
+
+	// Information
+	bool IsOpen() const { return mFD >= 0; }
+	size_t GetWatched() const { return mFiles.size(); }
+
+private:
+	int mFD = -1;
+
+	// Keyed by the directory's watch and the name within it
+	std::unordered_map<std::string, std::string> mFiles;
+};
+}
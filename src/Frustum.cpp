@@ -0,0 +1,28 @@
+#include "Frustum.h"
+
+namespace Vulkan
+{
+Frustum ExtractFrustum(const glm::mat4& Matrix)
+{
+	Frustum Result;
+
+	// glm is column major, so pull the rows out by hand
+	glm::vec4 Rows[4];
+	for (int i = 0; i < 4; ++i)
+		Rows[i] = glm::vec4(Matrix[0][i], Matrix[1][i], Matrix[2][i], Matrix[3][i]);
+
+	// glm::perspective gives us GL style -1..1 clip depth
+	Result.Planes[Frustum::LEFT]   = Rows[3] + Rows[0];
+	Result.Planes[Frustum::RIGHT]  = Rows[3] - Rows[0];
+	Result.Planes[Frustum::BOTTOM] = Rows[3] + Rows[1];
+	Result.Planes[Frustum::TOP]    = Rows[3] - Rows[1];
+	Result.Planes[Frustum::ZNEAR]  = Rows[3] + Rows[2];
+	Result.Planes[Frustum::ZFAR]   = Rows[3] - Rows[2];
+
+	// Normalize so sphere radii can be compared against the distances
+	for (auto& Plane : Result.Planes)
+		Plane /= glm::length(glm::vec3(Plane));
+
+	return Result;
+}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace Vulkan
+{
+// Six planes, normals pointing inwards
+// xyz is the normal and w the distance, a point is inside when dot(n, p) + w >= 0
+struct Frustum
+{
+	enum
+	{
+		LEFT = 0,
+		RIGHT,
+		BOTTOM,
+		TOP,
+		ZNEAR,
+		ZFAR,
+		PLANE_COUNT,
+	};
+
+	glm::vec4 Planes[PLANE_COUNT];
+};
+
+// Pulls the planes out of a combined projection * view (* model) matrix
+// Planes end up in the space the matrix transforms from
+Frustum ExtractFrustum(const glm::mat4& Matrix);
+}
@@ -0,0 +1,337 @@
+#include "Vulkan.h"
+#include "IndirectCuller.h"
+#include "Utils.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+namespace Vulkan
+{
+
+static const uint32_t CULL_GROUP_SIZE = 64;
+
+// Matches the push constant block in the culling shader
+struct CullConstants
+{
+	glm::vec4 Planes[Frustum::PLANE_COUNT];
+	uint32_t ObjectCount;
+	uint32_t Compact;
+};
+
+// Matches the storage buffer bindings in the culling shader
+struct CullDescriptors
+{
+	VkDescriptorBufferInfo Bounds;
+	VkDescriptorBufferInfo Records;
+	VkDescriptorBufferInfo Commands;
+	VkDescriptorBufferInfo Count;
+};
+
+static VkShaderModule PrepareCullModule(Vulkan::InstanceObject& Instance)
+{
+	const char css[] =
+		"#version 450 core\n"
+		"layout(local_size_x = 64) in;\n"
+		"struct DrawRecord\n"
+		"{\n"
+		"	uint IndexCount;\n"
+		"	uint FirstIndex;\n"
+		"	int VertexOffset;\n"
+		"	uint FirstInstance;\n"
+		"};\n"
+		"struct DrawCommand\n"
+		"{\n"
+		"	uint IndexCount;\n"
+		"	uint InstanceCount;\n"
+		"	uint FirstIndex;\n"
+		"	int VertexOffset;\n"
+		"	uint FirstInstance;\n"
+		"};\n"
+		"layout(std430, binding = 0) readonly buffer Bounds { vec4 uBounds[]; };\n"
+		"layout(std430, binding = 1) readonly buffer Records { DrawRecord uRecords[]; };\n"
+		"layout(std430, binding = 2) writeonly buffer Commands { DrawCommand uCommands[]; };\n"
+		"layout(std430, binding = 3) buffer Count { uint uDrawCount; };\n"
+		"layout(push_constant) uniform Cull\n"
+		"{\n"
+		"	vec4 Planes[6];\n"
+		"	uint ObjectCount;\n"
+		"	uint Compact;\n"
+		"};\n"
+		"void main()\n"
+		"{\n"
+		"	uint id = gl_GlobalInvocationID.x;\n"
+		"	if (id >= ObjectCount)\n"
+		"		return;\n"
+		"	vec4 Sphere = uBounds[id];\n"
+		"	bool Visible = true;\n"
+		"	for (int i = 0; i < 6; ++i)\n"
+		"		Visible = Visible && (dot(Planes[i].xyz, Sphere.xyz) + Planes[i].w >= -Sphere.w);\n"
+		"	uint Slot = id;\n"
+		"	if (Compact != 0)\n"
+		"	{\n"
+		"		if (!Visible)\n"
+		"			return;\n"
+		"		Slot = atomicAdd(uDrawCount, 1);\n"
+		"	}\n"
+		"	DrawRecord Record = uRecords[id];\n"
+		"	uCommands[Slot] = DrawCommand(Record.IndexCount, Visible ? 1 : 0,\n"
+		"		Record.FirstIndex, Record.VertexOffset, Record.FirstInstance);\n"
+		"}\n";
+
+	VkResult err;
+	VkShaderModule Module;
+	VkShaderModuleCreateInfo ModuleCreateInfo;
+	ModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	ModuleCreateInfo.pNext = nullptr;
+	ModuleCreateInfo.flags = 0;
+	ModuleCreateInfo.codeSize = sizeof(css);
+	ModuleCreateInfo.pCode = (const uint32_t*)css;
+
+	err = vkCreateShaderModule(*Instance.GetDevice(), &ModuleCreateInfo, nullptr, &Module);
+	CHECK_ERR(err);
+
+	return Module;
+}
+
+bool IndirectCuller::IsSupported(Vulkan::InstanceObject& Instance)
+{
+	return Instance.GetEnabledFeatures()->drawIndirectFirstInstance;
+}
+
+IndirectCuller::IndirectCuller(Vulkan::InstanceObject& Instance, uint32_t Capacity)
+	: mCapacity(Capacity)
+{
+	VkResult err;
+
+	assert(IsSupported(Instance));
+
+	mDrawCount = Instance.CmdDrawIndexedIndirectCountKHR != nullptr;
+	if (!mDrawCount)
+		printf("No indirect draw count, culled draws will be issued with zero instances\n");
+
+	// Inputs
+	mBounds = StorageBuffer::Create(Instance, sizeof(glm::vec4) * mCapacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	mRecords = StorageBuffer::Create(Instance, sizeof(DrawRecord) * mCapacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	// Outputs only the GPU touches
+	Util::CreateBuffer(Instance, sizeof(VkDrawIndexedIndirectCommand) * mCapacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mCommands, &mCommandsMemory);
+	Util::CreateBuffer(Instance, sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mCount, &mCountMemory);
+
+	// Descriptors
+	VkDescriptorSetLayoutBinding LayoutBinding[4];
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		LayoutBinding[i] =
+		{
+			.binding = i,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.pImmutableSamplers = nullptr,
+		};
+	}
+
+	const VkDescriptorSetLayoutCreateInfo DescriptorLayout =
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.bindingCount = 4,
+		.pBindings = LayoutBinding,
+	};
+
+	err = vkCreateDescriptorSetLayout(*Instance.GetDevice(), &DescriptorLayout, nullptr, &mLayout);
+	CHECK_ERR(err);
+
+	const VkDescriptorPoolSize TypeCount =
+	{
+		.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 4,
+	};
+
+	const VkDescriptorPoolCreateInfo DescriptorPool =
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.maxSets = 1,
+		.poolSizeCount = 1,
+		.pPoolSizes = &TypeCount,
+	};
+
+	err = vkCreateDescriptorPool(*Instance.GetDevice(), &DescriptorPool, nullptr, &mPool);
+	CHECK_ERR(err);
+
+	const VkDescriptorSetAllocateInfo AllocInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = nullptr,
+		.descriptorPool = mPool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &mLayout,
+	};
+
+	err = vkAllocateDescriptorSets(*Instance.GetDevice(), &AllocInfo, &mSet);
+	CHECK_ERR(err);
+
+	const CullDescriptors Data =
+	{
+		.Bounds = *mBounds->GetDesc(),
+		.Records = *mRecords->GetDesc(),
+		.Commands = { mCommands, 0, VK_WHOLE_SIZE },
+		.Count = { mCount, 0, VK_WHOLE_SIZE },
+	};
+
+	auto Updater = DescriptorUpdater::Create(Instance, mLayout,
+		{
+			{ 0, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(CullDescriptors, Bounds), sizeof(VkDescriptorBufferInfo) },
+			{ 1, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(CullDescriptors, Records), sizeof(VkDescriptorBufferInfo) },
+			{ 2, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(CullDescriptors, Commands), sizeof(VkDescriptorBufferInfo) },
+			{ 3, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(CullDescriptors, Count), sizeof(VkDescriptorBufferInfo) },
+		},
+		sizeof(CullDescriptors));
+	Updater->Update(Instance, mSet, &Data);
+	Updater->Flush(Instance);
+
+	// Pipeline
+	const VkPushConstantRange PushConstants =
+	{
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(CullConstants),
+	};
+
+	const VkPipelineLayoutCreateInfo PipelineLayoutInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.setLayoutCount = 1,
+		.pSetLayouts = &mLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &PushConstants,
+	};
+
+	err = vkCreatePipelineLayout(*Instance.GetDevice(), &PipelineLayoutInfo, nullptr, &mPipelineLayout);
+	CHECK_ERR(err);
+
+	const VkComputePipelineCreateInfo Pipeline =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.stage =
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = PrepareCullModule(Instance),
+			.pName = "main",
+			.pSpecializationInfo = nullptr,
+		},
+		.layout = mPipelineLayout,
+		.basePipelineHandle = VK_NULL_HANDLE,
+		.basePipelineIndex = 0,
+	};
+
+	err = vkCreateComputePipelines(*Instance.GetDevice(), VK_NULL_HANDLE, 1, &Pipeline, nullptr, &mPipeline);
+	CHECK_ERR(err);
+
+	vkDestroyShaderModule(*Instance.GetDevice(), Pipeline.stage.module, nullptr);
+}
+
+IndirectCuller::~IndirectCuller()
+{
+}
+
+void IndirectCuller::SetObjectCount(uint32_t Count)
+{
+	assert(Count <= mCapacity);
+	mObjectCount = Count;
+}
+
+void IndirectCuller::Cull(Vulkan::InstanceObject& Instance, VkCommandBuffer Cmd, const Frustum& View)
+{
+	// Last frame's draws read the count, they have to be done with it before it's cleared
+	const VkBufferMemoryBarrier ClearBarrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.pNext = nullptr,
+		.srcAccessMask = 0,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = mCount,
+		.offset = 0,
+		.size = VK_WHOLE_SIZE,
+	};
+
+	vkCmdPipelineBarrier(Cmd,
+	                     VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+	                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     0, 0, nullptr, 1, &ClearBarrier, 0, nullptr);
+
+	// Survivors get appended from zero
+	vkCmdFillBuffer(Cmd, mCount, 0, sizeof(uint32_t), 0);
+
+	// Also keeps us from overwriting commands last frame's draws may still be reading
+	const VkBufferMemoryBarrier ResetBarrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.pNext = nullptr,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = mCount,
+		.offset = 0,
+		.size = VK_WHOLE_SIZE,
+	};
+
+	vkCmdPipelineBarrier(Cmd,
+	                     VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+	                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     0, 0, nullptr, 1, &ResetBarrier, 0, nullptr);
+
+	CullConstants Constants;
+	for (uint32_t i = 0; i < Frustum::PLANE_COUNT; ++i)
+		Constants.Planes[i] = View.Planes[i];
+	Constants.ObjectCount = mObjectCount;
+	Constants.Compact = mDrawCount;
+
+	vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeline);
+	vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipelineLayout,
+	                        0, 1, &mSet, 0, nullptr);
+	vkCmdPushConstants(Cmd, mPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+	                   0, sizeof(Constants), &Constants);
+	vkCmdDispatch(Cmd, (mObjectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+void IndirectCuller::Draw(Vulkan::InstanceObject& Instance, VkCommandBuffer Cmd)
+{
+	const uint32_t Stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	if (mDrawCount)
+	{
+		Instance.CmdDrawIndexedIndirectCountKHR(Cmd, mCommands, 0, mCount, 0, mObjectCount, Stride);
+	}
+	else if (Instance.GetEnabledFeatures()->multiDrawIndirect)
+	{
+		vkCmdDrawIndexedIndirect(Cmd, mCommands, 0, mObjectCount, Stride);
+	}
+	else
+	{
+		// Without multi draw we're stuck with one indirect draw per object
+		for (uint32_t i = 0; i < mObjectCount; ++i)
+			vkCmdDrawIndexedIndirect(Cmd, mCommands, Stride * i, 1, Stride);
+	}
+}
+
+}
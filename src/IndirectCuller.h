@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Frustum.h"
+#include "VertexInfo.h"
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <memory>
+
+namespace Vulkan
+{
+class InstanceObject;
+class DescriptorUpdater;
+
+// GPU driven drawing
+// A compute pass frustum culls every object and writes out the indexed
+// indirect draws for the survivors, so the CPU cost doesn't depend on object count
+class IndirectCuller
+{
+public:
+	// What to draw for a single object
+	struct DrawRecord
+	{
+		uint32_t IndexCount;
+		uint32_t FirstIndex;
+		int32_t VertexOffset;
+		uint32_t FirstInstance;
+	};
+
+	IndirectCuller(Vulkan::InstanceObject& Instance, uint32_t Capacity);
+	~IndirectCuller();
+
+	static std::unique_ptr<IndirectCuller> Create(Vulkan::InstanceObject& Instance,
+		uint32_t Capacity)
+	{
+		return std::make_unique<IndirectCuller>(Instance, Capacity);
+	}
+
+	// Needs firstInstance in indirect draws to find the per-instance data
+	static bool IsSupported(Vulkan::InstanceObject& Instance);
+
+	// Objects are written straight in to mapped memory
+	// Bounds are spheres, xyz center and w radius
+	glm::vec4* GetBounds() const { return mBounds->GetData<glm::vec4>(); }
+	DrawRecord* GetRecords() const { return mRecords->GetData<DrawRecord>(); }
+	void SetObjectCount(uint32_t Count);
+
+	// Runs the culling pass, must be outside of a render pass
+	// Doesn't make its outputs visible to the draw, the render graph does that
+	void Cull(Vulkan::InstanceObject& Instance, VkCommandBuffer Cmd, const Frustum& View);
+
+	// Draws what survived culling, index buffer must already be bound
+	void Draw(Vulkan::InstanceObject& Instance, VkCommandBuffer Cmd);
+
+	// Information
+	uint32_t GetCapacity() const { return mCapacity; }
+	uint32_t GetObjectCount() const { return mObjectCount; }
+	bool UsesDrawCount() const { return mDrawCount; }
+
+	// Written by Cull, read by Draw
+	VkBuffer GetCommandsBuffer() const { return mCommands; }
+	VkBuffer GetCountBuffer() const { return mCount; }
+
+private:
+	const uint32_t mCapacity;
+	uint32_t mObjectCount = 0;
+
+	// With VK_KHR_draw_indirect_count the survivors get compacted and the GPU
+	// provides the draw count. Without it every object gets a draw, culled ones
+	// just have zero instances.
+	bool mDrawCount;
+
+	// CPU written inputs
+	std::unique_ptr<StorageBuffer> mBounds;
+	std::unique_ptr<StorageBuffer> mRecords;
+
+	// GPU written outputs
+	VkBuffer mCommands;
+	VkDeviceMemory mCommandsMemory;
+	VkBuffer mCount;
+	VkDeviceMemory mCountMemory;
+
+	VkDescriptorSetLayout mLayout;
+	VkDescriptorPool mPool;
+	VkDescriptorSet mSet;
+	VkPipelineLayout mPipelineLayout;
+	VkPipeline mPipeline;
+};
+}
@@ -0,0 +1,413 @@
+#include "Inflate.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+namespace
+{
+	// Deflate keeps references up to this far back
+	const size_t WINDOW_SIZE = 32768;
+
+	// Inflate stops when a match might not fit, matches also copy up to 8 bytes past their end
+	const size_t MAX_MATCH = 258;
+	const size_t SLACK = MAX_MATCH + 8;
+
+	// Extra room so the window isn't slid for every row
+	const size_t SLIDE_BATCH = 65536;
+
+	const uint16_t LENGTH_BASE[29] =
+	{
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+	};
+	const uint8_t LENGTH_EXTRA[29] =
+	{
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+	};
+	const uint16_t DIST_BASE[30] =
+	{
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+	};
+	const uint8_t DIST_EXTRA[30] =
+	{
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+	};
+
+	// Order the code length code lengths come in
+	const uint8_t CODE_LENGTH_ORDER[19] =
+	{
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+	};
+
+	// The longest symbol, a length and distance with all their extra bits
+	const int32_t MAX_SYMBOL_BITS = 48;
+}
+
+Inflater::Inflater(const uint8_t* Data, size_t Size, size_t MaxRead)
+	: mIn(Data)
+	, mEnd(Data + Size + PADDING)
+{
+	mWindow.resize(WINDOW_SIZE + MaxRead + SLIDE_BATCH + SLACK);
+
+	// zlib header, deflate with no preset dictionary
+	Refill();
+	uint32_t CMF = GetBits(8);
+	uint32_t FLG = GetBits(8);
+	if (Size < 2 || (CMF & 0xF) != 8 || (CMF >> 4) > 7 || (FLG & 0x20) || ((CMF << 8) | FLG) % 31)
+		mFailed = true;
+}
+
+void Inflater::Refill()
+{
+	// Loads as many whole bytes as fit, the padding means there's always 8 to read
+	if (mEnd - mIn >= 8)
+	{
+		uint64_t Next;
+		memcpy(&Next, mIn, 8);
+		mBits |= Next << mCount;
+		mIn += (63 - mCount) >> 3;
+		mCount |= 56;
+		return;
+	}
+
+	while (mCount <= 56 && mIn < mEnd)
+	{
+		mBits |= (uint64_t)*mIn++ << mCount;
+		mCount += 8;
+	}
+}
+
+uint32_t Inflater::GetBits(uint32_t Count)
+{
+	uint32_t Value = mBits & ((1ULL << Count) - 1);
+	mBits >>= Count;
+	mCount -= Count;
+	return Value;
+}
+
+bool Inflater::BuildHuffman(Huffman* Table, const uint8_t* Lengths, uint32_t Count)
+{
+	memset(Table->Fast, 0, sizeof(Table->Fast));
+	memset(Table->Count, 0, sizeof(Table->Count));
+
+	for (uint32_t i = 0; i < Count; ++i)
+		Table->Count[Lengths[i]]++;
+	Table->Count[0] = 0;
+
+	// Over-subscribed sets can't be decoded, incomplete ones are allowed
+	int32_t Left = 1;
+	uint16_t Offsets[MAX_BITS + 2];
+	Offsets[1] = 0;
+	for (uint32_t Len = 1; Len <= MAX_BITS; ++Len)
+	{
+		Left = (Left << 1) - Table->Count[Len];
+		if (Left < 0)
+			return false;
+		Offsets[Len + 1] = Offsets[Len] + Table->Count[Len];
+	}
+
+	// Symbols sorted by code length, which is canonical code order
+	for (uint32_t i = 0; i < Count; ++i)
+		if (Lengths[i])
+			Table->Symbol[Offsets[Lengths[i]]++] = i;
+
+	// Codes go in to the stream most significant bit first, so the lookup is on the reversed code
+	uint32_t Code = 0;
+	uint32_t Index = 0;
+	for (uint32_t Len = 1; Len <= FAST_BITS; ++Len)
+	{
+		for (uint32_t i = 0; i < Table->Count[Len]; ++i, ++Code, ++Index)
+		{
+			uint32_t Reversed = 0;
+			for (uint32_t Bit = 0; Bit < Len; ++Bit)
+				Reversed |= ((Code >> Bit) & 1) << (Len - 1 - Bit);
+
+			const uint16_t Entry = (Table->Symbol[Index] << 4) | Len;
+			for (uint32_t Fill = Reversed; Fill < (1U << FAST_BITS); Fill += 1U << Len)
+				Table->Fast[Fill] = Entry;
+		}
+		Code <<= 1;
+	}
+
+	return true;
+}
+
+int32_t Inflater::DecodeSymbol(const Huffman& Table)
+{
+	const uint16_t Entry = Table.Fast[mBits & ((1 << FAST_BITS) - 1)];
+	if (Entry)
+	{
+		GetBits(Entry & 0xF);
+		return Entry >> 4;
+	}
+
+	// Long code, walk the canonical table a bit at a time
+	int32_t Code = 0, First = 0, Index = 0;
+	for (uint32_t Len = 1; Len <= MAX_BITS; ++Len)
+	{
+		Code |= GetBits(1);
+		const int32_t Count = Table.Count[Len];
+		if (Code - Count < First)
+			return Table.Symbol[Index + (Code - First)];
+		Index += Count;
+		First = (First + Count) << 1;
+		Code <<= 1;
+	}
+	return -1;
+}
+
+bool Inflater::ReadDynamicTables()
+{
+	uint8_t Lengths[286 + 30];
+
+	const uint32_t LitLenCount = GetBits(5) + 257;
+	const uint32_t DistCount = GetBits(5) + 1;
+	const uint32_t CodeLengthCount = GetBits(4) + 4;
+	if (LitLenCount > 286 || DistCount > 30)
+		return false;
+
+	uint8_t CodeLengths[19] = {};
+	for (uint32_t i = 0; i < CodeLengthCount; ++i)
+	{
+		Refill();
+		CodeLengths[CODE_LENGTH_ORDER[i]] = GetBits(3);
+	}
+
+	Huffman CodeLengthTable;
+	if (!BuildHuffman(&CodeLengthTable, CodeLengths, 19))
+		return false;
+
+	for (uint32_t i = 0; i < LitLenCount + DistCount;)
+	{
+		Refill();
+		if (mCount < 0)
+			return false;
+
+		int32_t Symbol = DecodeSymbol(CodeLengthTable);
+		if (Symbol < 0)
+			return false;
+
+		if (Symbol < 16)
+		{
+			Lengths[i++] = Symbol;
+			continue;
+		}
+
+		uint8_t Repeat = 0;
+		uint32_t Times;
+		if (Symbol == 16)
+		{
+			if (i == 0)
+				return false;
+			Repeat = Lengths[i - 1];
+			Times = 3 + GetBits(2);
+		}
+		else if (Symbol == 17)
+		{
+			Times = 3 + GetBits(3);
+		}
+		else
+		{
+			Times = 11 + GetBits(7);
+		}
+
+		if (i + Times > LitLenCount + DistCount)
+			return false;
+		memset(&Lengths[i], Repeat, Times);
+		i += Times;
+	}
+
+	// Without an end of block code the block could never finish
+	if (!Lengths[256])
+		return false;
+
+	return BuildHuffman(&mLitLen, Lengths, LitLenCount) &&
+	       BuildHuffman(&mDist, Lengths + LitLenCount, DistCount);
+}
+
+bool Inflater::ReadBlockHeader()
+{
+	if (mFinalBlock)
+	{
+		mState = State::Done;
+		return true;
+	}
+
+	Refill();
+	mFinalBlock = GetBits(1);
+	switch (GetBits(2))
+	{
+	case 0:
+	{
+		// Stored, skip to the next byte and give the bits we've buffered back
+		GetBits(mCount & 7);
+		mIn -= mCount >> 3;
+		mBits = 0;
+		mCount = 0;
+
+		if (mEnd - mIn < 4 + (ptrdiff_t)PADDING)
+			return false;
+
+		const uint32_t Len = mIn[0] | (mIn[1] << 8);
+		const uint32_t NLen = mIn[2] | (mIn[3] << 8);
+		if (Len != (~NLen & 0xFFFF))
+			return false;
+
+		mIn += 4;
+		mStoredLeft = Len;
+		mState = State::Stored;
+		return true;
+	}
+	case 1:
+	{
+		// Fixed codes, the same every time
+		uint8_t Lengths[288 + 30];
+		memset(&Lengths[0], 8, 144);
+		memset(&Lengths[144], 9, 112);
+		memset(&Lengths[256], 7, 24);
+		memset(&Lengths[280], 8, 8);
+		memset(&Lengths[288], 5, 30);
+		BuildHuffman(&mLitLen, Lengths, 288);
+		BuildHuffman(&mDist, Lengths + 288, 30);
+		mState = State::Huffman;
+		return true;
+	}
+	case 2:
+		mState = State::Huffman;
+		return ReadDynamicTables();
+	default:
+		return false;
+	}
+}
+
+bool Inflater::Inflate()
+{
+	const size_t Limit = mWindow.size() - SLACK;
+	uint8_t* Window = &mWindow[0];
+
+	while (mOut < Limit)
+	{
+		switch (mState)
+		{
+		case State::Done:
+			return true;
+
+		case State::Header:
+			if (!ReadBlockHeader())
+				return false;
+			break;
+
+		case State::Stored:
+		{
+			const size_t Size = std::min<size_t>(mStoredLeft, Limit - mOut);
+			if ((size_t)(mEnd - mIn) < Size + PADDING)
+				return false;
+
+			memcpy(Window + mOut, mIn, Size);
+			mIn += Size;
+			mOut += Size;
+			mStoredLeft -= Size;
+			if (!mStoredLeft)
+				mState = State::Header;
+			break;
+		}
+
+		case State::Huffman:
+		{
+			// Everything for one symbol is in the bit buffer after a refill
+			// Coming up short means we've gone through the padding, so the stream was cut off
+			Refill();
+			if (mCount < MAX_SYMBOL_BITS)
+				return false;
+
+			int32_t Symbol = DecodeSymbol(mLitLen);
+			if (Symbol < 256)
+			{
+				if (Symbol < 0)
+					return false;
+				Window[mOut++] = Symbol;
+				break;
+			}
+
+			if (Symbol == 256)
+			{
+				mState = State::Header;
+				break;
+			}
+
+			Symbol -= 257;
+			if (Symbol >= 29)
+				return false;
+			const uint32_t Length = LENGTH_BASE[Symbol] + GetBits(LENGTH_EXTRA[Symbol]);
+
+			int32_t DistSymbol = DecodeSymbol(mDist);
+			if (DistSymbol < 0 || DistSymbol >= 30)
+				return false;
+			const size_t Dist = DIST_BASE[DistSymbol] + GetBits(DIST_EXTRA[DistSymbol]);
+			if (Dist > mOut)
+				return false;
+
+			uint8_t* Out = Window + mOut;
+			const uint8_t* Src = Out - Dist;
+			if (Dist >= 8)
+			{
+				// Can't overlap within 8 bytes, the overshoot lands in the slack
+				for (uint32_t i = 0; i < Length; i += 8)
+					memcpy(Out + i, Src + i, 8);
+			}
+			else if (Dist == 1)
+			{
+				memset(Out, *Src, Length);
+			}
+			else
+			{
+				for (uint32_t i = 0; i < Length; ++i)
+					Out[i] = Src[i];
+			}
+			mOut += Length;
+			break;
+		}
+		}
+	}
+
+	return true;
+}
+
+void Inflater::Slide()
+{
+	// Keep the window deflate can reference, and anything not read yet
+	size_t Keep = mOut > WINDOW_SIZE ? mOut - WINDOW_SIZE : 0;
+	Keep = std::min(Keep, mRead);
+	if (!Keep)
+		return;
+
+	memmove(&mWindow[0], &mWindow[Keep], mOut - Keep);
+	mOut -= Keep;
+	mRead -= Keep;
+}
+
+bool Inflater::Read(uint8_t* Dest, size_t Size)
+{
+	while (mOut - mRead < Size)
+	{
+		if (mFailed || mState == State::Done)
+			return false;
+
+		if (mOut + SLACK + SLIDE_BATCH > mWindow.size())
+			Slide();
+
+		if (!Inflate())
+		{
+			mFailed = true;
+			return false;
+		}
+	}
+
+	memcpy(Dest, &mWindow[mRead], Size);
+	mRead += Size;
+	return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// zlib stream decompressor for PNG image data
+// Output goes through a sliding window, so only the last 32KB plus whatever
+// hasn't been read yet is ever held rather than the whole image
+class Inflater
+{
+public:
+	// Data needs 16 bytes of zeroes after Size so the bit reader can load 8 at a time
+	// MaxRead is the most Read will ever be asked for in one go
+	Inflater(const uint8_t* Data, size_t Size, size_t MaxRead);
+
+	// Copies exactly Size bytes out, false if the stream is corrupt or ends first
+	bool Read(uint8_t* Dest, size_t Size);
+
+	// Information
+	bool HasFailed() const { return mFailed; }
+
+	// Bytes the bit reader has to be able to read past the end of the data
+	static const size_t PADDING = 16;
+
+private:
+	// Huffman codes up to this long decode with a single lookup
+	static const uint32_t FAST_BITS = 10;
+	static const uint32_t MAX_BITS = 15;
+
+	struct Huffman
+	{
+		// Symbol << 4 | length, length of 0 means it's a longer code
+		uint16_t Fast[1 << FAST_BITS];
+
+		// Canonical tables for the long codes
+		uint16_t Count[MAX_BITS + 1];
+		uint16_t Symbol[288];
+	};
+
+	static bool BuildHuffman(Huffman* Table, const uint8_t* Lengths, uint32_t Count);
+	int32_t DecodeSymbol(const Huffman& Table);
+
+	void Refill();
+	uint32_t GetBits(uint32_t Count);
+
+	bool ReadBlockHeader();
+	bool ReadDynamicTables();
+
+	// Inflates until the window is full or the stream ends
+	bool Inflate();
+	void Slide();
+
+	// Bit reader
+	const uint8_t* mIn;
+	const uint8_t* mEnd;
+	uint64_t mBits = 0;
+	int32_t mCount = 0;
+
+	// Window, everything before mRead has been handed out
+	std::vector<uint8_t> mWindow;
+	size_t mOut = 0;
+	size_t mRead = 0;
+
+	// Where we are in the stream
+	enum class State
+	{
+		Header,  // Between blocks
+		Stored,  // mStoredLeft bytes of a stored block left
+		Huffman, // Somewhere in a compressed block
+		Done,
+	};
+	State mState = State::Header;
+	bool mFinalBlock = false;
+	bool mFailed = false;
+	uint32_t mStoredLeft = 0;
+
+	Huffman mLitLen;
+	Huffman mDist;
+};
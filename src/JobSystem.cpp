@@ -0,0 +1,215 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <assert.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Vulkan
+{
+
+static thread_local uint32_t tThreadIndex = 0;
+
+JobSystem::JobSystem(uint32_t Threads, bool Pin)
+{
+	if (!Threads)
+		Threads = std::max(1U, std::thread::hardware_concurrency());
+
+	for (uint32_t i = 0; i < Threads; ++i)
+		mQueues.emplace_back(std::make_unique<Queue>());
+
+	for (uint32_t i = 1; i < Threads; ++i)
+	{
+		mWorkers.emplace_back(&JobSystem::WorkerLoop, this, i);
+
+#ifdef __linux__
+		if (Pin)
+		{
+			cpu_set_t Set;
+			CPU_ZERO(&Set);
+			CPU_SET(i % std::max(1U, std::thread::hardware_concurrency()), &Set);
+			pthread_setaffinity_np(mWorkers.back().native_handle(), sizeof(Set), &Set);
+		}
+#endif
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> Lock(mSleepLock);
+		mQuit = true;
+	}
+	mWake.notify_all();
+
+	for (auto& Worker : mWorkers)
+		Worker.join();
+}
+
+uint32_t JobSystem::GetThreadIndex()
+{
+	return tThreadIndex;
+}
+
+void JobSystem::Push(Job&& NewJob)
+{
+	// Threads outside the system share queue 0
+	uint32_t Thread = std::min<uint32_t>(tThreadIndex, mQueues.size() - 1);
+	{
+		std::lock_guard<std::mutex> Lock(mQueues[Thread]->Lock);
+		mQueues[Thread]->Jobs.push_back(std::move(NewJob));
+	}
+
+	{
+		std::lock_guard<std::mutex> Lock(mSleepLock);
+		mQueued.fetch_add(1, std::memory_order_release);
+	}
+	mWake.notify_one();
+}
+
+bool JobSystem::Pop(uint32_t Thread, Job* Out)
+{
+	if (!mQueued.load(std::memory_order_acquire))
+		return false;
+
+	// Newest first from our own queue, it's the most likely to still be in cache
+	{
+		Queue& Own = *mQueues[Thread];
+		std::lock_guard<std::mutex> Lock(Own.Lock);
+		if (!Own.Jobs.empty())
+		{
+			*Out = std::move(Own.Jobs.back());
+			Own.Jobs.pop_back();
+			mQueued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// Oldest first from everyone else, those tend to be the biggest chunks of work
+	for (uint32_t i = 1; i < mQueues.size(); ++i)
+	{
+		Queue& Victim = *mQueues[(Thread + i) % mQueues.size()];
+		std::lock_guard<std::mutex> Lock(Victim.Lock);
+		if (!Victim.Jobs.empty())
+		{
+			*Out = std::move(Victim.Jobs.front());
+			Victim.Jobs.pop_front();
+			mQueued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::Execute(Job& CurrentJob)
+{
+	CurrentJob.Func();
+
+	JobCounter* Signal = CurrentJob.Signal;
+	if (!Signal)
+		return;
+
+	// Keeps Done() false until we stop touching the counter
+	Signal->mReleasing.fetch_add(1, std::memory_order_acq_rel);
+
+	if (Signal->mPending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		// Last one out releases anything that was waiting on the counter
+		std::vector<std::pair<JobFunc, JobCounter*>> Waiting;
+		{
+			std::lock_guard<std::mutex> Lock(Signal->mLock);
+			Waiting.swap(Signal->mWaiting);
+		}
+
+		for (auto& Waiter : Waiting)
+			Push({ std::move(Waiter.first), Waiter.second });
+	}
+
+	Signal->mReleasing.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::Run(JobFunc Func, JobCounter* Signal, JobCounter* After)
+{
+	if (Signal)
+		Signal->mPending.fetch_add(1, std::memory_order_relaxed);
+
+	if (After)
+	{
+		// Checked under the lock so we can't miss the counter hitting zero
+		std::lock_guard<std::mutex> Lock(After->mLock);
+		if (After->mPending.load(std::memory_order_acquire))
+		{
+			After->mWaiting.emplace_back(std::move(Func), Signal);
+			return;
+		}
+	}
+
+	Push({ std::move(Func), Signal });
+}
+
+void JobSystem::Wait(JobCounter* Counter)
+{
+	const uint32_t Thread = std::min<uint32_t>(tThreadIndex, mQueues.size() - 1);
+
+	Job CurrentJob;
+	while (!Counter->Done())
+	{
+		if (Pop(Thread, &CurrentJob))
+			Execute(CurrentJob);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::ParallelFor(uint32_t Count, uint32_t MinChunk, const RangeFunc& Func)
+{
+	if (!Count)
+		return;
+
+	// A few chunks per thread so stealing can even out uneven chunks
+	uint32_t Chunks = std::min(GetThreads() * 4, std::max(1U, Count / std::max(1U, MinChunk)));
+	uint32_t Chunk = (Count + Chunks - 1) / Chunks;
+
+	if (Chunks == 1)
+	{
+		Func(0, Count);
+		return;
+	}
+
+	JobCounter Counter;
+	for (uint32_t Begin = Chunk; Begin < Count; Begin += Chunk)
+	{
+		uint32_t End = std::min(Count, Begin + Chunk);
+		Run([&Func, Begin, End]() { Func(Begin, End); }, &Counter);
+	}
+
+	// The caller takes the first chunk itself
+	Func(0, std::min(Count, Chunk));
+	Wait(&Counter);
+}
+
+void JobSystem::WorkerLoop(uint32_t Thread)
+{
+	tThreadIndex = Thread;
+
+	Job CurrentJob;
+	while (true)
+	{
+		if (Pop(Thread, &CurrentJob))
+		{
+			Execute(CurrentJob);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> Lock(mSleepLock);
+		mWake.wait(Lock, [this]() { return mQuit || mQueued.load(std::memory_order_acquire); });
+		if (mQuit)
+			return;
+	}
+}
+
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Vulkan
+{
+// Counts outstanding jobs
+// Jobs can signal one when they finish, and other jobs can be held back until it hits zero
+class JobCounter
+{
+public:
+	// Only true once the last job has also finished releasing the waiting jobs,
+	// so the counter can go out of scope as soon as this returns true
+	bool Done() const
+	{
+		return mPending.load(std::memory_order_acquire) == 0 &&
+		       mReleasing.load(std::memory_order_acquire) == 0;
+	}
+
+private:
+	friend class JobSystem;
+
+	std::atomic<uint32_t> mPending{0};
+	std::atomic<uint32_t> mReleasing{0};
+
+	// Jobs waiting on this counter, queued once it reaches zero
+	std::mutex mLock;
+	std::vector<std::pair<std::function<void()>, JobCounter*>> mWaiting;
+};
+
+// Work stealing job scheduler
+// Every thread owns a deque, pushing and popping at the back of its own
+// and stealing from the front of the others when it runs dry
+// The thread that created the system counts as thread 0 and helps out while it waits
+class JobSystem
+{
+public:
+	typedef std::function<void()> JobFunc;
+	typedef std::function<void(uint32_t Begin, uint32_t End)> RangeFunc;
+
+	// Threads of 0 means one per core, Pin locks each worker to its own core
+	JobSystem(uint32_t Threads = 0, bool Pin = false);
+	~JobSystem();
+
+	static std::unique_ptr<JobSystem> Create(uint32_t Threads = 0, bool Pin = false)
+	{
+		return std::make_unique<JobSystem>(Threads, Pin);
+	}
+
+	// Queues Func, which decrements Signal when done
+	// If After is given the job isn't queued until After reaches zero
+	void Run(JobFunc Func, JobCounter* Signal = nullptr, JobCounter* After = nullptr);
+
+	// Runs other jobs until Counter reaches zero
+	void Wait(JobCounter* Counter);
+
+	// Splits [0, Count) in to chunks of at least MinChunk and waits for all of them
+	void ParallelFor(uint32_t Count, uint32_t MinChunk, const RangeFunc& Func);
+
+	// Information
+	uint32_t GetThreads() const { return mQueues.size(); }
+
+	// Index of the calling thread, 0 for any thread outside the system
+	static uint32_t GetThreadIndex();
+
+private:
+	struct Job
+	{
+		JobFunc Func;
+		JobCounter* Signal;
+	};
+
+	struct Queue
+	{
+		std::mutex Lock;
+		std::deque<Job> Jobs;
+	};
+
+	void Push(Job&& NewJob);
+	bool Pop(uint32_t Thread, Job* Out);
+	void Execute(Job& CurrentJob);
+	void WorkerLoop(uint32_t Thread);
+
+	std::vector<std::unique_ptr<Queue>> mQueues;
+	std::vector<std::thread> mWorkers;
+
+	// Idle workers sleep here until something gets queued
+	std::atomic<uint32_t> mQueued{0};
+	std::mutex mSleepLock;
+	std::condition_variable mWake;
+	bool mQuit = false;
+};
+}
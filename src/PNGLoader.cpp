@@ -1,66 +1,312 @@
 #include "PNGLoader.h"
+#include "Inflate.h"
+#include "PNGUnfilter.h"
+#include "Profiler.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <png.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <vector>
 
+namespace
+{
+	// How much of the compressed stream gets handed to libpng at a time
+	const size_t DECODE_CHUNK_SIZE = 64 * 1024;
+
+	// Signature plus the IHDR chunk up to the interlace method
+	const size_t HEADER_SIZE = 29;
+
+	// Chunks are a length, a type, the data and then a CRC
+	const size_t CHUNK_OVERHEAD = 12;
+
+	uint32_t ReadBE32(const uint8_t* Data)
+	{
+		return (Data[0] << 24) | (Data[1] << 16) | (Data[2] << 8) | Data[3];
+	}
+}
+
 PNGLoader::PNGLoader(std::string Filename)
+	: mFilename(Filename)
 {
+	PROFILE_SCOPE("PNGLoader");
 	printf("Loading PNG '%s'\n", Filename.c_str());
 	FILE* fp = fopen(Filename.c_str(), "rb");
 
-	assert(!fp);
+	// Left at 0x0 like anything else that can't be read
+	if (!fp)
+	{
+		printf("Couldn't open '%s'\n", Filename.c_str());
+		return;
+	}
 
-	png_structp ReadStruct = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-	assert(!ReadStruct);
+	fseek(fp, 0, SEEK_END);
+	mFile.resize(ftell(fp));
+	fseek(fp, 0, SEEK_SET);
+	size_t Read = mFile.empty() ? 0 : fread(&mFile[0], 1, mFile.size(), fp);
+	fclose(fp);
 
-	png_infop InfoStruct = png_create_info_struct(ReadStruct);
+	if (Read != mFile.size())
+	{
+		printf("Couldn't read '%s'\n", Filename.c_str());
+		mFile.clear();
+		return;
+	}
 
-	assert(!InfoStruct);
+	ParseHeader();
+	printf("Dim: %dx%d\n", mWidth, mHeight);
+}
 
-	png_init_io(ReadStruct, fp);
+PNGLoader::PNGLoader(std::string Name, std::vector<uint8_t> File)
+	: mFilename(Name)
+	, mFile(std::move(File))
+{
+	ParseHeader();
+}
 
-	png_read_info(ReadStruct, InfoStruct);
+bool PNGLoader::ReadSize(const std::string& Filename, uint32_t* Width, uint32_t* Height)
+{
+	uint8_t Header[HEADER_SIZE];
+	FILE* fp = fopen(Filename.c_str(), "rb");
+	if (!fp)
+		return false;
+	const size_t Read = fread(Header, 1, HEADER_SIZE, fp);
+	fclose(fp);
 
-	mWidth = png_get_image_width(ReadStruct, InfoStruct);
-	mHeight = png_get_image_height(ReadStruct, InfoStruct);
-	mColor = png_get_color_type(ReadStruct, InfoStruct);
-	mDepth = png_get_bit_depth(ReadStruct, InfoStruct);
+	if (Read < HEADER_SIZE || png_sig_cmp(Header, 0, 8) || memcmp(&Header[12], "IHDR", 4))
+		return false;
 
-	printf("Dim: %dx%d\n", mWidth, mHeight);
+	*Width = ReadBE32(&Header[16]);
+	*Height = ReadBE32(&Header[20]);
+	return true;
+}
 
-	// If the colour depth is 16bit, strip it to 8bit
-	if (mDepth == 16)
+void PNGLoader::ParseHeader()
+{
+	// IHDR is always the first chunk so the dimensions can be pulled out without libpng
+	if (mFile.size() < HEADER_SIZE ||
+	    png_sig_cmp(&mFile[0], 0, 8) ||
+	    memcmp(&mFile[12], "IHDR", 4))
 	{
-		mDepth = 8;
-		png_set_strip_16(ReadStruct);
+		printf("'%s' isn't a PNG\n", mFilename.c_str());
+		return;
 	}
 
+	mWidth = ReadBE32(&mFile[16]);
+	mHeight = ReadBE32(&mFile[20]);
+	mDepth = mFile[24];
+	mColor = mFile[25];
+	mInterlace = mFile[28];
 
-	// Crush the palette
-	if (mColor == PNG_COLOR_TYPE_PALETTE)
+	// Transparency turns RGB in to RGBA, which only libpng handles
+	for (size_t Offset = 8; Offset + CHUNK_OVERHEAD <= mFile.size();)
 	{
-		png_set_palette_to_rgb(ReadStruct);
+		const uint32_t Length = ReadBE32(&mFile[Offset]);
+		const uint8_t* Type = &mFile[Offset + 4];
+		if (!memcmp(Type, "tRNS", 4))
+			mHasTransparency = true;
+		if (!memcmp(Type, "IDAT", 4) || Length > mFile.size())
+			break;
+		Offset += CHUNK_OVERHEAD + Length;
 	}
+}
 
+void PNGLoader::InfoCallback(void* ReadStructPtr, void* InfoStructPtr)
+{
+	png_structp ReadStruct = (png_structp)ReadStructPtr;
+	png_infop InfoStruct = (png_infop)InfoStructPtr;
+	PNGLoader* Loader = (PNGLoader*)png_get_progressive_ptr(ReadStruct);
+
+	// Crush the palette, and bring anything under 8bit up to it
+	// Everything else is left as is and converted to BGRA by our own kernels as rows come out
+	png_byte Color = png_get_color_type(ReadStruct, InfoStruct);
+	if (Color == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(ReadStruct);
+	if (png_get_bit_depth(ReadStruct, InfoStruct) < 8)
+		png_set_expand(ReadStruct);
+	if (png_get_valid(ReadStruct, InfoStruct, PNG_INFO_tRNS))
+		png_set_tRNS_to_alpha(ReadStruct);
+
+	png_set_interlace_handling(ReadStruct);
 	png_read_update_info(ReadStruct, InfoStruct);
 
-	uint32_t rowWidth = png_get_rowbytes(ReadStruct, InfoStruct);
-	mData.resize(mWidth * mHeight * rowWidth);
+	const bool Wide = png_get_bit_depth(ReadStruct, InfoStruct) == 16;
+	Vulkan::PixelFormat Format;
+	switch (png_get_color_type(ReadStruct, InfoStruct))
+	{
+	case PNG_COLOR_TYPE_GRAY:
+		Format = Wide ? Vulkan::PixelFormat::Gray16 : Vulkan::PixelFormat::Gray8;
+		break;
+	case PNG_COLOR_TYPE_GRAY_ALPHA:
+		Format = Wide ? Vulkan::PixelFormat::GrayAlpha16 : Vulkan::PixelFormat::GrayAlpha8;
+		break;
+	case PNG_COLOR_TYPE_RGB:
+		Format = Wide ? Vulkan::PixelFormat::RGB16 : Vulkan::PixelFormat::RGB8;
+		break;
+	default:
+		Format = Wide ? Vulkan::PixelFormat::RGBA16 : Vulkan::PixelFormat::RGBA8;
+		break;
+	}
+	Loader->mConverter = Vulkan::PixelConverter(Format, Loader->mPremultiply);
 
-	std::vector<uint8_t*> RowPointers(mHeight);
-	for (uint32_t i = 0; i < mHeight; ++i)
+	// Interlaced rows only come out complete on the last pass, so they get put together
+	// in their own buffer first and converted once at the end
+	if (png_get_interlace_type(ReadStruct, InfoStruct) != PNG_INTERLACE_NONE)
 	{
-		RowPointers[i] = &mData[mHeight * rowWidth];
+		Loader->mInterlacePitch = png_get_rowbytes(ReadStruct, InfoStruct);
+		Loader->mInterlaced.assign(Loader->mInterlacePitch * Loader->mHeight, 0);
 	}
 
-	png_read_image(ReadStruct, &RowPointers[0]);
+	assert(png_get_rowbytes(ReadStruct, InfoStruct) == png_get_image_width(ReadStruct, InfoStruct) * Vulkan::GetPixelSize(Format));
+}
 
-	png_destroy_read_struct(&ReadStruct, &InfoStruct, nullptr);
+void PNGLoader::RowCallback(void* ReadStructPtr, uint8_t* NewRow, uint32_t Row, int)
+{
+	png_structp ReadStruct = (png_structp)ReadStructPtr;
+	PNGLoader* Loader = (PNGLoader*)png_get_progressive_ptr(ReadStruct);
 
-	fclose(fp);
-	printf("Done reading in PNG\n");
+	// Null rows are interlace passes that didn't touch this row
+	if (!NewRow)
+		return;
+
+	if (!Loader->mInterlaced.empty())
+	{
+		png_progressive_combine_row(ReadStruct, &Loader->mInterlaced[Row * Loader->mInterlacePitch], NewRow);
+		return;
+	}
+
+	// Converted while the row is still in cache, straight in to the destination
+	Loader->mConverter.Convert(NewRow, Loader->mDest + Row * Loader->mRowPitch, Loader->mWidth);
+}
+
+bool PNGLoader::Decode(uint8_t* Dest, size_t RowPitch, bool Premultiply)
+{
+	PROFILE_SCOPE("PNGLoader::Decode");
+
+	bool Decoded = CanDecodeFast() ?
+		DecodeFast(Dest, RowPitch, Premultiply) :
+		DecodeLibPNG(Dest, RowPitch, Premultiply);
+
+	if (Decoded)
+		printf("Done reading in PNG\n");
+	return Decoded;
+}
+
+bool PNGLoader::CanDecodeFast() const
+{
+	return mWidth && mHeight && mDepth == 8 && !mInterlace && !mHasTransparency &&
+	       (mColor == PNG_COLOR_TYPE_RGB || mColor == PNG_COLOR_TYPE_RGB_ALPHA);
+}
+
+bool PNGLoader::DecodeFast(uint8_t* Dest, size_t RowPitch, bool Premultiply)
+{
+	assert(CanDecodeFast());
+	assert(RowPitch >= (size_t)mWidth * 4);
+
+	// The image data is one zlib stream split across the IDAT chunks, put it back together
+	std::vector<uint8_t> Stream;
+	for (size_t Offset = 8; Offset + CHUNK_OVERHEAD <= mFile.size();)
+	{
+		const uint32_t Length = ReadBE32(&mFile[Offset]);
+		if (Length > mFile.size() - Offset - CHUNK_OVERHEAD)
+			break;
+
+		const uint8_t* Type = &mFile[Offset + 4];
+		if (!memcmp(Type, "IDAT", 4))
+			Stream.insert(Stream.end(), &mFile[Offset + 8], &mFile[Offset + 8] + Length);
+		else if (!memcmp(Type, "IEND", 4))
+			break;
+		Offset += CHUNK_OVERHEAD + Length;
+	}
+	const size_t StreamSize = Stream.size();
+	Stream.resize(StreamSize + Inflater::PADDING, 0);
+
+	const uint32_t BPP = mColor == PNG_COLOR_TYPE_RGB ? 3 : 4;
+	const uint32_t Stride = mWidth * BPP;
+
+	// The unfilter wants zeroes standing in for the pixel left of the first one, and room to read past the end
+	const uint32_t LEAD = 16, TAIL = 16;
+	std::vector<uint8_t> Rows(2 * (LEAD + Stride + TAIL), 0);
+	uint8_t* Current = &Rows[LEAD];
+	uint8_t* Previous = &Rows[LEAD + Stride + TAIL + LEAD];
+
+	static const SIMDLevel Kernel = SIMDResolve(SIMDLevel::Best);
+	Vulkan::PixelConverter Converter(BPP == 3 ? Vulkan::PixelFormat::RGB8 : Vulkan::PixelFormat::RGBA8, Premultiply);
+	Inflater Inflate(Stream.data(), StreamSize, Stride);
+
+	for (uint32_t y = 0; y < mHeight; ++y)
+	{
+		uint8_t Filter;
+		if (!Inflate.Read(&Filter, 1) || !Inflate.Read(Current, Stride) ||
+		    !PNGUnfilter(Kernel, Filter, Current, Previous, Stride, BPP))
+		{
+			printf("Failed decoding PNG '%s'\n", mFilename.c_str());
+			return false;
+		}
+
+		Converter.Convert(Current, Dest + y * RowPitch, mWidth);
+		std::swap(Current, Previous);
+	}
+
+	return true;
 }
 
+bool PNGLoader::DecodeLibPNG(uint8_t* Dest, size_t RowPitch, bool Premultiply)
+{
+	assert(RowPitch >= (size_t)mWidth * 4);
+
+	if (!mWidth || !mHeight)
+		return false;
+
+	png_structp ReadStruct = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	assert(ReadStruct);
+
+	png_infop InfoStruct = png_create_info_struct(ReadStruct);
+	assert(InfoStruct);
+
+	mDest = Dest;
+	mRowPitch = RowPitch;
+	mPremultiply = Premultiply;
+	mFinished = false;
+
+	// libpng longjmps back here on a corrupt stream
+	if (setjmp(png_jmpbuf(ReadStruct)))
+	{
+		printf("Failed decoding PNG '%s'\n", mFilename.c_str());
+		png_destroy_read_struct(&ReadStruct, &InfoStruct, nullptr);
+		std::vector<uint8_t>().swap(mInterlaced);
+		return false;
+	}
+
+	// Rows get handed over as they come out of inflate, so nothing ever holds the whole image but Dest
+	png_set_progressive_read_fn(ReadStruct, this,
+		[](png_structp Read, png_infop Info) { InfoCallback(Read, Info); },
+		[](png_structp Read, png_bytep NewRow, png_uint_32 Row, int Pass) { RowCallback(Read, NewRow, Row, Pass); },
+		[](png_structp Read, png_infop) { ((PNGLoader*)png_get_progressive_ptr(Read))->mFinished = true; });
+
+	for (size_t Offset = 0; Offset < mFile.size(); Offset += DECODE_CHUNK_SIZE)
+	{
+		size_t Size = std::min(DECODE_CHUNK_SIZE, mFile.size() - Offset);
+		png_process_data(ReadStruct, InfoStruct, &mFile[Offset], Size);
+	}
+
+	png_destroy_read_struct(&ReadStruct, &InfoStruct, nullptr);
+
+	if (mFinished && !mInterlaced.empty())
+	{
+		for (uint32_t y = 0; y < mHeight; ++y)
+			mConverter.Convert(&mInterlaced[y * mInterlacePitch], mDest + y * mRowPitch, mWidth);
+	}
+	std::vector<uint8_t>().swap(mInterlaced);
+	mDest = nullptr;
+
+	if (!mFinished)
+	{
+		printf("PNG '%s' is truncated\n", mFilename.c_str());
+		return false;
+	}
+
+	return true;
+}
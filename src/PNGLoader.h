@@ -1,24 +1,65 @@
 #pragma once
 
+#include "PixelConvert.h"
+
 #include <stdint.h>
+#include <stddef.h>
 #include <string>
 #include <vector>
 
 class PNGLoader
 {
 public:
+	// Only reads the file in and parses the header, pixels come out of Decode
 	PNGLoader(std::string Filename);
 
-	// Data
-	const std::vector<uint8_t>& GetData() const { return mData; }
+	// For a PNG that's already in memory, Name is only for messages
+	PNGLoader(std::string Name, std::vector<uint8_t> File);
+
+	// Only reads as far as the dimensions, false if it isn't a PNG
+	static bool ReadSize(const std::string& Filename, uint32_t* Width, uint32_t* Height);
+
+	// Decodes straight in to Dest, row y landing at Dest + y * RowPitch
+	// Always four bytes per pixel in BGRA order, alpha is filled in if the PNG has none
+	// Returns false if the PNG turned out to be broken
+	bool Decode(uint8_t* Dest, size_t RowPitch, bool Premultiply = false);
+
+	// Decode picks between these, they're only public so they can be compared
+	// The fast path is our own inflate and unfilter, it only handles plain 8bit RGB and RGBA
+	// and doesn't check CRCs or the Adler-32, libpng handles everything else
+	bool CanDecodeFast() const;
+	bool DecodeFast(uint8_t* Dest, size_t RowPitch, bool Premultiply = false);
+	bool DecodeLibPNG(uint8_t* Dest, size_t RowPitch, bool Premultiply = false);
 
 	// Information
 	uint32_t GetWidth() const { return mWidth; }
 	uint32_t GetHeight() const { return mHeight; }
+	size_t GetDecodedSize() const { return (size_t)mWidth * mHeight * 4; }
+	const std::vector<uint8_t>& GetFile() const { return mFile; }
 
 private:
-	uint32_t mWidth, mHeight;
-	uint8_t mColor, mDepth;
-	std::vector<uint8_t> mData;
+	void ParseHeader();
+
+	static void InfoCallback(void* ReadStruct, void* InfoStruct);
+	static void RowCallback(void* ReadStruct, uint8_t* NewRow, uint32_t Row, int Pass);
+
+	std::string mFilename;
+	uint32_t mWidth = 0, mHeight = 0;
+	uint8_t mColor = 0, mDepth = 0;
+	uint8_t mInterlace = 0;
+	bool mHasTransparency = false;
+
+	// Compressed file contents, a lot smaller than the decoded image
+	std::vector<uint8_t> mFile;
+
+	// Where Decode is currently writing
+	uint8_t* mDest = nullptr;
+	size_t mRowPitch = 0;
+	bool mPremultiply = false;
+	bool mFinished = false;
+	Vulkan::PixelConverter mConverter{Vulkan::PixelFormat::BGRA8};
 
+	// Only used for interlaced images
+	std::vector<uint8_t> mInterlaced;
+	size_t mInterlacePitch = 0;
 };
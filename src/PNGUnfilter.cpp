@@ -0,0 +1,242 @@
+#include "PNGUnfilter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UNFILTER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	enum Filter
+	{
+		FILTER_NONE,
+		FILTER_SUB,
+		FILTER_UP,
+		FILTER_AVERAGE,
+		FILTER_PAETH,
+	};
+
+	// Scalar, reads to the left go in to the zeroes before the row
+	void SubScalar(uint8_t* Row, uint32_t Size, uint32_t BPP)
+	{
+		for (uint32_t i = 0; i < Size; ++i)
+			Row[i] += Row[(int32_t)i - (int32_t)BPP];
+	}
+
+	void UpScalar(uint8_t* Row, const uint8_t* Prev, uint32_t Size)
+	{
+		for (uint32_t i = 0; i < Size; ++i)
+			Row[i] += Prev[i];
+	}
+
+	void AverageScalar(uint8_t* Row, const uint8_t* Prev, uint32_t Size, uint32_t BPP)
+	{
+		for (uint32_t i = 0; i < Size; ++i)
+			Row[i] += (Row[(int32_t)i - (int32_t)BPP] + Prev[i]) >> 1;
+	}
+
+	inline uint8_t PaethPredictor(int32_t a, int32_t b, int32_t c)
+	{
+		int32_t pa = abs(b - c);
+		int32_t pb = abs(a - c);
+		int32_t pc = abs(a + b - 2 * c);
+		if (pa <= pb && pa <= pc)
+			return a;
+		if (pb <= pc)
+			return b;
+		return c;
+	}
+
+	void PaethScalar(uint8_t* Row, const uint8_t* Prev, uint32_t Size, uint32_t BPP)
+	{
+		for (uint32_t i = 0; i < Size; ++i)
+		{
+			const int32_t Left = (int32_t)i - (int32_t)BPP;
+			Row[i] += PaethPredictor(Row[Left], Prev[i], Prev[Left]);
+		}
+	}
+
+#ifdef UNFILTER_X86
+	// Only Up is independent across a row, the rest depend on the pixel to their left
+	// so those go a pixel at a time with all of its channels in one register
+	template<uint32_t BPP>
+	inline __m128i LoadPixel(const uint8_t* Data)
+	{
+		int32_t Value = 0;
+		memcpy(&Value, Data, BPP);
+		return _mm_cvtsi32_si128(Value);
+	}
+
+	template<uint32_t BPP>
+	inline void StorePixel(uint8_t* Data, __m128i Pixel)
+	{
+		int32_t Value = _mm_cvtsi128_si32(Pixel);
+		memcpy(Data, &Value, BPP);
+	}
+
+	void UpSSE(uint8_t* Row, const uint8_t* Prev, uint32_t Size)
+	{
+		uint32_t i = 0;
+		for (; i + 16 <= Size; i += 16)
+		{
+			__m128i Sum = _mm_add_epi8(_mm_loadu_si128((const __m128i*)(Row + i)),
+			                           _mm_loadu_si128((const __m128i*)(Prev + i)));
+			_mm_storeu_si128((__m128i*)(Row + i), Sum);
+		}
+		UpScalar(Row + i, Prev + i, Size - i);
+	}
+
+	// Sub is a prefix sum of pixels, done four pixels at a time
+	void Sub4SSE(uint8_t* Row, uint32_t Size)
+	{
+		__m128i Last = _mm_setzero_si128();
+		uint32_t i = 0;
+		for (; i + 16 <= Size; i += 16)
+		{
+			__m128i X = _mm_loadu_si128((const __m128i*)(Row + i));
+			X = _mm_add_epi8(X, _mm_slli_si128(X, 4));
+			X = _mm_add_epi8(X, _mm_slli_si128(X, 8));
+			X = _mm_add_epi8(X, Last);
+			_mm_storeu_si128((__m128i*)(Row + i), X);
+			Last = _mm_shuffle_epi32(X, 0xFF);
+		}
+		SubScalar(Row + i, Size - i, 4);
+	}
+
+	void Sub3SSE(uint8_t* Row, uint32_t Size)
+	{
+		const __m128i PixelMask = _mm_cvtsi32_si128(0xFFFFFF);
+		__m128i Last = _mm_setzero_si128();
+		uint32_t i = 0;
+
+		// Reads 16 bytes for four 3 byte pixels, the last 4 bytes are never stored
+		for (; i + 12 <= Size; i += 12)
+		{
+			__m128i X = _mm_loadu_si128((const __m128i*)(Row + i));
+			X = _mm_add_epi8(X, _mm_slli_si128(X, 3));
+			X = _mm_add_epi8(X, _mm_slli_si128(X, 6));
+			X = _mm_add_epi8(X, Last);
+
+			_mm_storel_epi64((__m128i*)(Row + i), X);
+			int32_t High = _mm_cvtsi128_si32(_mm_srli_si128(X, 8));
+			memcpy(Row + i + 8, &High, 4);
+
+			__m128i P = _mm_and_si128(_mm_srli_si128(X, 9), PixelMask);
+			P = _mm_or_si128(P, _mm_slli_si128(P, 3));
+			Last = _mm_or_si128(P, _mm_slli_si128(P, 6));
+		}
+		SubScalar(Row + i, Size - i, 3);
+	}
+
+	template<uint32_t BPP>
+	void AverageSSE(uint8_t* Row, const uint8_t* Prev, uint32_t Size)
+	{
+		const __m128i One = _mm_set1_epi8(1);
+		__m128i A = _mm_setzero_si128();
+		for (uint32_t i = 0; i < Size; i += BPP)
+		{
+			__m128i B = LoadPixel<BPP>(Prev + i);
+
+			// pavgb rounds up, take the carried bit back off
+			__m128i Avg = _mm_sub_epi8(_mm_avg_epu8(A, B), _mm_and_si128(_mm_xor_si128(A, B), One));
+			A = _mm_add_epi8(LoadPixel<BPP>(Row + i), Avg);
+			StorePixel<BPP>(Row + i, A);
+		}
+	}
+
+	template<uint32_t BPP>
+	void PaethSSE(uint8_t* Row, const uint8_t* Prev, uint32_t Size)
+	{
+		const __m128i Zero = _mm_setzero_si128();
+		__m128i A = Zero, C = Zero;
+		for (uint32_t i = 0; i < Size; i += BPP)
+		{
+			__m128i B = _mm_unpacklo_epi8(LoadPixel<BPP>(Prev + i), Zero);
+
+			// Same distances as the scalar predictor, in 16bit lanes
+			__m128i PA = _mm_sub_epi16(B, C);
+			__m128i PB = _mm_sub_epi16(A, C);
+			__m128i PC = _mm_add_epi16(PA, PB);
+			PA = _mm_max_epi16(PA, _mm_sub_epi16(Zero, PA));
+			PB = _mm_max_epi16(PB, _mm_sub_epi16(Zero, PB));
+			PC = _mm_max_epi16(PC, _mm_sub_epi16(Zero, PC));
+
+			// Ties go to a, then b
+			__m128i Smallest = _mm_min_epi16(PC, _mm_min_epi16(PA, PB));
+			__m128i UseB = _mm_cmpeq_epi16(Smallest, PB);
+			__m128i UseA = _mm_cmpeq_epi16(Smallest, PA);
+			__m128i Pred = _mm_or_si128(_mm_and_si128(UseB, B), _mm_andnot_si128(UseB, C));
+			Pred = _mm_or_si128(_mm_and_si128(UseA, A), _mm_andnot_si128(UseA, Pred));
+
+			__m128i Out = _mm_add_epi8(LoadPixel<BPP>(Row + i), _mm_packus_epi16(Pred, Pred));
+			StorePixel<BPP>(Row + i, Out);
+
+			A = _mm_unpacklo_epi8(Out, Zero);
+			C = B;
+		}
+	}
+
+	bool UnfilterSSE(uint8_t Filter, uint8_t* Row, const uint8_t* Prev, uint32_t Size, uint32_t BPP)
+	{
+		switch (Filter)
+		{
+		case FILTER_SUB:
+			if (BPP == 4)
+				Sub4SSE(Row, Size);
+			else
+				Sub3SSE(Row, Size);
+			return true;
+		case FILTER_UP:
+			UpSSE(Row, Prev, Size);
+			return true;
+		case FILTER_AVERAGE:
+			if (BPP == 4)
+				AverageSSE<4>(Row, Prev, Size);
+			else
+				AverageSSE<3>(Row, Prev, Size);
+			return true;
+		case FILTER_PAETH:
+			if (BPP == 4)
+				PaethSSE<4>(Row, Prev, Size);
+			else
+				PaethSSE<3>(Row, Prev, Size);
+			return true;
+		}
+		return false;
+	}
+#endif
+}
+
+bool PNGUnfilter(SIMDLevel Kernel, uint8_t Filter, uint8_t* Row, const uint8_t* Prev,
+                 uint32_t Size, uint32_t BPP)
+{
+	if (Filter == FILTER_NONE)
+		return true;
+
+#ifdef UNFILTER_X86
+	// Nothing here gets any wider with AVX2, every pixel depends on the last
+	if ((Kernel == SIMDLevel::SSE || Kernel == SIMDLevel::AVX2) && (BPP == 3 || BPP == 4))
+		return UnfilterSSE(Filter, Row, Prev, Size, BPP);
+#endif
+
+	switch (Filter)
+	{
+	case FILTER_SUB:
+		SubScalar(Row, Size, BPP);
+		return true;
+	case FILTER_UP:
+		UpScalar(Row, Prev, Size);
+		return true;
+	case FILTER_AVERAGE:
+		AverageScalar(Row, Prev, Size, BPP);
+		return true;
+	case FILTER_PAETH:
+		PaethScalar(Row, Prev, Size, BPP);
+		return true;
+	default:
+		return false;
+	}
+}
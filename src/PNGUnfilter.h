@@ -0,0 +1,12 @@
+#pragma once
+
+#include "SIMD.h"
+
+#include <stdint.h>
+
+// Undoes a PNG row filter in place
+// Row and Prev both need BPP bytes of zeroes before them, and 16 bytes readable after Size
+// Prev is the previous row already unfiltered, all zeroes for the first row
+// Returns false for filter types that don't exist
+bool PNGUnfilter(SIMDLevel Kernel, uint8_t Filter, uint8_t* Row, const uint8_t* Prev,
+                 uint32_t Size, uint32_t BPP);
@@ -0,0 +1,84 @@
+#include "ParallelRecorder.h"
+#include "CommandAllocator.h"
+#include "JobSystem.h"
+#include "Utils.h"
+#include "Vulkan.h"
+
+#include <algorithm>
+#include <assert.h>
+
+namespace Vulkan
+{
+
+ParallelRecorder::ParallelRecorder(JobSystem* Jobs, CommandAllocator* Commands)
+	: mJobs(Jobs)
+	, mCommands(Commands)
+	, mWorkers(Jobs->GetThreads())
+{
+}
+
+ParallelRecorder::~ParallelRecorder()
+{
+}
+
+void ParallelRecorder::Record(Vulkan::InstanceObject& Instance, VkCommandBuffer Primary,
+                              VkRenderPass RenderPass, uint32_t Subpass, VkFramebuffer Framebuffer,
+                              uint32_t Count, const RecordFunc& Func)
+{
+	// Small lists stay on this thread
+	const uint32_t Workers = std::max(1U, std::min(mWorkers, Count / MIN_ITEMS_PER_WORKER));
+	const uint32_t Chunk = (Count + Workers - 1) / Workers;
+
+	const VkCommandBufferInheritanceInfo InheritanceInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		.pNext = nullptr,
+		.renderPass = RenderPass,
+		.subpass = Subpass,
+		.framebuffer = Framebuffer,
+		.occlusionQueryEnable = VK_FALSE,
+		.queryFlags = 0,
+		.pipelineStatistics = 0,
+	};
+
+	const VkCommandBufferBeginInfo BeginInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = nullptr,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+		         VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+		.pInheritanceInfo = &InheritanceInfo,
+	};
+
+	std::vector<VkCommandBuffer> Secondaries(Workers);
+	auto RecordChunk = [&](uint32_t Worker)
+	{
+		VkResult err;
+
+		// Whichever thread picks the chunk up records it from its own pool
+		VkCommandBuffer Cmd = mCommands->Allocate(Instance, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+		Secondaries[Worker] = Cmd;
+
+		err = vkBeginCommandBuffer(Cmd, &BeginInfo);
+		CHECK_ERR(err);
+
+		uint32_t Begin = std::min(Count, Chunk * Worker);
+		uint32_t End = std::min(Count, Begin + Chunk);
+		Func(Cmd, Begin, End);
+
+		err = vkEndCommandBuffer(Cmd);
+		CHECK_ERR(err);
+	};
+
+	// This thread takes the first chunk
+	JobCounter Counter;
+	for (uint32_t Worker = 1; Worker < Workers; ++Worker)
+		mJobs->Run([&RecordChunk, Worker]() { RecordChunk(Worker); }, &Counter);
+	RecordChunk(0);
+
+	mJobs->Wait(&Counter);
+
+	vkCmdExecuteCommands(Primary, Workers, &Secondaries[0]);
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Vulkan
+{
+class CommandAllocator;
+class InstanceObject;
+class JobSystem;
+
+// Records the contents of a subpass on several threads at once
+// Secondaries come from the recording thread's own pool, so nothing is shared while recording
+class ParallelRecorder
+{
+public:
+	// Workers aren't worth waking for less than this many items each
+	static const uint32_t MIN_ITEMS_PER_WORKER = 256;
+
+	// Records items [Begin, End) in to Cmd
+	// Nothing is bound in Cmd yet, secondaries don't inherit any state
+	typedef std::function<void(VkCommandBuffer Cmd, uint32_t Begin, uint32_t End)> RecordFunc;
+
+	// Splits work in to as many chunks as Jobs has threads
+	// Commands needs a pool for each of those threads
+	ParallelRecorder(JobSystem* Jobs, CommandAllocator* Commands);
+	~ParallelRecorder();
+
+	static std::unique_ptr<ParallelRecorder> Create(JobSystem* Jobs, CommandAllocator* Commands)
+	{
+		return std::make_unique<ParallelRecorder>(Jobs, Commands);
+	}
+
+	// Splits [0, Count) in to contiguous chunks recorded as secondaries by jobs,
+	// then executes them in order in Primary
+	// Primary must be inside RenderPass, begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+	// Secondaries are allocated for the allocator's current frame
+	void Record(Vulkan::InstanceObject& Instance, VkCommandBuffer Primary,
+	            VkRenderPass RenderPass, uint32_t Subpass, VkFramebuffer Framebuffer,
+	            uint32_t Count, const RecordFunc& Func);
+
+	// Information
+	uint32_t GetWorkers() const { return mWorkers; }
+
+private:
+	JobSystem* mJobs;
+	CommandAllocator* mCommands;
+	const uint32_t mWorkers;
+};
+}
@@ -0,0 +1,627 @@
+#include "PixelConvert.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXEL_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#define PIXEL_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace Vulkan
+{
+namespace
+{
+	// Pixels converted per trip through the stack buffers, small enough to stay in L1
+	const uint32_t CHUNK_PIXELS = 256;
+
+	typedef void (*RowFunc)(const uint8_t* Src, uint8_t* Dest, uint32_t Count);
+
+	struct RowKernels
+	{
+		RowFunc Gray, GrayAlpha, RGB, RGBA;
+		RowFunc Narrow16; // Count is in samples, not pixels
+		void (*Premultiply)(uint8_t* Data, uint32_t Count); // In place on BGRA8
+	};
+
+	uint32_t GetChannels(PixelFormat Format)
+	{
+		switch (Format)
+		{
+		case PixelFormat::Gray8:
+		case PixelFormat::Gray16:
+			return 1;
+		case PixelFormat::GrayAlpha8:
+		case PixelFormat::GrayAlpha16:
+			return 2;
+		case PixelFormat::RGB8:
+		case PixelFormat::RGB16:
+			return 3;
+		default:
+			return 4;
+		}
+	}
+
+	bool IsWide(PixelFormat Format)
+	{
+		return Format >= PixelFormat::Gray16;
+	}
+
+	// c * a / 255 rounded to nearest, exact for every 8bit input
+	// The SIMD kernels do the same adds and shifts so results match bit for bit
+	inline uint8_t MulDiv255(uint32_t c, uint32_t a)
+	{
+		uint32_t t = c * a + 128;
+		return (t + (t >> 8)) >> 8;
+	}
+
+	void CopyBGRA(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		if (Src != Dest)
+			memmove(Dest, Src, Count * 4);
+	}
+
+	// Scalar
+	void GrayScalar(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		for (uint32_t i = 0; i < Count; ++i, Dest += 4)
+		{
+			Dest[0] = Dest[1] = Dest[2] = Src[i];
+			Dest[3] = 0xFF;
+		}
+	}
+
+	void GrayAlphaScalar(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		for (uint32_t i = 0; i < Count; ++i, Src += 2, Dest += 4)
+		{
+			Dest[0] = Dest[1] = Dest[2] = Src[0];
+			Dest[3] = Src[1];
+		}
+	}
+
+	void RGBScalar(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		for (uint32_t i = 0; i < Count; ++i, Src += 3, Dest += 4)
+		{
+			Dest[0] = Src[2];
+			Dest[1] = Src[1];
+			Dest[2] = Src[0];
+			Dest[3] = 0xFF;
+		}
+	}
+
+	void RGBAScalar(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		for (uint32_t i = 0; i < Count; ++i, Src += 4, Dest += 4)
+		{
+			// Read everything first, this runs in place
+			uint8_t R = Src[0], G = Src[1], B = Src[2], A = Src[3];
+			Dest[0] = B;
+			Dest[1] = G;
+			Dest[2] = R;
+			Dest[3] = A;
+		}
+	}
+
+	// Keeps the high byte, same as libpng's png_set_strip_16
+	void Narrow16Scalar(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		for (uint32_t i = 0; i < Count; ++i)
+			Dest[i] = Src[i * 2];
+	}
+
+	void PremultiplyScalar(uint8_t* Data, uint32_t Count)
+	{
+		for (uint32_t i = 0; i < Count; ++i, Data += 4)
+		{
+			Data[0] = MulDiv255(Data[0], Data[3]);
+			Data[1] = MulDiv255(Data[1], Data[3]);
+			Data[2] = MulDiv255(Data[2], Data[3]);
+		}
+	}
+
+	const RowKernels ScalarKernels =
+	{
+		GrayScalar, GrayAlphaScalar, RGBScalar, RGBAScalar, Narrow16Scalar, PremultiplyScalar,
+	};
+
+#ifdef PIXEL_X86
+	// SSE2 only, there's no pshufb so swizzles are done with shifts and masks
+	void GraySSE(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		const __m128i Alpha = _mm_set1_epi8((char)0xFF);
+		uint32_t i = 0;
+		for (; i + 16 <= Count; i += 16, Dest += 64)
+		{
+			__m128i G = _mm_loadu_si128((const __m128i*)(Src + i));
+			__m128i GGLo = _mm_unpacklo_epi8(G, G);
+			__m128i GGHi = _mm_unpackhi_epi8(G, G);
+			__m128i GALo = _mm_unpacklo_epi8(G, Alpha);
+			__m128i GAHi = _mm_unpackhi_epi8(G, Alpha);
+			_mm_storeu_si128((__m128i*)Dest + 0, _mm_unpacklo_epi16(GGLo, GALo));
+			_mm_storeu_si128((__m128i*)Dest + 1, _mm_unpackhi_epi16(GGLo, GALo));
+			_mm_storeu_si128((__m128i*)Dest + 2, _mm_unpacklo_epi16(GGHi, GAHi));
+			_mm_storeu_si128((__m128i*)Dest + 3, _mm_unpackhi_epi16(GGHi, GAHi));
+		}
+		GrayScalar(Src + i, Dest, Count - i);
+	}
+
+	void GrayAlphaSSE(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		const __m128i Low = _mm_set1_epi16(0xFF);
+		uint32_t i = 0;
+		for (; i + 8 <= Count; i += 8, Dest += 32)
+		{
+			// Each 16bit lane is a << 8 | g
+			__m128i GA = _mm_loadu_si128((const __m128i*)(Src + i * 2));
+			__m128i G = _mm_and_si128(GA, Low);
+			__m128i GG = _mm_or_si128(G, _mm_slli_epi16(G, 8));
+			_mm_storeu_si128((__m128i*)Dest + 0, _mm_unpacklo_epi16(GG, GA));
+			_mm_storeu_si128((__m128i*)Dest + 1, _mm_unpackhi_epi16(GG, GA));
+		}
+		GrayAlphaScalar(Src + i * 2, Dest, Count - i);
+	}
+
+	// Swaps bytes 0 and 2 of each 32bit lane, ORing in Alpha
+	inline __m128i SwapRB(__m128i Pixels, __m128i Keep, __m128i Alpha)
+	{
+		const __m128i Byte = _mm_set1_epi32(0xFF);
+		__m128i R = _mm_slli_epi32(_mm_and_si128(Pixels, Byte), 16);
+		__m128i B = _mm_and_si128(_mm_srli_epi32(Pixels, 16), Byte);
+		return _mm_or_si128(_mm_or_si128(_mm_and_si128(Pixels, Keep), Alpha), _mm_or_si128(R, B));
+	}
+
+	void RGBSSE(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		const __m128i Keep = _mm_set1_epi32(0x0000FF00);
+		const __m128i Alpha = _mm_set1_epi32(0xFF000000);
+		uint32_t i = 0;
+
+		// Each load reads 16 bytes for 12 bytes of pixels, stop while that's still in bounds
+		for (; i + 6 <= Count; i += 4, Dest += 16)
+		{
+			__m128i P = _mm_loadu_si128((const __m128i*)(Src + i * 3));
+
+			// Pixel n starts at byte 3n, shift each of them down to the bottom lane
+			__m128i P01 = _mm_unpacklo_epi32(P, _mm_srli_si128(P, 3));
+			__m128i P23 = _mm_unpacklo_epi32(_mm_srli_si128(P, 6), _mm_srli_si128(P, 9));
+			_mm_storeu_si128((__m128i*)Dest, SwapRB(_mm_unpacklo_epi64(P01, P23), Keep, Alpha));
+		}
+		RGBScalar(Src + i * 3, Dest, Count - i);
+	}
+
+	void RGBASSE(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		const __m128i Keep = _mm_set1_epi32(0xFF00FF00);
+		const __m128i Alpha = _mm_setzero_si128();
+		uint32_t i = 0;
+		for (; i + 4 <= Count; i += 4)
+		{
+			__m128i P = _mm_loadu_si128((const __m128i*)(Src + i * 4));
+			_mm_storeu_si128((__m128i*)(Dest + i * 4), SwapRB(P, Keep, Alpha));
+		}
+		RGBAScalar(Src + i * 4, Dest + i * 4, Count - i);
+	}
+
+	void Narrow16SSE(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		// Big endian, so the high byte is the low half of each little endian lane
+		const __m128i Low = _mm_set1_epi16(0xFF);
+		uint32_t i = 0;
+		for (; i + 16 <= Count; i += 16)
+		{
+			__m128i A = _mm_and_si128(_mm_loadu_si128((const __m128i*)(Src + i * 2)), Low);
+			__m128i B = _mm_and_si128(_mm_loadu_si128((const __m128i*)(Src + i * 2 + 16)), Low);
+			_mm_storeu_si128((__m128i*)(Dest + i), _mm_packus_epi16(A, B));
+		}
+		Narrow16Scalar(Src + i * 2, Dest + i, Count - i);
+	}
+
+	// Two pixels widened to 16bit lanes
+	inline __m128i PremultiplyPairSSE(__m128i Pixels)
+	{
+		// Alpha's own lane multiplies by 255 which leaves it unchanged
+		const __m128i Colour = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+		const __m128i AlphaMul = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+		const __m128i Half = _mm_set1_epi16(128);
+
+		__m128i A = _mm_shufflehi_epi16(_mm_shufflelo_epi16(Pixels, 0xFF), 0xFF);
+		A = _mm_or_si128(_mm_and_si128(A, Colour), AlphaMul);
+
+		__m128i T = _mm_add_epi16(_mm_mullo_epi16(Pixels, A), Half);
+		return _mm_srli_epi16(_mm_add_epi16(T, _mm_srli_epi16(T, 8)), 8);
+	}
+
+	void PremultiplySSE(uint8_t* Data, uint32_t Count)
+	{
+		const __m128i Zero = _mm_setzero_si128();
+		uint32_t i = 0;
+		for (; i + 4 <= Count; i += 4)
+		{
+			__m128i P = _mm_loadu_si128((const __m128i*)(Data + i * 4));
+			__m128i Lo = PremultiplyPairSSE(_mm_unpacklo_epi8(P, Zero));
+			__m128i Hi = PremultiplyPairSSE(_mm_unpackhi_epi8(P, Zero));
+			_mm_storeu_si128((__m128i*)(Data + i * 4), _mm_packus_epi16(Lo, Hi));
+		}
+		PremultiplyScalar(Data + i * 4, Count - i);
+	}
+
+	const RowKernels SSEKernels =
+	{
+		GraySSE, GrayAlphaSSE, RGBSSE, RGBASSE, Narrow16SSE, PremultiplySSE,
+	};
+
+	__attribute__((target("avx2")))
+	void GrayAVX2(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		const __m256i Alpha = _mm256_set1_epi32(0xFF000000);
+		uint32_t i = 0;
+		for (; i + 8 <= Count; i += 8)
+		{
+			__m256i G = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(Src + i)));
+			__m256i GGG = _mm256_or_si256(_mm256_or_si256(G, _mm256_slli_epi32(G, 8)), _mm256_slli_epi32(G, 16));
+			_mm256_storeu_si256((__m256i*)(Dest + i * 4), _mm256_or_si256(GGG, Alpha));
+		}
+		GrayScalar(Src + i, Dest + i * 4, Count - i);
+	}
+
+	__attribute__((target("avx2")))
+	void GrayAlphaAVX2(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		const __m256i Low = _mm256_set1_epi32(0xFF);
+		const __m256i High = _mm256_set1_epi32(0xFF00);
+		uint32_t i = 0;
+		for (; i + 8 <= Count; i += 8)
+		{
+			__m256i GA = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(Src + i * 2)));
+			__m256i G = _mm256_and_si256(GA, Low);
+			__m256i A = _mm256_slli_epi32(_mm256_and_si256(GA, High), 16);
+			__m256i GGG = _mm256_or_si256(_mm256_or_si256(G, _mm256_slli_epi32(G, 8)), _mm256_slli_epi32(G, 16));
+			_mm256_storeu_si256((__m256i*)(Dest + i * 4), _mm256_or_si256(GGG, A));
+		}
+		GrayAlphaScalar(Src + i * 2, Dest + i * 4, Count - i);
+	}
+
+	__attribute__((target("avx2")))
+	void RGBAVX2(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		// pshufb works within each 128bit half, so each half gets loaded with its own four pixels
+		const __m256i Shuffle = _mm256_setr_epi8(
+			2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+			2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+		const __m256i Alpha = _mm256_set1_epi32(0xFF000000);
+		uint32_t i = 0;
+
+		// The upper load reads 4 bytes past its pixels
+		for (; i + 10 <= Count; i += 8)
+		{
+			__m128i Lo = _mm_loadu_si128((const __m128i*)(Src + i * 3));
+			__m128i Hi = _mm_loadu_si128((const __m128i*)(Src + i * 3 + 12));
+			__m256i P = _mm256_inserti128_si256(_mm256_castsi128_si256(Lo), Hi, 1);
+			P = _mm256_or_si256(_mm256_shuffle_epi8(P, Shuffle), Alpha);
+			_mm256_storeu_si256((__m256i*)(Dest + i * 4), P);
+		}
+		RGBSSE(Src + i * 3, Dest + i * 4, Count - i);
+	}
+
+	__attribute__((target("avx2")))
+	void RGBAAVX2(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		const __m256i Shuffle = _mm256_setr_epi8(
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		uint32_t i = 0;
+		for (; i + 8 <= Count; i += 8)
+		{
+			__m256i P = _mm256_loadu_si256((const __m256i*)(Src + i * 4));
+			_mm256_storeu_si256((__m256i*)(Dest + i * 4), _mm256_shuffle_epi8(P, Shuffle));
+		}
+		RGBAScalar(Src + i * 4, Dest + i * 4, Count - i);
+	}
+
+	__attribute__((target("avx2")))
+	void Narrow16AVX2(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		const __m256i Low = _mm256_set1_epi16(0xFF);
+		uint32_t i = 0;
+		for (; i + 32 <= Count; i += 32)
+		{
+			__m256i A = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(Src + i * 2)), Low);
+			__m256i B = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(Src + i * 2 + 32)), Low);
+
+			// Pack interleaves the 128bit halves, put them back in order
+			__m256i P = _mm256_permute4x64_epi64(_mm256_packus_epi16(A, B), 0xD8);
+			_mm256_storeu_si256((__m256i*)(Dest + i), P);
+		}
+		Narrow16Scalar(Src + i * 2, Dest + i, Count - i);
+	}
+
+	__attribute__((target("avx2")))
+	inline __m256i PremultiplyPairAVX2(__m256i Pixels)
+	{
+		const __m256i Colour = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1);
+		const __m256i AlphaMul = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+		const __m256i Half = _mm256_set1_epi16(128);
+
+		__m256i A = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(Pixels, 0xFF), 0xFF);
+		A = _mm256_or_si256(_mm256_and_si256(A, Colour), AlphaMul);
+
+		__m256i T = _mm256_add_epi16(_mm256_mullo_epi16(Pixels, A), Half);
+		return _mm256_srli_epi16(_mm256_add_epi16(T, _mm256_srli_epi16(T, 8)), 8);
+	}
+
+	__attribute__((target("avx2")))
+	void PremultiplyAVX2(uint8_t* Data, uint32_t Count)
+	{
+		// Unpack and pack both stay within each half, so pixel order comes out right
+		const __m256i Zero = _mm256_setzero_si256();
+		uint32_t i = 0;
+		for (; i + 8 <= Count; i += 8)
+		{
+			__m256i P = _mm256_loadu_si256((const __m256i*)(Data + i * 4));
+			__m256i Lo = PremultiplyPairAVX2(_mm256_unpacklo_epi8(P, Zero));
+			__m256i Hi = PremultiplyPairAVX2(_mm256_unpackhi_epi8(P, Zero));
+			_mm256_storeu_si256((__m256i*)(Data + i * 4), _mm256_packus_epi16(Lo, Hi));
+		}
+		PremultiplyScalar(Data + i * 4, Count - i);
+	}
+
+	const RowKernels AVX2Kernels =
+	{
+		GrayAVX2, GrayAlphaAVX2, RGBAVX2, RGBAAVX2, Narrow16AVX2, PremultiplyAVX2,
+	};
+#endif
+
+#ifdef PIXEL_NEON
+	// Structured loads and stores do all the interleaving for us
+	void GrayNEON(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		uint32_t i = 0;
+		for (; i + 16 <= Count; i += 16)
+		{
+			uint8x16_t G = vld1q_u8(Src + i);
+			uint8x16x4_t Out = {{ G, G, G, vdupq_n_u8(0xFF) }};
+			vst4q_u8(Dest + i * 4, Out);
+		}
+		GrayScalar(Src + i, Dest + i * 4, Count - i);
+	}
+
+	void GrayAlphaNEON(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		uint32_t i = 0;
+		for (; i + 16 <= Count; i += 16)
+		{
+			uint8x16x2_t GA = vld2q_u8(Src + i * 2);
+			uint8x16x4_t Out = {{ GA.val[0], GA.val[0], GA.val[0], GA.val[1] }};
+			vst4q_u8(Dest + i * 4, Out);
+		}
+		GrayAlphaScalar(Src + i * 2, Dest + i * 4, Count - i);
+	}
+
+	void RGBNEON(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		uint32_t i = 0;
+		for (; i + 16 <= Count; i += 16)
+		{
+			uint8x16x3_t RGB = vld3q_u8(Src + i * 3);
+			uint8x16x4_t Out = {{ RGB.val[2], RGB.val[1], RGB.val[0], vdupq_n_u8(0xFF) }};
+			vst4q_u8(Dest + i * 4, Out);
+		}
+		RGBScalar(Src + i * 3, Dest + i * 4, Count - i);
+	}
+
+	void RGBANEON(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		uint32_t i = 0;
+		for (; i + 16 <= Count; i += 16)
+		{
+			uint8x16x4_t RGBA = vld4q_u8(Src + i * 4);
+			uint8x16_t R = RGBA.val[0];
+			RGBA.val[0] = RGBA.val[2];
+			RGBA.val[2] = R;
+			vst4q_u8(Dest + i * 4, RGBA);
+		}
+		RGBAScalar(Src + i * 4, Dest + i * 4, Count - i);
+	}
+
+	void Narrow16NEON(const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+	{
+		uint32_t i = 0;
+		for (; i + 16 <= Count; i += 16)
+			vst1q_u8(Dest + i, vld2q_u8(Src + i * 2).val[0]);
+		Narrow16Scalar(Src + i * 2, Dest + i, Count - i);
+	}
+
+	// Same as MulDiv255, the rounding shifts add the 128s
+	inline uint8x8_t MulDiv255NEON(uint8x8_t c, uint8x8_t a)
+	{
+		uint16x8_t p = vmull_u8(c, a);
+		return vrshrn_n_u16(vrsraq_n_u16(p, p, 8), 8);
+	}
+
+	void PremultiplyNEON(uint8_t* Data, uint32_t Count)
+	{
+		uint32_t i = 0;
+		for (; i + 8 <= Count; i += 8)
+		{
+			uint8x8x4_t P = vld4_u8(Data + i * 4);
+			P.val[0] = MulDiv255NEON(P.val[0], P.val[3]);
+			P.val[1] = MulDiv255NEON(P.val[1], P.val[3]);
+			P.val[2] = MulDiv255NEON(P.val[2], P.val[3]);
+			vst4_u8(Data + i * 4, P);
+		}
+		PremultiplyScalar(Data + i * 4, Count - i);
+	}
+
+	const RowKernels NEONKernels =
+	{
+		GrayNEON, GrayAlphaNEON, RGBNEON, RGBANEON, Narrow16NEON, PremultiplyNEON,
+	};
+#endif
+
+	const RowKernels& GetKernels(SIMDLevel Kernel)
+	{
+		switch (Kernel)
+		{
+#ifdef PIXEL_X86
+		case SIMDLevel::SSE:
+			return SSEKernels;
+		case SIMDLevel::AVX2:
+			return AVX2Kernels;
+#endif
+#ifdef PIXEL_NEON
+		case SIMDLevel::NEON:
+			return NEONKernels;
+#endif
+		default:
+			return ScalarKernels;
+		}
+	}
+
+	RowFunc GetRowFunc(const RowKernels& Kernels, PixelFormat Format)
+	{
+		switch (Format)
+		{
+		case PixelFormat::Gray8:
+		case PixelFormat::Gray16:
+			return Kernels.Gray;
+		case PixelFormat::GrayAlpha8:
+		case PixelFormat::GrayAlpha16:
+			return Kernels.GrayAlpha;
+		case PixelFormat::RGB8:
+		case PixelFormat::RGB16:
+			return Kernels.RGB;
+		case PixelFormat::RGBA8:
+		case PixelFormat::RGBA16:
+			return Kernels.RGBA;
+		default:
+			return CopyBGRA;
+		}
+	}
+}
+
+uint32_t GetPixelSize(PixelFormat Format)
+{
+	return GetChannels(Format) * (IsWide(Format) ? 2 : 1);
+}
+
+const char* GetPixelFormatName(PixelFormat Format)
+{
+	switch (Format)
+	{
+	case PixelFormat::Gray8: return "Gray8";
+	case PixelFormat::GrayAlpha8: return "GrayAlpha8";
+	case PixelFormat::RGB8: return "RGB8";
+	case PixelFormat::RGBA8: return "RGBA8";
+	case PixelFormat::BGRA8: return "BGRA8";
+	case PixelFormat::Gray16: return "Gray16";
+	case PixelFormat::GrayAlpha16: return "GrayAlpha16";
+	case PixelFormat::RGB16: return "RGB16";
+	case PixelFormat::RGBA16: return "RGBA16";
+	default: return "Unknown";
+	}
+}
+
+PixelConverter::PixelConverter(PixelFormat Source, bool Premultiply, SIMDLevel Kernel)
+	: mKernel(SIMDResolve(Kernel))
+	, mSource(Source)
+	, mPremultiply(Premultiply)
+{
+	assert(SIMDSupported(mKernel));
+}
+
+void PixelConverter::ConvertRange(SIMDLevel Kernel, PixelFormat Source, bool Premultiply,
+                                  const uint8_t* Src, uint8_t* Dest, uint32_t Count)
+{
+	const RowKernels& Kernels = GetKernels(Kernel);
+	RowFunc Func = GetRowFunc(Kernels, Source);
+	const bool Wide = IsWide(Source);
+
+	// The common case goes straight across
+	if (!Wide && !Premultiply)
+	{
+		Func(Src, Dest, Count);
+		return;
+	}
+
+	// Anything needing a second step goes through the stack so Dest never gets read back
+	alignas(32) uint8_t Narrowed[CHUNK_PIXELS * 4];
+	alignas(32) uint8_t Converted[CHUNK_PIXELS * 4];
+
+	const uint32_t Channels = GetChannels(Source);
+	const uint32_t SrcSize = GetPixelSize(Source);
+	for (uint32_t Done = 0; Done < Count; Done += CHUNK_PIXELS)
+	{
+		const uint32_t Pixels = std::min(CHUNK_PIXELS, Count - Done);
+		const uint8_t* In = Src + Done * SrcSize;
+		uint8_t* Out = Dest + Done * 4;
+
+		if (Wide)
+		{
+			Kernels.Narrow16(In, Narrowed, Pixels * Channels);
+			In = Narrowed;
+		}
+
+		if (!Premultiply)
+		{
+			Func(In, Out, Pixels);
+			continue;
+		}
+
+		Func(In, Converted, Pixels);
+		Kernels.Premultiply(Converted, Pixels);
+		memcpy(Out, Converted, Pixels * 4);
+	}
+}
+
+uint32_t GetMipLevels(uint32_t Width, uint32_t Height)
+{
+	uint32_t Levels = 1;
+	for (uint32_t Size = std::max(Width, Height); Size > 1; Size >>= 1)
+		++Levels;
+	return Levels;
+}
+
+size_t GetMipOffset(uint32_t Width, uint32_t Height, uint32_t Level)
+{
+	size_t Offset = 0;
+	for (uint32_t i = 0; i < Level; ++i)
+		Offset += (size_t)std::max(Width >> i, 1U) * std::max(Height >> i, 1U) * 4;
+	return Offset;
+}
+
+void GenerateMips(uint8_t* Data, uint32_t Width, uint32_t Height, uint32_t Levels)
+{
+	for (uint32_t Level = 1; Level < Levels; ++Level)
+	{
+		const uint32_t SrcWidth = std::max(Width >> (Level - 1), 1U);
+		const uint32_t SrcHeight = std::max(Height >> (Level - 1), 1U);
+		const uint32_t DestWidth = std::max(Width >> Level, 1U);
+		const uint32_t DestHeight = std::max(Height >> Level, 1U);
+		const uint8_t* Src = Data + GetMipOffset(Width, Height, Level - 1);
+		uint8_t* Dest = Data + GetMipOffset(Width, Height, Level);
+
+		// Odd sizes drop the last row or column, a 1 texel side just repeats itself
+		for (uint32_t y = 0; y < DestHeight; ++y)
+		{
+			const uint8_t* Row0 = Src + (size_t)std::min(y * 2, SrcHeight - 1) * SrcWidth * 4;
+			const uint8_t* Row1 = Src + (size_t)std::min(y * 2 + 1, SrcHeight - 1) * SrcWidth * 4;
+			for (uint32_t x = 0; x < DestWidth; ++x)
+			{
+				const uint32_t Left = std::min(x * 2, SrcWidth - 1) * 4;
+				const uint32_t Right = std::min(x * 2 + 1, SrcWidth - 1) * 4;
+				for (uint32_t c = 0; c < 4; ++c)
+					Dest[x * 4 + c] = (Row0[Left + c] + Row0[Right + c] + Row1[Left + c] + Row1[Right + c] + 2) >> 2;
+			}
+			Dest += DestWidth * 4;
+		}
+	}
+}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "SIMD.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Vulkan
+{
+// Layouts pixels come in from image decoders
+// 16bit formats are big endian like PNG stores them
+enum class PixelFormat
+{
+	Gray8,
+	GrayAlpha8,
+	RGB8,
+	RGBA8,
+	BGRA8,
+	Gray16,
+	GrayAlpha16,
+	RGB16,
+	RGBA16,
+};
+
+uint32_t GetPixelSize(PixelFormat Format);
+const char* GetPixelFormatName(PixelFormat Format);
+
+// Converts rows of pixels to the BGRA8 our textures use
+// Runs inside the decoder's row callback so each row is converted while it's still in cache
+class PixelConverter
+{
+public:
+	PixelConverter(PixelFormat Source, bool Premultiply = false, SIMDLevel Kernel = SIMDLevel::Best);
+
+	void Convert(const uint8_t* Src, uint8_t* Dest, uint32_t Count) const
+	{
+		ConvertRange(mKernel, mSource, mPremultiply, Src, Dest, Count);
+	}
+
+	// Converts Count pixels from Src to BGRA8 in Dest, optionally premultiplying the alpha
+	// Dest is only ever written so it can be write-combined mapped memory
+	// Src and Dest can only be the same for RGBA8 and BGRA8
+	static void ConvertRange(SIMDLevel Kernel, PixelFormat Source, bool Premultiply,
+	                         const uint8_t* Src, uint8_t* Dest, uint32_t Count);
+
+	// Information
+	SIMDLevel GetKernel() const { return mKernel; }
+
+private:
+	SIMDLevel mKernel;
+	PixelFormat mSource;
+	bool mPremultiply;
+};
+
+// Mip chains of BGRA8, every level tightly packed straight after the one before it
+// Levels go all the way down to 1x1
+uint32_t GetMipLevels(uint32_t Width, uint32_t Height);
+size_t GetMipOffset(uint32_t Width, uint32_t Height, uint32_t Level);
+
+// Box filters level 0 at Data down in to the rest of the levels
+// Reads back what it writes, so Data shouldn't be mapped write-combined memory
+void GenerateMips(uint8_t* Data, uint32_t Width, uint32_t Height, uint32_t Levels);
+}
@@ -0,0 +1,183 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace Profiler
+{
+	namespace
+	{
+		struct Event
+		{
+			const char* Name;
+			uint64_t Start, End; // Nanoseconds since Start
+			uint32_t Thread;
+			uint32_t Depth;
+		};
+
+		// Times merged by the path of names from the root down
+		struct Node
+		{
+			uint64_t Total = 0;
+			uint32_t Calls = 0;
+			uint64_t First = ~0ULL; // Keeps the output in the order things happened
+			std::map<std::string, Node> Children;
+		};
+
+		std::atomic<bool> gEnabled{false};
+		std::chrono::high_resolution_clock::time_point gBase;
+
+		std::mutex gLock;
+		std::vector<Event> gEvents;
+		std::atomic<uint32_t> gNextThread{0};
+
+		thread_local uint32_t tDepth = 0;
+		thread_local uint32_t tThread = ~0U;
+
+		uint64_t Now()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::high_resolution_clock::now() - gBase).count();
+		}
+
+		void PrintChildren(const Node& Parent, uint32_t Depth)
+		{
+			std::vector<std::pair<const std::string*, const Node*>> Order;
+			for (const auto& Child : Parent.Children)
+				Order.emplace_back(&Child.first, &Child.second);
+			std::sort(Order.begin(), Order.end(), [](const auto& A, const auto& B)
+			{
+				return A.second->First < B.second->First;
+			});
+
+			for (const auto& Child : Order)
+			{
+				const Node& Current = *Child.second;
+				printf("%*s%-*s %9.2fms", Depth * 2 + 1, "", 40 - Depth * 2, Child.first->c_str(), Current.Total / 1e6);
+				if (Current.Calls > 1)
+					printf(" (%d calls)", Current.Calls);
+				printf("\n");
+
+				PrintChildren(Current, Depth + 1);
+			}
+		}
+
+		void WriteTrace(const char* Path, const std::vector<Event>& Events)
+		{
+			FILE* fp = fopen(Path, "wb");
+			if (!fp)
+			{
+				fprintf(stderr, "Couldn't write trace to '%s'\n", Path);
+				return;
+			}
+
+			// Complete events, times are in microseconds
+			fprintf(fp, "{\"traceEvents\":[\n");
+			for (size_t i = 0; i < Events.size(); ++i)
+			{
+				const Event& Current = Events[i];
+				fprintf(fp, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+				        Current.Name, Current.Thread, Current.Start / 1e3, (Current.End - Current.Start) / 1e3,
+				        i + 1 == Events.size() ? "" : ",");
+			}
+			fprintf(fp, "]}\n");
+			fclose(fp);
+
+			printf("Wrote %zd trace events to %s\n", Events.size(), Path);
+		}
+	}
+
+	Scope::Scope(const char* Name)
+		: mName(gEnabled.load(std::memory_order_relaxed) ? Name : nullptr)
+	{
+		if (!mName)
+			return;
+
+		++tDepth;
+		mStart = Now();
+	}
+
+	Scope::~Scope()
+	{
+		if (!mName)
+			return;
+
+		uint64_t End = Now();
+		--tDepth;
+
+		if (tThread == ~0U)
+			tThread = gNextThread.fetch_add(1, std::memory_order_relaxed);
+
+		std::lock_guard<std::mutex> Lock(gLock);
+		gEvents.push_back({ mName, mStart, End, tThread, tDepth });
+	}
+
+	void Start()
+	{
+		gBase = std::chrono::high_resolution_clock::now();
+		gEnabled.store(true);
+	}
+
+	bool IsEnabled()
+	{
+		return gEnabled.load(std::memory_order_relaxed);
+	}
+
+	double GetElapsed()
+	{
+		return Now() / 1e6;
+	}
+
+	void Stop(const char* TracePath)
+	{
+		if (!gEnabled.exchange(false))
+			return;
+
+		std::vector<Event> Events;
+		{
+			std::lock_guard<std::mutex> Lock(gLock);
+			Events.swap(gEvents);
+		}
+
+		// Parents start before their children and end after, so on each thread
+		// ordering by start with the outer scope first puts them right before them
+		std::sort(Events.begin(), Events.end(), [](const Event& A, const Event& B)
+		{
+			if (A.Thread != B.Thread)
+				return A.Thread < B.Thread;
+			if (A.Start != B.Start)
+				return A.Start < B.Start;
+			return A.Depth < B.Depth;
+		});
+
+		Node Root;
+		std::vector<Node*> Stack;
+		for (size_t i = 0; i < Events.size(); ++i)
+		{
+			const Event& Current = Events[i];
+			if (i == 0 || Events[i - 1].Thread != Current.Thread)
+				Stack.clear();
+
+			Stack.resize(std::min<size_t>(Stack.size(), Current.Depth));
+			Node* Parent = Stack.empty() ? &Root : Stack.back();
+
+			Node& Child = Parent->Children[Current.Name];
+			Child.Total += Current.End - Current.Start;
+			Child.Calls++;
+			Child.First = std::min(Child.First, Current.Start);
+			Stack.push_back(&Child);
+		}
+
+		printf("Profile, %.2fms since start:\n", GetElapsed());
+		PrintChildren(Root, 0);
+
+		if (TracePath)
+			WriteTrace(TracePath, Events);
+	}
+}
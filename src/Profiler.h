@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// Scoped CPU timers for the load path
+// Does nothing until Start, then every scope gets recorded with its thread and
+// nesting so Stop can print a timing tree and write a chrome://tracing file
+namespace Profiler
+{
+	// Times from construction until the end of the scope
+	// Name has to outlive the profiler, string literals are the idea
+	class Scope
+	{
+	public:
+		Scope(const char* Name);
+		~Scope();
+
+	private:
+		const char* mName;
+		uint64_t mStart;
+	};
+
+	void Start();
+
+	// Prints the tree, and writes a trace to TracePath if it isn't null
+	void Stop(const char* TracePath);
+
+	bool IsEnabled();
+
+	// Milliseconds since Start
+	double GetElapsed();
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(Name) Profiler::Scope PROFILE_CONCAT(ProfileScope, __LINE__)(Name)
@@ -0,0 +1,355 @@
+#include "RenderGraph.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <assert.h>
+
+namespace Vulkan
+{
+namespace
+{
+	// What last frame could have left a transient's memory being written or read by
+	void GetAttachmentUsage(const TransientPool::Desc& Info, VkPipelineStageFlags* Stage, VkAccessFlags* Access)
+	{
+		*Stage = 0;
+		*Access = 0;
+
+		VkPipelineStageFlags LayoutStage;
+		VkAccessFlags LayoutAccess;
+		if (Info.Usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
+		{
+			Util::GetLayoutUsage(VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, &LayoutStage, &LayoutAccess);
+			*Stage |= LayoutStage;
+			*Access |= LayoutAccess & VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		}
+		if (Info.Usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
+		{
+			Util::GetLayoutUsage(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, &LayoutStage, &LayoutAccess);
+			*Stage |= LayoutStage;
+			*Access |= LayoutAccess & VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		}
+		if (Info.Usage & VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT)
+			*Stage |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+}
+
+void RenderGraph::Pass::ReadImage(Resource Image, VkImageLayout Layout)
+{
+	Use NewUse { Image, Layout, 0, 0, false };
+	Util::GetLayoutUsage(Layout, &NewUse.Stage, &NewUse.Access);
+
+	// Only keep the read half of the access
+	NewUse.Access &= VK_ACCESS_SHADER_READ_BIT |
+	                 VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+	                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+	                 VK_ACCESS_TRANSFER_READ_BIT |
+	                 VK_ACCESS_MEMORY_READ_BIT;
+	mUses.push_back(NewUse);
+}
+
+void RenderGraph::Pass::WriteImage(Resource Image, VkImageLayout Layout)
+{
+	Use NewUse { Image, Layout, 0, 0, true };
+	Util::GetLayoutUsage(Layout, &NewUse.Stage, &NewUse.Access);
+	mUses.push_back(NewUse);
+}
+
+void RenderGraph::Pass::ReadBuffer(Resource Buffer, VkPipelineStageFlags Stage, VkAccessFlags Access)
+{
+	mUses.push_back({ Buffer, VK_IMAGE_LAYOUT_UNDEFINED, Stage, Access, false });
+}
+
+void RenderGraph::Pass::WriteBuffer(Resource Buffer, VkPipelineStageFlags Stage, VkAccessFlags Access)
+{
+	mUses.push_back({ Buffer, VK_IMAGE_LAYOUT_UNDEFINED, Stage, Access, true });
+}
+
+void RenderGraph::Reset()
+{
+	mResources.clear();
+	mPasses.clear();
+	mFinal = Pass();
+	mStats = {};
+}
+
+RenderGraph::Resource RenderGraph::ImportImage(VkImage Image, VkImageAspectFlags Aspect,
+                                               VkImageLayout Layout, VkPipelineStageFlags Stage, VkAccessFlags Access,
+                                               VkImageLayout FinalLayout)
+{
+	ResourceState State{};
+	State.Image = Image;
+	State.Aspect = Aspect;
+	State.Transient = ~0U;
+	State.FinalLayout = FinalLayout;
+	State.Layout = Layout;
+	State.WriteStages = Stage;
+	State.WriteAccess = Access;
+	mResources.push_back(State);
+	return mResources.size() - 1;
+}
+
+RenderGraph::Resource RenderGraph::ImportBuffer(VkBuffer Buffer, VkPipelineStageFlags Stage, VkAccessFlags Access)
+{
+	ResourceState State{};
+	State.Buffer = Buffer;
+	State.Transient = ~0U;
+	State.WriteStages = Stage;
+	State.WriteAccess = Access;
+	mResources.push_back(State);
+	return mResources.size() - 1;
+}
+
+uint32_t RenderGraph::AddTransient(Vulkan::InstanceObject& Instance, const TransientPool::Desc& Info)
+{
+	return mTransients.Add(Instance, Info);
+}
+
+RenderGraph::Resource RenderGraph::ImportTransient(uint32_t Index)
+{
+	// The image and what it waits on get filled in once Compile has placed it
+	ResourceState State{};
+	State.Aspect = (mTransients.GetDesc(Index).Usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) ?
+		VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+	State.Transient = Index;
+	State.Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	State.FinalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	mResources.push_back(State);
+	return mResources.size() - 1;
+}
+
+void RenderGraph::MarkOutput(Resource Res)
+{
+	mResources[Res].Output = true;
+}
+
+RenderGraph::Pass& RenderGraph::AddPass(const char* Name, ExecuteFunc Execute)
+{
+	mPasses.emplace_back();
+	mPasses.back().mName = Name;
+	mPasses.back().mExecute = Execute;
+	return mPasses.back();
+}
+
+void RenderGraph::AddBarrier(Pass& Target, ResourceState& State, const Pass::Use& Use)
+{
+	// Nothing touched it yet this frame, still needs a source stage for the transition
+	VkPipelineStageFlags SrcStages = State.WriteStages | State.ReadStages;
+	Target.mSrcStages |= SrcStages ? SrcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	Target.mDstStages |= Use.Stage;
+	++mStats.Barriers;
+
+	if (State.Image != VK_NULL_HANDLE)
+	{
+		Target.mImageBarriers.push_back(
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = State.WriteAccess,
+			.dstAccessMask = Use.Access,
+			.oldLayout = State.Layout,
+			.newLayout = Use.Layout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = State.Image,
+			.subresourceRange = {State.Aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS},
+		});
+	}
+	else
+	{
+		Target.mBufferBarriers.push_back(
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = State.WriteAccess,
+			.dstAccessMask = Use.Access,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = State.Buffer,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+		});
+	}
+}
+
+void RenderGraph::PlaceTransients(Vulkan::InstanceObject& Instance)
+{
+	if (!mTransients.GetCount())
+		return;
+
+	// Lifetimes are counted in live passes, culled ones don't hold anything
+	std::vector<TransientPool::Lifetime> Lifetimes(mTransients.GetCount(), TransientPool::Lifetime{~0U, 0});
+	uint32_t Order = 0;
+	for (auto& Current : mPasses)
+	{
+		if (!Current.mLive)
+			continue;
+
+		for (const auto& Use : Current.mUses)
+		{
+			const uint32_t Transient = mResources[Use.Res].Transient;
+			if (Transient == ~0U)
+				continue;
+			Lifetimes[Transient].First = std::min(Lifetimes[Transient].First, Order);
+			Lifetimes[Transient].Last = std::max(Lifetimes[Transient].Last, Order);
+		}
+		++Order;
+	}
+
+	// Only when two targets sharing memory would now be alive together
+	if (!mTransients.IsAllocated() || !mTransients.Fits(Lifetimes))
+	{
+		mTransients.Allocate(Instance, Lifetimes);
+		++mTransientGeneration;
+	}
+
+	// Last frame could have left any target sharing the memory using it
+	for (auto& State : mResources)
+	{
+		if (State.Transient == ~0U)
+			continue;
+
+		State.Image = mTransients.Get(State.Transient)->GetImage();
+		for (uint32_t Other = 0; Other < mTransients.GetCount(); ++Other)
+		{
+			if (!mTransients.Aliases(State.Transient, Other))
+				continue;
+
+			VkPipelineStageFlags Stage;
+			VkAccessFlags Access;
+			GetAttachmentUsage(mTransients.GetDesc(Other), &Stage, &Access);
+			State.WriteStages |= Stage;
+			State.WriteAccess |= Access;
+		}
+	}
+}
+
+void RenderGraph::Compile(Vulkan::InstanceObject& Instance)
+{
+	mStats.Passes = mPasses.size();
+
+	// Walk backwards, a pass lives if it writes something a later live pass or the outside wants
+	// Writes count as wanted too since we can't tell if a write loads the old contents
+	std::vector<bool> Needed(mResources.size());
+	for (uint32_t i = 0; i < mResources.size(); ++i)
+		Needed[i] = mResources[i].Output;
+
+	for (auto It = mPasses.rbegin(); It != mPasses.rend(); ++It)
+	{
+		Pass& Current = *It;
+		Current.mLive = Current.mSideEffects;
+		for (const auto& Use : Current.mUses)
+			Current.mLive |= Use.Write && Needed[Use.Res];
+
+		if (!Current.mLive)
+		{
+			++mStats.Culled;
+			continue;
+		}
+
+		for (const auto& Use : Current.mUses)
+			Needed[Use.Res] = true;
+	}
+
+	PlaceTransients(Instance);
+
+	// Then forwards, working out what each live pass has to wait on
+	for (auto& Current : mPasses)
+	{
+		if (!Current.mLive)
+			continue;
+
+		for (const auto& Use : Current.mUses)
+		{
+			ResourceState& State = mResources[Use.Res];
+
+			// A transient's first use takes its memory over from whatever had it earlier in the frame
+			// It comes in UNDEFINED, so this always ends up as a barrier below
+			if (State.Transient != ~0U && !State.Touched)
+			{
+				bool Aliased = false;
+				for (const auto& Previous : mResources)
+				{
+					if (&Previous == &State || Previous.Transient == ~0U || !Previous.Touched ||
+					    !mTransients.Aliases(State.Transient, Previous.Transient))
+						continue;
+
+					State.WriteStages |= Previous.WriteStages | Previous.ReadStages;
+					State.WriteAccess |= Previous.WriteAccess;
+					Aliased = true;
+				}
+				mStats.AliasBarriers += Aliased;
+			}
+			State.Touched = true;
+			bool IsImage = State.Image != VK_NULL_HANDLE;
+			bool Transition = IsImage && Use.Layout != State.Layout;
+
+			if (Use.Write || Transition)
+			{
+				// Waits on the last write and every read since, layout changes count as a write
+				// Only skipped for a buffer imported with nothing using it before
+				if (Transition || State.WriteStages || State.ReadStages)
+					AddBarrier(Current, State, Use);
+				State.Layout = IsImage ? Use.Layout : State.Layout;
+				State.WriteStages = Use.Stage;
+				State.WriteAccess = Use.Write ? Use.Access : 0;
+				State.ReadStages = Use.Write ? 0 : Use.Stage;
+				State.VisibleStages = Use.Stage;
+			}
+			else if (State.WriteAccess && (Use.Stage & ~State.VisibleStages))
+			{
+				// Read after write, the first time this stage looks at it
+				AddBarrier(Current, State, Use);
+				State.ReadStages |= Use.Stage;
+				State.VisibleStages |= Use.Stage;
+			}
+			else
+			{
+				// Already visible, or nothing to see
+				State.ReadStages |= Use.Stage;
+			}
+		}
+	}
+
+	// Leave imported images how the outside expects them
+	for (Resource Res = 0; Res < mResources.size(); ++Res)
+	{
+		ResourceState& State = mResources[Res];
+		if (State.Image == VK_NULL_HANDLE ||
+		    State.FinalLayout == VK_IMAGE_LAYOUT_UNDEFINED ||
+		    State.FinalLayout == State.Layout)
+			continue;
+
+		Pass::Use Final { Res, State.FinalLayout, 0, 0, true };
+		Util::GetLayoutUsage(State.FinalLayout, &Final.Stage, &Final.Access);
+		AddBarrier(mFinal, State, Final);
+		State.Layout = State.FinalLayout;
+	}
+}
+
+void RenderGraph::Execute(VkCommandBuffer Cmd)
+{
+	auto IssueBarriers = [&](Pass& Current)
+	{
+		if (Current.mImageBarriers.empty() && Current.mBufferBarriers.empty())
+			return;
+
+		vkCmdPipelineBarrier(Cmd, Current.mSrcStages, Current.mDstStages, 0,
+		                     0, nullptr,
+		                     Current.mBufferBarriers.size(), Current.mBufferBarriers.data(),
+		                     Current.mImageBarriers.size(), Current.mImageBarriers.data());
+		++mStats.BarrierCalls;
+	};
+
+	for (auto& Current : mPasses)
+	{
+		if (!Current.mLive)
+			continue;
+
+		IssueBarriers(Current);
+		Current.mExecute(Cmd);
+	}
+
+	IssueBarriers(mFinal);
+}
+
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "TransientPool.h"
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace Vulkan
+{
+class InstanceObject;
+
+// Describes a frame as passes that read and write resources
+// Barriers and layout transitions get worked out from that, batched in to
+// one vkCmdPipelineBarrier per pass, and passes nothing needs are dropped
+// Transient targets are placed in memory from the order the live passes use them in
+class RenderGraph
+{
+public:
+	typedef uint32_t Resource;
+	typedef std::function<void(VkCommandBuffer Cmd)> ExecuteFunc;
+
+	class Pass
+	{
+	public:
+		// Stages and accesses for images come from the layout
+		void ReadImage(Resource Image, VkImageLayout Layout);
+		void WriteImage(Resource Image, VkImageLayout Layout);
+		void ReadBuffer(Resource Buffer, VkPipelineStageFlags Stage, VkAccessFlags Access);
+		void WriteBuffer(Resource Buffer, VkPipelineStageFlags Stage, VkAccessFlags Access);
+
+		// Keeps the pass around even when nothing uses what it writes
+		void SetSideEffects() { mSideEffects = true; }
+
+	private:
+		friend class RenderGraph;
+
+		struct Use
+		{
+			Resource Res;
+			VkImageLayout Layout;
+			VkPipelineStageFlags Stage;
+			VkAccessFlags Access;
+			bool Write;
+		};
+
+		const char* mName;
+		ExecuteFunc mExecute;
+		std::vector<Use> mUses;
+		bool mSideEffects = false;
+		bool mLive = false;
+
+		// Filled in by Compile, issued before the pass runs
+		VkPipelineStageFlags mSrcStages = 0;
+		VkPipelineStageFlags mDstStages = 0;
+		std::vector<VkImageMemoryBarrier> mImageBarriers;
+		std::vector<VkBufferMemoryBarrier> mBufferBarriers;
+	};
+
+	struct Stats
+	{
+		uint32_t Passes;
+		uint32_t Culled;
+		uint32_t Barriers;
+		uint32_t BarrierCalls;
+		uint32_t AliasBarriers; // Of Barriers, ones taking memory over from another transient
+	};
+
+	// Drops all passes and resources, the graph gets rebuilt every frame
+	// Transient targets stay
+	void Reset();
+
+	// Render targets that only hold anything within a frame, they outlive Reset
+	// No memory until the first Compile that uses them
+	uint32_t AddTransient(Vulkan::InstanceObject& Instance, const TransientPool::Desc& Info);
+	Texture2D* GetTransient(uint32_t Index) const { return mTransients.Get(Index); }
+
+	// Brings a transient target in to this frame, whatever was in it is gone
+	Resource ImportTransient(uint32_t Index);
+
+	// Brings in an image along with the layout it's in and the stage and writes that last touched it
+	// Transient targets come in UNDEFINED with whatever last used their memory
+	// If FinalLayout isn't UNDEFINED the image is left in it at the end of the frame
+	Resource ImportImage(VkImage Image, VkImageAspectFlags Aspect,
+	                     VkImageLayout Layout, VkPipelineStageFlags Stage, VkAccessFlags Access,
+	                     VkImageLayout FinalLayout = VK_IMAGE_LAYOUT_UNDEFINED);
+
+	// Buffers shared between frames come in with whatever last frame did to them
+	// Access is 0 when that was only a read, the first write still waits on it
+	Resource ImportBuffer(VkBuffer Buffer, VkPipelineStageFlags Stage, VkAccessFlags Access);
+
+	// Resources something outside the graph wants, passes writing them are never culled
+	void MarkOutput(Resource Res);
+
+	// The returned pass stays valid until Reset
+	Pass& AddPass(const char* Name, ExecuteFunc Execute);
+
+	// Culls passes, places the transients if they no longer fit, and derives the barriers
+	void Compile(Vulkan::InstanceObject& Instance);
+
+	// Records the live passes with their barriers, then the final transitions
+	void Execute(VkCommandBuffer Cmd);
+
+	// Information
+	const Stats& GetStats() const { return mStats; }
+	VkImageLayout GetLayout(Resource Res) const { return mResources[Res].Layout; }
+	const TransientPool& GetTransients() const { return mTransients; }
+
+	// Goes up whenever Compile placed the transients again, their images and views are all new
+	uint32_t GetTransientGeneration() const { return mTransientGeneration; }
+
+private:
+	struct ResourceState
+	{
+		VkImage Image;
+		VkBuffer Buffer;
+		VkImageAspectFlags Aspect;
+		VkImageLayout FinalLayout;
+		bool Output;
+		uint32_t Transient; // In to mTransients, ~0U for imported resources
+		bool Touched; // Used by a live pass yet
+
+		// Tracked through Compile
+		VkImageLayout Layout;
+		VkPipelineStageFlags WriteStages; // Last write, or the import stage
+		VkAccessFlags WriteAccess;
+		VkPipelineStageFlags ReadStages; // Reads since then
+		VkPipelineStageFlags VisibleStages; // Stages already made to wait on the last write
+	};
+
+	void AddBarrier(Pass& Target, ResourceState& State, const Pass::Use& Use);
+
+	// Works out when each transient is used and places them again if that changed too much
+	void PlaceTransients(Vulkan::InstanceObject& Instance);
+
+	std::vector<ResourceState> mResources;
+	std::deque<Pass> mPasses;
+
+	// Final layout transitions
+	Pass mFinal;
+
+	TransientPool mTransients;
+	uint32_t mTransientGeneration = 0;
+
+	Stats mStats{};
+};
+}
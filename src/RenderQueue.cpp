@@ -0,0 +1,196 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+namespace Vulkan
+{
+
+RenderQueue::RenderQueue(VkShaderStageFlags ConstantStages, uint32_t ConstantSize)
+	: mConstantStages(ConstantStages)
+	, mConstantSize(ConstantSize)
+{
+	assert(ConstantSize <= sizeof(DrawPacket::Constants));
+}
+
+void RenderQueue::Reset()
+{
+	mPackets.clear();
+	mOrder.clear();
+	mStats = {};
+
+	RecycleIDs(mPipelineIDs);
+	RecycleIDs(mSetIDs);
+	RecycleIDs(mVertexIDs);
+}
+
+void RenderQueue::RecycleIDs(IDMap& Map)
+{
+	// Destroyed handles can come back as something else, so anything unused goes
+	for (auto It = Map.IDs.begin(); It != Map.IDs.end();)
+	{
+		if (Map.Used[It->second])
+		{
+			++It;
+			continue;
+		}
+
+		Map.Free.push_back(It->second);
+		It = Map.IDs.erase(It);
+	}
+
+	std::fill(Map.Used.begin(), Map.Used.end(), false);
+}
+
+uint32_t RenderQueue::GetID(IDMap& Map, uint64_t Handle, uint32_t Bits)
+{
+	uint32_t ID;
+	auto It = Map.IDs.find(Handle);
+	if (It != Map.IDs.end())
+	{
+		ID = It->second;
+	}
+	else if (!Map.Free.empty())
+	{
+		ID = Map.Free.back();
+		Map.Free.pop_back();
+		Map.IDs.emplace(Handle, ID);
+	}
+	else
+	{
+		// More handles in one frame than the key has room for
+		ID = Map.Used.size();
+		assert(ID < (1U << Bits));
+		Map.Used.push_back(false);
+		Map.IDs.emplace(Handle, ID);
+	}
+
+	Map.Used[ID] = true;
+	return ID;
+}
+
+void RenderQueue::Submit(uint32_t Pass, float Depth, const DrawPacket& Packet)
+{
+	assert(Pass < (1U << PASS_BITS));
+
+	uint64_t Pipeline = GetID(mPipelineIDs, (uint64_t)Packet.Pipeline, PIPELINE_BITS);
+	uint64_t Set = GetID(mSetIDs, (uint64_t)Packet.Set, SET_BITS);
+	uint64_t Vertex = GetID(mVertexIDs, (uint64_t)Packet.VertexBuffers[0], VERTEX_BITS);
+
+	const uint32_t DepthMax = (1U << DEPTH_BITS) - 1;
+	uint64_t DepthBits = (uint64_t)(std::min(std::max(Depth, 0.0f), 1.0f) * DepthMax);
+
+	uint64_t Key = (uint64_t)Pass;
+	Key = (Key << PIPELINE_BITS) | Pipeline;
+	Key = (Key << SET_BITS) | Set;
+	Key = (Key << VERTEX_BITS) | Vertex;
+	Key = (Key << DEPTH_BITS) | DepthBits;
+
+	mOrder.push_back({ Key, (uint32_t)mPackets.size() });
+	mPackets.push_back(Packet);
+	mPackets.back().Key = Key;
+}
+
+void RenderQueue::Sort()
+{
+	const size_t Count = mOrder.size();
+	if (Count < 2)
+		return;
+
+	mScratch.resize(Count);
+
+	// LSD radix sort, a byte at a time
+	// Bytes that are the same in every key get skipped, which is most of them
+	// when there are only a handful of pipelines and sets
+	SortEntry* Src = &mOrder[0];
+	SortEntry* Dst = &mScratch[0];
+	for (uint32_t Shift = 0; Shift < 64; Shift += 8)
+	{
+		uint32_t Histogram[256]{};
+		for (size_t i = 0; i < Count; ++i)
+			++Histogram[(Src[i].Key >> Shift) & 0xFF];
+
+		if (Histogram[(Src[0].Key >> Shift) & 0xFF] == Count)
+			continue;
+
+		uint32_t Offset = 0;
+		for (auto& Bucket : Histogram)
+		{
+			uint32_t Size = Bucket;
+			Bucket = Offset;
+			Offset += Size;
+		}
+
+		for (size_t i = 0; i < Count; ++i)
+			Dst[Histogram[(Src[i].Key >> Shift) & 0xFF]++] = Src[i];
+
+		std::swap(Src, Dst);
+	}
+
+	if (Src != &mOrder[0])
+		mOrder.swap(mScratch);
+}
+
+void RenderQueue::Record(VkCommandBuffer Cmd, uint32_t Begin, uint32_t End)
+{
+	assert(End <= mOrder.size());
+
+	// Counted locally so threads only meet at the end
+	Stats Local{};
+	const DrawPacket* Last = nullptr;
+	for (uint32_t i = Begin; i < End; ++i)
+	{
+		const DrawPacket& Packet = mPackets[mOrder[i].Index];
+
+		if (!Last || Last->Pipeline != Packet.Pipeline)
+		{
+			vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, Packet.Pipeline);
+			++Local.PipelineBinds;
+		}
+		else
+			++Local.Skipped;
+
+		if (!Last || Last->Set != Packet.Set || Last->Layout != Packet.Layout)
+		{
+			vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, Packet.Layout,
+			                        0, 1, &Packet.Set, 0, nullptr);
+			++Local.SetBinds;
+		}
+		else
+			++Local.Skipped;
+
+		if (!Last || memcmp(Last->VertexBuffers, Packet.VertexBuffers, sizeof(Packet.VertexBuffers)))
+		{
+			const VkDeviceSize Offsets[2]{};
+			vkCmdBindVertexBuffers(Cmd, 0, 2, Packet.VertexBuffers, Offsets);
+			++Local.VertexBinds;
+		}
+		else
+			++Local.Skipped;
+
+		if (mConstantSize &&
+		    (!Last || Last->Layout != Packet.Layout || memcmp(Last->Constants, Packet.Constants, mConstantSize)))
+		{
+			vkCmdPushConstants(Cmd, Packet.Layout, mConstantStages, 0, mConstantSize, Packet.Constants);
+			++Local.ConstantPushes;
+		}
+		else if (mConstantSize)
+			++Local.Skipped;
+
+		vkCmdDraw(Cmd, Packet.VertexCount, Packet.InstanceCount, Packet.FirstVertex, Packet.FirstInstance);
+		++Local.Draws;
+
+		Last = &Packet;
+	}
+
+	std::lock_guard<std::mutex> Lock(mStatsLock);
+	mStats.Draws += Local.Draws;
+	mStats.PipelineBinds += Local.PipelineBinds;
+	mStats.SetBinds += Local.SetBinds;
+	mStats.VertexBinds += Local.VertexBinds;
+	mStats.ConstantPushes += Local.ConstantPushes;
+	mStats.Skipped += Local.Skipped;
+}
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace Vulkan
+{
+// One draw along with all the state it needs bound
+struct DrawPacket
+{
+	static const uint32_t MAX_CONSTANTS = 8;
+
+	uint64_t Key;
+
+	VkPipeline Pipeline;
+	VkPipelineLayout Layout;
+	VkDescriptorSet Set;
+	VkBuffer VertexBuffers[2]; // Bindings 0 and 1, per vertex and per instance
+	uint32_t Constants[MAX_CONSTANTS];
+
+	uint32_t VertexCount;
+	uint32_t InstanceCount;
+	uint32_t FirstVertex;
+	uint32_t FirstInstance;
+};
+
+// Collects a frame's draws, sorts them by state and records them
+// with only the binds that actually change between neighbouring draws
+class RenderQueue
+{
+public:
+	// How the key's 64 bits are split up, most significant first
+	static const uint32_t PASS_BITS = 4;
+	static const uint32_t PIPELINE_BITS = 12;
+	static const uint32_t SET_BITS = 12;
+	static const uint32_t VERTEX_BITS = 12;
+	static const uint32_t DEPTH_BITS = 24;
+
+	// Per frame bind counts, Skipped is what a naive bind-everything-per-draw would have added
+	struct Stats
+	{
+		uint32_t Draws;
+		uint32_t PipelineBinds;
+		uint32_t SetBinds;
+		uint32_t VertexBinds;
+		uint32_t ConstantPushes;
+		uint32_t Skipped;
+	};
+
+	// Constants get pushed at offset 0 in to ConstantStages, ConstantSize bytes of them
+	RenderQueue(VkShaderStageFlags ConstantStages, uint32_t ConstantSize);
+
+	// Drops the previous frame's packets and stats
+	// Handles that weren't drawn with last frame give their ids back
+	void Reset();
+
+	// Fills in the packet's key before queueing it
+	// Depth is 0 to 1, nearer sorts first within the same state
+	void Submit(uint32_t Pass, float Depth, const DrawPacket& Packet);
+
+	// Radix sorts the packets by key
+	void Sort();
+
+	// Records packets [Begin, End) in sorted order
+	// Assumes nothing is bound yet, so ranges can go to different command buffers
+	// Separate ranges can be recorded from separate threads
+	void Record(VkCommandBuffer Cmd, uint32_t Begin, uint32_t End);
+	void Record(VkCommandBuffer Cmd) { Record(Cmd, 0, Size()); }
+
+	// Information
+	uint32_t Size() const { return mPackets.size(); }
+	const Stats& GetStats() const { return mStats; }
+
+private:
+	// Handles are squashed to small ids, which only have to be unique within a frame
+	struct IDMap
+	{
+		std::unordered_map<uint64_t, uint32_t> IDs;
+		std::vector<uint32_t> Free;
+		std::vector<bool> Used; // By id, since the last Reset
+	};
+
+	uint32_t GetID(IDMap& Map, uint64_t Handle, uint32_t Bits);
+	void RecycleIDs(IDMap& Map);
+
+	VkShaderStageFlags mConstantStages;
+	uint32_t mConstantSize;
+
+	IDMap mPipelineIDs;
+	IDMap mSetIDs;
+	IDMap mVertexIDs;
+
+	std::vector<DrawPacket> mPackets;
+
+	// Sorted order, key and packet index side by side plus the scratch for the sort
+	struct SortEntry
+	{
+		uint64_t Key;
+		uint32_t Index;
+	};
+	std::vector<SortEntry> mOrder;
+	std::vector<SortEntry> mScratch;
+
+	std::mutex mStatsLock;
+	Stats mStats{};
+};
+}
@@ -0,0 +1,54 @@
+#include "SIMD.h"
+
+bool SIMDSupported(SIMDLevel Level)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	// Can get here from a static constructor, before the runtime has filled in what the CPU has
+	__builtin_cpu_init();
+#endif
+
+	switch (Level)
+	{
+#if defined(__x86_64__) || defined(__i386__)
+	case SIMDLevel::SSE:
+		return __builtin_cpu_supports("sse2");
+	case SIMDLevel::AVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__aarch64__) || defined(__ARM_NEON)
+	case SIMDLevel::NEON:
+		return true;
+#endif
+	case SIMDLevel::Scalar:
+	case SIMDLevel::Best:
+		return true;
+	default:
+		return false;
+	}
+}
+
+const char* SIMDName(SIMDLevel Level)
+{
+	switch (Level)
+	{
+	case SIMDLevel::Scalar: return "Scalar";
+	case SIMDLevel::SSE: return "SSE";
+	case SIMDLevel::AVX2: return "AVX2";
+	case SIMDLevel::NEON: return "NEON";
+	default: return "Best";
+	}
+}
+
+SIMDLevel SIMDResolve(SIMDLevel Level)
+{
+	if (Level != SIMDLevel::Best)
+		return Level;
+
+	if (SIMDSupported(SIMDLevel::AVX2))
+		return SIMDLevel::AVX2;
+	if (SIMDSupported(SIMDLevel::NEON))
+		return SIMDLevel::NEON;
+	if (SIMDSupported(SIMDLevel::SSE))
+		return SIMDLevel::SSE;
+	return SIMDLevel::Scalar;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// Instruction set levels our CPU kernels come in
+// Kernels pick one at runtime so a single binary runs everywhere
+enum class SIMDLevel
+{
+	Scalar,
+	SSE,
+	AVX2,
+	NEON,
+	Best, // Widest the CPU supports
+};
+
+bool SIMDSupported(SIMDLevel Level);
+const char* SIMDName(SIMDLevel Level);
+
+// Resolves Best to the widest level this CPU has
+SIMDLevel SIMDResolve(SIMDLevel Level);
@@ -0,0 +1,167 @@
+#include "Vulkan.h"
+#include "SetupBatch.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <assert.h>
+
+namespace Vulkan
+{
+
+SetupBatch::SetupBatch(Vulkan::InstanceObject& Instance, uint32_t Threads)
+	: mThreads(Threads)
+{
+	VkResult err;
+
+	mPools.resize(mThreads);
+	for (auto& CurrentPool : mPools)
+	{
+		// Reset as a whole after every submit
+		const VkCommandPoolCreateInfo PoolInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = Instance.GetPresentQueueIndex(),
+		};
+
+		err = vkCreateCommandPool(*Instance.GetDevice(), &PoolInfo, nullptr, &CurrentPool.Handle);
+		CHECK_ERR(err);
+
+		const VkCommandBufferAllocateInfo AllocInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.pNext = nullptr,
+			.commandPool = CurrentPool.Handle,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+
+		err = vkAllocateCommandBuffers(*Instance.GetDevice(), &AllocInfo, &CurrentPool.Buffer);
+		CHECK_ERR(err);
+
+		CurrentPool.Recording = false;
+	}
+
+	const VkFenceCreateInfo FenceInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+	};
+
+	err = vkCreateFence(*Instance.GetDevice(), &FenceInfo, nullptr, &mFence);
+	CHECK_ERR(err);
+}
+
+SetupBatch::~SetupBatch()
+{
+}
+
+SetupBatch::Recording::Recording(Vulkan::InstanceObject& Instance, uint64_t* Owner)
+	: mBatch(Instance.mSetup.get())
+{
+	mBatch->mRecording.fetch_add(1, std::memory_order_acquire);
+	mCommand = mBatch->GetCommand(Instance);
+
+	// The batch it was last recorded in and the thread that did it
+	if (Owner)
+	{
+		const uint64_t Current = ((uint64_t)mBatch->mSubmits << 32) | (JobSystem::GetThreadIndex() + 1);
+		assert(!*Owner || (*Owner >> 32) != mBatch->mSubmits || *Owner == Current);
+		*Owner = Current;
+	}
+}
+
+SetupBatch::Recording::~Recording()
+{
+	mBatch->mRecording.fetch_sub(1, std::memory_order_release);
+}
+
+VkCommandBuffer SetupBatch::GetCommand(Vulkan::InstanceObject& Instance)
+{
+	const uint32_t Thread = JobSystem::GetThreadIndex();
+	assert(Thread < mThreads);
+
+	Pool& CurrentPool = mPools[Thread];
+	if (!CurrentPool.Recording)
+	{
+		const VkCommandBufferBeginInfo BeginInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.pNext = nullptr,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			.pInheritanceInfo = nullptr,
+		};
+
+		VkResult err;
+		err = vkBeginCommandBuffer(CurrentPool.Buffer, &BeginInfo);
+		CHECK_ERR(err);
+
+		CurrentPool.Recording = true;
+	}
+
+	return CurrentPool.Buffer;
+}
+
+void SetupBatch::Submit(Vulkan::InstanceObject& Instance)
+{
+	PROFILE_SCOPE("SetupBatch::Submit");
+	VkResult err;
+
+	// Other threads' buffers get ended here, they can't still be adding to them
+	assert(mRecording.load(std::memory_order_acquire) == 0);
+
+	// Thread order is submission order, so barriers in later buffers cover earlier ones
+	std::vector<VkCommandBuffer> Buffers;
+	for (auto& CurrentPool : mPools)
+	{
+		if (!CurrentPool.Recording)
+			continue;
+
+		err = vkEndCommandBuffer(CurrentPool.Buffer);
+		CHECK_ERR(err);
+		Buffers.push_back(CurrentPool.Buffer);
+	}
+
+	if (Buffers.empty())
+		return;
+
+	const VkSubmitInfo SubmitInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = nullptr,
+		.waitSemaphoreCount = 0,
+		.pWaitSemaphores = nullptr,
+		.pWaitDstStageMask = nullptr,
+		.commandBufferCount = (uint32_t)Buffers.size(),
+		.pCommandBuffers = Buffers.data(),
+		.signalSemaphoreCount = 0,
+		.pSignalSemaphores = nullptr,
+	};
+
+	err = vkQueueSubmit(*Instance.GetQueue(), 1, &SubmitInfo, mFence);
+	CHECK_ERR(err);
+
+	// Only waits on our own work rather than idling the whole queue
+	err = vkWaitForFences(*Instance.GetDevice(), 1, &mFence, VK_TRUE, UINT64_MAX);
+	CHECK_ERR(err);
+
+	err = vkResetFences(*Instance.GetDevice(), 1, &mFence);
+	CHECK_ERR(err);
+
+	for (auto& CurrentPool : mPools)
+	{
+		if (!CurrentPool.Recording)
+			continue;
+
+		err = vkResetCommandPool(*Instance.GetDevice(), CurrentPool.Handle, 0);
+		CHECK_ERR(err);
+		CurrentPool.Recording = false;
+	}
+
+	++mSubmits;
+	mCommandsSubmitted += Buffers.size();
+}
+
+}
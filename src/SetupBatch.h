@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace Vulkan
+{
+class InstanceObject;
+
+// Collects the transitions and copies resources need when they get created
+// Each thread records in to its own buffer, begun the first time it asks for
+// one, and Submit sends them all off together behind a single fence
+// Buffers go in thread order with nothing between them, so each resource can only be
+// recorded from one thread per batch, Recording checks that when it's given an owner
+class SetupBatch
+{
+public:
+	SetupBatch(Vulkan::InstanceObject& Instance, uint32_t Threads);
+	~SetupBatch();
+
+	static std::unique_ptr<SetupBatch> Create(Vulkan::InstanceObject& Instance, uint32_t Threads)
+	{
+		return std::make_unique<SetupBatch>(Instance, Threads);
+	}
+
+	// Holds the calling thread's buffer open for as long as it lives
+	// Owner lives alongside the resource being recorded, starting at 0
+	class Recording
+	{
+	public:
+		Recording(Vulkan::InstanceObject& Instance, uint64_t* Owner = nullptr);
+		~Recording();
+
+		VkCommandBuffer Get() const { return mCommand; }
+
+	private:
+		SetupBatch* mBatch;
+		VkCommandBuffer mCommand;
+	};
+
+	// Ends and submits everything recorded since the last Submit, then waits for it
+	// Does nothing when nothing was recorded
+	// Nothing can be recording, on any thread
+	void Submit(Vulkan::InstanceObject& Instance);
+
+	// Information
+	uint32_t GetSubmits() const { return mSubmits; }
+	uint32_t GetCommandsSubmitted() const { return mCommandsSubmitted; }
+
+private:
+	// Calling thread's buffer, already recording
+	VkCommandBuffer GetCommand(Vulkan::InstanceObject& Instance);
+
+	const uint32_t mThreads;
+	std::atomic<uint32_t> mRecording{0};
+
+	struct Pool
+	{
+		VkCommandPool Handle;
+		VkCommandBuffer Buffer;
+		bool Recording;
+	};
+	std::vector<Pool> mPools;
+
+	VkFence mFence;
+
+	uint32_t mSubmits = 0;
+	uint32_t mCommandsSubmitted = 0;
+};
+}
@@ -0,0 +1,126 @@
+#include "TaskGraph.h"
+#include "Profiler.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+
+namespace Vulkan
+{
+
+TaskGraph::Task TaskGraph::Add(const char* Name, TaskFunc Func, std::initializer_list<Task> After)
+{
+	const Task Index = mNodes.size();
+
+	mNodes.emplace_back();
+	Node& NewNode = mNodes.back();
+	NewNode.Name = Name;
+	NewNode.Func = std::move(Func);
+	NewNode.After = After;
+	NewNode.Remaining.store(After.size(), std::memory_order_relaxed);
+
+	for (Task Dependency : After)
+	{
+		assert(Dependency < Index);
+		mNodes[Dependency].Dependents.push_back(Index);
+	}
+
+	return Index;
+}
+
+void TaskGraph::Execute(Node& Current)
+{
+	Current.Thread = JobSystem::GetThreadIndex();
+	Current.Start = Clock::now();
+	if (!mCancelled.load(std::memory_order_acquire))
+	{
+		PROFILE_SCOPE(Current.Name);
+		Current.Func();
+	}
+	Current.End = Clock::now();
+}
+
+void TaskGraph::Launch(Task Index)
+{
+	mJobs->Run([this, Index]()
+	{
+		Node& Current = mNodes[Index];
+		Execute(Current);
+
+		// Queued before this job signals, so the counter can't hit zero early
+		for (Task Dependent : Current.Dependents)
+		{
+			if (mNodes[Dependent].Remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				Launch(Dependent);
+		}
+	}, &mCounter);
+}
+
+bool TaskGraph::Run(bool Serial)
+{
+	mSerial = Serial;
+	mStart = Clock::now();
+
+	if (Serial)
+	{
+		for (auto& Current : mNodes)
+			Execute(Current);
+	}
+	else
+	{
+		for (Task Index = 0; Index < mNodes.size(); ++Index)
+		{
+			if (mNodes[Index].After.size() == 0)
+				Launch(Index);
+		}
+
+		mJobs->Wait(&mCounter);
+	}
+
+	mEnd = Clock::now();
+	return !mCancelled.load(std::memory_order_acquire);
+}
+
+void TaskGraph::PrintTimings(const char* Title) const
+{
+	auto MS = [&](Clock::time_point Time)
+	{
+		return std::chrono::duration<double, std::milli>(Time - mStart).count();
+	};
+
+	printf("%s: %.2fms on %d threads\n", Title, MS(mEnd), mJobs->GetThreads());
+
+	Task Last = 0;
+	for (Task Index = 0; Index < mNodes.size(); ++Index)
+	{
+		const Node& Current = mNodes[Index];
+		printf("\t%-20s %8.2fms - %8.2fms (%7.2fms) thread %d\n", Current.Name,
+		       MS(Current.Start), MS(Current.End), MS(Current.End) - MS(Current.Start), Current.Thread);
+
+		if (Current.End > mNodes[Last].End)
+			Last = Index;
+	}
+
+	// Serially everything is on the critical path
+	if (mNodes.empty() || mSerial)
+		return;
+
+	// Walk back from whatever finished last through whichever dependency held it up longest
+	std::string Path = mNodes[Last].Name;
+	while (!mNodes[Last].After.empty())
+	{
+		Task Latest = mNodes[Last].After[0];
+		for (Task Dependency : mNodes[Last].After)
+		{
+			if (mNodes[Dependency].End > mNodes[Latest].End)
+				Latest = Dependency;
+		}
+
+		Last = Latest;
+		Path = std::string(mNodes[Last].Name) + " -> " + Path;
+	}
+
+	printf("%s critical path: %s\n", Title, Path.c_str());
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "JobSystem.h"
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+namespace Vulkan
+{
+// One off tasks with dependencies between them, run on the job system
+// A task gets queued as soon as the last task it depends on finishes, and
+// each task's start and end get recorded so the critical path can be shown
+class TaskGraph
+{
+public:
+	typedef uint32_t Task;
+	typedef std::function<void()> TaskFunc;
+
+	TaskGraph(JobSystem* Jobs)
+		: mJobs(Jobs)
+	{}
+
+	// Dependencies have to be added first, which also keeps the graph acyclic
+	Task Add(const char* Name, TaskFunc Func, std::initializer_list<Task> After = {});
+
+	// Runs everything and returns once it's all done
+	// Serial runs the tasks in the order they were added on the calling thread
+	// False when a task cancelled the run
+	bool Run(bool Serial = false);
+
+	// Called from a task that failed, anything that hasn't started yet gets skipped
+	// Tasks already running still finish
+	void Cancel() { mCancelled.store(true, std::memory_order_release); }
+
+	// When each task ran, and the chain of tasks that the total time came down to
+	void PrintTimings(const char* Title) const;
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct Node
+	{
+		const char* Name;
+		TaskFunc Func;
+		std::vector<Task> After;
+		std::vector<Task> Dependents;
+		std::atomic<uint32_t> Remaining;
+
+		Clock::time_point Start, End;
+		uint32_t Thread;
+	};
+
+	void Launch(Task Index);
+	void Execute(Node& Current);
+
+	JobSystem* mJobs;
+	std::deque<Node> mNodes;
+	JobCounter mCounter;
+
+	Clock::time_point mStart, mEnd;
+	bool mSerial = false;
+	std::atomic<bool> mCancelled{false};
+};
+}
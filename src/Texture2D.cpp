@@ -1,8 +1,12 @@
 #include "Vulkan.h"
 #include "Texture2D.h"
+#include "PixelConvert.h"
+#include "Profiler.h"
 #include "Utils.h"
 
+#include <algorithm>
 #include <string.h>
+#include <vector>
 
 namespace Vulkan
 {
@@ -21,10 +25,14 @@ Texture2D::Texture2D(Vulkan::InstanceObject& Instance,
 		VkImageViewType ViewType, VkImageTiling Tiling,
 		VkImageUsageFlags Usage, VkFlags Props)
 	: mDim(Dim), mLevels(Levels), mLayers(Layers), mFormat(Format)
-	, mSamples(Samples), mTiling(Tiling), mProps(Props)
+	, mSamples(Samples), mViewType(ViewType), mTiling(Tiling), mProps(Props)
 	, mUsage(Usage)
 {
-	auto AspectMask = IsDepthFormat(mFormat) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+	PROFILE_SCOPE("Texture2D");
+
+	// Host written images have to keep their contents through the first transition
+	if (mTiling == VK_IMAGE_TILING_LINEAR && (mProps & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+		mLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
 
 	const VkImageCreateInfo ImageInfo =
 	{
@@ -42,24 +50,86 @@ Texture2D::Texture2D(Vulkan::InstanceObject& Instance,
 		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 		.queueFamilyIndexCount = 0,
 		.pQueueFamilyIndices = nullptr,
-		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.initialLayout = mLayout,
 	};
 
+	VkResult err;
+
+	// Create image
+	err = vkCreateImage(*Instance.GetDevice(), &ImageInfo, nullptr, &mImage);
+	CHECK_ERR(err);
+
+	// Get memory requirements
+	vkGetImageMemoryRequirements(*Instance.GetDevice(), mImage, &mRequirements);
+	mAllocationSize = mRequirements.size;
+
+	// Transient, whoever owns the memory binds it later
+	if (!mProps)
+		return;
+
 	VkMemoryAllocateInfo MemAllocate =
 	{
 		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
 		.pNext = nullptr,
-		.allocationSize = 0, // Placeholder
-		.memoryTypeIndex = 0, // Placeholder
+		.allocationSize = mRequirements.size,
+		.memoryTypeIndex = Util::MemoryTypeFromProperties(Instance, mRequirements.memoryTypeBits, mProps),
 	};
+	assert(MemAllocate.memoryTypeIndex != ~0U);
 
-	VkImageViewCreateInfo ViewCreateInfo =
+	// Allocate Memory
+	err = vkAllocateMemory(*Instance.GetDevice(), &MemAllocate, nullptr, &mMemory);
+	CHECK_ERR(err);
+
+	// Bind Memory
+	err = vkBindImageMemory(*Instance.GetDevice(), mImage, mMemory, 0);
+	CHECK_ERR(err);
+
+	CreateView(Instance);
+}
+
+void Texture2D::Destroy(Vulkan::InstanceObject& Instance)
+{
+	Destroy(*Instance.GetDevice());
+}
+
+void Texture2D::Destroy(VkDevice Device)
+{
+	if (mView != VK_NULL_HANDLE)
+		vkDestroyImageView(Device, mView, nullptr);
+	vkDestroyImage(Device, mImage, nullptr);
+
+	// Transients don't own theirs
+	if (mProps && mMemory != VK_NULL_HANDLE)
+		vkFreeMemory(Device, mMemory, nullptr);
+
+	mView = VK_NULL_HANDLE;
+	mImage = VK_NULL_HANDLE;
+	mMemory = VK_NULL_HANDLE;
+}
+
+void Texture2D::BindMemory(Vulkan::InstanceObject& Instance, VkDeviceMemory Memory, VkDeviceSize Offset)
+{
+	assert(!mProps && mView == VK_NULL_HANDLE);
+	assert(Offset % mRequirements.alignment == 0);
+
+	VkResult err;
+	err = vkBindImageMemory(*Instance.GetDevice(), mImage, Memory, Offset);
+	CHECK_ERR(err);
+
+	CreateView(Instance);
+}
+
+void Texture2D::CreateView(Vulkan::InstanceObject& Instance)
+{
+	auto AspectMask = IsDepthFormat(mFormat) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+
+	const VkImageViewCreateInfo ViewCreateInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
 		.pNext = nullptr,
 		.flags = 0,
-		.image = VK_NULL_HANDLE,
-		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.image = mImage,
+		.viewType = mViewType,
 		.format = mFormat,
 		.components =
 		{
@@ -72,39 +142,14 @@ Texture2D::Texture2D(Vulkan::InstanceObject& Instance,
 		{
 			.aspectMask = AspectMask,
 			.baseMipLevel = 0,
-			.levelCount = 1,
+			.levelCount = mLevels,
 			.baseArrayLayer = 0,
-			.layerCount = 1,
+			// A plain 2D view can only see the first
+			.layerCount = mViewType == VK_IMAGE_VIEW_TYPE_2D ? 1 : mLayers,
 		},
 	};
 
-
 	VkResult err;
-	uint32_t MemTypeIndex = ~0U;
-	VkMemoryRequirements MemRequirements;
-
-	// Create image
-	err = vkCreateImage(*Instance.GetDevice(), &ImageInfo, nullptr, &mImage);
-	CHECK_ERR(err);
-
-	// Get memory requirements
-	vkGetImageMemoryRequirements(*Instance.GetDevice(), mImage, &MemRequirements);
-
-	MemAllocate.allocationSize = MemRequirements.size;
-	mAllocationSize = MemAllocate.allocationSize;
-	MemTypeIndex = Util::MemoryTypeFromProperties(Instance, MemRequirements.memoryTypeBits, mProps);
-	assert(MemTypeIndex != ~0U);
-
-	// Allocate Memory
-	err = vkAllocateMemory(*Instance.GetDevice(), &MemAllocate, nullptr, &mMemory);
-	CHECK_ERR(err);
-
-	// Bind Memory
-	err = vkBindImageMemory(*Instance.GetDevice(), mImage, mMemory, 0);
-	CHECK_ERR(err);
-
-	// Create view
-	ViewCreateInfo.image = mImage;
 	err = vkCreateImageView(*Instance.GetDevice(), &ViewCreateInfo, nullptr, &mView);
 	CHECK_ERR(err);
 }
@@ -115,7 +160,8 @@ void Texture2D::CopyToTexture(Vulkan::InstanceObject& Instance, PNGLoader* Png)
 	assert(GetUsage() & VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
 	assert(GetFlags() & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
 
-	// This is really expecting you to know the format you're copying in from the PNG is the exact same as you'd expect
+	// PNGs always decode to four byte BGRA
+	assert(mFormat == VK_FORMAT_B8G8R8A8_UNORM);
 	auto AspectMask = IsDepthFormat(mFormat) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
 	const VkImageSubresource SubResource =
 	{
@@ -135,13 +181,11 @@ void Texture2D::CopyToTexture(Vulkan::InstanceObject& Instance, PNGLoader* Png)
 
 	VkExtent2D Dim = GetDimensions();
 
+	// Rows get decoded straight in to the mapping, no copy of the image in between
 	assert(Dim.width == Png->GetWidth() && Dim.height == Png->GetHeight());
-	const std::vector<uint8_t> PNGData = Png->GetData();
-	for (uint32_t y = 0; y < Dim.height; ++y)
-	{
-		void* Row = (void*)((uint8_t*)Data + SubLayout.rowPitch * y);
-		memcpy(Row, &PNGData.at(y * Dim.width), Dim.width * 4);
-	}
+	bool Decoded = Png->Decode((uint8_t*)Data + SubLayout.offset, SubLayout.rowPitch);
+	assert(Decoded);
+	(void)Decoded;
 
 	vkUnmapMemory(*Instance.GetDevice(), GetMemory());
 
@@ -152,8 +196,8 @@ void Texture2D::CopyFromTexture(Vulkan::InstanceObject& Instance, Texture2D *Tex
 {
 	assert(Texture->GetDimensions() == GetDimensions());
 	assert(Texture->GetFormat() == GetFormat());
-	assert(Texture->GetUsage() == VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
-	assert(GetUsage() == VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+	assert(Texture->GetUsage() & VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+	assert(GetUsage() & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
 
 	// Transition images to the optimal transfer types
 	VkImageLayout OldSrcLayout, OldDstLayout;
@@ -189,105 +233,128 @@ void Texture2D::CopyFromTexture(Vulkan::InstanceObject& Instance, Texture2D *Tex
 		},
 	};
 
-	vkCmdCopyImage(Instance.mSetupCommand,
-	               Texture->GetImage(), Texture->GetLayout(),
-			   GetImage(), GetLayout(),
-			   1, &CopyRegion);
+	{
+		SetupBatch::Recording Setup(Instance, &mSetupOwner);
+		vkCmdCopyImage(Setup.Get(),
+		               Texture->GetImage(), Texture->GetLayout(),
+		               GetImage(), GetLayout(),
+		               1, &CopyRegion);
+	}
 
 	// Transition back to the Old format for the destination
+	// Nothing can transition in to UNDEFINED or PREINITIALIZED, so leave those for the caller
 	// XXX: Should we skip the source since it would most likely be just a staging buffer?
 	// Texture->TransitionImageFormat(Instance, OldSrcLayout);
-	TransitionImageFormat(Instance, OldDstLayout);
+	if (OldDstLayout != VK_IMAGE_LAYOUT_UNDEFINED &&
+	    OldDstLayout != VK_IMAGE_LAYOUT_PREINITIALIZED)
+		TransitionImageFormat(Instance, OldDstLayout);
 }
 
 void Texture2D::TransitionImageFormat(Vulkan::InstanceObject& Instance, VkImageLayout NewLayout)
 {
-	VkResult err;
-	if (Instance.mSetupCommand == VK_NULL_HANDLE)
-	{
-		// If we've never called this before, let's generate it
-		const VkCommandBufferAllocateInfo CommandInfo =
-		{
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-			.pNext = nullptr,
-			.commandPool = Instance.mCommandPool,
-			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-			.commandBufferCount = 1,
-		};
-
-		err = vkAllocateCommandBuffers(*Instance.GetDevice(), &CommandInfo, &Instance.mSetupCommand);
-		CHECK_ERR(err);
-	}
+	// Recorded in to the setup batch, doesn't happen until it gets submitted
+	VkPipelineStageFlags SrcStage, DstStage;
+	const VkImageMemoryBarrier MemoryBarrier = Transition(NewLayout, &SrcStage, &DstStage);
 
-	const VkCommandBufferInheritanceInfo CommandBufferInherentInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
-		.pNext = nullptr,
-		.renderPass = VK_NULL_HANDLE,
-		.subpass = 0,
-		.framebuffer = VK_NULL_HANDLE,
-		.occlusionQueryEnable = VK_FALSE,
-		.queryFlags = 0,
-		.pipelineStatistics = 0,
-	};
-
-	const VkCommandBufferBeginInfo CommandBufferInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.pNext = nullptr,
-		.flags = 0,
-		.pInheritanceInfo = &CommandBufferInherentInfo,
-	};
-
-	err = vkBeginCommandBuffer(Instance.mSetupCommand, &CommandBufferInfo);
-	CHECK_ERR(err);
+	SetupBatch::Recording Setup(Instance, &mSetupOwner);
+	vkCmdPipelineBarrier(Setup.Get(), SrcStage, DstStage, 0, 0, nullptr,
+	                     0, nullptr, 1, &MemoryBarrier);
+}
 
+VkImageMemoryBarrier Texture2D::Transition(VkImageLayout NewLayout, VkPipelineStageFlags* SrcStage, VkPipelineStageFlags* DstStage)
+{
 	auto AspectMask = IsDepthFormat(mFormat) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
 
-	// Let's actually set the image layout now
-	VkImageMemoryBarrier MemoryBarrier =
+	// Wait on whatever the old layout was used for, block whatever the new one is used for
+	VkAccessFlags SrcAccess, DstAccess;
+	Util::GetLayoutUsage(mLayout, SrcStage, &SrcAccess);
+	Util::GetLayoutUsage(NewLayout, DstStage, &DstAccess);
+
+	const VkImageMemoryBarrier MemoryBarrier =
 	{
 		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
 		.pNext = nullptr,
-		.srcAccessMask = 0,
-		.dstAccessMask = 0,
+		.srcAccessMask = SrcAccess,
+		.dstAccessMask = DstAccess,
 		.oldLayout = mLayout,
 		.newLayout = NewLayout,
 		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
 		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
 		.image = mImage,
-		.subresourceRange = {AspectMask, 0, 1, 0, 1},
+		.subresourceRange = {AspectMask, 0, mLevels, 0, mLayers},
 	};
 
-	switch (NewLayout)
+	mLayout = NewLayout;
+	return MemoryBarrier;
+}
+
+void Texture2D::CopyFromBuffer(VkCommandBuffer Cmd, VkBuffer Buffer, VkDeviceSize Offset, uint32_t Level, uint32_t Layer)
+{
+	assert(GetUsage() & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+	assert(Level < mLevels && Layer < mLayers);
+	assert(mLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+	auto AspectMask = IsDepthFormat(mFormat) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+	const VkBufferImageCopy CopyRegion =
 	{
-	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-		MemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		break;
-	case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
-		MemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		break;
-	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
-		MemoryBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-		break;
-	case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
-		MemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
-		break;
-	default:
-		// Do nothing
-		break;
-	}
+		.bufferOffset = Offset,
+		.bufferRowLength = 0, // Tightly packed
+		.bufferImageHeight = 0,
+		.imageSubresource =
+		{
+			AspectMask, Level, Layer, 1
+		},
+		.imageOffset =
+		{
+			0, 0, 0
+		},
+		.imageExtent =
+		{
+			std::max(mDim.width >> Level, 1U), std::max(mDim.height >> Level, 1U), 1
+		},
+	};
 
-	VkPipelineStageFlags SrcStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	VkPipelineStageFlags DstStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	vkCmdCopyBufferToImage(Cmd, Buffer, mImage, mLayout, 1, &CopyRegion);
+}
 
-	vkCmdPipelineBarrier(Instance.mSetupCommand, SrcStage, DstStage, 0, 0, nullptr,
-	                     0, nullptr, 1, &MemoryBarrier);
+void Texture2D::CopyLayersFromBuffer(VkCommandBuffer Cmd, VkBuffer Buffer,
+                                     const uint32_t* Layers, const VkDeviceSize* Offsets, uint32_t Count)
+{
+	assert(GetUsage() & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+	assert(mLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	if (!Count)
+		return;
 
-	err = vkEndCommandBuffer(Instance.mSetupCommand);
-	CHECK_ERR(err);
+	auto AspectMask = IsDepthFormat(mFormat) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+	std::vector<VkBufferImageCopy> Regions;
+	Regions.reserve(Count * mLevels);
+	for (uint32_t i = 0; i < Count; ++i)
+	{
+		assert(Layers[i] < mLayers);
+		for (uint32_t Level = 0; Level < mLevels; ++Level)
+		{
+			Regions.push_back(
+			{
+				.bufferOffset = Offsets[i] + GetMipOffset(mDim.width, mDim.height, Level),
+				.bufferRowLength = 0, // Tightly packed
+				.bufferImageHeight = 0,
+				.imageSubresource =
+				{
+					AspectMask, Level, Layers[i], 1
+				},
+				.imageOffset =
+				{
+					0, 0, 0
+				},
+				.imageExtent =
+				{
+					std::max(mDim.width >> Level, 1U), std::max(mDim.height >> Level, 1U), 1
+				},
+			});
+		}
+	}
 
-	mLayout = NewLayout;
+	vkCmdCopyBufferToImage(Cmd, Buffer, mImage, mLayout, (uint32_t)Regions.size(), Regions.data());
 }
 
 Texture2D::~Texture2D()
@@ -318,7 +385,8 @@ Sampler::Sampler(Vulkan::InstanceObject& Instance,
 		.compareEnable = VK_FALSE,
 		.compareOp = VK_COMPARE_OP_NEVER,
 		.minLod = 0.0f,
-		.maxLod = 0.0f,
+		// Views decide how many levels there are, so textures can be swapped for ones with more
+		.maxLod = VK_LOD_CLAMP_NONE,
 		.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
 		.unnormalizedCoordinates = VK_FALSE,
 	};
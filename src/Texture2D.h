@@ -38,15 +38,48 @@ public:
 		return std::make_unique<Texture2D>(Instance, Dim, Levels, Layers, Format, Samples, ViewType, Tiling, Usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
 	}
 
+	// Attachment that never leaves the GPU, contents only live within a render pass
+	// Has no memory or view until BindMemory, so it can share memory with others
+	static std::unique_ptr<Texture2D> CreateTransient(Vulkan::InstanceObject& Instance,
+		VkExtent2D Dim, VkFormat Format, VkSampleCountFlagBits Samples,
+		VkImageUsageFlags Usage)
+	{
+		return std::make_unique<Texture2D>(Instance, Dim, 1, 1, Format, Samples, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_TILING_OPTIMAL,
+			Usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, 0);
+	}
+
+	// Frees the image, its view and its memory if it owns it
+	// Nothing can still be using it, the texture is left empty
+	void Destroy(Vulkan::InstanceObject& Instance);
+	void Destroy(VkDevice Device);
+
+	// Only for textures created without memory properties
+	// Memory isn't owned by the texture
+	void BindMemory(Vulkan::InstanceObject& Instance, VkDeviceMemory Memory, VkDeviceSize Offset);
+
 	// Copy from a PNG to this texture
 	// Must be linear and host visible
 	void CopyToTexture(Vulkan::InstanceObject& Instance, PNGLoader* Png);
 
 	// Copy from one Texture2D to this one
 	// Useful for copy staging to tiling buffers
+	// Both are recorded in to Instance.mSetup and happen when it gets submitted
 	void CopyFromTexture(Vulkan::InstanceObject& Instance, Texture2D *Texture);
 	void TransitionImageFormat(Vulkan::InstanceObject& Instance, VkImageLayout NewLayout);
 
+	// Barrier moving the whole image to NewLayout, for callers batching their own barriers
+	// The texture assumes it gets recorded, so tracks NewLayout from here on
+	VkImageMemoryBarrier Transition(VkImageLayout NewLayout, VkPipelineStageFlags* SrcStage, VkPipelineStageFlags* DstStage);
+
+	// Records a copy of tightly packed texels at Offset in Buffer to Level of Layer
+	// Has to be in TRANSFER_DST_OPTIMAL already
+	void CopyFromBuffer(VkCommandBuffer Cmd, VkBuffer Buffer, VkDeviceSize Offset, uint32_t Level = 0, uint32_t Layer = 0);
+
+	// Records a single copy of whole mip chains in to several layers at once
+	// Offsets[i] is where the tightly packed chain for Layers[i] starts in Buffer
+	void CopyLayersFromBuffer(VkCommandBuffer Cmd, VkBuffer Buffer,
+	                          const uint32_t* Layers, const VkDeviceSize* Offsets, uint32_t Count);
+
 	// Device objects
 	VkImage GetImage() const { return mImage; }
 	VkDeviceMemory GetMemory() const { return mMemory; }
@@ -56,27 +89,34 @@ public:
 	VkExtent2D GetDimensions() const { return mDim; }
 	uint32_t GetLevels() const { return mLevels; }
 	uint32_t GetLayers() const { return mLayers; }
+	VkImageViewType GetViewType() const { return mViewType; }
 	VkFormat GetFormat() const { return mFormat; }
 	VkSampleCountFlagBits GetSamples() const { return mSamples; }
 	VkImageLayout GetLayout() const { return mLayout; }
 	VkImageTiling GetTiling() const { return mTiling; }
 	VkFlags GetFlags() const { return mProps; }
 	VkImageUsageFlags GetUsage() const { return mUsage; }
+	const VkMemoryRequirements& GetMemoryRequirements() const { return mRequirements; }
 
 private:
+	void CreateView(Vulkan::InstanceObject& Instance);
+
 	VkExtent2D mDim;
 	uint32_t mLevels, mLayers;
 	VkFormat mFormat;
 	VkSampleCountFlagBits mSamples;
+	VkImageViewType mViewType;
 	VkImageLayout mLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	uint64_t mSetupOwner = 0; // Which thread is recording it in the setup batch
 	VkImageTiling mTiling;
 	VkFlags mProps;
 	VkImageUsageFlags mUsage;
 	uint32_t mAllocationSize;
+	VkMemoryRequirements mRequirements;
 
 	VkImage mImage;
-	VkDeviceMemory mMemory;
-	VkImageView mView;
+	VkDeviceMemory mMemory = VK_NULL_HANDLE;
+	VkImageView mView = VK_NULL_HANDLE;
 
 };
 
@@ -95,6 +135,14 @@ public:
 	// Information
 	Texture2D* GetTexture() const { return mTexture.get(); }
 
+	// Samples a different texture from here on, handing the old one back
+	// Anything that has the view, like a texture table, needs pointing at it again
+	std::unique_ptr<Texture2D> SetTexture(std::unique_ptr<Texture2D> Texture)
+	{
+		std::swap(mTexture, Texture);
+		return Texture;
+	}
+
 private:
 	std::unique_ptr<Texture2D> mTexture;
 
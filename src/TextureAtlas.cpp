@@ -0,0 +1,188 @@
+#include "Vulkan.h"
+#include "TextureAtlas.h"
+#include "PixelConvert.h"
+#include "Profiler.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+namespace Vulkan
+{
+namespace
+{
+	uint32_t AlignUp(uint32_t Value, uint32_t Alignment)
+	{
+		return (Value + Alignment - 1) & ~(Alignment - 1);
+	}
+
+	// Copies Src in to the middle of Dest, with its edge texels stretched out over the gutter
+	void Pad(const uint8_t* Src, uint32_t Width, uint32_t Height,
+	         uint8_t* Dest, uint32_t PaddedWidth, uint32_t PaddedHeight, uint32_t Gutter)
+	{
+		const uint32_t* From = (const uint32_t*)Src;
+		uint32_t* To = (uint32_t*)Dest;
+		for (uint32_t y = 0; y < PaddedHeight; ++y)
+		{
+			const uint32_t Row = std::min((uint32_t)std::max((int32_t)y - (int32_t)Gutter, 0), Height - 1);
+			const uint32_t* SrcRow = From + (size_t)Row * Width;
+			uint32_t* DestRow = To + (size_t)y * PaddedWidth;
+
+			uint32_t x = 0;
+			for (; x < Gutter; ++x)
+				DestRow[x] = SrcRow[0];
+			memcpy(DestRow + Gutter, SrcRow, Width * 4);
+			for (x = Gutter + Width; x < PaddedWidth; ++x)
+				DestRow[x] = SrcRow[Width - 1];
+		}
+	}
+}
+
+TextureAtlas::TextureAtlas(Vulkan::InstanceObject& Instance, TextureTable* Table, uint32_t Size, VkDeviceSize StagingSize)
+	: mDevice(*Instance.GetDevice())
+	, mSize(Size)
+	, mLayout(Size, GUTTER)
+	, mTable(Table)
+	, mStagingSize(StagingSize)
+{
+	VkResult err;
+	assert(Size % GUTTER == 0);
+
+	auto Texture = Texture2D::CreateGPU(Instance, VkExtent2D{Size, Size}, LEVELS, 1,
+		VK_FORMAT_B8G8R8A8_UNORM, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+	// Readable straight away, even though nothing's in it yet
+	Texture->TransitionImageFormat(Instance, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	mSampler = std::make_unique<Sampler>(Instance, std::move(Texture));
+	mTableIndex = mTable->Add(Instance, mSampler.get());
+
+	Util::CreateBuffer(Instance, mStagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&mStaging, &mStagingMemory);
+
+	void* Data;
+	err = vkMapMemory(*Instance.GetDevice(), mStagingMemory, 0, VK_WHOLE_SIZE, 0, &Data);
+	CHECK_ERR(err);
+	mMapped = (uint8_t*)Data;
+}
+
+TextureAtlas::~TextureAtlas()
+{
+	// Flush waits for its copies, so nothing can still be reading staging
+	vkUnmapMemory(mDevice, mStagingMemory);
+	vkDestroyBuffer(mDevice, mStaging, nullptr);
+	vkFreeMemory(mDevice, mStagingMemory, nullptr);
+}
+
+uint32_t TextureAtlas::Add(Vulkan::InstanceObject& Instance, const uint8_t* Data, uint32_t Width, uint32_t Height)
+{
+	PROFILE_SCOPE("TextureAtlas::Add");
+
+	// Starting on a multiple of the gutter and being a multiple of it means
+	// every level lines up with the texels of the one above
+	const uint32_t PaddedWidth = AlignUp(Width, GUTTER) + GUTTER * 2;
+	const uint32_t PaddedHeight = AlignUp(Height, GUTTER) + GUTTER * 2;
+	const VkDeviceSize Size = GetMipOffset(PaddedWidth, PaddedHeight, LEVELS);
+	if (Size > mStagingSize)
+		return ~0U;
+
+	if (mStagingUsed + Size > mStagingSize)
+		Flush(Instance);
+
+	// Packed in gutter sized units, so placements are aligned for free
+	const uint32_t Handle = mLayout.Add(PaddedWidth, PaddedHeight, mStagingUsed);
+	if (Handle == ~0U)
+		return ~0U;
+	const AtlasPacker::Rect& Rect = mLayout.GetRect(Handle);
+
+	// Mips get read back while they're made, so they're built outside of the mapping
+	static thread_local std::vector<uint8_t> Scratch;
+	Scratch.resize(Size);
+	Pad(Data, Width, Height, Scratch.data(), PaddedWidth, PaddedHeight, GUTTER);
+	GenerateMips(Scratch.data(), PaddedWidth, PaddedHeight, LEVELS);
+	memcpy(mMapped + mStagingUsed, Scratch.data(), Size);
+	mStagingUsed = AlignUp(mStagingUsed + Size, 16);
+
+	if (Handle >= mRegions.size())
+		mRegions.resize(Handle + 1);
+	mRegions[Handle] =
+	{
+		.Scale = { (float)Width / mSize, (float)Height / mSize },
+		.Offset = { (float)(Rect.X + GUTTER) / mSize, (float)(Rect.Y + GUTTER) / mSize },
+	};
+	return Handle;
+}
+
+void TextureAtlas::Remove(uint32_t Handle)
+{
+	// Its staging stays used until the next Flush, which is when it gets reset anyway
+	mLayout.Remove(Handle);
+}
+
+void TextureAtlas::Flush(Vulkan::InstanceObject& Instance)
+{
+	PROFILE_SCOPE("TextureAtlas::Flush");
+	if (mLayout.GetCopies().empty())
+	{
+		mStagingUsed = 0;
+		return;
+	}
+
+	// Every level of every texture in one copy
+	std::vector<VkBufferImageCopy> Regions;
+	for (const auto& Pending : mLayout.GetCopies())
+	{
+		for (uint32_t Level = 0; Level < LEVELS; ++Level)
+		{
+			Regions.push_back(
+			{
+				.bufferOffset = Pending.Offset + GetMipOffset(Pending.Rect.Width, Pending.Rect.Height, Level),
+				.bufferRowLength = 0, // Tightly packed
+				.bufferImageHeight = 0,
+				.imageSubresource =
+				{
+					VK_IMAGE_ASPECT_COLOR_BIT, Level, 0, 1
+				},
+				.imageOffset =
+				{
+					(int32_t)(Pending.Rect.X >> Level), (int32_t)(Pending.Rect.Y >> Level), 0
+				},
+				.imageExtent =
+				{
+					Pending.Rect.Width >> Level, Pending.Rect.Height >> Level, 1
+				},
+			});
+		}
+	}
+
+	Texture2D* Texture = mSampler->GetTexture();
+	Texture->TransitionImageFormat(Instance, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	{
+		SetupBatch::Recording Setup(Instance);
+		vkCmdCopyBufferToImage(Setup.Get(), mStaging, Texture->GetImage(),
+		                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)Regions.size(), Regions.data());
+	}
+	Texture->TransitionImageFormat(Instance, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	// Waits for the copies, so staging can be reused straight away
+	Instance.mSetup->Submit(Instance);
+
+	mLayout.ClearCopies();
+	mStagingUsed = 0;
+}
+
+void TextureAtlas::RemapUVs(uint32_t Handle, float* UVs, uint32_t Count, uint32_t Stride) const
+{
+	const Region& Placed = mRegions[Handle];
+	uint8_t* Next = (uint8_t*)UVs;
+	for (uint32_t i = 0; i < Count; ++i, Next += Stride)
+	{
+		float* UV = (float*)Next;
+		UV[0] = UV[0] * Placed.Scale[0] + Placed.Offset[0];
+		UV[1] = UV[1] * Placed.Scale[1] + Placed.Offset[1];
+	}
+}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "AtlasPacker.h"
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <vector>
+
+namespace Vulkan
+{
+class InstanceObject;
+class Sampler;
+class TextureTable;
+
+// Packs small textures in to one big one, so they share an image, an allocation and a
+// texture table slot instead of having one each
+// Every texture is surrounded by a gutter of its own edge texels and placed on a
+// multiple of the gutter, so each mip level filters only its own texels and never its
+// neighbours'. That's what limits the atlas to LEVELS levels
+// Textures can be added and removed whenever, Add only fills staging and Flush uploads
+// everything added since in one go
+class TextureAtlas
+{
+public:
+	// Mips the atlas keeps, the gutter is the size of a texel in the smallest one
+	static const uint32_t LEVELS = 4;
+	static const uint32_t GUTTER = 1U << (LEVELS - 1);
+
+	TextureAtlas(Vulkan::InstanceObject& Instance, TextureTable* Table, uint32_t Size = 2048,
+	             VkDeviceSize StagingSize = 8 * 1024 * 1024);
+	~TextureAtlas();
+
+	static std::unique_ptr<TextureAtlas> Create(Vulkan::InstanceObject& Instance, TextureTable* Table,
+		uint32_t Size = 2048, VkDeviceSize StagingSize = 8 * 1024 * 1024)
+	{
+		return std::make_unique<TextureAtlas>(Instance, Table, Size, StagingSize);
+	}
+
+	// Where a texture ended up, UVs in to it become UV * Scale + Offset
+	struct Region
+	{
+		float Scale[2];
+		float Offset[2];
+	};
+
+	// Data is BGRA8, tightly packed
+	// Returns the handle, or ~0U when there's no room left for it
+	uint32_t Add(Vulkan::InstanceObject& Instance, const uint8_t* Data, uint32_t Width, uint32_t Height);
+
+	// Its space can be reused straight away, so nothing in flight can still be drawing it
+	// Anything not flushed yet never gets uploaded
+	void Remove(uint32_t Handle);
+
+	// Records the copies for everything added since the last Flush in to the setup batch and submits it
+	void Flush(Vulkan::InstanceObject& Instance);
+
+	// Rewrites UVs in vertex data so they point at the texture's region
+	// Stride is in bytes between each UV pair
+	// UVs outside 0 to 1 would read other textures, so repeating isn't possible
+	void RemapUVs(uint32_t Handle, float* UVs, uint32_t Count, uint32_t Stride = sizeof(float) * 2) const;
+
+	// Information
+	const Region& GetRegion(uint32_t Handle) const { return mRegions[Handle]; }
+	uint32_t GetTableIndex() const { return mTableIndex; }
+	Sampler* GetSampler() const { return mSampler.get(); }
+	uint32_t GetCount() const { return mLayout.GetCount(); }
+	const AtlasPacker& GetPacker() const { return mLayout.GetPacker(); } // In GUTTER sized units
+
+private:
+	VkDevice mDevice;
+	uint32_t mSize;
+	AtlasLayout mLayout; // Rects include the gutter
+	std::vector<Region> mRegions;
+
+	std::unique_ptr<Sampler> mSampler;
+	TextureTable* mTable;
+	uint32_t mTableIndex;
+
+	VkBuffer mStaging;
+	VkDeviceMemory mStagingMemory;
+	uint8_t* mMapped;
+	VkDeviceSize mStagingSize;
+	VkDeviceSize mStagingUsed = 0;
+};
+}
@@ -0,0 +1,337 @@
+#include "TextureCache.h"
+#include "Profiler.h"
+
+#include <atomic>
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace Vulkan
+{
+namespace
+{
+	const uint32_t CACHE_MAGIC = 0x30435854; // TXC0
+	const uint32_t CACHE_VERSION = 1;
+
+	// Padded out so the pixels after it stay nicely aligned in the mapping
+	struct CacheHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint64_t Key;
+		uint32_t Width, Height;
+		uint32_t Levels;
+		uint32_t Format;
+		uint64_t Size; // Of the pixels after the header
+		uint8_t Padding[24];
+	};
+	static_assert(sizeof(CacheHeader) == 64, "Cache header needs to stay 64 bytes");
+
+	const char* CACHE_EXTENSION = ".tex";
+
+	uint64_t GetTime()
+	{
+		timespec Now;
+		clock_gettime(CLOCK_REALTIME, &Now);
+		return (uint64_t)Now.tv_sec * 1000000000ULL + Now.tv_nsec;
+	}
+
+	// xxHash64, a few GB/s so hashing a PNG costs a small fraction of decoding it
+	const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+	const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+	const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+	const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+	const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+	inline uint64_t Rotate(uint64_t Value, uint32_t Bits)
+	{
+		return (Value << Bits) | (Value >> (64 - Bits));
+	}
+
+	inline uint64_t Read64(const uint8_t* Data)
+	{
+		uint64_t Value;
+		memcpy(&Value, Data, sizeof(Value));
+		return Value;
+	}
+
+	inline uint32_t Read32(const uint8_t* Data)
+	{
+		uint32_t Value;
+		memcpy(&Value, Data, sizeof(Value));
+		return Value;
+	}
+
+	inline uint64_t Round(uint64_t Acc, uint64_t Input)
+	{
+		return Rotate(Acc + Input * PRIME2, 31) * PRIME1;
+	}
+
+	inline uint64_t Merge(uint64_t Acc, uint64_t Value)
+	{
+		return (Acc ^ Round(0, Value)) * PRIME1 + PRIME4;
+	}
+
+	uint64_t Hash64(const uint8_t* Data, size_t Size, uint64_t Seed)
+	{
+		const uint8_t* End = Data + Size;
+		uint64_t Hash;
+
+		if (Size >= 32)
+		{
+			uint64_t V1 = Seed + PRIME1 + PRIME2;
+			uint64_t V2 = Seed + PRIME2;
+			uint64_t V3 = Seed;
+			uint64_t V4 = Seed - PRIME1;
+			for (; Data + 32 <= End; Data += 32)
+			{
+				V1 = Round(V1, Read64(Data));
+				V2 = Round(V2, Read64(Data + 8));
+				V3 = Round(V3, Read64(Data + 16));
+				V4 = Round(V4, Read64(Data + 24));
+			}
+			Hash = Rotate(V1, 1) + Rotate(V2, 7) + Rotate(V3, 12) + Rotate(V4, 18);
+			Hash = Merge(Hash, V1);
+			Hash = Merge(Hash, V2);
+			Hash = Merge(Hash, V3);
+			Hash = Merge(Hash, V4);
+		}
+		else
+		{
+			Hash = Seed + PRIME5;
+		}
+
+		Hash += Size;
+		for (; Data + 8 <= End; Data += 8)
+			Hash = Rotate(Hash ^ Round(0, Read64(Data)), 27) * PRIME1 + PRIME4;
+		if (Data + 4 <= End)
+		{
+			Hash = Rotate(Hash ^ (Read32(Data) * PRIME1), 23) * PRIME2 + PRIME3;
+			Data += 4;
+		}
+		for (; Data < End; ++Data)
+			Hash = Rotate(Hash ^ (*Data * PRIME5), 11) * PRIME1;
+
+		Hash ^= Hash >> 33;
+		Hash *= PRIME2;
+		Hash ^= Hash >> 29;
+		Hash *= PRIME3;
+		Hash ^= Hash >> 32;
+		return Hash;
+	}
+}
+
+TextureCache::Entry::~Entry()
+{
+	munmap(mMapping, mMappingSize);
+}
+
+TextureCache::TextureCache(std::string Directory, uint64_t MaxSize)
+	: mDirectory(Directory)
+	, mMaxSize(MaxSize)
+{
+	PROFILE_SCOPE("TextureCache");
+
+	mkdir(mDirectory.c_str(), 0755);
+
+	DIR* Dir = opendir(mDirectory.c_str());
+	if (!Dir)
+	{
+		printf("Couldn't open texture cache '%s', nothing will be cached\n", mDirectory.c_str());
+		mMaxSize = 0;
+		return;
+	}
+
+	// Entries are named after their key, anything else in here isn't ours
+	const size_t NameLength = 16 + strlen(CACHE_EXTENSION);
+	while (dirent* File = readdir(Dir))
+	{
+		if (strlen(File->d_name) != NameLength || strcmp(File->d_name + 16, CACHE_EXTENSION))
+			continue;
+
+		struct stat Info;
+		if (stat((mDirectory + "/" + File->d_name).c_str(), &Info))
+			continue;
+
+		const uint64_t Key = strtoull(std::string(File->d_name, 16).c_str(), nullptr, 16);
+		mEntries[Key] = Record
+		{
+			.Size = (uint64_t)Info.st_size,
+			.LastUsed = (uint64_t)Info.st_mtim.tv_sec * 1000000000ULL + Info.st_mtim.tv_nsec,
+		};
+		mSize += Info.st_size;
+	}
+	closedir(Dir);
+
+	// The limit might have come down since last time
+	Evict();
+
+	printf("Texture cache '%s': %d entries, %.1fMB of %.1fMB\n", mDirectory.c_str(), GetEntries(),
+	       mSize / (1024.0 * 1024.0), mMaxSize / (1024.0 * 1024.0));
+}
+
+uint64_t TextureCache::GetKey(const uint8_t* Source, size_t Size, const Params& Conversion)
+{
+	// Bumping the version throws out everything cached by older code
+	const uint64_t Seed = ((uint64_t)CACHE_VERSION << 32) | ((uint64_t)Conversion.Format << 2) |
+	                      (Conversion.Premultiplied << 1) | Conversion.Mips;
+	return Hash64(Source, Size, Seed);
+}
+
+std::string TextureCache::GetPath(uint64_t Key) const
+{
+	char Name[32];
+	snprintf(Name, sizeof(Name), "/%016" PRIx64 "%s", Key, CACHE_EXTENSION);
+	return mDirectory + Name;
+}
+
+std::unique_ptr<TextureCache::Entry> TextureCache::Find(uint64_t Key)
+{
+	PROFILE_SCOPE("TextureCache::Find");
+
+	{
+		std::lock_guard<std::mutex> Guard(mLock);
+		if (!mEntries.count(Key))
+			return nullptr;
+	}
+
+	const std::string Path = GetPath(Key);
+	int fd = open(Path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		std::lock_guard<std::mutex> Guard(mLock);
+		Remove(Key);
+		return nullptr;
+	}
+
+	struct stat Info;
+	void* Mapping = MAP_FAILED;
+	if (!fstat(fd, &Info) && (size_t)Info.st_size >= sizeof(CacheHeader))
+		Mapping = mmap(nullptr, Info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	// Touching it is what marks it as used for the next run
+	futimens(fd, nullptr);
+	close(fd);
+
+	const CacheHeader* Header = (const CacheHeader*)Mapping;
+	if (Mapping == MAP_FAILED ||
+	    Header->Magic != CACHE_MAGIC ||
+	    Header->Version != CACHE_VERSION ||
+	    Header->Key != Key ||
+	    Header->Size != Info.st_size - sizeof(CacheHeader))
+	{
+		printf("Texture cache entry '%s' is broken, throwing it out\n", Path.c_str());
+		if (Mapping != MAP_FAILED)
+			munmap(Mapping, Info.st_size);
+
+		std::lock_guard<std::mutex> Guard(mLock);
+		Remove(Key);
+		return nullptr;
+	}
+
+	// All of it is about to get copied out
+	madvise(Mapping, Info.st_size, MADV_WILLNEED);
+
+	{
+		std::lock_guard<std::mutex> Guard(mLock);
+		auto It = mEntries.find(Key);
+		if (It != mEntries.end())
+			It->second.LastUsed = GetTime();
+	}
+
+	std::unique_ptr<Entry> Hit(new Entry());
+	Hit->Width = Header->Width;
+	Hit->Height = Header->Height;
+	Hit->Levels = Header->Levels;
+	Hit->Format = (VkFormat)Header->Format;
+	Hit->Data = (const uint8_t*)Mapping + sizeof(CacheHeader);
+	Hit->Size = Header->Size;
+	Hit->mMapping = Mapping;
+	Hit->mMappingSize = Info.st_size;
+	return Hit;
+}
+
+void TextureCache::Store(uint64_t Key, uint32_t Width, uint32_t Height, uint32_t Levels, VkFormat Format,
+                         const uint8_t* Data, uint64_t Size)
+{
+	PROFILE_SCOPE("TextureCache::Store");
+
+	const uint64_t FileSize = sizeof(CacheHeader) + Size;
+	if (FileSize > mMaxSize)
+		return;
+
+	CacheHeader Header{};
+	Header.Magic = CACHE_MAGIC;
+	Header.Version = CACHE_VERSION;
+	Header.Key = Key;
+	Header.Width = Width;
+	Header.Height = Height;
+	Header.Levels = Levels;
+	Header.Format = Format;
+	Header.Size = Size;
+
+	// Written under another name and renamed over, so nothing ever maps half an entry
+	static std::atomic<uint32_t> Writes{0};
+	const std::string Path = GetPath(Key);
+	const std::string Temporary = Path + "." + std::to_string(getpid()) + "." + std::to_string(Writes++);
+
+	FILE* fp = fopen(Temporary.c_str(), "wb");
+	bool Written = fp &&
+	               fwrite(&Header, sizeof(Header), 1, fp) == 1 &&
+	               fwrite(Data, 1, Size, fp) == Size;
+	if (fp)
+		Written = !fclose(fp) && Written;
+
+	if (!Written || rename(Temporary.c_str(), Path.c_str()))
+	{
+		printf("Couldn't write texture cache entry '%s'\n", Path.c_str());
+		unlink(Temporary.c_str());
+		return;
+	}
+
+	std::lock_guard<std::mutex> Guard(mLock);
+	auto It = mEntries.find(Key);
+	if (It != mEntries.end())
+		mSize -= It->second.Size;
+
+	mEntries[Key] = Record
+	{
+		.Size = FileSize,
+		.LastUsed = GetTime(),
+	};
+	mSize += FileSize;
+
+	// The new entry is the most recently used, so it's always the last to go
+	Evict();
+}
+
+void TextureCache::Remove(uint64_t Key)
+{
+	auto It = mEntries.find(Key);
+	if (It == mEntries.end())
+		return;
+
+	unlink(GetPath(Key).c_str());
+	mSize -= It->second.Size;
+	mEntries.erase(It);
+}
+
+void TextureCache::Evict()
+{
+	// XXX: Linear search for the oldest, fine for the few hundred entries we'd ever have
+	while (mSize > mMaxSize && !mEntries.empty())
+	{
+		auto Oldest = mEntries.begin();
+		for (auto It = mEntries.begin(); It != mEntries.end(); ++It)
+			if (It->second.LastUsed < Oldest->second.LastUsed)
+				Oldest = It;
+		Remove(Oldest->first);
+	}
+}
+}
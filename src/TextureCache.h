@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Vulkan
+{
+// On disk cache of decoded textures, ready to copy straight in to staging memory
+// Entries are keyed by a hash of the source file's contents and how it was converted,
+// so an edited file or a different conversion just misses rather than going stale
+// The directory is kept under a size limit by throwing out the least recently used entries,
+// with file modification times standing in for last use so it carries across runs
+// Safe to use from any number of threads at once
+class TextureCache
+{
+public:
+	// Everything about a texture the cached pixels depend on besides the source file
+	struct Params
+	{
+		VkFormat Format;
+		bool Premultiplied;
+		bool Mips;
+	};
+
+	// A hit, mapped in to memory until this goes away
+	class Entry
+	{
+	public:
+		~Entry();
+
+		uint32_t Width, Height, Levels;
+		VkFormat Format;
+
+		// Every level tightly packed one after the other
+		const uint8_t* Data;
+		uint64_t Size;
+
+	private:
+		friend class TextureCache;
+		Entry() {}
+
+		void* mMapping = nullptr;
+		size_t mMappingSize = 0;
+	};
+
+	TextureCache(std::string Directory, uint64_t MaxSize = 256 * 1024 * 1024);
+
+	static std::unique_ptr<TextureCache> Create(std::string Directory, uint64_t MaxSize = 256 * 1024 * 1024)
+	{
+		return std::make_unique<TextureCache>(Directory, MaxSize);
+	}
+
+	static uint64_t GetKey(const uint8_t* Source, size_t Size, const Params& Conversion);
+
+	// Returns nullptr on a miss, broken entries get thrown out and miss too
+	std::unique_ptr<Entry> Find(uint64_t Key);
+
+	// Writes the entry out, evicting old ones to make room
+	// Anything bigger than the whole cache isn't kept
+	void Store(uint64_t Key, uint32_t Width, uint32_t Height, uint32_t Levels, VkFormat Format,
+	           const uint8_t* Data, uint64_t Size);
+
+	// Information
+	uint64_t GetSize() const { return mSize; }
+	uint64_t GetMaxSize() const { return mMaxSize; }
+	uint32_t GetEntries() const { return mEntries.size(); }
+
+private:
+	struct Record
+	{
+		uint64_t Size;     // Of the whole file
+		uint64_t LastUsed; // Nanoseconds, same clock as file times
+	};
+
+	std::string GetPath(uint64_t Key) const;
+	void Remove(uint64_t Key);
+	void Evict();
+
+	std::string mDirectory;
+	uint64_t mMaxSize;
+
+	std::mutex mLock;
+	std::unordered_map<uint64_t, Record> mEntries;
+	uint64_t mSize = 0;
+};
+}
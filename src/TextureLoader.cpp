@@ -0,0 +1,395 @@
+#include "Vulkan.h"
+#include "TextureLoader.h"
+#include "PNGLoader.h"
+#include "PixelConvert.h"
+#include "Profiler.h"
+#include "Utils.h"
+
+#include <assert.h>
+#include <chrono>
+#include <deque>
+#include <stdio.h>
+#include <string.h>
+
+namespace Vulkan
+{
+namespace
+{
+	// PNGs always decode to this, what the cache gets keyed on has to match
+	const VkFormat TEXTURE_FORMAT = VK_FORMAT_B8G8R8A8_UNORM;
+	const TextureCache::Params CACHE_PARAMS =
+	{
+		.Format = TEXTURE_FORMAT,
+		.Premultiplied = false,
+		.Mips = true,
+	};
+}
+
+TextureBatchLoader::TextureBatchLoader(Vulkan::InstanceObject& Instance, JobSystem* Jobs,
+                                       VkDeviceSize StagingSize, uint32_t Slots)
+	: mDevice(*Instance.GetDevice())
+	, mJobs(Jobs)
+{
+	VkResult err;
+
+	if (!Slots)
+		Slots = mJobs->GetThreads() * 2;
+
+	// Copy offsets have to be a multiple of the texel size, keep them nicely aligned
+	mSlotSize = (StagingSize / Slots) & ~255ULL;
+	assert(mSlotSize);
+
+	mSlots.resize(Slots);
+	for (uint32_t i = 0; i < Slots; ++i)
+	{
+		mSlots[i] = std::make_unique<Slot>();
+		mSlots[i]->Offset = i * mSlotSize;
+	}
+
+	// Stays mapped for the life of the loader, decodes only ever write to it
+	Util::CreateBuffer(Instance, mSlotSize * Slots, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&mStaging, &mStagingMemory);
+
+	void* Data;
+	err = vkMapMemory(*Instance.GetDevice(), mStagingMemory, 0, VK_WHOLE_SIZE, 0, &Data);
+	CHECK_ERR(err);
+	mMapped = (uint8_t*)Data;
+
+	mRing = UploadRing::Create(Instance);
+}
+
+TextureBatchLoader::~TextureBatchLoader()
+{
+	// Loads wait for everything they submit, this only matters if one never finished
+	// The ring waits on its fences as it goes, so nothing is still copying out of staging
+	mRing.reset();
+
+	for (auto& Current : mSlots)
+	{
+		if (Current->Dedicated == VK_NULL_HANDLE)
+			continue;
+		vkDestroyBuffer(mDevice, Current->Dedicated, nullptr);
+		vkFreeMemory(mDevice, Current->DedicatedMemory, nullptr);
+	}
+
+	vkUnmapMemory(mDevice, mStagingMemory);
+	vkDestroyBuffer(mDevice, mStaging, nullptr);
+	vkFreeMemory(mDevice, mStagingMemory, nullptr);
+}
+
+uint8_t* TextureBatchLoader::MapStaging(Vulkan::InstanceObject& Instance, Slot& Current)
+{
+	if (Current.Size <= mSlotSize)
+		return mMapped + Current.Offset;
+
+	Util::CreateBuffer(Instance, Current.Size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&Current.Dedicated, &Current.DedicatedMemory);
+
+	void* Data;
+	VkResult err;
+	err = vkMapMemory(*Instance.GetDevice(), Current.DedicatedMemory, 0, VK_WHOLE_SIZE, 0, &Data);
+	CHECK_ERR(err);
+	return (uint8_t*)Data;
+}
+
+void TextureBatchLoader::UnmapStaging(Vulkan::InstanceObject& Instance, Slot& Current)
+{
+	if (Current.Dedicated != VK_NULL_HANDLE)
+		vkUnmapMemory(*Instance.GetDevice(), Current.DedicatedMemory);
+}
+
+void TextureBatchLoader::Decode(Vulkan::InstanceObject& Instance, Slot& Current, const std::string& File)
+{
+	Current.Loaded = false;
+	Current.Cached = false;
+
+	// Packed textures are already decoded with their mips, the pages should be on their way in too
+	const AssetPack::Asset* Packed = mPack ? mPack->Find(File) : nullptr;
+	if (Packed && Packed->Type == AssetPack::AssetType::Texture && Packed->Format == TEXTURE_FORMAT &&
+	    Packed->Size == GetMipOffset(Packed->Width, Packed->Height, Packed->Levels))
+	{
+		Current.Width = Packed->Width;
+		Current.Height = Packed->Height;
+		Current.Levels = Packed->Levels;
+		Current.Size = Packed->Size;
+
+		memcpy(MapStaging(Instance, Current), Packed->Data, Current.Size);
+		UnmapStaging(Instance, Current);
+		mPack->Release(*Packed);
+
+		Current.Loaded = true;
+		Current.Cached = true;
+		return;
+	}
+
+	PNGLoader Png(File);
+
+	Current.Width = Png.GetWidth();
+	Current.Height = Png.GetHeight();
+	Current.Levels = GetMipLevels(Current.Width, Current.Height);
+	Current.Size = GetMipOffset(Current.Width, Current.Height, Current.Levels);
+
+	if (!Png.GetDecodedSize())
+		return;
+
+	// Hashing the file is a lot cheaper than decoding it
+	uint64_t Key = 0;
+	std::unique_ptr<TextureCache::Entry> Hit;
+	if (mCache)
+	{
+		const auto& Source = Png.GetFile();
+		Key = TextureCache::GetKey(Source.data(), Source.size(), CACHE_PARAMS);
+		Hit = mCache->Find(Key);
+
+		// Should never happen unless the hash collides
+		if (Hit && (Hit->Width != Current.Width || Hit->Height != Current.Height ||
+		            Hit->Levels != Current.Levels || Hit->Format != TEXTURE_FORMAT ||
+		            Hit->Size != Current.Size))
+			Hit.reset();
+	}
+
+	uint8_t* Dest = MapStaging(Instance, Current);
+	if (Hit)
+	{
+		// XXX: Could import the mapping as the staging buffer with VK_EXT_external_memory_host and skip the copy
+		memcpy(Dest, Hit->Data, Current.Size);
+		Current.Loaded = true;
+		Current.Cached = true;
+	}
+	else
+	{
+		// Building mips reads back every level, which is slow from write-combined staging memory,
+		// so the chain is put together on the side and copied over in one go
+		thread_local std::vector<uint8_t> Scratch;
+		Scratch.resize(Current.Size);
+
+		// Tightly packed, which is what the buffer to image copy expects
+		Current.Loaded = Png.Decode(Scratch.data(), Current.Width * 4);
+		if (Current.Loaded)
+		{
+			GenerateMips(Scratch.data(), Current.Width, Current.Height, Current.Levels);
+			memcpy(Dest, Scratch.data(), Current.Size);
+
+			if (mCache)
+				mCache->Store(Key, Current.Width, Current.Height, Current.Levels, TEXTURE_FORMAT,
+				              Scratch.data(), Current.Size);
+		}
+	}
+	UnmapStaging(Instance, Current);
+}
+
+void TextureBatchLoader::Retire(Vulkan::InstanceObject& Instance, uint32_t Batch, std::vector<uint32_t>* Free)
+{
+	if (!mRing->Finish(Batch))
+		return;
+
+	for (uint32_t Index : mBatchSlots[Batch])
+	{
+		Slot& Used = *mSlots[Index];
+		if (Used.Dedicated != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(*Instance.GetDevice(), Used.Dedicated, nullptr);
+			vkFreeMemory(*Instance.GetDevice(), Used.DedicatedMemory, nullptr);
+			Used.Dedicated = VK_NULL_HANDLE;
+			Used.DedicatedMemory = VK_NULL_HANDLE;
+		}
+		Free->push_back(Index);
+	}
+
+	mBatchSlots[Batch].clear();
+}
+
+void TextureBatchLoader::Record(Vulkan::InstanceObject& Instance,
+                                std::vector<std::unique_ptr<Texture2D>>* Textures, Texture2D* Array)
+{
+	const std::vector<uint32_t>& Slots = mBatchSlots[mRing->GetCurrent()];
+	VkCommandBuffer Cmd = mRing->Begin();
+
+	std::vector<Texture2D*> Uploading;
+	if (Array)
+		Uploading.push_back(Array);
+
+	for (uint32_t Index : Slots)
+	{
+		const Slot& Ready = *mSlots[Index];
+		if (!Ready.Loaded || Array)
+			continue;
+
+		VkExtent2D Dim { Ready.Width, Ready.Height };
+		auto& Texture = (*Textures)[Ready.File];
+		Texture = Texture2D::CreateGPU(Instance, Dim, Ready.Levels, 1,
+			TEXTURE_FORMAT, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+		Uploading.push_back(Texture.get());
+	}
+
+	Util::TransitionAll(Cmd, Uploading, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+	// Layers out of the shared staging all go in one copy, ones too big for a slot copy on their own
+	std::vector<uint32_t> Layers;
+	std::vector<VkDeviceSize> Offsets;
+	for (uint32_t Index : Slots)
+	{
+		const Slot& Ready = *mSlots[Index];
+		if (!Ready.Loaded || !Array)
+			continue;
+
+		if (Ready.Dedicated != VK_NULL_HANDLE)
+		{
+			const VkDeviceSize Start = 0;
+			Array->CopyLayersFromBuffer(Cmd, Ready.Dedicated, &Ready.File, &Start, 1);
+			continue;
+		}
+		Layers.push_back(Ready.File);
+		Offsets.push_back(Ready.Offset);
+	}
+	if (Array)
+		Array->CopyLayersFromBuffer(Cmd, mStaging, Layers.data(), Offsets.data(), (uint32_t)Layers.size());
+
+	for (uint32_t Index : Slots)
+	{
+		const Slot& Ready = *mSlots[Index];
+		if (!Ready.Loaded || Array)
+			continue;
+
+		VkBuffer Source = Ready.Dedicated != VK_NULL_HANDLE ? Ready.Dedicated : mStaging;
+		VkDeviceSize Offset = Ready.Dedicated != VK_NULL_HANDLE ? 0 : Ready.Offset;
+		for (uint32_t Level = 0; Level < Ready.Levels; ++Level)
+			(*Textures)[Ready.File]->CopyFromBuffer(Cmd, Source,
+				Offset + GetMipOffset(Ready.Width, Ready.Height, Level), Level);
+	}
+
+	Util::TransitionAll(Cmd, Uploading, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	mRing->Submit(Instance);
+}
+
+std::vector<std::unique_ptr<Texture2D>> TextureBatchLoader::Load(Vulkan::InstanceObject& Instance, const std::vector<std::string>& Files)
+{
+	PROFILE_SCOPE("TextureBatchLoader::Load");
+	std::vector<std::unique_ptr<Texture2D>> Textures(Files.size());
+	LoadFiles(Instance, Files, &Textures, nullptr);
+	return Textures;
+}
+
+std::unique_ptr<Texture2D> TextureBatchLoader::LoadArray(Vulkan::InstanceObject& Instance, const std::vector<std::string>& Files,
+                                                         VkExtent2D Dim)
+{
+	PROFILE_SCOPE("TextureBatchLoader::LoadArray");
+	auto Array = Texture2D::CreateGPU(Instance, Dim, GetMipLevels(Dim.width, Dim.height), Files.size(),
+		TEXTURE_FORMAT, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+	LoadFiles(Instance, Files, nullptr, Array.get());
+
+	// Every layer failing would still leave it in UNDEFINED
+	if (Array->GetLayout() != VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	{
+		Array->TransitionImageFormat(Instance, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		Instance.mSetup->Submit(Instance);
+	}
+	return Array;
+}
+
+void TextureBatchLoader::LoadFiles(Vulkan::InstanceObject& Instance, const std::vector<std::string>& Files,
+                                   std::vector<std::unique_ptr<Texture2D>>* Textures, Texture2D* Array)
+{
+	auto Start = std::chrono::high_resolution_clock::now();
+
+	std::vector<uint32_t> Free;
+	for (uint32_t i = 0; i < mSlots.size(); ++i)
+		Free.push_back(i);
+
+	// Slots in the order their decodes were started
+	std::deque<uint32_t> Decoding;
+
+	// Packed files get read in a few slots ahead of being decoded
+	auto Prefetch = [&](uint32_t File)
+	{
+		if (!mPack || File >= Files.size())
+			return;
+		if (const AssetPack::Asset* Packed = mPack->Find(Files[File]))
+			mPack->Prefetch(*Packed);
+	};
+	for (uint32_t i = 0; i < mSlots.size(); ++i)
+		Prefetch(i);
+
+	uint32_t Next = 0;
+	uint32_t Batches = 0;
+	uint32_t Loaded = 0;
+	uint32_t Cached = 0;
+	VkDeviceSize Bytes = 0;
+
+	while (Next < Files.size() || !Decoding.empty())
+	{
+		// The batch about to be recorded has to be done with its slots first
+		const uint32_t Current = mRing->GetCurrent();
+		Retire(Instance, Current, &Free);
+
+		// Everything is either copying or waiting on a copy, nothing to overlap with
+		if (Free.empty() && Decoding.empty())
+			Retire(Instance, (Current + 1) % UploadRing::COUNT, &Free);
+
+		// Keep every free slot decoding
+		while (Next < Files.size() && !Free.empty())
+		{
+			uint32_t Index = Free.back();
+			Free.pop_back();
+
+			Slot* Target = mSlots[Index].get();
+			Target->File = Next;
+			const std::string& File = Files[Next];
+			mJobs->Run([this, &Instance, Target, &File]() { Decode(Instance, *Target, File); }, &Target->Decoded);
+
+			Decoding.push_back(Index);
+			Prefetch(Next + mSlots.size());
+			++Next;
+		}
+
+		// Oldest first keeps things in order, anything else done by then goes in the same batch
+		mJobs->Wait(&mSlots[Decoding.front()]->Decoded);
+		while (!Decoding.empty() && mSlots[Decoding.front()]->Decoded.Done())
+		{
+			Slot& Ready = *mSlots[Decoding.front()];
+			if (Ready.Loaded && Array)
+			{
+				const VkExtent2D Dim = Array->GetDimensions();
+				if (Ready.Width != Dim.width || Ready.Height != Dim.height || Ready.Levels != Array->GetLevels())
+				{
+					printf("'%s' is %dx%d, it can't go in a %dx%d array\n", Files[Ready.File].c_str(),
+					       Ready.Width, Ready.Height, Dim.width, Dim.height);
+					Ready.Loaded = false;
+				}
+			}
+
+			if (Ready.Loaded)
+			{
+				++Loaded;
+				Cached += Ready.Cached;
+				Bytes += Ready.Size;
+			}
+			else
+			{
+				printf("Failed to load texture '%s'\n", Files[Ready.File].c_str());
+			}
+
+			mBatchSlots[Current].push_back(Decoding.front());
+			Decoding.pop_front();
+		}
+
+		Record(Instance, Textures, Array);
+		++Batches;
+	}
+
+	for (uint32_t i = 0; i < UploadRing::COUNT; ++i)
+		Retire(Instance, i, &Free);
+
+	double MS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+	printf("Loaded %d/%d %s (%d without decoding), %.1fMB in %.2fms (%.1fMB/s), %d batches over %d slots\n",
+	       Loaded, (uint32_t)Files.size(), Array ? "array layers" : "textures", Cached, Bytes / (1024.0 * 1024.0), MS,
+	       Bytes / (1024.0 * 1024.0) / (MS / 1000.0), Batches, (uint32_t)mSlots.size());
+}
+
+}
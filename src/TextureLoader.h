@@ -0,0 +1,110 @@
+#pragma once
+
+#include "AssetPack.h"
+#include "JobSystem.h"
+#include "TextureCache.h"
+#include "UploadRing.h"
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Vulkan
+{
+class InstanceObject;
+class Texture2D;
+
+// Loads a list of PNGs in to GPU textures
+// Files get decoded across the job system straight in to slots of one persistently
+// mapped staging buffer. The calling thread is the only upload stage, taking
+// finished slots in order and copying every one that's ready in a single submit.
+// The slots are the bounded queue between the two, so decoding stalls rather than
+// running ahead of the GPU, and the next images decode while the last batch copies
+// Every texture gets a full mip chain, and with a cache set decoded chains are kept
+// on disk so the next run only has to copy them
+// Files found in the asset pack skip decoding entirely and are copied out of its mapping
+class TextureBatchLoader
+{
+public:
+	// Slots of 0 means two per thread, so every thread has one decoding while another is uploading
+	TextureBatchLoader(Vulkan::InstanceObject& Instance, JobSystem* Jobs,
+	                   VkDeviceSize StagingSize = 64 * 1024 * 1024, uint32_t Slots = 0);
+	~TextureBatchLoader();
+
+	static std::unique_ptr<TextureBatchLoader> Create(Vulkan::InstanceObject& Instance, JobSystem* Jobs,
+		VkDeviceSize StagingSize = 64 * 1024 * 1024, uint32_t Slots = 0)
+	{
+		return std::make_unique<TextureBatchLoader>(Instance, Jobs, StagingSize, Slots);
+	}
+
+	// Returns the textures in the same order as Files, ready to sample in SHADER_READ_ONLY_OPTIMAL
+	// Files that fail to load come back null
+	// Only one thread can be loading at a time, and nothing else can be submitting to the queue
+	std::vector<std::unique_ptr<Texture2D>> Load(Vulkan::InstanceObject& Instance, const std::vector<std::string>& Files);
+
+	// Same again, but every file goes in to a layer of one texture array, in the same order as Files
+	// They all have to be Dim, files that aren't or fail to load leave their layer undefined
+	std::unique_ptr<Texture2D> LoadArray(Vulkan::InstanceObject& Instance, const std::vector<std::string>& Files,
+	                                     VkExtent2D Dim);
+
+	// Neither are owned, and both can be shared between loaders
+	void SetCache(TextureCache* Cache) { mCache = Cache; }
+	void SetPack(const AssetPack* Pack) { mPack = Pack; }
+
+	// Information
+	uint32_t GetSlots() const { return mSlots.size(); }
+	VkDeviceSize GetSlotSize() const { return mSlotSize; }
+
+private:
+	struct Slot
+	{
+		VkDeviceSize Offset; // In to mStaging
+
+		// Filled in by the decode job
+		uint32_t File;
+		uint32_t Width, Height;
+		uint32_t Levels;
+		VkDeviceSize Size; // Of the whole mip chain
+		bool Loaded;
+		bool Cached; // Copied out of the cache or pack rather than decoded
+
+		// Images too big for a slot get a buffer of their own, freed once copied
+		VkBuffer Dedicated = VK_NULL_HANDLE;
+		VkDeviceMemory DedicatedMemory = VK_NULL_HANDLE;
+
+		JobCounter Decoded;
+	};
+
+	void Decode(Vulkan::InstanceObject& Instance, Slot& Current, const std::string& File);
+
+	// Where Current's mip chain goes, its own buffer if it doesn't fit in the slot
+	uint8_t* MapStaging(Vulkan::InstanceObject& Instance, Slot& Current);
+	void UnmapStaging(Vulkan::InstanceObject& Instance, Slot& Current);
+
+	// Waits for the ring entry's copies then hands its slots back
+	void Retire(Vulkan::InstanceObject& Instance, uint32_t Batch, std::vector<uint32_t>* Free);
+
+	// Uploads the current ring entry's slots in to new textures in Textures, or layers of Array when there is one
+	void Record(Vulkan::InstanceObject& Instance, std::vector<std::unique_ptr<Texture2D>>* Textures, Texture2D* Array);
+
+	void LoadFiles(Vulkan::InstanceObject& Instance, const std::vector<std::string>& Files,
+	               std::vector<std::unique_ptr<Texture2D>>* Textures, Texture2D* Array);
+
+	VkDevice mDevice;
+	JobSystem* mJobs;
+	TextureCache* mCache = nullptr;
+	const AssetPack* mPack = nullptr;
+
+	VkBuffer mStaging;
+	VkDeviceMemory mStagingMemory;
+	uint8_t* mMapped;
+	VkDeviceSize mSlotSize;
+
+	std::vector<std::unique_ptr<Slot>> mSlots;
+
+	// Slots each ring entry is copying out of
+	std::unique_ptr<UploadRing> mRing;
+	std::vector<uint32_t> mBatchSlots[UploadRing::COUNT];
+};
+}
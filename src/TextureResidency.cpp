@@ -0,0 +1,218 @@
+#include "TextureResidency.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+namespace Vulkan
+{
+
+TextureResidency::TextureResidency(uint64_t Budget, uint64_t UploadLimit, uint32_t TailSize)
+	: mBudget(Budget)
+	, mUploadLimit(UploadLimit)
+	, mTailSize(TailSize)
+{
+}
+
+uint32_t TextureResidency::Add(uint32_t Width, uint32_t Height, uint32_t Levels)
+{
+	assert(Levels);
+
+	Texture New{};
+	New.Width = Width;
+	New.Height = Height;
+	New.Levels = Levels;
+	New.Resident = Levels;
+	New.Wanted = Levels;
+
+	New.Tail = 0;
+	while (New.Tail + 1 < Levels && std::max(Width >> New.Tail, Height >> New.Tail) > mTailSize)
+		++New.Tail;
+
+	mTextures.push_back(New);
+	mAdded.push_back(mTextures.size() - 1);
+	return mTextures.size() - 1;
+}
+
+void TextureResidency::Request(uint32_t Handle, float ScreenSize)
+{
+	Texture& Requested = mTextures[Handle];
+
+	// One level down for every halving of the texels per screen pixel
+	uint32_t Level = Requested.Tail;
+	if (ScreenSize > 0.0f)
+	{
+		const float Ratio = std::max(Requested.Width, Requested.Height) / ScreenSize;
+		Level = Ratio <= 1.0f ? 0 : std::min((uint32_t)log2f(Ratio), Requested.Tail);
+	}
+
+	// First request this frame
+	if (Requested.LastRequested != mFrame + 1)
+	{
+		mRequested.push_back(Handle);
+		Requested.Wanted = Level;
+		Requested.Priority = ScreenSize;
+	}
+	else
+	{
+		Requested.Wanted = std::min(Requested.Wanted, Level);
+		Requested.Priority = std::max(Requested.Priority, ScreenSize);
+	}
+	Requested.LastRequested = mFrame + 1;
+}
+
+uint64_t TextureResidency::GetSize(uint32_t Handle, uint32_t Level) const
+{
+	// XXX: Assumes four bytes a texel, which is all we stream for now
+	const Texture& Sized = mTextures[Handle];
+	uint64_t Size = 0;
+	for (uint32_t i = Level; i < Sized.Levels; ++i)
+		Size += (uint64_t)std::max(Sized.Width >> i, 1U) * std::max(Sized.Height >> i, 1U) * 4;
+	return Size;
+}
+
+void TextureResidency::SetResident(uint32_t Handle, uint32_t Resident)
+{
+	Texture& Changed = mTextures[Handle];
+	Changed.Resident = Resident;
+
+	if (Changed.Change < 0)
+	{
+		Changed.Change = mChanges.size();
+		mChanges.push_back({Handle, Resident});
+	}
+	else
+	{
+		mChanges[Changed.Change].Resident = Resident;
+	}
+}
+
+void TextureResidency::BuildVictims()
+{
+	if (mVictimsBuilt)
+		return;
+
+	// Anything used this frame is off limits
+	mVictims.clear();
+	mEvictable = 0;
+	for (uint32_t i = 0; i < mTextures.size(); ++i)
+	{
+		if (mTextures[i].LastRequested != mFrame + 1 && mTextures[i].Resident < mTextures[i].Tail)
+		{
+			mVictims.push_back(i);
+			mEvictable += GetSize(i, mTextures[i].Resident) - GetSize(i, mTextures[i].Tail);
+		}
+	}
+
+	std::sort(mVictims.begin(), mVictims.end(), [this](uint32_t A, uint32_t B)
+	{
+		return mTextures[A].LastRequested < mTextures[B].LastRequested;
+	});
+	mNextVictim = 0;
+	mVictimsBuilt = true;
+}
+
+uint64_t TextureResidency::GetEvictable()
+{
+	BuildVictims();
+	return mEvictable;
+}
+
+bool TextureResidency::MakeRoom(uint64_t Bytes)
+{
+	while (mCommitted + Bytes > mBudget)
+	{
+		BuildVictims();
+
+		while (mNextVictim < mVictims.size() &&
+		       mTextures[mVictims[mNextVictim]].Resident >= mTextures[mVictims[mNextVictim]].Tail)
+			++mNextVictim;
+		if (mNextVictim == mVictims.size())
+			return false;
+
+		// A level at a time, so the oldest texture gets blurrier before anything else loses out
+		const uint32_t Victim = mVictims[mNextVictim];
+		const uint32_t Resident = mTextures[Victim].Resident;
+		const uint64_t Freed = GetSize(Victim, Resident) - GetSize(Victim, Resident + 1);
+		mCommitted -= Freed;
+		mEvictable -= Freed;
+		SetResident(Victim, Resident + 1);
+		++mStats.Evictions;
+	}
+	return true;
+}
+
+const std::vector<TextureResidency::Change>& TextureResidency::Update()
+{
+	for (const Change& Last : mChanges)
+		mTextures[Last.Handle].Change = -1;
+	mChanges.clear();
+	mVictimsBuilt = false;
+	mStats = {};
+
+	uint64_t Uploaded = 0;
+
+	// New textures can't be sampled at all until their tail is in, so they go first
+	// Tails don't count against the budget, they're what's left after evicting everything else
+	size_t Added = 0;
+	for (; Added < mAdded.size(); ++Added)
+	{
+		const uint32_t Handle = mAdded[Added];
+		const uint64_t Size = GetSize(Handle, mTextures[Handle].Tail);
+		if (Uploaded && Uploaded + Size > mUploadLimit)
+			break;
+
+		MakeRoom(Size);
+		mCommitted += Size;
+		SetResident(Handle, mTextures[Handle].Tail);
+		Uploaded += Size;
+	}
+	mAdded.erase(mAdded.begin(), mAdded.begin() + Added);
+
+	// Biggest on screen first
+	std::sort(mRequested.begin(), mRequested.end(), [this](uint32_t A, uint32_t B)
+	{
+		return mTextures[A].Priority > mTextures[B].Priority;
+	});
+
+	for (uint32_t Handle : mRequested)
+	{
+		Texture& Requested = mTextures[Handle];
+		if (Requested.Resident == Requested.Levels || Requested.Wanted >= Requested.Resident)
+			continue;
+
+		// A new image means uploading the whole chain, not just the new levels
+		// Settle for something blurrier if the sharpest doesn't fit this frame
+		// Picked before evicting anything, so only the level it ends up with costs anyone else
+		const uint64_t Current = GetSize(Handle, Requested.Resident);
+		const uint64_t Available = mBudget + GetEvictable();
+		uint32_t Level = Requested.Wanted;
+		for (; Level < Requested.Resident; ++Level)
+		{
+			const uint64_t Size = GetSize(Handle, Level);
+			if (Uploaded + Size <= mUploadLimit && mCommitted + Size - Current <= Available)
+				break;
+		}
+
+		if (Level != Requested.Wanted)
+			++mStats.Deferred;
+		if (Level == Requested.Resident)
+			continue;
+
+		const uint64_t Size = GetSize(Handle, Level);
+		const bool Fits = MakeRoom(Size - Current);
+		assert(Fits);
+		(void)Fits;
+		mCommitted += Size - Current;
+		SetResident(Handle, Level);
+		Uploaded += Size;
+		++mStats.Upgrades;
+	}
+
+	mStats.Uploaded = Uploaded;
+	mRequested.clear();
+	++mFrame;
+	return mChanges;
+}
+
+}
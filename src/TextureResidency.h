@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Vulkan
+{
+// Decides which mips of each streamed texture should be on the GPU
+// Only the policy lives here, TextureStreamer does the uploads it asks for
+//
+// Residency is the first level a texture has on the GPU, it always holds every level from
+// there down. The mip tail, levels no bigger than TailSize, is always resident. Textures get
+// requested each frame with how big they are on screen, and anything not requested for a
+// while gives up its top levels one at a time, oldest first, to make room under the budget
+class TextureResidency
+{
+public:
+	// UploadLimit caps the bytes Update asks to be uploaded each frame
+	TextureResidency(uint64_t Budget, uint64_t UploadLimit = 16 * 1024 * 1024, uint32_t TailSize = 64);
+
+	// Starts with nothing resident, the tail gets asked for by the next Update
+	uint32_t Add(uint32_t Width, uint32_t Height, uint32_t Levels);
+
+	// ScreenSize is the most pixels the texture covers on screen along either axis this frame
+	void Request(uint32_t Handle, float ScreenSize);
+
+	struct Change
+	{
+		uint32_t Handle;
+		uint32_t Resident; // New first resident level
+	};
+
+	// Call once a frame after the requests, returns the textures that need a new image
+	// Sharper mips for bigger requests come first, a texture only shows up once
+	const std::vector<Change>& Update();
+
+	// Bytes of the level chain from Level down to 1x1
+	uint64_t GetSize(uint32_t Handle, uint32_t Level) const;
+
+	// Information
+	uint32_t GetResident(uint32_t Handle) const { return mTextures[Handle].Resident; }
+	uint32_t GetTail(uint32_t Handle) const { return mTextures[Handle].Tail; }
+	uint32_t GetLevels(uint32_t Handle) const { return mTextures[Handle].Levels; }
+	uint64_t GetCommitted() const { return mCommitted; }
+	uint64_t GetBudget() const { return mBudget; }
+	uint64_t GetFrame() const { return mFrame; }
+
+	struct Stats
+	{
+		uint32_t Upgrades;
+		uint32_t Evictions; // In levels
+		uint32_t Deferred;  // Requests that didn't fit this frame
+		uint64_t Uploaded;
+	};
+	const Stats& GetStats() const { return mStats; }
+
+private:
+	struct Texture
+	{
+		uint32_t Width, Height, Levels;
+		uint32_t Tail;
+		uint32_t Resident;      // Levels when nothing is resident yet
+		uint32_t Wanted;
+		float Priority;         // Biggest screen size requested this frame
+		uint64_t LastRequested; // Frame + 1, 0 for never
+		int32_t Change = -1;    // In to mChanges this frame
+	};
+
+	void SetResident(uint32_t Handle, uint32_t Resident);
+
+	void BuildVictims();
+
+	// Bytes MakeRoom could still free this frame
+	uint64_t GetEvictable();
+
+	// Evicts the least recently used levels until Bytes more fit, false if it can't
+	bool MakeRoom(uint64_t Bytes);
+
+	uint64_t mBudget;
+	uint64_t mUploadLimit;
+	uint32_t mTailSize;
+
+	uint64_t mFrame = 0;
+	uint64_t mCommitted = 0;
+
+	std::vector<Texture> mTextures;
+	std::vector<uint32_t> mRequested;
+	std::vector<uint32_t> mAdded;
+	std::vector<Change> mChanges;
+
+	// Eviction candidates oldest first, built the first time a frame needs one
+	std::vector<uint32_t> mVictims;
+	size_t mNextVictim = 0;
+	uint64_t mEvictable = 0;
+	bool mVictimsBuilt = false;
+
+	Stats mStats{};
+};
+}
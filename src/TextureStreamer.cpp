@@ -0,0 +1,212 @@
+#include "Vulkan.h"
+#include "TextureStreamer.h"
+#include "PixelConvert.h"
+#include "Profiler.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+namespace Vulkan
+{
+
+TextureStreamer::TextureStreamer(Vulkan::InstanceObject& Instance, TextureTable* Table, JobSystem* Jobs,
+                                 VkDeviceSize Budget, VkDeviceSize UploadLimit)
+	: mDevice(*Instance.GetDevice())
+	, mTable(Table)
+	, mJobs(Jobs)
+	, mResidency(Budget, UploadLimit)
+	, mUploadLimit(UploadLimit)
+{
+	VkResult err;
+
+	Util::CreateBuffer(Instance, mUploadLimit * UploadRing::COUNT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&mStaging, &mStagingMemory);
+
+	void* Data;
+	err = vkMapMemory(*Instance.GetDevice(), mStagingMemory, 0, VK_WHOLE_SIZE, 0, &Data);
+	CHECK_ERR(err);
+	mMapped = (uint8_t*)Data;
+
+	mRing = UploadRing::Create(Instance);
+	for (uint32_t i = 0; i < UploadRing::COUNT; ++i)
+		mBatches[i].Offset = i * mUploadLimit;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// Whatever is still copying has to finish before its images and staging go
+	// Frames sampling the rest have to have been waited on by whoever owns us
+	mRing.reset();
+
+	for (auto& Remaining : mBatches)
+		for (auto& Pending : Remaining.Uploads)
+			Pending.Texture->Destroy(mDevice);
+
+	for (auto& Old : mRetired)
+		Old.Texture->Destroy(mDevice);
+
+	for (auto& Texture : mTextures)
+		if (Texture.Current)
+			Texture.Current->GetTexture()->Destroy(mDevice);
+
+	vkUnmapMemory(mDevice, mStagingMemory);
+	vkDestroyBuffer(mDevice, mStaging, nullptr);
+	vkFreeMemory(mDevice, mStagingMemory, nullptr);
+}
+
+uint32_t TextureStreamer::Add(const uint8_t* Data, uint32_t Width, uint32_t Height, uint32_t Levels)
+{
+	Streamed New;
+	New.Data = Data;
+	New.Width = Width;
+	New.Height = Height;
+	New.Levels = Levels;
+	mTextures.push_back(std::move(New));
+
+	uint32_t Handle = mResidency.Add(Width, Height, Levels);
+	assert(Handle == mTextures.size() - 1);
+	return Handle;
+}
+
+void TextureStreamer::Retire(Vulkan::InstanceObject& Instance, uint32_t Index)
+{
+	mRing->Finish(Index);
+
+	Batch& Current = mBatches[Index];
+	for (auto& Done : Current.Uploads)
+	{
+		Streamed& Texture = mTextures[Done.Handle];
+		if (!Texture.Current)
+		{
+			Texture.Current = std::make_unique<Sampler>(Instance, std::move(Done.Texture));
+			Texture.TableIndex = mTable->Add(Instance, Texture.Current.get());
+			continue;
+		}
+
+		mRetired.push_back({Texture.Current->SetTexture(std::move(Done.Texture)), mFrame});
+		mTable->Replace(Instance, Texture.TableIndex, Texture.Current.get());
+	}
+
+	Current.Uploads.clear();
+}
+
+void TextureStreamer::Record(Vulkan::InstanceObject& Instance, const std::vector<TextureResidency::Change>& Changes)
+{
+	PROFILE_SCOPE("TextureStreamer::Record");
+	Batch& Current = mBatches[mRing->GetCurrent()];
+
+	// Staging gets filled across the job system while the commands are recorded
+	JobCounter Copied;
+	VkDeviceSize Offset = 0;
+	std::vector<VkDeviceSize> Offsets;
+	for (const auto& Change : Changes)
+	{
+		const Streamed& Source = mTextures[Change.Handle];
+		const VkExtent2D Dim
+		{
+			std::max(Source.Width >> Change.Resident, 1U),
+			std::max(Source.Height >> Change.Resident, 1U),
+		};
+
+		auto Texture = Texture2D::CreateGPU(Instance, Dim, Source.Levels - Change.Resident, 1,
+			VK_FORMAT_B8G8R8A8_UNORM, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+		// The resident levels are the end of the full chain, so it's a single copy
+		const uint64_t Size = mResidency.GetSize(Change.Handle, Change.Resident);
+		const uint8_t* From = Source.Data + GetMipOffset(Source.Width, Source.Height, Change.Resident);
+		uint8_t* To = mMapped + Current.Offset + Offset;
+		assert(Offset + Size <= mUploadLimit);
+		mJobs->Run([From, To, Size]() { memcpy(To, From, Size); }, &Copied);
+
+		Current.Uploads.push_back({Change.Handle, std::move(Texture)});
+		Offsets.push_back(Current.Offset + Offset);
+		Offset += Size;
+	}
+
+	VkCommandBuffer Cmd = mRing->Begin();
+
+	std::vector<Texture2D*> Uploading;
+	for (auto& Pending : Current.Uploads)
+		Uploading.push_back(Pending.Texture.get());
+	Util::TransitionAll(Cmd, Uploading, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+	for (uint32_t i = 0; i < Current.Uploads.size(); ++i)
+	{
+		Texture2D* Texture = Current.Uploads[i].Texture.get();
+		const VkExtent2D Dim = Texture->GetDimensions();
+		for (uint32_t Level = 0; Level < Texture->GetLevels(); ++Level)
+			Texture->CopyFromBuffer(Cmd, mStaging, Offsets[i] + GetMipOffset(Dim.width, Dim.height, Level), Level);
+	}
+
+	Util::TransitionAll(Cmd, Uploading, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	// The copies only read staging once submitted
+	mJobs->Wait(&Copied);
+	mRing->Submit(Instance);
+}
+
+void TextureStreamer::Update(Vulkan::InstanceObject& Instance)
+{
+	PROFILE_SCOPE("TextureStreamer::Update");
+	++mFrame;
+
+	// Oldest batch first, so a texture that changed twice ends up with the newer image
+	for (uint32_t i = 0; i < UploadRing::COUNT; ++i)
+	{
+		const uint32_t Oldest = (mRing->GetCurrent() + i) % UploadRing::COUNT;
+		if (!mRing->IsPending(Oldest))
+			continue;
+		if (!mRing->IsDone(Oldest))
+			break;
+		Retire(Instance, Oldest);
+	}
+
+	while (!mRetired.empty() && mRetired.front().Frame + FRAMES_IN_FLIGHT <= mFrame)
+	{
+		mRetired.front().Texture->Destroy(Instance);
+		mRetired.pop_front();
+	}
+
+	// Both batches still copying, the requests carry over to next frame
+	if (mRing->IsPending(mRing->GetCurrent()))
+		return;
+
+	const auto& Changes = mResidency.Update();
+	if (Changes.empty())
+		return;
+
+	Record(Instance, Changes);
+}
+
+void TextureStreamer::Flush(Vulkan::InstanceObject& Instance)
+{
+	auto AllResident = [this]()
+	{
+		for (const auto& Texture : mTextures)
+			if (Texture.TableIndex == ~0U)
+				return false;
+		return true;
+	};
+
+	while (true)
+	{
+		bool Waited = false;
+		for (uint32_t i = 0; i < UploadRing::COUNT; ++i)
+		{
+			if (!mRing->IsPending(i))
+				continue;
+			mRing->Wait(i);
+			Waited = true;
+		}
+
+		if (!Waited && AllResident())
+			break;
+		Update(Instance);
+	}
+}
+
+}
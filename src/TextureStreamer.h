@@ -0,0 +1,115 @@
+#pragma once
+
+#include "JobSystem.h"
+#include "TextureResidency.h"
+#include "UploadRing.h"
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace Vulkan
+{
+class InstanceObject;
+class Sampler;
+class Texture2D;
+class TextureTable;
+
+// Streams mips of textures in and out under a memory budget
+// TextureResidency decides what should be on the GPU, this makes it so. Every change gets
+// a new image holding the resident levels, uploaded in the background and swapped in to
+// the texture table once its copy is done. Old images hang around for a couple of frames
+// in case anything in flight still samples them
+class TextureStreamer
+{
+public:
+	TextureStreamer(Vulkan::InstanceObject& Instance, TextureTable* Table, JobSystem* Jobs,
+	                VkDeviceSize Budget, VkDeviceSize UploadLimit = 16 * 1024 * 1024);
+	~TextureStreamer();
+
+	static std::unique_ptr<TextureStreamer> Create(Vulkan::InstanceObject& Instance, TextureTable* Table, JobSystem* Jobs,
+		VkDeviceSize Budget, VkDeviceSize UploadLimit = 16 * 1024 * 1024)
+	{
+		return std::make_unique<TextureStreamer>(Instance, Table, Jobs, Budget, UploadLimit);
+	}
+
+	// Data is the whole BGRA8 mip chain from level 0, tightly packed
+	// It's read from whenever a level gets streamed back in, so it has to outlive the streamer,
+	// which pointing it at an asset pack mapping does for free
+	uint32_t Add(const uint8_t* Data, uint32_t Width, uint32_t Height, uint32_t Levels);
+
+	void Request(uint32_t Handle, float ScreenSize) { mResidency.Request(Handle, ScreenSize); }
+
+	// Call once a frame from the thread that submits, between frames
+	// Swaps in whatever finished copying, then starts the uploads for this frame's requests
+	void Update(Vulkan::InstanceObject& Instance);
+
+	// Updates until every texture added so far is in the table
+	void Flush(Vulkan::InstanceObject& Instance);
+
+	// ~0U until the texture's tail has been uploaded
+	uint32_t GetTableIndex(uint32_t Handle) const { return mTextures[Handle].TableIndex; }
+
+	// Information
+	uint32_t GetCount() const { return mTextures.size(); }
+	const TextureResidency& GetResidency() const { return mResidency; }
+
+private:
+	// Updates an old image is kept around for after it's swapped out
+	static const uint32_t FRAMES_IN_FLIGHT = 2;
+
+	struct Streamed
+	{
+		const uint8_t* Data;
+		uint32_t Width, Height, Levels;
+
+		std::unique_ptr<Sampler> Current;
+		uint32_t TableIndex = ~0U;
+	};
+
+	struct Upload
+	{
+		uint32_t Handle;
+		std::unique_ptr<Texture2D> Texture;
+	};
+
+	// What each ring entry is uploading
+	struct Batch
+	{
+		VkDeviceSize Offset; // In to mStaging
+		std::vector<Upload> Uploads;
+	};
+
+	struct Retired
+	{
+		std::unique_ptr<Texture2D> Texture;
+		uint64_t Frame;
+	};
+
+	// Swaps the ring entry's images in, its fence has to have signalled
+	void Retire(Vulkan::InstanceObject& Instance, uint32_t Index);
+
+	// Uploads Changes through the current ring entry
+	void Record(Vulkan::InstanceObject& Instance, const std::vector<TextureResidency::Change>& Changes);
+
+	VkDevice mDevice;
+	TextureTable* mTable;
+	JobSystem* mJobs;
+	TextureResidency mResidency;
+	VkDeviceSize mUploadLimit;
+
+	// A region of mUploadLimit for each batch, persistently mapped
+	VkBuffer mStaging;
+	VkDeviceMemory mStagingMemory;
+	uint8_t* mMapped;
+
+	std::vector<Streamed> mTextures;
+
+	std::unique_ptr<UploadRing> mRing;
+	Batch mBatches[UploadRing::COUNT];
+
+	std::deque<Retired> mRetired;
+	uint64_t mFrame = 0;
+};
+}
@@ -0,0 +1,203 @@
+#include "Vulkan.h"
+#include "TextureTable.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+namespace Vulkan
+{
+
+TextureTable::TextureTable(Vulkan::InstanceObject& Instance, uint32_t Capacity)
+	: mBindless(Instance.SupportsBindless())
+{
+	VkResult err;
+
+	if (mBindless)
+	{
+		// Update after bind arrays have their own, usually much larger, limits
+		const auto& Props = Instance.mDescriptorIndexingProps;
+		mCapacity = std::min(Capacity, std::min(Props.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		                                        Props.maxDescriptorSetUpdateAfterBindSampledImages));
+		if (mCapacity < Capacity)
+			printf("Texture table limited to %d by the device\n", mCapacity);
+	}
+	else
+	{
+		// Every slot has to hold a valid texture, keep it small
+		uint32_t Fallback = FALLBACK_CAPACITY;
+		mCapacity = std::min(Fallback, Instance.GetGPUProp()->limits.maxPerStageDescriptorSampledImages);
+		printf("Descriptor indexing unsupported, texture table limited to %d\n", mCapacity);
+	}
+
+	mSlots.resize(mCapacity, nullptr);
+	for (uint32_t i = mCapacity; i > 0; --i)
+		mFreeSlots.push_back(i - 1);
+
+	const VkDescriptorSetLayoutBinding LayoutBinding =
+	{
+		.binding = 0,
+		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.descriptorCount = mCapacity,
+		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+		.pImmutableSamplers = nullptr,
+	};
+
+	const VkDescriptorBindingFlagsEXT BindingFlags =
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT;
+
+	const VkDescriptorSetLayoutBindingFlagsCreateInfoEXT BindingFlagsInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT,
+		.pNext = nullptr,
+		.bindingCount = 1,
+		.pBindingFlags = &BindingFlags,
+	};
+
+	const VkDescriptorSetLayoutCreateInfo DescriptorLayout =
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = mBindless ? &BindingFlagsInfo : nullptr,
+		.flags = mBindless ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT : 0u,
+		.bindingCount = 1,
+		.pBindings = &LayoutBinding,
+	};
+
+	err = vkCreateDescriptorSetLayout(*Instance.GetDevice(), &DescriptorLayout, nullptr, &mLayout);
+	CHECK_ERR(err);
+
+	const VkDescriptorPoolSize TypeCount =
+	{
+		.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.descriptorCount = mCapacity,
+	};
+
+	const VkDescriptorPoolCreateInfo DescriptorPool =
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = mBindless ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT : 0u,
+		.maxSets = 1,
+		.poolSizeCount = 1,
+		.pPoolSizes = &TypeCount,
+	};
+
+	err = vkCreateDescriptorPool(*Instance.GetDevice(), &DescriptorPool, nullptr, &mPool);
+	CHECK_ERR(err);
+
+	const VkDescriptorSetAllocateInfo AllocInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = nullptr,
+		.descriptorPool = mPool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &mLayout,
+	};
+
+	err = vkAllocateDescriptorSets(*Instance.GetDevice(), &AllocInfo, &mSet);
+	CHECK_ERR(err);
+}
+
+TextureTable::~TextureTable()
+{
+}
+
+uint32_t TextureTable::Add(Vulkan::InstanceObject& Instance, Sampler* Texture)
+{
+	assert(!mFreeSlots.empty());
+
+	// The fallback array isn't partially bound
+	// The first texture in fills every slot so none are left dangling
+	if (!mBindless && mFreeSlots.size() == mCapacity)
+	{
+		for (uint32_t i = 0; i < mCapacity; ++i)
+			Write(Instance, i, Texture);
+	}
+
+	uint32_t Index = mFreeSlots.back();
+	mFreeSlots.pop_back();
+
+	mSlots[Index] = Texture;
+	Write(Instance, Index, Texture);
+
+	return Index;
+}
+
+void TextureTable::Remove(Vulkan::InstanceObject& Instance, uint32_t Index)
+{
+	assert(mSlots[Index] != nullptr);
+
+	mSlots[Index] = nullptr;
+	mFreeSlots.push_back(Index);
+
+	if (mBindless)
+		return;
+
+	// Point the slot at something that is still alive
+	for (Sampler* Texture : mSlots)
+	{
+		if (Texture)
+		{
+			Write(Instance, Index, Texture);
+			break;
+		}
+	}
+}
+
+void TextureTable::Replace(Vulkan::InstanceObject& Instance, uint32_t Index, Sampler* Texture)
+{
+	assert(mSlots[Index] != nullptr);
+
+	mSlots[Index] = Texture;
+	Write(Instance, Index, Texture);
+}
+
+std::string TextureTable::GetShaderDeclaration(uint32_t Set) const
+{
+	std::string Decl;
+
+	if (mBindless)
+	{
+		Decl += "#extension GL_EXT_nonuniform_qualifier : require\n";
+		Decl += "layout(set = " + std::to_string(Set) + ", binding = 0) uniform sampler2DArray uTextures[];\n";
+		Decl += "#define SAMPLE_TEXTURE_LAYER(index, uv, layer) texture(uTextures[nonuniformEXT(index)], vec3(uv, layer))\n";
+	}
+	else
+	{
+		Decl += "layout(set = " + std::to_string(Set) + ", binding = 0) uniform sampler2DArray uTextures[" + std::to_string(mCapacity) + "];\n";
+		Decl += "#define SAMPLE_TEXTURE_LAYER(index, uv, layer) texture(uTextures[index], vec3(uv, layer))\n";
+	}
+	Decl += "#define SAMPLE_TEXTURE(index, uv) SAMPLE_TEXTURE_LAYER(index, uv, 0)\n";
+
+	return Decl;
+}
+
+void TextureTable::Write(Vulkan::InstanceObject& Instance, uint32_t Index, Sampler* Texture)
+{
+	assert(Texture->GetTexture()->GetViewType() == VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+
+	const VkDescriptorImageInfo TextureInfo =
+	{
+		.sampler = Texture->GetSampler(),
+		.imageView = Texture->GetTexture()->GetView(),
+		.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	};
+
+	const VkWriteDescriptorSet Write =
+	{
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.pNext = nullptr,
+		.dstSet = mSet,
+		.dstBinding = 0,
+		.dstArrayElement = Index,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.pImageInfo = &TextureInfo,
+		.pBufferInfo = nullptr,
+		.pTexelBufferView = nullptr,
+	};
+
+	vkUpdateDescriptorSets(*Instance.GetDevice(), 1, &Write, 0, nullptr);
+}
+
+}
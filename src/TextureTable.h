@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Vulkan
+{
+class InstanceObject;
+class Sampler;
+
+// One big descriptor array holding every texture we sample
+// Draws pick their texture with the index returned from Add, and the layer within it
+// Everything in it is sampled as an array, so textures need 2D_ARRAY views even with one layer
+//
+// With descriptor indexing this is a partially bound, update-after-bind array
+// Without it we fall back to a small fixed array where every slot is kept valid
+class TextureTable
+{
+public:
+	TextureTable(Vulkan::InstanceObject& Instance, uint32_t Capacity);
+	~TextureTable();
+
+	static std::unique_ptr<TextureTable> Create(Vulkan::InstanceObject& Instance,
+		uint32_t Capacity)
+	{
+		return std::make_unique<TextureTable>(Instance, Capacity);
+	}
+
+	// Returns the index shaders use to sample this texture
+	uint32_t Add(Vulkan::InstanceObject& Instance, Sampler* Texture);
+	void Remove(Vulkan::InstanceObject& Instance, uint32_t Index);
+
+	// Points an existing slot at a different texture
+	// Safe while the set is bound when we're bindless
+	void Replace(Vulkan::InstanceObject& Instance, uint32_t Index, Sampler* Texture);
+
+	// Device objects
+	VkDescriptorSetLayout GetLayout() const { return mLayout; }
+	VkDescriptorSet GetSet() const { return mSet; }
+
+	// Information
+	bool IsBindless() const { return mBindless; }
+	uint32_t GetCapacity() const { return mCapacity; }
+
+	// GLSL declaration of the table for shaders to include
+	// Binds to the given descriptor set, always binding 0
+	std::string GetShaderDeclaration(uint32_t Set) const;
+
+private:
+	// Size of the table when descriptor indexing isn't available
+	static const uint32_t FALLBACK_CAPACITY = 16;
+
+	void Write(Vulkan::InstanceObject& Instance, uint32_t Index, Sampler* Texture);
+
+	bool mBindless;
+	uint32_t mCapacity;
+
+	VkDescriptorSetLayout mLayout;
+	VkDescriptorPool mPool;
+	VkDescriptorSet mSet;
+
+	std::vector<Sampler*> mSlots;
+	std::vector<uint32_t> mFreeSlots;
+};
+}
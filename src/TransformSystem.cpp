@@ -0,0 +1,375 @@
+#include "TransformSystem.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <assert.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TRANSFORM_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Vulkan
+{
+
+void TransformStreams::Resize(uint32_t Count)
+{
+	PX.resize(Count, 0.0f);
+	PY.resize(Count, 0.0f);
+	PZ.resize(Count, 0.0f);
+	QX.resize(Count, 0.0f);
+	QY.resize(Count, 0.0f);
+	QZ.resize(Count, 0.0f);
+	QW.resize(Count, 1.0f);
+	SX.resize(Count, 1.0f);
+	SY.resize(Count, 1.0f);
+	SZ.resize(Count, 1.0f);
+}
+
+// Scale, then rotate, then translate
+// The SIMD kernels do the exact same mul/add sequence so results match bit for bit
+static void ComposeScalar(const TransformStreams& S, uint32_t i, float* M)
+{
+	// Pulled in to locals, otherwise every store to M forces a reload
+	const float QX = S.QX[i], QY = S.QY[i], QZ = S.QZ[i], QW = S.QW[i];
+	const float SX = S.SX[i], SY = S.SY[i], SZ = S.SZ[i];
+	const float PX = S.PX[i], PY = S.PY[i], PZ = S.PZ[i];
+
+	float x2 = QX + QX;
+	float y2 = QY + QY;
+	float z2 = QZ + QZ;
+
+	float xx = QX * x2, yy = QY * y2, zz = QZ * z2;
+	float xy = QX * y2, xz = QX * z2, yz = QY * z2;
+	float wx = QW * x2, wy = QW * y2, wz = QW * z2;
+
+	M[0] = (1.0f - (yy + zz)) * SX;
+	M[1] = (xy + wz) * SX;
+	M[2] = (xz - wy) * SX;
+	M[3] = 0.0f;
+
+	M[4] = (xy - wz) * SY;
+	M[5] = (1.0f - (xx + zz)) * SY;
+	M[6] = (yz + wx) * SY;
+	M[7] = 0.0f;
+
+	M[8] = (xz + wy) * SZ;
+	M[9] = (yz - wx) * SZ;
+	M[10] = (1.0f - (xx + yy)) * SZ;
+	M[11] = 0.0f;
+
+	M[12] = PX;
+	M[13] = PY;
+	M[14] = PZ;
+	M[15] = 1.0f;
+}
+
+#ifdef TRANSFORM_X86
+// Composes the 4 objects starting at Begin, only storing the ones set in Mask
+static void ComposeSSE(const TransformStreams& S, uint32_t Begin, uint32_t Mask, uint8_t* Out, size_t Stride)
+{
+	const __m128 One = _mm_set1_ps(1.0f);
+	const __m128 Zero = _mm_setzero_ps();
+
+	__m128 QX = _mm_loadu_ps(&S.QX[Begin]);
+	__m128 QY = _mm_loadu_ps(&S.QY[Begin]);
+	__m128 QZ = _mm_loadu_ps(&S.QZ[Begin]);
+	__m128 QW = _mm_loadu_ps(&S.QW[Begin]);
+	__m128 SX = _mm_loadu_ps(&S.SX[Begin]);
+	__m128 SY = _mm_loadu_ps(&S.SY[Begin]);
+	__m128 SZ = _mm_loadu_ps(&S.SZ[Begin]);
+
+	__m128 x2 = _mm_add_ps(QX, QX);
+	__m128 y2 = _mm_add_ps(QY, QY);
+	__m128 z2 = _mm_add_ps(QZ, QZ);
+
+	__m128 xx = _mm_mul_ps(QX, x2), yy = _mm_mul_ps(QY, y2), zz = _mm_mul_ps(QZ, z2);
+	__m128 xy = _mm_mul_ps(QX, y2), xz = _mm_mul_ps(QX, z2), yz = _mm_mul_ps(QY, z2);
+	__m128 wx = _mm_mul_ps(QW, x2), wy = _mm_mul_ps(QW, y2), wz = _mm_mul_ps(QW, z2);
+
+	// Rows of these are one matrix element across the 4 objects
+	__m128 C0X = _mm_mul_ps(_mm_sub_ps(One, _mm_add_ps(yy, zz)), SX);
+	__m128 C0Y = _mm_mul_ps(_mm_add_ps(xy, wz), SX);
+	__m128 C0Z = _mm_mul_ps(_mm_sub_ps(xz, wy), SX);
+	__m128 C0W = Zero;
+
+	__m128 C1X = _mm_mul_ps(_mm_sub_ps(xy, wz), SY);
+	__m128 C1Y = _mm_mul_ps(_mm_sub_ps(One, _mm_add_ps(xx, zz)), SY);
+	__m128 C1Z = _mm_mul_ps(_mm_add_ps(yz, wx), SY);
+	__m128 C1W = Zero;
+
+	__m128 C2X = _mm_mul_ps(_mm_add_ps(xz, wy), SZ);
+	__m128 C2Y = _mm_mul_ps(_mm_sub_ps(yz, wx), SZ);
+	__m128 C2Z = _mm_mul_ps(_mm_sub_ps(One, _mm_add_ps(xx, yy)), SZ);
+	__m128 C2W = Zero;
+
+	__m128 C3X = _mm_loadu_ps(&S.PX[Begin]);
+	__m128 C3Y = _mm_loadu_ps(&S.PY[Begin]);
+	__m128 C3Z = _mm_loadu_ps(&S.PZ[Begin]);
+	__m128 C3W = One;
+
+	// Transposed, each register is now one column of one object
+	_MM_TRANSPOSE4_PS(C0X, C0Y, C0Z, C0W);
+	_MM_TRANSPOSE4_PS(C1X, C1Y, C1Z, C1W);
+	_MM_TRANSPOSE4_PS(C2X, C2Y, C2Z, C2W);
+	_MM_TRANSPOSE4_PS(C3X, C3Y, C3Z, C3W);
+
+	auto Store = [&](uint32_t Lane, __m128 Col0, __m128 Col1, __m128 Col2, __m128 Col3)
+	{
+		if (!(Mask & (1U << Lane)))
+			return;
+
+		float* M = (float*)(Out + (Begin + Lane) * Stride);
+		_mm_storeu_ps(M + 0, Col0);
+		_mm_storeu_ps(M + 4, Col1);
+		_mm_storeu_ps(M + 8, Col2);
+		_mm_storeu_ps(M + 12, Col3);
+	};
+
+	Store(0, C0X, C1X, C2X, C3X);
+	Store(1, C0Y, C1Y, C2Y, C3Y);
+	Store(2, C0Z, C1Z, C2Z, C3Z);
+	Store(3, C0W, C1W, C2W, C3W);
+}
+
+// Transposes 4 rows of 8 objects in to one column per object
+// Each 128bit lane gets transposed on its own, so lane 0 holds objects 0-3 and lane 1 objects 4-7
+__attribute__((target("avx2")))
+static inline void Transpose8x4(__m256& A, __m256& B, __m256& C, __m256& D)
+{
+	__m256 T0 = _mm256_unpacklo_ps(A, B);
+	__m256 T1 = _mm256_unpacklo_ps(C, D);
+	__m256 T2 = _mm256_unpackhi_ps(A, B);
+	__m256 T3 = _mm256_unpackhi_ps(C, D);
+	A = _mm256_shuffle_ps(T0, T1, _MM_SHUFFLE(1, 0, 1, 0));
+	B = _mm256_shuffle_ps(T0, T1, _MM_SHUFFLE(3, 2, 3, 2));
+	C = _mm256_shuffle_ps(T2, T3, _MM_SHUFFLE(1, 0, 1, 0));
+	D = _mm256_shuffle_ps(T2, T3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+__attribute__((target("avx2")))
+static void ComposeAVX2(const TransformStreams& S, uint32_t Begin, uint32_t Mask, uint8_t* Out, size_t Stride)
+{
+	const __m256 One = _mm256_set1_ps(1.0f);
+	const __m256 Zero = _mm256_setzero_ps();
+
+	__m256 QX = _mm256_loadu_ps(&S.QX[Begin]);
+	__m256 QY = _mm256_loadu_ps(&S.QY[Begin]);
+	__m256 QZ = _mm256_loadu_ps(&S.QZ[Begin]);
+	__m256 QW = _mm256_loadu_ps(&S.QW[Begin]);
+	__m256 SX = _mm256_loadu_ps(&S.SX[Begin]);
+	__m256 SY = _mm256_loadu_ps(&S.SY[Begin]);
+	__m256 SZ = _mm256_loadu_ps(&S.SZ[Begin]);
+
+	__m256 x2 = _mm256_add_ps(QX, QX);
+	__m256 y2 = _mm256_add_ps(QY, QY);
+	__m256 z2 = _mm256_add_ps(QZ, QZ);
+
+	// No FMA, we want to match the scalar kernel exactly
+	__m256 xx = _mm256_mul_ps(QX, x2), yy = _mm256_mul_ps(QY, y2), zz = _mm256_mul_ps(QZ, z2);
+	__m256 xy = _mm256_mul_ps(QX, y2), xz = _mm256_mul_ps(QX, z2), yz = _mm256_mul_ps(QY, z2);
+	__m256 wx = _mm256_mul_ps(QW, x2), wy = _mm256_mul_ps(QW, y2), wz = _mm256_mul_ps(QW, z2);
+
+	__m256 C0X = _mm256_mul_ps(_mm256_sub_ps(One, _mm256_add_ps(yy, zz)), SX);
+	__m256 C0Y = _mm256_mul_ps(_mm256_add_ps(xy, wz), SX);
+	__m256 C0Z = _mm256_mul_ps(_mm256_sub_ps(xz, wy), SX);
+	__m256 C0W = Zero;
+
+	__m256 C1X = _mm256_mul_ps(_mm256_sub_ps(xy, wz), SY);
+	__m256 C1Y = _mm256_mul_ps(_mm256_sub_ps(One, _mm256_add_ps(xx, zz)), SY);
+	__m256 C1Z = _mm256_mul_ps(_mm256_add_ps(yz, wx), SY);
+	__m256 C1W = Zero;
+
+	__m256 C2X = _mm256_mul_ps(_mm256_add_ps(xz, wy), SZ);
+	__m256 C2Y = _mm256_mul_ps(_mm256_sub_ps(yz, wx), SZ);
+	__m256 C2Z = _mm256_mul_ps(_mm256_sub_ps(One, _mm256_add_ps(xx, yy)), SZ);
+	__m256 C2W = Zero;
+
+	__m256 C3X = _mm256_loadu_ps(&S.PX[Begin]);
+	__m256 C3Y = _mm256_loadu_ps(&S.PY[Begin]);
+	__m256 C3Z = _mm256_loadu_ps(&S.PZ[Begin]);
+	__m256 C3W = One;
+
+	Transpose8x4(C0X, C0Y, C0Z, C0W);
+	Transpose8x4(C1X, C1Y, C1Z, C1W);
+	Transpose8x4(C2X, C2Y, C2Z, C2W);
+	Transpose8x4(C3X, C3Y, C3Z, C3W);
+
+	auto Store = [&](uint32_t Lane, __m128 Col0, __m128 Col1, __m128 Col2, __m128 Col3)
+	{
+		if (!(Mask & (1U << Lane)))
+			return;
+
+		float* M = (float*)(Out + (Begin + Lane) * Stride);
+		_mm_storeu_ps(M + 0, Col0);
+		_mm_storeu_ps(M + 4, Col1);
+		_mm_storeu_ps(M + 8, Col2);
+		_mm_storeu_ps(M + 12, Col3);
+	};
+
+#define LO(x) _mm256_castps256_ps128(x)
+#define HI(x) _mm256_extractf128_ps(x, 1)
+	Store(0, LO(C0X), LO(C1X), LO(C2X), LO(C3X));
+	Store(1, LO(C0Y), LO(C1Y), LO(C2Y), LO(C3Y));
+	Store(2, LO(C0Z), LO(C1Z), LO(C2Z), LO(C3Z));
+	Store(3, LO(C0W), LO(C1W), LO(C2W), LO(C3W));
+	Store(4, HI(C0X), HI(C1X), HI(C2X), HI(C3X));
+	Store(5, HI(C0Y), HI(C1Y), HI(C2Y), HI(C3Y));
+	Store(6, HI(C0Z), HI(C1Z), HI(C2Z), HI(C3Z));
+	Store(7, HI(C0W), HI(C1W), HI(C2W), HI(C3W));
+#undef LO
+#undef HI
+}
+#endif
+
+TransformSystem::TransformSystem(SIMDLevel Kernel)
+	: mKernel(SIMDResolve(Kernel))
+{
+	assert(SIMDSupported(mKernel));
+}
+
+void TransformSystem::Resize(uint32_t Count)
+{
+	uint32_t Old = mCount;
+	uint32_t Words = (Count + 63) / 64;
+
+	mStreams.Resize(Words * 64);
+	mDirty.resize(Words, 0);
+	mCount = Count;
+
+	// Anything dropped can't stay dirty, anything new needs a first write
+	for (uint32_t i = Count; i < Words * 64; ++i)
+		mDirty[i / 64] &= ~(1ULL << (i % 64));
+	for (uint32_t i = Old; i < Count; ++i)
+		MarkDirty(i);
+}
+
+uint32_t TransformSystem::Add(const glm::vec3& Position, const glm::quat& Rotation, const glm::vec3& Scale)
+{
+	uint32_t Index = mCount;
+	Resize(mCount + 1);
+	Set(Index, Position, Rotation, Scale);
+	return Index;
+}
+
+void TransformSystem::SetPosition(uint32_t Index, const glm::vec3& Position)
+{
+	assert(Index < mCount);
+	mStreams.PX[Index] = Position.x;
+	mStreams.PY[Index] = Position.y;
+	mStreams.PZ[Index] = Position.z;
+	MarkDirty(Index);
+}
+
+void TransformSystem::SetRotation(uint32_t Index, const glm::quat& Rotation)
+{
+	assert(Index < mCount);
+	mStreams.QX[Index] = Rotation.x;
+	mStreams.QY[Index] = Rotation.y;
+	mStreams.QZ[Index] = Rotation.z;
+	mStreams.QW[Index] = Rotation.w;
+	MarkDirty(Index);
+}
+
+void TransformSystem::SetScale(uint32_t Index, const glm::vec3& Scale)
+{
+	assert(Index < mCount);
+	mStreams.SX[Index] = Scale.x;
+	mStreams.SY[Index] = Scale.y;
+	mStreams.SZ[Index] = Scale.z;
+	MarkDirty(Index);
+}
+
+void TransformSystem::Set(uint32_t Index, const glm::vec3& Position, const glm::quat& Rotation, const glm::vec3& Scale)
+{
+	SetPosition(Index, Position);
+	SetRotation(Index, Rotation);
+	SetScale(Index, Scale);
+}
+
+void TransformSystem::MarkAllDirty()
+{
+	for (auto& Word : mDirty)
+		Word = ~0ULL;
+
+	// Keep the padding past the end clean
+	if (mCount % 64)
+		mDirty.back() = (1ULL << (mCount % 64)) - 1;
+}
+
+uint32_t TransformSystem::UpdateWords(uint32_t FirstWord, uint32_t EndWord, uint8_t* Dst, size_t Stride)
+{
+	uint32_t Written = 0;
+
+	uint32_t Width = 1;
+#ifdef TRANSFORM_X86
+	if (mKernel == SIMDLevel::AVX2)
+		Width = 8;
+	else if (mKernel == SIMDLevel::SSE)
+		Width = 4;
+#endif
+	const uint64_t BlockMask = (1ULL << Width) - 1;
+
+	// Whole words of clean objects get skipped with a single test
+	for (uint32_t Word = FirstWord; Word < EndWord; ++Word)
+	{
+		uint64_t Bits = mDirty[Word];
+		if (!Bits)
+			continue;
+
+		mDirty[Word] = 0;
+		Written += __builtin_popcountll(Bits);
+
+		const uint32_t Base = Word * 64;
+		for (uint32_t Offset = 0; Offset < 64; Offset += Width)
+		{
+			uint32_t Mask = (Bits >> Offset) & BlockMask;
+			if (!Mask)
+				continue;
+
+			// A lone dirty object isn't worth composing a whole block for
+			if (!(Mask & (Mask - 1)))
+			{
+				uint32_t Index = Base + Offset + __builtin_ctz(Mask);
+				ComposeScalar(mStreams, Index, (float*)(Dst + Index * Stride));
+				continue;
+			}
+
+			switch (Width)
+			{
+#ifdef TRANSFORM_X86
+			case 8:
+				ComposeAVX2(mStreams, Base + Offset, Mask, Dst, Stride);
+				break;
+			case 4:
+				ComposeSSE(mStreams, Base + Offset, Mask, Dst, Stride);
+				break;
+#endif
+			default:
+				assert(false);
+				break;
+			}
+		}
+	}
+
+	return Written;
+}
+
+uint32_t TransformSystem::Update(void* Out, size_t Stride, JobSystem* Jobs)
+{
+	uint8_t* Dst = (uint8_t*)Out;
+	const uint32_t Words = mDirty.size();
+
+	if (!Jobs || mCount < PARALLEL_THRESHOLD)
+		return UpdateWords(0, Words, Dst, Stride);
+
+	// Jobs own whole dirty words, so no two touch the same bits
+	std::atomic<uint32_t> Written{0};
+	Jobs->ParallelFor(Words, PARALLEL_THRESHOLD / 64, [&](uint32_t Begin, uint32_t End)
+	{
+		Written += UpdateWords(Begin, End, Dst, Stride);
+	});
+	return Written;
+}
+
+}
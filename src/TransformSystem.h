@@ -0,0 +1,73 @@
+#pragma once
+
+#include "SIMD.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Vulkan
+{
+class JobSystem;
+
+// Object transforms stored as structure of arrays
+// Lets the SIMD kernels load 4 or 8 objects worth of a component at once
+struct TransformStreams
+{
+	std::vector<float> PX, PY, PZ;
+	std::vector<float> QX, QY, QZ, QW;
+	std::vector<float> SX, SY, SZ;
+
+	void Resize(uint32_t Count);
+};
+
+// Position, rotation and scale for lots of objects
+// Only objects that changed get their world matrix rebuilt on Update
+class TransformSystem
+{
+public:
+	// Updates smaller than this aren't worth splitting in to jobs
+	static const uint32_t PARALLEL_THRESHOLD = 1 << 14;
+
+	TransformSystem(SIMDLevel Kernel = SIMDLevel::Best);
+
+	// New objects start out as identity and dirty
+	void Resize(uint32_t Count);
+	uint32_t Add(const glm::vec3& Position, const glm::quat& Rotation, const glm::vec3& Scale);
+
+	void SetPosition(uint32_t Index, const glm::vec3& Position);
+	void SetRotation(uint32_t Index, const glm::quat& Rotation);
+	void SetScale(uint32_t Index, const glm::vec3& Scale);
+	void Set(uint32_t Index, const glm::vec3& Position, const glm::quat& Rotation, const glm::vec3& Scale);
+
+	glm::vec3 GetPosition(uint32_t Index) const
+	{
+		return glm::vec3(mStreams.PX[Index], mStreams.PY[Index], mStreams.PZ[Index]);
+	}
+
+	void MarkDirty(uint32_t Index) { mDirty[Index / 64] |= 1ULL << (Index % 64); }
+	void MarkAllDirty();
+
+	// Writes the column major world matrix of every dirty object i to Out + i * Stride
+	// Out can be mapped memory, clean objects aren't touched
+	// Spread across Jobs when given one
+	// Returns how many matrices were written
+	uint32_t Update(void* Out, size_t Stride, JobSystem* Jobs = nullptr);
+
+	// Information
+	uint32_t Size() const { return mCount; }
+	SIMDLevel GetKernel() const { return mKernel; }
+
+private:
+	uint32_t UpdateWords(uint32_t FirstWord, uint32_t EndWord, uint8_t* Dst, size_t Stride);
+
+	SIMDLevel mKernel;
+	uint32_t mCount = 0;
+
+	// Streams are padded out to a whole dirty word, so kernels never need a tail
+	TransformStreams mStreams;
+	std::vector<uint64_t> mDirty;
+};
+}
@@ -0,0 +1,97 @@
+#include "TransientLayout.h"
+
+#include <algorithm>
+#include <assert.h>
+
+namespace Vulkan
+{
+
+bool TransientLayout::Aliases(uint32_t A, uint32_t B) const
+{
+	return mOffsets[A] < mOffsets[B] + mBlocks[B].Size &&
+	       mOffsets[B] < mOffsets[A] + mBlocks[A].Size;
+}
+
+bool TransientLayout::Fits(const std::vector<Lifetime>& Lifetimes) const
+{
+	assert(Lifetimes.size() == mBlocks.size());
+	for (uint32_t A = 0; A < mBlocks.size(); ++A)
+	{
+		for (uint32_t B = A + 1; B < mBlocks.size(); ++B)
+		{
+			if (Overlaps(Lifetimes[A], Lifetimes[B]) && Aliases(A, B))
+				return false;
+		}
+	}
+	return true;
+}
+
+void TransientLayout::Place(const std::vector<Block>& Blocks, const std::vector<Lifetime>& Lifetimes)
+{
+	assert(Lifetimes.size() == Blocks.size());
+	mBlocks = Blocks;
+	mOffsets.assign(mBlocks.size(), 0);
+	mSize = 0;
+	mUnaliasedSize = 0;
+
+	std::vector<uint32_t> Order(mBlocks.size());
+	for (uint32_t i = 0; i < Order.size(); ++i)
+		Order[i] = i;
+
+	std::sort(Order.begin(), Order.end(), [&](uint32_t A, uint32_t B)
+	{
+		return mBlocks[A].Size > mBlocks[B].Size;
+	});
+
+	std::vector<uint32_t> Placed;
+	for (uint32_t Index : Order)
+	{
+		const Block& Current = mBlocks[Index];
+		mUnaliasedSize += Current.Size;
+
+		auto Align = [&](uint64_t Offset)
+		{
+			return (Offset + Current.Alignment - 1) / Current.Alignment * Current.Alignment;
+		};
+
+		auto Alive = [&](uint32_t Other)
+		{
+			return Overlaps(Lifetimes[Index], Lifetimes[Other]);
+		};
+
+		// Candidates are the start of the block and the end of every live neighbour
+		std::vector<uint64_t> Candidates { 0 };
+		for (uint32_t Other : Placed)
+		{
+			if (Alive(Other))
+				Candidates.push_back(Align(mOffsets[Other] + mBlocks[Other].Size));
+		}
+		std::sort(Candidates.begin(), Candidates.end());
+
+		for (uint64_t Offset : Candidates)
+		{
+			bool Fits = true;
+			for (uint32_t Other : Placed)
+			{
+				const uint64_t End = mOffsets[Other] + mBlocks[Other].Size;
+				if (Alive(Other) &&
+				    Offset < End && mOffsets[Other] < Offset + Current.Size)
+				{
+					Fits = false;
+					break;
+				}
+			}
+
+			if (Fits)
+			{
+				mOffsets[Index] = Offset;
+				break;
+			}
+		}
+
+		mSize = std::max(mSize, mOffsets[Index] + Current.Size);
+		Placed.push_back(Index);
+	}
+}
+
+}
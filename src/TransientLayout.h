@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Vulkan
+{
+// Where each transient target goes in the memory they share, from when each one is used
+// Only the placement lives here, TransientPool makes the images and binds them
+// Biggest first, each goes at the lowest offset that doesn't overlap anything already
+// placed that is alive at the same time
+class TransientLayout
+{
+public:
+	// Passes the target is used in, inclusive
+	// First > Last for targets that aren't used at all
+	struct Lifetime
+	{
+		uint32_t First;
+		uint32_t Last;
+	};
+
+	struct Block
+	{
+		uint64_t Size;
+		uint64_t Alignment;
+	};
+
+	// Lifetimes line up with Blocks, anything placed before is forgotten
+	void Place(const std::vector<Block>& Blocks, const std::vector<Lifetime>& Lifetimes);
+
+	// False when two blocks sharing memory would be alive at the same time
+	bool Fits(const std::vector<Lifetime>& Lifetimes) const;
+
+	// Whether the blocks share any memory, a block aliases itself
+	bool Aliases(uint32_t A, uint32_t B) const;
+
+	static bool Overlaps(const Lifetime& A, const Lifetime& B)
+	{
+		return A.First <= B.Last && B.First <= A.Last && A.First <= A.Last && B.First <= B.Last;
+	}
+
+	// Information
+	uint64_t GetOffset(uint32_t Index) const { return mOffsets[Index]; }
+	uint32_t GetCount() const { return mBlocks.size(); }
+	uint64_t GetSize() const { return mSize; }
+	uint64_t GetUnaliasedSize() const { return mUnaliasedSize; }
+
+private:
+	std::vector<Block> mBlocks;
+	std::vector<uint64_t> mOffsets;
+	uint64_t mSize = 0;
+	uint64_t mUnaliasedSize = 0;
+};
+}
@@ -0,0 +1,80 @@
+#include "TransientPool.h"
+#include "Utils.h"
+#include "Vulkan.h"
+
+#include <assert.h>
+
+namespace Vulkan
+{
+
+uint32_t TransientPool::Add(Vulkan::InstanceObject& Instance, const Desc& Info)
+{
+	assert(mMemory == VK_NULL_HANDLE);
+
+	// Transient images can't be sampled, copied or stored to
+	assert(!(Info.Usage & ~(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+	                        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+	                        VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT)));
+
+	Target NewTarget;
+	NewTarget.Info = Info;
+	NewTarget.Texture = Texture2D::CreateTransient(Instance, Info.Dim, Info.Format, VK_SAMPLE_COUNT_1_BIT, Info.Usage);
+	mTargets.push_back(std::move(NewTarget));
+	return mTargets.size() - 1;
+}
+
+void TransientPool::Allocate(Vulkan::InstanceObject& Instance, const std::vector<Lifetime>& Lifetimes)
+{
+	assert(Lifetimes.size() == mTargets.size());
+	if (mTargets.empty())
+		return;
+
+	// Images can only be bound once, moving them means making them again
+	if (mMemory != VK_NULL_HANDLE)
+	{
+		for (auto& Current : mTargets)
+		{
+			Current.Texture->Destroy(Instance);
+			Current.Texture = Texture2D::CreateTransient(Instance, Current.Info.Dim, Current.Info.Format,
+				VK_SAMPLE_COUNT_1_BIT, Current.Info.Usage);
+		}
+
+		vkFreeMemory(*Instance.GetDevice(), mMemory, nullptr);
+		mMemory = VK_NULL_HANDLE;
+	}
+
+	uint32_t TypeBits = ~0U;
+	std::vector<TransientLayout::Block> Blocks;
+	for (const auto& Current : mTargets)
+	{
+		const auto& Requirements = Current.Texture->GetMemoryRequirements();
+		TypeBits &= Requirements.memoryTypeBits;
+		Blocks.push_back({Requirements.size, Requirements.alignment});
+	}
+	mLayout.Place(Blocks, Lifetimes);
+
+	// Lazily allocated memory only gets committed if a render pass actually has to store it
+	uint32_t MemoryType = Util::MemoryTypeFromProperties(Instance, TypeBits,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+	mLazy = MemoryType != ~0U;
+	if (!mLazy)
+		MemoryType = Util::MemoryTypeFromProperties(Instance, TypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	assert(MemoryType != ~0U);
+
+	const VkMemoryAllocateInfo MemAllocate =
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.pNext = nullptr,
+		.allocationSize = mLayout.GetSize(),
+		.memoryTypeIndex = MemoryType,
+	};
+
+	VkResult err;
+	err = vkAllocateMemory(*Instance.GetDevice(), &MemAllocate, nullptr, &mMemory);
+	CHECK_ERR(err);
+
+	for (uint32_t i = 0; i < mTargets.size(); ++i)
+		mTargets[i].Texture->BindMemory(Instance, mMemory, mLayout.GetOffset(i));
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Texture2D.h"
+#include "TransientLayout.h"
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <vector>
+
+namespace Vulkan
+{
+class InstanceObject;
+
+// Render targets that only hold anything for part of a frame
+// Ones whose lifetimes don't overlap get placed in the same memory, and it
+// all comes from lazily allocated memory when the device has it so tilers
+// never need to back them at all
+// The render graph owns it, lifetimes come from the order it compiles passes in
+class TransientPool
+{
+public:
+	struct Desc
+	{
+		VkExtent2D Dim;
+		VkFormat Format;
+		VkImageUsageFlags Usage; // Attachment usages only
+	};
+
+	typedef TransientLayout::Lifetime Lifetime;
+
+	// Creates the image straight away, it has no memory until Allocate
+	uint32_t Add(Vulkan::InstanceObject& Instance, const Desc& Info);
+
+	// Places everything by when it's used and binds it
+	// Doing it again frees the old memory and remakes every image, nothing can still be using them
+	void Allocate(Vulkan::InstanceObject& Instance, const std::vector<Lifetime>& Lifetimes);
+
+	// False when two targets sharing memory would be alive at the same time
+	bool Fits(const std::vector<Lifetime>& Lifetimes) const { return mLayout.Fits(Lifetimes); }
+
+	// Whether the targets share any memory, a target aliases itself
+	bool Aliases(uint32_t A, uint32_t B) const { return mLayout.Aliases(A, B); }
+
+	Texture2D* Get(uint32_t Index) const { return mTargets[Index].Texture.get(); }
+	const Desc& GetDesc(uint32_t Index) const { return mTargets[Index].Info; }
+
+	// Information
+	uint32_t GetCount() const { return mTargets.size(); }
+	bool IsAllocated() const { return mMemory != VK_NULL_HANDLE; }
+	VkDeviceSize GetSize() const { return mLayout.GetSize(); }
+	VkDeviceSize GetUnaliasedSize() const { return mLayout.GetUnaliasedSize(); }
+	bool IsLazy() const { return mLazy; }
+
+private:
+	struct Target
+	{
+		Desc Info;
+		std::unique_ptr<Texture2D> Texture;
+	};
+
+	std::vector<Target> mTargets;
+	TransientLayout mLayout;
+
+	VkDeviceMemory mMemory = VK_NULL_HANDLE;
+	bool mLazy = false;
+};
+}
@@ -0,0 +1,145 @@
+#include "Vulkan.h"
+#include "UploadRing.h"
+
+#include <assert.h>
+
+namespace Vulkan
+{
+
+UploadRing::UploadRing(Vulkan::InstanceObject& Instance)
+	: mDevice(*Instance.GetDevice())
+{
+	VkResult err;
+
+	for (auto& Current : mEntries)
+	{
+		// Reset as a whole once the fence says its submit is done
+		const VkCommandPoolCreateInfo PoolInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = Instance.GetPresentQueueIndex(),
+		};
+
+		err = vkCreateCommandPool(mDevice, &PoolInfo, nullptr, &Current.Pool);
+		CHECK_ERR(err);
+
+		const VkCommandBufferAllocateInfo AllocInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.pNext = nullptr,
+			.commandPool = Current.Pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+
+		err = vkAllocateCommandBuffers(mDevice, &AllocInfo, &Current.Command);
+		CHECK_ERR(err);
+
+		const VkFenceCreateInfo FenceInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+		};
+
+		err = vkCreateFence(mDevice, &FenceInfo, nullptr, &Current.Fence);
+		CHECK_ERR(err);
+	}
+}
+
+UploadRing::~UploadRing()
+{
+	for (uint32_t i = 0; i < COUNT; ++i)
+	{
+		Wait(i);
+		vkDestroyCommandPool(mDevice, mEntries[i].Pool, nullptr);
+		vkDestroyFence(mDevice, mEntries[i].Fence, nullptr);
+	}
+}
+
+VkCommandBuffer UploadRing::Begin()
+{
+	Entry& Current = mEntries[mCurrent];
+	assert(!Current.Pending);
+
+	const VkCommandBufferBeginInfo BeginInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = nullptr,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = nullptr,
+	};
+
+	VkResult err;
+	err = vkBeginCommandBuffer(Current.Command, &BeginInfo);
+	CHECK_ERR(err);
+	return Current.Command;
+}
+
+void UploadRing::Submit(Vulkan::InstanceObject& Instance)
+{
+	Entry& Current = mEntries[mCurrent];
+	VkResult err;
+
+	err = vkEndCommandBuffer(Current.Command);
+	CHECK_ERR(err);
+
+	const VkSubmitInfo SubmitInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = nullptr,
+		.waitSemaphoreCount = 0,
+		.pWaitSemaphores = nullptr,
+		.pWaitDstStageMask = nullptr,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &Current.Command,
+		.signalSemaphoreCount = 0,
+		.pSignalSemaphores = nullptr,
+	};
+
+	err = vkQueueSubmit(*Instance.GetQueue(), 1, &SubmitInfo, Current.Fence);
+	CHECK_ERR(err);
+
+	Current.Pending = true;
+	mCurrent = (mCurrent + 1) % COUNT;
+}
+
+bool UploadRing::IsDone(uint32_t Index) const
+{
+	const Entry& Current = mEntries[Index];
+	return Current.Pending && vkGetFenceStatus(mDevice, Current.Fence) == VK_SUCCESS;
+}
+
+void UploadRing::Wait(uint32_t Index)
+{
+	Entry& Current = mEntries[Index];
+	if (!Current.Pending)
+		return;
+
+	VkResult err;
+	err = vkWaitForFences(mDevice, 1, &Current.Fence, VK_TRUE, UINT64_MAX);
+	CHECK_ERR(err);
+}
+
+bool UploadRing::Finish(uint32_t Index)
+{
+	Entry& Current = mEntries[Index];
+	if (!Current.Pending)
+		return false;
+
+	Wait(Index);
+
+	VkResult err;
+	err = vkResetFences(mDevice, 1, &Current.Fence);
+	CHECK_ERR(err);
+
+	err = vkResetCommandPool(mDevice, Current.Pool, 0);
+	CHECK_ERR(err);
+
+	Current.Pending = false;
+	return true;
+}
+
+}
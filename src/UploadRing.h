@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory>
+
+namespace Vulkan
+{
+class InstanceObject;
+
+// A few command buffers that take turns uploading, each with a pool and fence of its own
+// For uploads that get submitted on their own rather than through the setup batch, so
+// the next one can be recorded while the last is still copying
+// Owners keep whatever a submit uses per entry, indexed the same way
+class UploadRing
+{
+public:
+	// Submits in flight at once
+	static const uint32_t COUNT = 2;
+
+	UploadRing(Vulkan::InstanceObject& Instance);
+	~UploadRing();
+
+	static std::unique_ptr<UploadRing> Create(Vulkan::InstanceObject& Instance)
+	{
+		return std::make_unique<UploadRing>(Instance);
+	}
+
+	// Starts recording the current entry, which can't be pending
+	VkCommandBuffer Begin();
+
+	// Submits the current entry with its fence and moves on to the next
+	void Submit(Vulkan::InstanceObject& Instance);
+
+	// Blocks until Index's submit is done, if it has one
+	void Wait(uint32_t Index);
+
+	// Waits for Index's submit then resets its pool and fence for reuse
+	// False if there was nothing pending
+	bool Finish(uint32_t Index);
+
+	// Information
+	uint32_t GetCurrent() const { return mCurrent; }
+	bool IsPending(uint32_t Index) const { return mEntries[Index].Pending; }
+	bool IsDone(uint32_t Index) const;
+
+private:
+	struct Entry
+	{
+		VkCommandPool Pool;
+		VkCommandBuffer Command;
+		VkFence Fence;
+		bool Pending = false;
+	};
+
+	VkDevice mDevice;
+	Entry mEntries[COUNT];
+	uint32_t mCurrent = 0;
+};
+}
@@ -1,4 +1,8 @@
+#include "Utils.h"
 #include "Vulkan.h"
+#include "Texture2D.h"
+
+#include <stdio.h>
 
 namespace Vulkan
 {
@@ -23,5 +27,112 @@ uint32_t MemoryTypeFromProperties(Vulkan::InstanceObject& Instance, uint32_t Typ
 	// Nothing found that matches the requirements
 	return ~0U;
 }
+
+void CreateBuffer(Vulkan::InstanceObject& Instance, VkDeviceSize Size,
+                  VkBufferUsageFlags Usage, VkFlags Props,
+                  VkBuffer* Buffer, VkDeviceMemory* Memory)
+{
+	VkResult err;
+	const VkBufferCreateInfo BufferInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.size = Size,
+		.usage = Usage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = 0,
+		.pQueueFamilyIndices = nullptr,
+	};
+
+	err = vkCreateBuffer(*Instance.GetDevice(), &BufferInfo, nullptr, Buffer);
+	CHECK_ERR(err);
+
+	VkMemoryRequirements MemRequirements{};
+	vkGetBufferMemoryRequirements(*Instance.GetDevice(), *Buffer, &MemRequirements);
+
+	VkMemoryAllocateInfo MemAllocate =
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.pNext = nullptr,
+		.allocationSize = MemRequirements.size,
+		.memoryTypeIndex = MemoryTypeFromProperties(Instance, MemRequirements.memoryTypeBits, Props),
+	};
+	assert(MemAllocate.memoryTypeIndex != ~0U);
+
+	err = vkAllocateMemory(*Instance.GetDevice(), &MemAllocate, nullptr, Memory);
+	CHECK_ERR(err);
+
+	err = vkBindBufferMemory(*Instance.GetDevice(), *Buffer, *Memory, 0);
+	CHECK_ERR(err);
+}
+
+void GetLayoutUsage(VkImageLayout Layout, VkPipelineStageFlags* Stage, VkAccessFlags* Access)
+{
+	switch (Layout)
+	{
+	case VK_IMAGE_LAYOUT_UNDEFINED:
+		// Nothing to wait on, the contents get thrown away
+		*Stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		*Access = 0;
+		break;
+	case VK_IMAGE_LAYOUT_PREINITIALIZED:
+		*Stage = VK_PIPELINE_STAGE_HOST_BIT;
+		*Access = VK_ACCESS_HOST_WRITE_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+		*Stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		*Access = VK_ACCESS_TRANSFER_READ_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+		*Stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		*Access = VK_ACCESS_TRANSFER_WRITE_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+		*Stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		*Access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+		*Stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		*Access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+		*Stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		*Access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+		*Stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		*Access = VK_ACCESS_SHADER_READ_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+		// Present waits on the semaphore the submit signals, which covers everything before it
+		*Stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		*Access = 0;
+		break;
+	default:
+		// GENERAL and anything we don't know, be safe rather than fast
+		*Stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		*Access = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		break;
+	}
+}
+
+void TransitionAll(VkCommandBuffer Cmd, const std::vector<Texture2D*>& Textures, VkImageLayout NewLayout)
+{
+	if (Textures.empty())
+		return;
+
+	std::vector<VkImageMemoryBarrier> Barriers;
+	VkPipelineStageFlags SrcStage = 0, DstStage = 0;
+	for (Texture2D* Texture : Textures)
+	{
+		VkPipelineStageFlags Src, Dst;
+		Barriers.push_back(Texture->Transition(NewLayout, &Src, &Dst));
+		SrcStage |= Src;
+		DstStage |= Dst;
+	}
+	vkCmdPipelineBarrier(Cmd, SrcStage, DstStage, 0, 0, nullptr,
+	                     0, nullptr, (uint32_t)Barriers.size(), Barriers.data());
+}
 }
 }
@@ -1,11 +1,27 @@
 #pragma once
 #include "Vulkan.h"
 
+#include <vector>
+
 namespace Vulkan
 {
+class Texture2D;
+
 namespace Util
 {
 uint32_t MemoryTypeFromProperties(Vulkan::InstanceObject& Instance, uint32_t TypeBits,
                                   VkFlags RequirementsMask);
+
+// Creates a buffer and binds freshly allocated memory matching Props to it
+void CreateBuffer(Vulkan::InstanceObject& Instance, VkDeviceSize Size,
+                  VkBufferUsageFlags Usage, VkFlags Props,
+                  VkBuffer* Buffer, VkDeviceMemory* Memory);
+
+// The stages and accesses an image in Layout is typically used with
+// Good for either side of a barrier in to or out of that layout
+void GetLayoutUsage(VkImageLayout Layout, VkPipelineStageFlags* Stage, VkAccessFlags* Access);
+
+// Moves every texture to NewLayout in one barrier call
+void TransitionAll(VkCommandBuffer Cmd, const std::vector<Texture2D*>& Textures, VkImageLayout NewLayout);
 }
 }
@@ -7,12 +7,17 @@
 namespace Vulkan
 {
 	VkPipelineVertexInputStateCreateInfo VertexBuffer::mVI;
+	VkVertexInputBindingDescription VertexBuffer::mVIBindings[16];
+	VkVertexInputAttributeDescription VertexBuffer::mVIAttributes[16];
+	uint32_t VertexBuffer::mNumBindings = 0;
+	uint32_t VertexBuffer::mNumAttribs = 0;
 
 	VertexBuffer::VertexBuffer(Vulkan::InstanceObject& Instance,
 	                           const std::vector<float>& Vertices,
 			               uint32_t BindingID,
 	                           uint32_t Stride,
-			               VkBufferUsageFlagBits Usage)
+			               VkBufferUsageFlagBits Usage,
+			               VkVertexInputRate InputRate)
 		: mBindingID(BindingID)
 	{
 		VkResult err;
@@ -58,6 +63,7 @@ namespace Vulkan
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
 		printf("MemTypeIndex %d\n", MemTypeIndex);
 		assert(MemTypeIndex != ~0U);
+		MemAllocate.memoryTypeIndex = MemTypeIndex;
 
 		// Allocate the memory
 		err = vkAllocateMemory(*Instance.GetDevice(), &MemAllocate, nullptr, &mMemory);
@@ -78,25 +84,33 @@ namespace Vulkan
 		CHECK_ERR(err);
 
 		// Setup the vertex bindings
-		mVIBinding.binding = mBindingID;
-		mVIBinding.stride = Stride;
-		mVIBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		AddBinding({
+			.binding = mBindingID,
+			.stride = Stride,
+			.inputRate = InputRate});
+	}
+
+	VertexBuffer::~VertexBuffer()
+	{
+	}
+
+	void VertexBuffer::AddBinding(VkVertexInputBindingDescription VIBinding)
+	{
+		assert(mNumBindings < 16);
+		memcpy(&mVIBindings[mNumBindings], &VIBinding, sizeof(VkVertexInputBindingDescription));
 
 		// Setup the vertex input info
 		mVI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 		mVI.pNext = nullptr;
 		mVI.flags = 0;
-		mVI.vertexBindingDescriptionCount = 1;
-		mVI.pVertexBindingDescriptions = &mVIBinding;
+		mVI.vertexBindingDescriptionCount = ++mNumBindings;
+		mVI.pVertexBindingDescriptions = mVIBindings;
 		mVI.pVertexAttributeDescriptions = mVIAttributes;
 	}
 
-	VertexBuffer::~VertexBuffer()
-	{
-	}
-
 	void VertexBuffer::AddAttribute(VkVertexInputAttributeDescription VIAttribute)
 	{
+		assert(mNumAttribs < 16);
 		memcpy(&mVIAttributes[mNumAttribs], &VIAttribute, sizeof(VkVertexInputAttributeDescription));
 
 		mVI.vertexAttributeDescriptionCount = ++mNumAttribs;
@@ -146,6 +160,7 @@ namespace Vulkan
 		                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
 		printf("MemTypeIndex %d\n", MemTypeIndex);
 		assert(MemTypeIndex != ~0U);
+		MemAllocate.memoryTypeIndex = MemTypeIndex;
 
 		// Allocate the memory
 		err = vkAllocateMemory(*Instance.GetDevice(), &MemAllocate, nullptr, &mMemory);
@@ -172,6 +187,30 @@ namespace Vulkan
 	{
 	}
 
+	StorageBuffer::StorageBuffer(Vulkan::InstanceObject& Instance,
+	                             VkDeviceSize Size, VkBufferUsageFlags Usage,
+	                             VkMemoryPropertyFlags MemoryProperty)
+		: mSize(Size)
+	{
+		VkResult err;
+
+		Util::CreateBuffer(Instance, Size, Usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | MemoryProperty,
+		                   &mBuffer, &mMemory);
+
+		// Keep it mapped, remapping per update is a waste
+		err = vkMapMemory(*Instance.GetDevice(), mMemory, 0, mSize, 0, &mData);
+		CHECK_ERR(err);
+
+		// Setup descriptor
+		mDesc.buffer = mBuffer;
+		mDesc.offset = 0;
+		mDesc.range = Size;
+	}
+
+	StorageBuffer::~StorageBuffer()
+	{
+	}
+
 	UniformBuffer::UniformBuffer(Vulkan::InstanceObject& Instance,
 	                             uint32_t Size, VkMemoryPropertyFlagBits MemoryProperty)
 	{
@@ -216,6 +255,7 @@ namespace Vulkan
 		                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | MemoryProperty);
 
 		assert(MemTypeIndex != ~0U);
+		MemAllocate.memoryTypeIndex = MemTypeIndex;
 
 		// Allocate the memory
 		err = vkAllocateMemory(*Instance.GetDevice(), &MemAllocate, nullptr, &mMemory);
@@ -15,19 +15,24 @@ public:
 	             const std::vector<float>& Vertices,
 			 uint32_t BindingID,
 	             uint32_t Stride,
-			 VkBufferUsageFlagBits Usage);
+			 VkBufferUsageFlagBits Usage,
+			 VkVertexInputRate InputRate = VK_VERTEX_INPUT_RATE_VERTEX);
 	~VertexBuffer();
 
 	static std::unique_ptr<VertexBuffer> Create(Vulkan::InstanceObject& Instance,
 		const std::vector<float>& Vertices,
 		uint32_t BindingID,
 		uint32_t Stride,
-		VkBufferUsageFlagBits Usage)
+		VkBufferUsageFlagBits Usage,
+		VkVertexInputRate InputRate = VK_VERTEX_INPUT_RATE_VERTEX)
 	{
-		return std::make_unique<VertexBuffer>(Instance, Vertices, BindingID, Stride, Usage);
+		return std::make_unique<VertexBuffer>(Instance, Vertices, BindingID, Stride, Usage, InputRate);
 	}
 
-	void AddAttribute(VkVertexInputAttributeDescription VIAttribute);
+	// The vertex input state is shared by every binding we create
+	// Bindings that aren't backed by a VertexBuffer can register themselves here
+	static void AddBinding(VkVertexInputBindingDescription VIBinding);
+	static void AddAttribute(VkVertexInputAttributeDescription VIAttribute);
 
 	// Device Objects
 	VkBuffer* GetBuffer() { return &mBuffer; }
@@ -44,12 +49,12 @@ private:
 	VkDeviceMemory mMemory{};
 
 	static VkPipelineVertexInputStateCreateInfo mVI;
-	VkVertexInputBindingDescription mVIBinding{};
-	VkVertexInputAttributeDescription mVIAttributes[16]{};
+	static VkVertexInputBindingDescription mVIBindings[16];
+	static VkVertexInputAttributeDescription mVIAttributes[16];
+	static uint32_t mNumBindings;
+	static uint32_t mNumAttribs;
 
 	const uint32_t mBindingID;
-
-	uint32_t mNumAttribs = 0;
 };
 
 class IndicesBuffer
@@ -78,6 +83,44 @@ private:
 	uint32_t mCount;
 };
 
+// Host visible buffer that stays mapped for its whole lifetime
+// For data the CPU rewrites often, like per-instance data
+class StorageBuffer
+{
+public:
+	StorageBuffer(Vulkan::InstanceObject& Instance,
+	              VkDeviceSize Size, VkBufferUsageFlags Usage,
+	              VkMemoryPropertyFlags MemoryProperty);
+	~StorageBuffer();
+
+	static std::unique_ptr<StorageBuffer> Create(Vulkan::InstanceObject& Instance,
+		VkDeviceSize Size, VkBufferUsageFlags Usage,
+		VkMemoryPropertyFlags MemoryProperty = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+	{
+		return std::make_unique<StorageBuffer>(Instance, Size, Usage, MemoryProperty);
+	}
+
+	// Device Objects
+	VkBuffer GetBuffer() const { return mBuffer; }
+	VkDeviceMemory GetMemory() const { return mMemory; }
+	const VkDescriptorBufferInfo* GetDesc() const { return &mDesc; }
+
+	// Information
+	VkDeviceSize GetSize() const { return mSize; }
+
+	template<typename T>
+	T* GetData() const { return static_cast<T*>(mData); }
+
+private:
+	VkBuffer mBuffer{};
+	VkDeviceMemory mMemory{};
+	VkDescriptorBufferInfo mDesc{};
+
+	VkDeviceSize mSize;
+
+	void *mData;
+};
+
 class UniformBuffer
 {
 public:
@@ -1,4 +1,5 @@
 #include "Vulkan.h"
+#include "Profiler.h"
 
 #include <algorithm>
 #include <array>
@@ -58,6 +59,7 @@ namespace Vulkan
 	InstanceObject::InstanceObject(bool validate)
 		: mValidate(validate)
 	{
+		PROFILE_SCOPE("InstanceObject");
 		std::vector<const char*> Extensions;
 		std::vector<VkExtensionProperties> InstanceExtensions;
 		const char** RequiredExtensions;
@@ -71,6 +73,17 @@ namespace Vulkan
 			mInstanceExtensionNames[mInstanceExtensions++] = RequiredExtensions[i];
 		}
 
+		// Needed to query descriptor indexing support
+		for (const auto& ext : InstanceExtensions)
+		{
+			if (!strcmp(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+			            ext.extensionName))
+			{
+				mInstanceExtensionNames[mInstanceExtensions++] = ext.extensionName;
+				break;
+			}
+		}
+
 		if (mValidate)
 		{
 			for (const auto& ext : InstanceExtensions)
@@ -127,6 +140,8 @@ namespace Vulkan
 		GET_INSTANCE_ADDR(this, GetPhysicalDeviceSurfacePresentModesKHR);
 		GET_INSTANCE_ADDR(this, GetPhysicalDeviceSurfaceSupportKHR);
 		GET_INSTANCE_ADDRS(this, CreateDebugReportCallback, EXT);
+		GET_INSTANCE_ADDRS(this, GetPhysicalDeviceFeatures2, KHR);
+		GET_INSTANCE_ADDRS(this, GetPhysicalDeviceProperties2, KHR);
 
 		if (!CreateDebugReportCallback)
 		{
@@ -152,6 +167,15 @@ namespace Vulkan
 
 	void InstanceObject::SetDeviceExtensions()
 	{
+		// Extensions we take advantage of when the device exposes them
+		const char* OptionalExtensions[] =
+		{
+			VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME,
+			VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+			VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+			VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,
+		};
+
 		std::vector<VkExtensionProperties> Extensions;
 		Vulkan::GetDeviceExtensions(*this, &Extensions);
 		for (auto ext : Extensions)
@@ -160,9 +184,29 @@ namespace Vulkan
 			            ext.extensionName))
 			{
 				mDeviceExtensionNames[mDeviceExtensions++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
-				break;
+				continue;
 			}
+
+			for (const char* Optional : OptionalExtensions)
+			{
+				if (!strcmp(Optional, ext.extensionName))
+				{
+					printf("Enabling device extension %s\n", Optional);
+					mDeviceExtensionNames[mDeviceExtensions++] = Optional;
+					break;
+				}
+			}
+		}
+	}
+
+	bool InstanceObject::HasDeviceExtension(const char* Name)
+	{
+		for (uint32_t i = 0; i < mDeviceExtensions; ++i)
+		{
+			if (!strcmp(Name, mDeviceExtensionNames[i]))
+				return true;
 		}
+		return false;
 	}
 
 	const char** GetRequiredExtensions(uint32_t *count)
@@ -218,8 +262,9 @@ namespace Vulkan
 		inst.SetGPU(GPUs[0]);
 	}
 
-	void CreateDevice(InstanceObject& inst)
+	bool CreateDevice(InstanceObject& inst)
 	{
+		PROFILE_SCOPE("CreateDevice");
 		VkResult err;
 		float queue_priorities[1] = { 0.0 };
 		uint32_t ExtensionCount;
@@ -265,10 +310,65 @@ namespace Vulkan
 			.pQueuePriorities = queue_priorities,
 		};
 
+		// Core features we make use of when they're there
+		VkPhysicalDeviceFeatures Supported;
+		vkGetPhysicalDeviceFeatures(inst.GetGPU(), &Supported);
+		VkPhysicalDeviceFeatures* Enabled = inst.GetEnabledFeatures();
+		*Enabled = {};
+		Enabled->multiDrawIndirect = Supported.multiDrawIndirect;
+		Enabled->drawIndirectFirstInstance = Supported.drawIndirectFirstInstance;
+
+		// The texture table is indexed with a push constant, bindless or not
+		if (!Supported.shaderSampledImageArrayDynamicIndexing)
+		{
+			fprintf(stderr, "GPU can't dynamically index sampler arrays, the texture table needs it\n");
+			return false;
+		}
+		Enabled->shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+
+		// Descriptor indexing features have to be explicitly turned on
+		// Only bother when everything the bindless texture table needs is there
+		VkPhysicalDeviceFeatures2KHR Features2 =
+		{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR,
+			.pNext = &inst.mDescriptorIndexing,
+		};
+		inst.mDescriptorIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		inst.mDescriptorIndexing.pNext = nullptr;
+
+		void* DevicePNext = nullptr;
+		if (inst.HasDeviceExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) &&
+		    inst.GetPhysicalDeviceFeatures2 && inst.GetPhysicalDeviceProperties2)
+		{
+			inst.GetPhysicalDeviceFeatures2(inst.GetGPU(), &Features2);
+			if (inst.SupportsBindless())
+			{
+				printf("Using bindless textures\n");
+				DevicePNext = &inst.mDescriptorIndexing;
+
+				// Limits on how big the table can get
+				VkPhysicalDeviceProperties2KHR Properties2 =
+				{
+					.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR,
+					.pNext = &inst.mDescriptorIndexingProps,
+				};
+				inst.mDescriptorIndexingProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+				inst.mDescriptorIndexingProps.pNext = nullptr;
+				inst.GetPhysicalDeviceProperties2(inst.GetGPU(), &Properties2);
+			}
+		}
+
+		if (!DevicePNext)
+		{
+			// Make sure nothing reads stale feature bits
+			inst.mDescriptorIndexing = {};
+			inst.mDescriptorIndexingProps = {};
+		}
+
 		VkDeviceCreateInfo DeviceInfo =
 		{
 			.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-			.pNext = nullptr,
+			.pNext = DevicePNext,
 			.flags = 0,
 			.queueCreateInfoCount = 1,
 			.pQueueCreateInfos = &DeviceCreateInfo,
@@ -276,6 +376,7 @@ namespace Vulkan
 			.ppEnabledLayerNames = LayerNames,
 			.enabledExtensionCount = ExtensionCount,
 			.ppEnabledExtensionNames = Extensions,
+			.pEnabledFeatures = inst.GetEnabledFeatures(),
 		};
 
 		err = vkCreateDevice(inst.GetGPU(), &DeviceInfo, nullptr, inst.GetDevice());
@@ -288,8 +389,20 @@ namespace Vulkan
 		GET_DEVICE_ADDR(inst, AcquireNextImageKHR);
 		GET_DEVICE_ADDR(inst, QueuePresentKHR);
 
-		vkGetDeviceQueue(*inst.GetDevice(), inst.GetPresentQueueIndex(), 0, inst.GetQueue());
+		if (inst.HasDeviceExtension(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME))
+		{
+			GET_DEVICE_ADDR(inst, CreateDescriptorUpdateTemplateKHR);
+			GET_DEVICE_ADDR(inst, DestroyDescriptorUpdateTemplateKHR);
+			GET_DEVICE_ADDR(inst, UpdateDescriptorSetWithTemplateKHR);
+		}
 
+		if (inst.HasDeviceExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME))
+		{
+			GET_DEVICE_ADDR(inst, CmdDrawIndexedIndirectCountKHR);
+		}
+
+		vkGetDeviceQueue(*inst.GetDevice(), inst.GetPresentQueueIndex(), 0, inst.GetQueue());
+		return true;
 	}
 
 	void GetDeviceValidationLayers(InstanceObject& inst, std::vector<VkLayerProperties>* Layers)
@@ -372,69 +485,12 @@ namespace Vulkan
 		assert(!err);
 	}
 
-	////////////////////////////////////////////////
-	// Pools
-	////////////////////////////////////////////////
-	void CreateCommandPool(InstanceObject& inst)
-	{
-		VkResult err;
-		const VkCommandPoolCreateInfo CommandPoolCreateInfo =
-		{
-			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-			.pNext = nullptr,
-			.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-			.queueFamilyIndex = inst.GetPresentQueueIndex(),
-		};
-
-		err = vkCreateCommandPool(*inst.GetDevice(), &CommandPoolCreateInfo, nullptr, &inst.mCommandPool);
-		assert(!err);
-
-		const VkCommandBufferAllocateInfo CommandBufferAllocateInfo =
-		{
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-			.pNext = nullptr,
-			.commandPool = inst.mCommandPool,
-			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-			.commandBufferCount = 1,
-		};
-
-		err = vkAllocateCommandBuffers(*inst.GetDevice(), &CommandBufferAllocateInfo, &inst.mDrawCommand);
-		assert(!err);
-
-		err = vkAllocateCommandBuffers(*inst.GetDevice(), &CommandBufferAllocateInfo, &inst.mSetupCommand);
-		CHECK_ERR(err);
-	}
-
-	void SubmitSetupQueue(InstanceObject& inst)
-	{
-		VkResult err;
-		VkFence NullFence = VK_NULL_HANDLE;
-		VkSubmitInfo SubmitInfo =
-		{
-			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-			.pNext = nullptr,
-			.waitSemaphoreCount = 0,
-			.pWaitSemaphores = nullptr,
-			.pWaitDstStageMask = nullptr,
-			.commandBufferCount = 1,
-			.pCommandBuffers = &inst.mSetupCommand,
-			.signalSemaphoreCount = 0,
-			.pSignalSemaphores = nullptr,
-		};
-
-		err = vkQueueSubmit(*inst.GetQueue(), 1, &SubmitInfo, NullFence);
-		CHECK_ERR(err);
-
-		err = vkQueueWaitIdle(*inst.GetQueue());
-		CHECK_ERR(err);
-
-	}
-
 	////////////////////////////////////////////////
 	// SwapChain
 	////////////////////////////////////////////////
 	void CreateSwapChain(InstanceObject& inst)
 	{
+		PROFILE_SCOPE("CreateSwapChain");
 		VkResult err;
 		VkSwapchainKHR OldSwapChain = inst.mSwapChain;
 		VkSurfaceCapabilitiesKHR SurfaceCaps;
@@ -1,6 +1,15 @@
 #pragma once
 
+#include "CommandAllocator.h"
+#include "DescriptorUpdater.h"
+#include "IndirectCuller.h"
+#include "SetupBatch.h"
 #include "Texture2D.h"
+#include "TextureAtlas.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+#include "TextureTable.h"
 #include "VertexInfo.h"
 
 #include <vulkan/vulkan.h>
@@ -62,6 +71,22 @@ namespace Vulkan
 			*count = mDeviceExtensions;
 			return mDeviceExtensionNames;
 		}
+		bool HasDeviceExtension(const char* Name);
+
+		// Features
+		// Core features turned on at device creation
+		VkPhysicalDeviceFeatures* GetEnabledFeatures() { return &mEnabledFeatures; }
+
+		// Everything the bindless texture table relies on
+		bool SupportsBindless() const
+		{
+			return mDescriptorIndexing.runtimeDescriptorArray &&
+			       mDescriptorIndexing.descriptorBindingPartiallyBound &&
+			       mDescriptorIndexing.descriptorBindingSampledImageUpdateAfterBind &&
+			       mDescriptorIndexing.shaderSampledImageArrayNonUniformIndexing;
+		}
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT mDescriptorIndexing{};
+		VkPhysicalDeviceDescriptorIndexingPropertiesEXT mDescriptorIndexingProps{}; // Only filled in when bindless
 
 
 		// Instance Function pointers
@@ -75,6 +100,10 @@ namespace Vulkan
 			GetPhysicalDeviceSurfaceSupportKHR;
 		PFN_vkCreateDebugReportCallbackEXT
 			CreateDebugReportCallback;
+		PFN_vkGetPhysicalDeviceFeatures2KHR
+			GetPhysicalDeviceFeatures2;
+		PFN_vkGetPhysicalDeviceProperties2KHR
+			GetPhysicalDeviceProperties2;
 
 
 		// Device function pointers
@@ -84,12 +113,21 @@ namespace Vulkan
 		PFN_vkAcquireNextImageKHR AcquireNextImageKHR;
 		PFN_vkQueuePresentKHR QueuePresentKHR;
 
-		// Command pool
-		VkCommandPool mCommandPool;
+		// Optional device function pointers
+		// nullptr when the extension isn't available
+		PFN_vkCreateDescriptorUpdateTemplateKHR CreateDescriptorUpdateTemplateKHR{};
+		PFN_vkDestroyDescriptorUpdateTemplateKHR DestroyDescriptorUpdateTemplateKHR{};
+		PFN_vkUpdateDescriptorSetWithTemplateKHR UpdateDescriptorSetWithTemplateKHR{};
+		PFN_vkCmdDrawIndexedIndirectCountKHR CmdDrawIndexedIndirectCountKHR{};
+
+		// Per frame, per thread command buffers
+		std::unique_ptr<CommandAllocator> mCommands;
+
+		// Transitions and uploads for resource creation, submitted in one go
+		std::unique_ptr<SetupBatch> mSetup;
 
 		// Command Buffer
-		VkCommandBuffer mDrawCommand{};
-		VkCommandBuffer mSetupCommand{}; // For initialization
+		VkCommandBuffer mDrawCommand{}; // From mCommands, only valid for the current frame
 
 		// Swap chain
 		VkSwapchainKHR mSwapChain = VK_NULL_HANDLE;
@@ -117,6 +155,7 @@ namespace Vulkan
 		VkDescriptorPool mDescriptorPool;
 		VkDescriptorSetLayout mDescriptorLayout;
 		VkPipelineLayout mPipelineLayout;
+		std::unique_ptr<DescriptorUpdater> mDescriptorUpdater;
 
 		// Uniform buffer
 		struct
@@ -134,11 +173,28 @@ namespace Vulkan
 		// Indices
 		std::unique_ptr<IndicesBuffer> mIndices;
 
-		// Depth texture
-		std::unique_ptr<Texture2D> mDepth;
+		// Per-instance data
+		std::unique_ptr<StorageBuffer> mInstanceData;
+		uint32_t mInstanceCount;
+
+		// GPU driven culling, null when it's off
+		std::unique_ptr<IndirectCuller> mCuller;
 
 		// Textures
 		std::unique_ptr<Sampler> mSampler;
+		std::unique_ptr<TextureTable> mTextures;
+		uint32_t mTextureIndex;
+		uint32_t mTextureLayer = 0;
+
+		// Scale then offset for the UVs of the drawn texture, for when it's in the atlas
+		float mTextureUV[4] = { 1.0f, 1.0f, 0.0f, 0.0f };
+
+		// Everything else loaded in to the table
+		std::vector<std::unique_ptr<Sampler>> mSamplers;
+		std::unique_ptr<TextureBatchLoader> mTextureLoader;
+		std::unique_ptr<TextureCache> mTextureCache;
+		std::unique_ptr<TextureStreamer> mStreamer;
+		std::unique_ptr<TextureAtlas> mAtlas;
 
 		// Debug callback
 		VkDebugReportCallbackEXT mMsgCallback;
@@ -178,6 +234,8 @@ namespace Vulkan
 		VkFormat mFormat;
 
 		VkPhysicalDeviceMemoryProperties mMemProp;
+
+		VkPhysicalDeviceFeatures mEnabledFeatures{};
 	};
 
 	const char** GetRequiredExtensions(uint32_t* count);
@@ -195,7 +253,8 @@ namespace Vulkan
 	// Used to bind a GPU to your instance
 	void UseGPU(InstanceObject& inst, uint32_t index);
 	// Use this to create a device
-	void CreateDevice(InstanceObject& inst);
+	// False when the GPU is missing a feature we can't run without
+	bool CreateDevice(InstanceObject& inst);
 
 	// Only use these once you have bound a GPU to your instance!
 	void GetDeviceValidationLayers(InstanceObject& inst, std::vector<VkLayerProperties>* Layers);
@@ -214,12 +273,6 @@ namespace Vulkan
 	VkBool32 QueueSupportsPresent(InstanceObject& inst, uint32_t index);
 	void GetSurfaceFormats(InstanceObject& inst, std::vector<VkSurfaceFormatKHR>* Formats);
 
-	////////////////////////////////////////////////
-	// Pools
-	////////////////////////////////////////////////
-	void CreateCommandPool(InstanceObject& inst);
-	void SubmitSetupQueue(InstanceObject& inst);
-
 	////////////////////////////////////////////////
 	// SwapChain
 	////////////////////////////////////////////////
@@ -1,11 +1,30 @@
+#include "AssetPack.h"
+#include "Bench.h"
+#include "CPUCulling.h"
 #include "Context.h"
+#include "FileWatcher.h"
+#include "JobSystem.h"
 #include "PNGLoader.h"
+#include "ParallelRecorder.h"
+#include "Profiler.h"
+#include "RenderGraph.h"
+#include "RenderQueue.h"
+#include "TaskGraph.h"
+#include "TextureAtlas.h"
+#include "TransformSystem.h"
+#include "Utils.h"
 #include "Vulkan.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <atomic>
 #include <chrono>
+#include <deque>
+#include <map>
+#include <math.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <thread>
 
@@ -16,6 +35,137 @@ float zoom = -2.5f;
 glm::vec3 rotation{};
 
 const uint32_t VERTEX_BUFFER_BIND_ID = 0;
+const uint32_t INSTANCE_BUFFER_BIND_ID = 1;
+
+// Instanced quads
+// Counts can be changed with --instances, --bench-instances walks 1 to 1M
+uint32_t gInstanceCount = 1;
+uint32_t gMaxInstances = 1;
+bool gBenchInstances = false;
+bool gGPUCulling = false;
+
+// CPU culling keeps the full set of instances here
+// and only copies the visible ones in to the instance buffer
+bool gCPUCulling = false;
+std::unique_ptr<Vulkan::CPUCuller> gCPUCuller;
+Vulkan::SphereBounds gBounds;
+std::vector<uint32_t> gVisible;
+uint32_t gVisibleCount = 0;
+const uint32_t BENCH_MAX_INSTANCES = 1000000;
+std::chrono::high_resolution_clock::duration gRecordTime{};
+
+// What the instance buffer holds for every quad
+struct InstanceData
+{
+	glm::mat4 Model;
+};
+std::vector<InstanceData> gInstances;
+
+// Every quad's transform, only the ones that change get rewritten each frame
+// --spin rotates every quad each frame to stress it
+Vulkan::TransformSystem gTransforms;
+bool gSpin = false;
+float gSpinAngle = 0.0f;
+
+// Draws go through the render queue so only changed state gets bound
+// --instances-per-draw splits the grid in to many draws, 0 keeps it as one
+std::unique_ptr<Vulkan::RenderQueue> gRenderQueue;
+uint32_t gInstancesPerDraw = 0;
+
+// Culling, transform updates and recording all share the one job system
+// --threads sets how many threads it has, one per core by default
+std::unique_ptr<Vulkan::JobSystem> gJobs;
+uint32_t gThreads = 0;
+bool gPinThreads = false;
+bool gSerialStartup = false;
+
+// --profile times the load path and writes a chrome://tracing file on exit
+const char* gTracePath = nullptr;
+
+// Every --texture gets loaded in to the texture table, the first is the one drawn
+std::vector<std::string> gTextureFiles;
+
+// Decoded textures are kept here between runs, --no-texture-cache turns it off
+const char* gTextureCachePath = "TextureCache";
+uint64_t gTextureCacheSize = 256 * 1024 * 1024;
+
+// --pack loads whatever is in the pack from it instead of the loose files
+// --build-pack packs up the textures and shaders that would have been loaded and exits
+std::unique_ptr<Vulkan::AssetPack> gAssetPack;
+const char* gBuildPackPath = nullptr;
+
+// --stream-budget streams the packed textures under that many MB instead of loading them whole
+uint64_t gStreamBudget = 0;
+
+// --atlas packs the small textures in to one atlas instead of giving each its own image
+bool gAtlas = false;
+const uint32_t ATLAS_MAX_TEXTURE = 256;
+
+// --texture-arrays puts textures of the same size in to layers of one array texture
+bool gTextureArrays = false;
+
+// --hot-reload watches the textures and shaders, anything changed gets swapped in between frames
+bool gHotReload = false;
+std::unique_ptr<Vulkan::FileWatcher> gWatcher;
+
+// Where each texture loaded from its own file ended up, so a new version can go in the same place
+struct LoadedTexture
+{
+	Vulkan::Sampler* Sampler;
+	uint32_t TableIndex;
+	uint32_t Layer;
+};
+std::map<std::string, LoadedTexture> gLoadedTextures;
+
+// Decoded or read on the job system, applied in the order they were started
+struct Reload
+{
+	std::string File;
+	bool Shader;
+
+	// Shaders
+	std::string VS, FS;
+
+	// Textures, the whole mip chain tightly packed
+	std::vector<uint8_t> Chain;
+	uint32_t Width, Height, Levels;
+	bool Loaded;
+
+	Vulkan::JobCounter Done;
+};
+std::deque<std::unique_ptr<Reload>> gReloads;
+
+std::unique_ptr<Vulkan::ParallelRecorder> gRecorder;
+
+// Rebuilt every frame, works out the barriers between culling, drawing and present
+// Also owns the transient targets, placed in memory by when its passes use them
+Vulkan::RenderGraph gFrameGraph;
+uint32_t gDepthTarget;
+
+// Framebuffers hold the transients' views, so they get remade whenever those are
+uint32_t gFramebufferGeneration = 0;
+
+// Descriptor set the bindless texture table lives in
+const uint32_t TEXTURE_TABLE_SET = 1;
+const uint32_t TEXTURE_TABLE_CAPACITY = 4096;
+
+// Per draw data handed over through push constants
+struct DrawConstants
+{
+	float UVTransform[4]; // Scale then offset, only not the identity for atlased textures
+	uint32_t TextureIndex;
+	uint32_t TextureLayer;
+};
+
+DrawConstants GetDrawConstants(Vulkan::InstanceObject& Instance)
+{
+	return
+	{
+		.UVTransform = { Instance.mTextureUV[0], Instance.mTextureUV[1], Instance.mTextureUV[2], Instance.mTextureUV[3] },
+		.TextureIndex = Instance.mTextureIndex,
+		.TextureLayer = Instance.mTextureLayer,
+	};
+}
 
 void GetInstanceInfo()
 {
@@ -139,82 +289,8 @@ void GetDeviceInfo(Vulkan::InstanceObject& Instance)
 	}
 }
 
-void SetImageLayout(Vulkan::InstanceObject& Instance, VkImage Image,
-                    VkImageAspectFlags AspectMask,
-			  VkImageLayout OldLayout,
-			  VkImageLayout NewLayout)
-{
-	VkResult err;
-	const VkCommandBufferInheritanceInfo CommandBufferInherentInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
-		.pNext = nullptr,
-		.renderPass = VK_NULL_HANDLE,
-		.subpass = 0,
-		.framebuffer = VK_NULL_HANDLE,
-		.occlusionQueryEnable = VK_FALSE,
-		.queryFlags = 0,
-		.pipelineStatistics = 0,
-	};
-
-	const VkCommandBufferBeginInfo CommandBufferInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.pNext = nullptr,
-		.flags = 0,
-		.pInheritanceInfo = &CommandBufferInherentInfo,
-	};
-
-	err = vkBeginCommandBuffer(Instance.mSetupCommand, &CommandBufferInfo);
-	CHECK_ERR(err);
-
-	// Let's actually set the image layout now
-	VkImageMemoryBarrier MemoryBarrier =
-	{
-		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		.pNext = nullptr,
-		.srcAccessMask = 0,
-		.dstAccessMask = 0,
-		.oldLayout = OldLayout,
-		.newLayout = NewLayout,
-		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.image = Image,
-		.subresourceRange = {AspectMask, 0, 1, 0, 1},
-	};
-
-	switch (NewLayout)
-	{
-	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-		MemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		break;
-	case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
-		MemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		break;
-	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
-		MemoryBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-		break;
-	case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
-		MemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
-		break;
-	default:
-		// Do nothing
-		break;
-	}
-
-	VkPipelineStageFlags SrcStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	VkPipelineStageFlags DstStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-
-	vkCmdPipelineBarrier(Instance.mSetupCommand, SrcStage, DstStage, 0, 0, nullptr,
-	                     0, nullptr, 1, &MemoryBarrier);
-
-	err = vkEndCommandBuffer(Instance.mSetupCommand);
-	CHECK_ERR(err);
-
-	Vulkan::SubmitSetupQueue(Instance);
-}
-
-void GenerateSwapChain(Vulkan::InstanceObject& Instance)
+// False when the device couldn't be made
+bool GenerateSwapChain(Vulkan::InstanceObject& Instance)
 {
 	std::vector<VkQueueFamilyProperties> Queues;
 	Vulkan::GetDeviceQueueProperties(Instance, &Queues);
@@ -235,7 +311,8 @@ void GenerateSwapChain(Vulkan::InstanceObject& Instance)
 
 	Instance.SetPresentQueueIndex(PresentGraphicsQueue);
 
-	Vulkan::CreateDevice(Instance);
+	if (!Vulkan::CreateDevice(Instance))
+		return false;
 
 	std::vector<VkSurfaceFormatKHR> SurfaceFormats;
 
@@ -251,11 +328,18 @@ void GenerateSwapChain(Vulkan::InstanceObject& Instance)
 	// For now let's just use format 0
 	Instance.SetSurfaceFormat(SurfaceFormats[0].format);
 
+	Vulkan::GetDeviceProperties(Instance);
 	Vulkan::GetMemoryProperties(Instance);
 
-	Vulkan::CreateCommandPool(Instance);
+	// Every thread that might create resources gets its own buffer
+	Instance.mSetup = Vulkan::SetupBatch::Create(Instance, gJobs->GetThreads());
 
 	Vulkan::CreateSwapChain(Instance);
+
+	// A frame in flight per swap chain image, and a pool for every thread that records
+	Instance.mCommands = Vulkan::CommandAllocator::Create(Instance, Instance.mSwapChainBuffers.size(),
+		gJobs->GetThreads());
+	return true;
 }
 
 void GetSurfaceCapabilities(Vulkan::InstanceObject& Instance)
@@ -274,6 +358,157 @@ void GetSurfaceCapabilities(Vulkan::InstanceObject& Instance)
 	printf("Max image layers: %d\n", SurfaceCaps.maxImageArrayLayers);
 }
 
+// Queues the quads as draws of up to gInstancesPerDraw instances each
+// Draws take turns between the first texture and the streamed ones, which get requested at
+// the size the quads are on screen, so splitting the draws up is what streams their mips in
+void QueueQuads(Vulkan::InstanceObject& Instance, uint32_t Count)
+{
+	assert(Count <= gMaxInstances);
+
+	gRenderQueue->Reset();
+
+	// Every quad is the same size, one cell of the grid FillInstanceGrid lays out
+	const uint32_t Streamed = Instance.mStreamer ? Instance.mStreamer->GetCount() : 0;
+	const uint32_t Side = (uint32_t)ceilf(sqrtf((float)std::max(Instance.mInstanceCount, 1U)));
+	const float ScreenSize = (float)std::max(gWidth, gHeight) / Side;
+
+	const uint32_t PerDraw = gInstancesPerDraw ? gInstancesPerDraw : std::max(Count, 1U);
+	for (uint32_t First = 0, DrawIndex = 0; First < Count; First += PerDraw, ++DrawIndex)
+	{
+		Vulkan::DrawPacket Packet =
+		{
+			.Key = 0,
+			.Pipeline = Instance.mPipeline,
+			.Layout = Instance.mPipelineLayout,
+			.Set = Instance.mDescriptorSet,
+			.VertexBuffers =
+			{
+				*Instance.mVertices->GetBuffer(), // VERTEX_BUFFER_BIND_ID
+				Instance.mInstanceData->GetBuffer(), // INSTANCE_BUFFER_BIND_ID
+			},
+			.VertexCount = Instance.mVerticeCount,
+			.InstanceCount = std::min(PerDraw, Count - First),
+			.FirstVertex = 0,
+			.FirstInstance = First,
+		};
+
+		DrawConstants Constants = GetDrawConstants(Instance);
+		const uint32_t Texture = DrawIndex % (Streamed + 1);
+		if (Texture)
+		{
+			// Sticks with the first texture until the tail is in the table
+			Instance.mStreamer->Request(Texture - 1, ScreenSize);
+			const uint32_t TableIndex = Instance.mStreamer->GetTableIndex(Texture - 1);
+			if (TableIndex != ~0U)
+			{
+				Constants = { .UVTransform = { 1.0f, 1.0f, 0.0f, 0.0f }, .TextureIndex = TableIndex, .TextureLayer = 0 };
+			}
+		}
+		memcpy(Packet.Constants, &Constants, sizeof(Constants));
+
+		// Everything sits on the z = 0 plane, so there's no depth to sort by yet
+		gRenderQueue->Submit(0, 0.0f, Packet);
+	}
+
+	gRenderQueue->Sort();
+}
+
+// Writes out the model matrices of any quads that moved
+// With CPU culling they go to gInstances and get packed in to the instance buffer when culling
+void UpdateInstances(Vulkan::InstanceObject& Instance)
+{
+	if (gSpin)
+	{
+		gSpinAngle += 0.01f;
+		const glm::quat Spin = glm::angleAxis(gSpinAngle, glm::vec3(0.0f, 0.0f, 1.0f));
+		for (uint32_t i = 0; i < gTransforms.Size(); ++i)
+			gTransforms.SetRotation(i, Spin);
+	}
+
+	InstanceData* Data = gCPUCulling ? &gInstances[0] : Instance.mInstanceData->GetData<InstanceData>();
+	gTransforms.Update(&Data[0].Model, sizeof(InstanceData), gJobs.get());
+}
+
+// Culls the instances on the CPU and packs the visible ones in to the instance buffer
+void CullInstances(Vulkan::InstanceObject& Instance)
+{
+	// Bounds are in the space of the shared model matrix
+	const glm::mat4 MVP = Instance.mUBOData.projectionMatrix *
+	                      Instance.mUBOData.viewMatrix *
+	                      Instance.mUBOData.modelMatrix;
+	gVisibleCount = gCPUCuller->Cull(Vulkan::ExtractFrustum(MVP), gBounds, &gVisible);
+
+	InstanceData* Data = Instance.mInstanceData->GetData<InstanceData>();
+	for (uint32_t i = 0; i < gVisibleCount; ++i)
+		Data[i] = gInstances[gVisible[i]];
+}
+
+// State every command buffer in the render pass needs before drawing
+// Secondaries don't inherit any of it, so each one sets it up again
+void SetFrameState(Vulkan::InstanceObject& Instance, VkCommandBuffer Cmd)
+{
+	// Every texture lives in the table, so it only needs binding the once
+	const VkDescriptorSet TextureSet = Instance.mTextures->GetSet();
+	vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, Instance.mPipelineLayout,
+	                        TEXTURE_TABLE_SET, 1, &TextureSet, 0, nullptr);
+
+	VkViewport VP{};
+	VP.height = (float)gHeight;
+	VP.width = (float)gWidth;
+	VP.minDepth = 0.0f;
+	VP.maxDepth = 1.0f;
+	vkCmdSetViewport(Cmd, 0, 1, &VP);
+
+	VkRect2D Scissor{};
+
+	Scissor.extent.width = gWidth;
+	Scissor.extent.height = gHeight;
+	Scissor.offset.x = 0;
+	Scissor.offset.y = 0;
+	vkCmdSetScissor(Cmd, 0, 1, &Scissor);
+}
+
+// Only between frames, the old ones can't still be in use
+void GenerateFramebuffers(Vulkan::InstanceObject& Instance)
+{
+	for (auto Framebuffer : Instance.mFramebuffers)
+		vkDestroyFramebuffer(*Instance.GetDevice(), Framebuffer, nullptr);
+
+	VkImageView Attachment[2];
+	Attachment[1] = gFrameGraph.GetTransient(gDepthTarget)->GetView();
+
+	const VkFramebufferCreateInfo FramebufferInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.renderPass = Instance.mRenderPass,
+		.attachmentCount = 2,
+		.pAttachments = Attachment,
+		.width = (uint32_t)gWidth,
+		.height = (uint32_t)gHeight,
+		.layers = 1,
+	};
+
+	VkResult err;
+
+	Instance.mFramebuffers.resize(Instance.mSwapChainBuffers.size());
+
+	for (int i = 0; i < Instance.mFramebuffers.size(); ++i)
+	{
+		Attachment[0] = Instance.mSwapChainBuffers[i].mView;
+		err = vkCreateFramebuffer(*Instance.GetDevice(), &FramebufferInfo, nullptr, &Instance.mFramebuffers[i]);
+		CHECK_ERR(err);
+	}
+
+	const Vulkan::TransientPool& Transients = gFrameGraph.GetTransients();
+	printf("Transient targets: %dKB, %dKB without aliasing, %s memory\n",
+	       (int)(Transients.GetSize() / 1024),
+	       (int)(Transients.GetUnaliasedSize() / 1024),
+	       Transients.IsLazy() ? "lazily allocated" : "device local");
+	gFramebufferGeneration = gFrameGraph.GetTransientGeneration();
+}
+
 void BuildCommandList(Vulkan::InstanceObject& Instance)
 {
 	const VkCommandBufferInheritanceInfo CommandBufferInherentInfo =
@@ -288,11 +523,12 @@ void BuildCommandList(Vulkan::InstanceObject& Instance)
 		.pipelineStatistics = 0,
 	};
 
+	// Recorded fresh every frame
 	const VkCommandBufferBeginInfo CommandBufferInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 		.pNext = nullptr,
-		.flags = 0,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
 		.pInheritanceInfo = &CommandBufferInherentInfo,
 	};
 
@@ -300,12 +536,12 @@ void BuildCommandList(Vulkan::InstanceObject& Instance)
 	ClearValue[0].color = {{0.2, 0.2, 0.2, 0.2}};
 	ClearValue[1].depthStencil = {1.0f, 0};
 
-	const VkRenderPassBeginInfo RenderPassBeginInfo =
+	VkRenderPassBeginInfo RenderPassBeginInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 		.pNext = nullptr,
 		.renderPass = Instance.mRenderPass,
-		.framebuffer = Instance.mFramebuffers[Instance.mCurrentSwapBuffer],
+		.framebuffer = VK_NULL_HANDLE, // Once the graph has placed the depth target
 		.renderArea =
 		{
 			.offset =
@@ -328,59 +564,98 @@ void BuildCommandList(Vulkan::InstanceObject& Instance)
 	err = vkBeginCommandBuffer(Instance.mDrawCommand, &CommandBufferInfo);
 	CHECK_ERR(err);
 
-	vkCmdBeginRenderPass(Instance.mDrawCommand, &RenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	vkCmdBindPipeline(Instance.mDrawCommand, VK_PIPELINE_BIND_POINT_GRAPHICS, Instance.mPipeline);
-	vkCmdBindDescriptorSets(Instance.mDrawCommand, VK_PIPELINE_BIND_POINT_GRAPHICS, Instance.mPipelineLayout,
-	                        0, 1, &Instance.mDescriptorSet, 0, nullptr);
+	gFrameGraph.Reset();
 
-	VkViewport VP{};
-	VP.height = (float)gHeight;
-	VP.width = (float)gWidth;
-	VP.minDepth = 0.0f;
-	VP.maxDepth = 1.0f;
-	vkCmdSetViewport(Instance.mDrawCommand, 0, 1, &VP);
-
-	VkRect2D Scissor{};
+	// Whatever was in the backbuffer gets cleared, it only needs to be presentable at the end
+	// The acquire semaphore is waited on at colour output so that's where the image comes in
+	auto Backbuffer = gFrameGraph.ImportImage(Instance.mSwapChainBuffers[Instance.mCurrentSwapBuffer].mImage,
+	                                          VK_IMAGE_ASPECT_COLOR_BIT,
+	                                          VK_IMAGE_LAYOUT_UNDEFINED,
+	                                          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+	                                          VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	gFrameGraph.MarkOutput(Backbuffer);
 
-	Scissor.extent.width = gWidth;
-	Scissor.extent.height = gHeight;
-	Scissor.offset.x = 0;
-	Scissor.offset.y = 0;
-	vkCmdSetScissor(Instance.mDrawCommand, 0, 1, &Scissor);
+	// Contents are thrown away every frame, the graph makes it wait on whatever used its memory last
+	auto Depth = gFrameGraph.ImportTransient(gDepthTarget);
 
-	VkDeviceSize Offsets{};
-	vkCmdBindVertexBuffers(Instance.mDrawCommand, VERTEX_BUFFER_BIND_ID, 1, Instance.mVertices->GetBuffer(), &Offsets);
+	if (Instance.mCuller)
+	{
+		// Shared by every frame, last frame's draws may still be reading them
+		auto Commands = gFrameGraph.ImportBuffer(Instance.mCuller->GetCommandsBuffer(), VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0);
+		auto Count = gFrameGraph.ImportBuffer(Instance.mCuller->GetCountBuffer(), VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0);
 
-#if 0
-	// Bind triangle index buffer
-	vkCmdBindIndexBuffer(Instance.mDrawCommand, Instance.mIndices->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+		auto& Cull = gFrameGraph.AddPass("Cull", [&](VkCommandBuffer Cmd)
+		{
+			// Bounds are in the space of the shared model matrix
+			const glm::mat4 MVP = Instance.mUBOData.projectionMatrix *
+			                      Instance.mUBOData.viewMatrix *
+			                      Instance.mUBOData.modelMatrix;
+			Instance.mCuller->Cull(Instance, Cmd, Vulkan::ExtractFrustum(MVP));
+		});
+		Cull.WriteBuffer(Commands, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+		// Cleared by a fill before the dispatch appends to it
+		Cull.WriteBuffer(Count, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		                 VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+		auto& Draw = gFrameGraph.AddPass("Draw", [&](VkCommandBuffer Cmd)
+		{
+			vkCmdBeginRenderPass(Cmd, &RenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			SetFrameState(Instance, Cmd);
+
+			// Draws come from the culling pass, so there's only the one set of state to bind
+			vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, Instance.mPipeline);
+			vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, Instance.mPipelineLayout,
+			                        0, 1, &Instance.mDescriptorSet, 0, nullptr);
+
+			VkDeviceSize Offsets{};
+			vkCmdBindVertexBuffers(Cmd, VERTEX_BUFFER_BIND_ID, 1, Instance.mVertices->GetBuffer(), &Offsets);
+
+			const VkBuffer InstanceBuffer = Instance.mInstanceData->GetBuffer();
+			vkCmdBindVertexBuffers(Cmd, INSTANCE_BUFFER_BIND_ID, 1, &InstanceBuffer, &Offsets);
+
+			// Textures are picked per draw
+			const DrawConstants Constants = GetDrawConstants(Instance);
+			vkCmdPushConstants(Cmd, Instance.mPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT,
+			                   0, sizeof(Constants), &Constants);
+
+			vkCmdBindIndexBuffer(Cmd, Instance.mIndices->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+			Instance.mCuller->Draw(Instance, Cmd);
+			vkCmdEndRenderPass(Cmd);
+		});
+		Draw.ReadBuffer(Commands, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+		Draw.ReadBuffer(Count, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+		Draw.WriteImage(Backbuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		Draw.WriteImage(Depth, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	}
+	else
+	{
+		QueueQuads(Instance, gCPUCulling ? gVisibleCount : Instance.mInstanceCount);
 
-	// Draw indexed triangle
-	vkCmdDrawIndexed(Instance.mDrawCommand, Instance.mIndices->GetCount(), 1, 0, 0, 1);
-#else
-	vkCmdDraw(Instance.mDrawCommand, Instance.mVerticeCount, 1, 0, 0);
-#endif
+		auto& Draw = gFrameGraph.AddPass("Draw", [&](VkCommandBuffer Cmd)
+		{
+			// The draws get split up and recorded in parallel
+			vkCmdBeginRenderPass(Cmd, &RenderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			gRecorder->Record(Instance, Cmd,
+			                  Instance.mRenderPass, 0, Instance.mFramebuffers[Instance.mCurrentSwapBuffer],
+			                  gRenderQueue->Size(),
+			                  [&](VkCommandBuffer Secondary, uint32_t Begin, uint32_t End)
+			{
+				SetFrameState(Instance, Secondary);
+				gRenderQueue->Record(Secondary, Begin, End);
+			});
+			vkCmdEndRenderPass(Cmd);
+		});
+		Draw.WriteImage(Backbuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		Draw.WriteImage(Depth, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	}
 
-	vkCmdEndRenderPass(Instance.mDrawCommand);
+	gFrameGraph.Compile(Instance);
+	if (gFrameGraph.GetTransientGeneration() != gFramebufferGeneration)
+		GenerateFramebuffers(Instance);
+	RenderPassBeginInfo.framebuffer = Instance.mFramebuffers[Instance.mCurrentSwapBuffer];
 
-	VkImageMemoryBarrier PrePresentBarrier =
-	{
-		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		.pNext = nullptr,
-		.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-		.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
-		.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-		.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.image = Instance.mSwapChainBuffers[Instance.mCurrentSwapBuffer].mImage,
-		.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1},
-	};
+	gFrameGraph.Execute(Instance.mDrawCommand);
 
-	vkCmdPipelineBarrier(Instance.mDrawCommand,
-	                     VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-				   VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-				   0, 0, nullptr, 0, nullptr, 1, &PrePresentBarrier);
 	err = vkEndCommandBuffer(Instance.mDrawCommand);
 	CHECK_ERR(err);
 }
@@ -399,21 +674,30 @@ void RenderVulkan(Vulkan::InstanceObject& Instance)
 	err = vkCreateSemaphore(*Instance.GetDevice(), &PresentCompleteSemaInfo, nullptr, &PresentCompleteSema);
 	CHECK_ERR(err);
 
+	// Signalled by the submit, present waits on it so the graph's last transition happens first
+	VkSemaphore RenderCompleteSema;
+	err = vkCreateSemaphore(*Instance.GetDevice(), &PresentCompleteSemaInfo, nullptr, &RenderCompleteSema);
+	CHECK_ERR(err);
+
 	err = Instance.AcquireNextImageKHR(*Instance.GetDevice(), Instance.mSwapChain, UINT64_MAX,
 	                                   PresentCompleteSema, nullptr, &Instance.mCurrentSwapBuffer);
 
 	CHECK_ERR(err);
 
-	SetImageLayout(Instance, Instance.mSwapChainBuffers[Instance.mCurrentSwapBuffer].mImage,
-	               VK_IMAGE_ASPECT_COLOR_BIT,
-	               VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-	               VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	// Recycles everything recorded the last time this image came round
+	Instance.mCommands->BeginFrame(Instance, Instance.mCurrentSwapBuffer);
+	Instance.mDrawCommand = Instance.mCommands->Allocate(Instance, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
+	auto RecordStart = std::chrono::high_resolution_clock::now();
+	UpdateInstances(Instance);
+	if (gCPUCulling)
+		CullInstances(Instance);
 	BuildCommandList(Instance);
+	gRecordTime += std::chrono::high_resolution_clock::now() - RecordStart;
 
 	// Submit a queue
-	VkFence NullFence = VK_NULL_HANDLE;
-	VkPipelineStageFlags PipeStageFlag = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	// Only colour output has to wait for the image, culling can start straight away
+	VkPipelineStageFlags PipeStageFlag = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	VkSubmitInfo SubmitInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
@@ -423,11 +707,11 @@ void RenderVulkan(Vulkan::InstanceObject& Instance)
 		.pWaitDstStageMask = &PipeStageFlag,
 		.commandBufferCount = 1,
 		.pCommandBuffers = &Instance.mDrawCommand,
-		.signalSemaphoreCount = 0,
-		.pSignalSemaphores = nullptr,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &RenderCompleteSema,
 	};
 
-	err = vkQueueSubmit(*Instance.GetQueue(), 1, &SubmitInfo, NullFence);
+	err = vkQueueSubmit(*Instance.GetQueue(), 1, &SubmitInfo, Instance.mCommands->GetFence());
 	CHECK_ERR(err);
 
 	// Let's do a present!
@@ -435,8 +719,8 @@ void RenderVulkan(Vulkan::InstanceObject& Instance)
 	{
 		.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 		.pNext = nullptr,
-		.waitSemaphoreCount = 0, // XXX: Not use 0?
-		.pWaitSemaphores = nullptr,
+		.waitSemaphoreCount = 1,
+		.pWaitSemaphores = &RenderCompleteSema,
 		.swapchainCount = 1,
 		.pSwapchains = &Instance.mSwapChain,
 		.pImageIndices = &Instance.mCurrentSwapBuffer,
@@ -451,12 +735,15 @@ void RenderVulkan(Vulkan::InstanceObject& Instance)
 	CHECK_ERR(err);
 
 	vkDestroySemaphore(*Instance.GetDevice(), PresentCompleteSema, nullptr);
+	vkDestroySemaphore(*Instance.GetDevice(), RenderCompleteSema, nullptr);
 }
 
 void GenerateRenderPass(Vulkan::InstanceObject& Instance)
 {
-	const VkAttachmentDescription Attachment =
+	// Layouts match what the frame graph transitions them to around the pass
+	const VkAttachmentDescription Attachments[2] =
 	{
+		{
 		.flags = 0,
 		.format = Instance.GetSurfaceFormat(),
 		.samples = VK_SAMPLE_COUNT_1_BIT,
@@ -466,6 +753,19 @@ void GenerateRenderPass(Vulkan::InstanceObject& Instance)
 		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 		.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
 		.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		},
+		{
+		// Depth never leaves the pass so it never needs to be written out
+		.flags = 0,
+		.format = gFrameGraph.GetTransient(gDepthTarget)->GetFormat(),
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		},
 	};
 
 	const VkAttachmentReference ColorReference =
@@ -474,6 +774,12 @@ void GenerateRenderPass(Vulkan::InstanceObject& Instance)
 		.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
 	};
 
+	const VkAttachmentReference DepthReference =
+	{
+		.attachment = 1,
+		.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+	};
+
 	const VkSubpassDescription SubPass =
 	{
 		.flags = 0,
@@ -483,7 +789,7 @@ void GenerateRenderPass(Vulkan::InstanceObject& Instance)
 		.colorAttachmentCount = 1,
 		.pColorAttachments = &ColorReference,
 		.pResolveAttachments = nullptr,
-		.pDepthStencilAttachment = nullptr,
+		.pDepthStencilAttachment = &DepthReference,
 		.preserveAttachmentCount = 0,
 		.pPreserveAttachments = nullptr,
 	};
@@ -493,8 +799,8 @@ void GenerateRenderPass(Vulkan::InstanceObject& Instance)
 		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
 		.pNext = nullptr,
 		.flags = 0,
-		.attachmentCount = 1,
-		.pAttachments = &Attachment,
+		.attachmentCount = 2,
+		.pAttachments = Attachments,
 		.subpassCount = 1,
 		.pSubpasses = &SubPass,
 		.dependencyCount = 0,
@@ -506,100 +812,79 @@ void GenerateRenderPass(Vulkan::InstanceObject& Instance)
 	CHECK_ERR(err);
 }
 
-void GenerateFramebuffers(Vulkan::InstanceObject& Instance)
-{
-	VkImageView Attachment[2];
-	Attachment[1] = Instance.mDepth->GetView();
+// Shader sources live in Data/Shaders without a #version line
+// That and anything generated at runtime gets put in front when the module is made
+const char* VS_PATH = "../Data/Shaders/Quad.vert";
+const char* FS_PATH = "../Data/Shaders/Quad.frag";
 
-	const VkFramebufferCreateInfo FramebufferInfo =
+// Reloads skip the pack, it's the file on disk that changed
+std::string LoadShaderSource(const char* Filename, bool UsePack = true)
+{
+	if (gAssetPack && UsePack)
 	{
-		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-		.pNext = nullptr,
-		.flags = 0,
-		.renderPass = Instance.mRenderPass,
-		.attachmentCount = 1,
-		.pAttachments = Attachment,
-		.width = (uint32_t)gWidth,
-		.height = (uint32_t)gHeight,
-		.layers = 1,
-	};
-
-	VkResult err;
-
-	Instance.mFramebuffers.resize(Instance.mSwapChainBuffers.size());
+		const Vulkan::AssetPack::Asset* Packed = gAssetPack->Find(Filename);
+		if (Packed && Packed->Type == Vulkan::AssetPack::AssetType::Shader)
+			return std::string((const char*)Packed->Data, Packed->Size);
+	}
 
-	for (int i = 0; i < Instance.mFramebuffers.size(); ++i)
+	FILE* fp = fopen(Filename, "rb");
+	if (!fp)
 	{
-		Attachment[0] = Instance.mSwapChainBuffers[i].mView;
-		err = vkCreateFramebuffer(*Instance.GetDevice(), &FramebufferInfo, nullptr, &Instance.mFramebuffers[i]);
-		CHECK_ERR(err);
+		fprintf(stderr, "Couldn't open shader '%s'\n", Filename);
+		assert(0);
+		return std::string();
 	}
+
+	fseek(fp, 0, SEEK_END);
+	std::string Source(ftell(fp), '\0');
+	fseek(fp, 0, SEEK_SET);
+	size_t Read = fread(&Source[0], 1, Source.size(), fp);
+	fclose(fp);
+
+	Source.resize(Read);
+	return Source;
 }
 
-VkShaderModule PrepareVSModule(Vulkan::InstanceObject& Instance)
+// VK_NULL_HANDLE when the source doesn't compile
+VkShaderModule PrepareShaderModule(Vulkan::InstanceObject& Instance, const std::string& Source)
 {
-	const char vss[] =
-		"#version 450 core\n"
-		"layout(location = 0) in vec3 aVertex;\n"
-		"layout(location = 1) in vec4 aColor;\n"
-		"layout(std140, binding = 0) uniform Block\n"
-		"{\n"
-		"	mat4 projectionMatrix;\n"
-		"	mat4 modelMatrix;\n"
-		"	mat4 viewMatrix;\n"
-		"};\n"
-		"out vec4 vColor;\n"
-		"void main()\n"
-		"{\n"
-		"    vColor = aColor;\n"
-		"    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(aVertex, 1.0);\n"
-		"}\n";
-
 	VkResult err;
 	VkShaderModule Module;
 	VkShaderModuleCreateInfo ModuleCreateInfo;
 	ModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 	ModuleCreateInfo.pNext = nullptr;
 	ModuleCreateInfo.flags = 0;
-	ModuleCreateInfo.codeSize = sizeof(vss);
-	ModuleCreateInfo.pCode = (const uint32_t*)vss;
+	ModuleCreateInfo.codeSize = Source.size() + 1;
+	ModuleCreateInfo.pCode = (const uint32_t*)Source.c_str();
 
 	err = vkCreateShaderModule(*Instance.GetDevice(), &ModuleCreateInfo, nullptr, &Module);
-	CHECK_ERR(err);
+	if (err != VK_SUCCESS)
+	{
+		fprintf(stderr, "Couldn't create shader module: %d\n", err);
+		return VK_NULL_HANDLE;
+	}
 
 	return Module;
 }
 
-VkShaderModule PrepareFSModule(Vulkan::InstanceObject& Instance)
+VkShaderModule PrepareVSModule(Vulkan::InstanceObject& Instance, const std::string& Source)
 {
-	const char fss[] =
-		"#version 450 core\n"
-		"in vec4 vColor;\n"
-		"out vec4 ocol;\n"
-		"layout(binding = 0) uniform sampler2D mySampler;\n"
-		"void main()\n"
-		"{\n"
-		"	ocol = vColor;\n"
-//		"	ocol = texture(mySampler, vec2(1.0, 1.0));\n"
-		"}\n";
-
-	VkResult err;
-	VkShaderModule Module;
-	VkShaderModuleCreateInfo ModuleCreateInfo;
-	ModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	ModuleCreateInfo.pNext = nullptr;
-	ModuleCreateInfo.flags = 0;
-	ModuleCreateInfo.codeSize = sizeof(fss);
-	ModuleCreateInfo.pCode = (const uint32_t*)fss;
-
-	err = vkCreateShaderModule(*Instance.GetDevice(), &ModuleCreateInfo, nullptr, &Module);
-	CHECK_ERR(err);
+	return PrepareShaderModule(Instance, "#version 450 core\n" + Source);
+}
 
-	return Module;
+VkShaderModule PrepareFSModule(Vulkan::InstanceObject& Instance, const std::string& Source)
+{
+	// The texture table decides how the sampler array is declared
+	return PrepareShaderModule(Instance,
+		"#version 450 core\n" +
+		Instance.mTextures->GetShaderDeclaration(TEXTURE_TABLE_SET) +
+		Source);
 }
 
-void GeneratePipeline(Vulkan::InstanceObject& Instance)
+// False when the shaders don't build, Instance.mPipeline is left as it was
+bool GeneratePipeline(Vulkan::InstanceObject& Instance, const std::string& VS, const std::string& FS)
 {
+	PROFILE_SCOPE("GeneratePipeline");
 	VkGraphicsPipelineCreateInfo Pipeline{};
 	VkPipelineCacheCreateInfo PipelineCache{};
 
@@ -667,12 +952,12 @@ void GeneratePipeline(Vulkan::InstanceObject& Instance)
 	// VKShader Module
 	ShaderStage[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	ShaderStage[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-	ShaderStage[0].module = PrepareVSModule(Instance);
+	ShaderStage[0].module = PrepareVSModule(Instance, VS);
 	ShaderStage[0].pName = "main";
 
 	ShaderStage[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	ShaderStage[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	ShaderStage[1].module = PrepareFSModule(Instance);
+	ShaderStage[1].module = PrepareFSModule(Instance, FS);
 	ShaderStage[1].pName = "main";
 
 	// Set all the Pipeline state
@@ -687,18 +972,42 @@ void GeneratePipeline(Vulkan::InstanceObject& Instance)
 	Pipeline.renderPass = Instance.mRenderPass;
 	Pipeline.pDynamicState = &DynamicState;
 
-	// Pipeline cache
-	PipelineCache.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	bool Created = ShaderStage[0].module != VK_NULL_HANDLE && ShaderStage[1].module != VK_NULL_HANDLE;
+	if (Created)
+	{
+		// Pipeline cache
+		PipelineCache.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
 
-	err = vkCreatePipelineCache(*Instance.GetDevice(), &PipelineCache, nullptr, &Instance.mPipelineCache);
-	CHECK_ERR(err);
+		err = vkCreatePipelineCache(*Instance.GetDevice(), &PipelineCache, nullptr, &Instance.mPipelineCache);
+		CHECK_ERR(err);
 
-	err = vkCreateGraphicsPipelines(*Instance.GetDevice(), Instance.mPipelineCache, 1, &Pipeline, nullptr, &Instance.mPipeline);
-	CHECK_ERR(err);
+		VkPipeline New;
+		err = vkCreateGraphicsPipelines(*Instance.GetDevice(), Instance.mPipelineCache, 1, &Pipeline, nullptr, &New);
+		Created = err == VK_SUCCESS;
+		if (Created)
+			Instance.mPipeline = New;
+		else
+			fprintf(stderr, "Couldn't create pipeline: %d\n", err);
 
-	vkDestroyPipelineCache(*Instance.GetDevice(), Instance.mPipelineCache, nullptr);
+		vkDestroyPipelineCache(*Instance.GetDevice(), Instance.mPipelineCache, nullptr);
+	}
+
+	// The pipeline has its own copy of the shaders
+	for (const auto& Stage : ShaderStage)
+		if (Stage.module != VK_NULL_HANDLE)
+			vkDestroyShaderModule(*Instance.GetDevice(), Stage.module, nullptr);
+
+	return Created;
 }
 
+// Packed descriptor infos for our set layout
+// Matches the bindings in GenerateDescriptorLayout
+struct DescriptorData
+{
+	VkDescriptorBufferInfo UBO;
+	VkDescriptorImageInfo Texture;
+};
+
 void GenerateDescriptorLayout(Vulkan::InstanceObject& Instance)
 {
 	const VkDescriptorSetLayoutBinding LayoutBinding[] =
@@ -732,27 +1041,56 @@ void GenerateDescriptorLayout(Vulkan::InstanceObject& Instance)
 	err = vkCreateDescriptorSetLayout(*Instance.GetDevice(), &DescriptorLayout, nullptr, &Instance.mDescriptorLayout);
 	CHECK_ERR(err);
 
+	const VkDescriptorSetLayout SetLayouts[] =
+	{
+		Instance.mDescriptorLayout,
+		Instance.mTextures->GetLayout(), // TEXTURE_TABLE_SET
+	};
+
+	const VkPushConstantRange PushConstants =
+	{
+		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+		.offset = 0,
+		.size = sizeof(DrawConstants),
+	};
+
 	const VkPipelineLayoutCreateInfo PipelineLayoutInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 		.pNext = nullptr,
 		.flags = 0,
-		.setLayoutCount = 1,
-		.pSetLayouts = &Instance.mDescriptorLayout,
-		.pushConstantRangeCount = 0,
-		.pPushConstantRanges = nullptr,
+		.setLayoutCount = 2,
+		.pSetLayouts = SetLayouts,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &PushConstants,
 	};
 
 	err = vkCreatePipelineLayout(*Instance.GetDevice(), &PipelineLayoutInfo, nullptr, &Instance.mPipelineLayout);
 	CHECK_ERR(err);
+
+	// Build the update path for this layout once up front
+	Instance.mDescriptorUpdater = Vulkan::DescriptorUpdater::Create(Instance, Instance.mDescriptorLayout,
+		{
+			{ 0, 0, 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			  offsetof(DescriptorData, UBO), sizeof(VkDescriptorBufferInfo) },
+			{ 1, 0, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			  offsetof(DescriptorData, Texture), sizeof(VkDescriptorImageInfo) },
+		},
+		sizeof(DescriptorData));
 }
 
 void GenerateDescriptorPool(Vulkan::InstanceObject& Instance)
 {
-	const VkDescriptorPoolSize TypeCount =
+	const VkDescriptorPoolSize TypeCount[] =
 	{
+		{
+		.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		.descriptorCount = 1,
+		},
+		{
 		.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 		.descriptorCount = 1,
+		},
 	};
 
 	// Pool size of 0 causes vkCreateDescriptorPool to crash
@@ -762,8 +1100,8 @@ void GenerateDescriptorPool(Vulkan::InstanceObject& Instance)
 		.pNext = nullptr,
 		.flags = 0,
 		.maxSets = 1,
-		.poolSizeCount = 1,
-		.pPoolSizes = &TypeCount,
+		.poolSizeCount = 2,
+		.pPoolSizes = TypeCount,
 	};
 
 	VkResult err;
@@ -772,6 +1110,28 @@ void GenerateDescriptorPool(Vulkan::InstanceObject& Instance)
 	CHECK_ERR(err);
 }
 
+// Written again whenever the drawn texture gets replaced
+void WriteDescriptorSet(Vulkan::InstanceObject& Instance)
+{
+	// Only unset when every texture went in to the atlas
+	const Vulkan::Sampler* Drawn = Instance.mSampler ? Instance.mSampler.get() : Instance.mAtlas->GetSampler();
+
+	const DescriptorData Data =
+	{
+		.UBO = *Instance.mUBO->GetDesc(),
+		// Set up samplers
+		.Texture =
+		{
+			.sampler = Drawn->GetSampler(),
+			.imageView = Drawn->GetTexture()->GetView(),
+			.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		},
+	};
+
+	Instance.mDescriptorUpdater->Update(Instance, Instance.mDescriptorSet, &Data);
+	Instance.mDescriptorUpdater->Flush(Instance);
+}
+
 void GenerateDescriptorSet(Vulkan::InstanceObject& Instance)
 {
 	VkResult err;
@@ -787,47 +1147,7 @@ void GenerateDescriptorSet(Vulkan::InstanceObject& Instance)
 	err = vkAllocateDescriptorSets(*Instance.GetDevice(), &AllocInfo, &Instance.mDescriptorSet);
 	CHECK_ERR(err);
 
-	// Set up samplers
-	VkDescriptorImageInfo TextureInfo =
-	{
-		.sampler = Instance.mSampler->GetSampler(),
-		.imageView = Instance.mSampler->GetTexture()->GetView(),
-		.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
-	};
-
-	VkWriteDescriptorSet Write[2] =
-	{
-		{
-		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-		.pNext = nullptr,
-		.dstSet = Instance.mDescriptorSet,
-		// Binds UBO to binding point 0
-		.dstBinding = 0,
-		.dstArrayElement = 0,
-		.descriptorCount = 1,
-		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		.pImageInfo = nullptr,
-		.pBufferInfo = Instance.mUBO->GetDesc(),
-		.pTexelBufferView = nullptr,
-		},
-
-		{
-		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-		.pNext = nullptr,
-		.dstSet = Instance.mDescriptorSet,
-		// Binds Sampler to binding point 0
-		.dstBinding = 1,
-		.dstArrayElement = 0,
-		.descriptorCount = 1,
-		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-		.pImageInfo = &TextureInfo,
-		.pBufferInfo = nullptr,
-		.pTexelBufferView = nullptr,
-		},
-
-	};
-
-	vkUpdateDescriptorSets(*Instance.GetDevice(), 2, Write, 0, nullptr);
+	WriteDescriptorSet(Instance);
 }
 
 void UpdateUniformBuffer(Vulkan::InstanceObject& Instance)
@@ -849,42 +1169,245 @@ void UpdateUniformBuffer(Vulkan::InstanceObject& Instance)
 	Instance.mUBO->UnmapData(Instance);
 }
 
-void GenerateTexture(Vulkan::InstanceObject& Instance)
+// Decodes the small textures across the job system and packs them in to the atlas
+// Returns each file's atlas handle, ~0U for the ones left to load on their own
+std::vector<uint32_t> AtlasTextures(Vulkan::InstanceObject& Instance)
 {
-	PNGLoader Png("../Data/Texture.png");
+	PROFILE_SCOPE("AtlasTextures");
 
-	VkExtent2D Dim { Png.GetWidth(), Png.GetHeight() };
+	struct Decoded
+	{
+		std::vector<uint8_t> Pixels;
+		const uint8_t* Data = nullptr;
+		uint32_t Width = 0, Height = 0;
+	};
+	std::vector<Decoded> Files(gTextureFiles.size());
 
-	// Create our staging buffer
-	std::unique_ptr<Vulkan::Texture2D> StagingTexture = Vulkan::Texture2D::CreateHost(Instance, Dim, 1, 1,
-		VK_FORMAT_B8G8R8A8_UNORM, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_TILING_LINEAR,
-		VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+	Vulkan::JobCounter Done;
+	for (uint32_t i = 0; i < gTextureFiles.size(); ++i)
+	{
+		gJobs->Run([i, &Files]()
+		{
+			Decoded& Current = Files[i];
 
-	// Create our GPU side buffer
-	std::unique_ptr<Vulkan::Texture2D> Texture = Vulkan::Texture2D::CreateGPU(Instance, Dim, 1, 1,
-		VK_FORMAT_B8G8R8A8_UNORM, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+			// Packed chains start with level 0, so those don't need decoding
+			const Vulkan::AssetPack::Asset* Packed = gAssetPack ? gAssetPack->Find(gTextureFiles[i]) : nullptr;
+			if (Packed && Packed->Type == Vulkan::AssetPack::AssetType::Texture && Packed->Format == VK_FORMAT_B8G8R8A8_UNORM)
+			{
+				if (std::max(Packed->Width, Packed->Height) <= ATLAS_MAX_TEXTURE)
+				{
+					Current.Data = Packed->Data;
+					Current.Width = Packed->Width;
+					Current.Height = Packed->Height;
+				}
+				return;
+			}
+
+			PNGLoader Png(gTextureFiles[i]);
+			if (!Png.GetWidth() || !Png.GetHeight() || std::max(Png.GetWidth(), Png.GetHeight()) > ATLAS_MAX_TEXTURE)
+				return;
+
+			Current.Pixels.resize(Png.GetDecodedSize());
+			if (!Png.Decode(Current.Pixels.data(), Png.GetWidth() * 4))
+				return;
+
+			Current.Data = Current.Pixels.data();
+			Current.Width = Png.GetWidth();
+			Current.Height = Png.GetHeight();
+		}, &Done);
+	}
+	gJobs->Wait(&Done);
+
+	Instance.mAtlas = Vulkan::TextureAtlas::Create(Instance, Instance.mTextures.get());
+
+	std::vector<uint32_t> Handles(Files.size(), ~0U);
+	for (uint32_t i = 0; i < Files.size(); ++i)
+	{
+		if (Files[i].Data)
+			Handles[i] = Instance.mAtlas->Add(Instance, Files[i].Data, Files[i].Width, Files[i].Height);
+	}
+	Instance.mAtlas->Flush(Instance);
+
+	const Vulkan::AtlasPacker& Packer = Instance.mAtlas->GetPacker();
+	printf("Atlased %d textures, %.1f%% of the atlas used\n", Instance.mAtlas->GetCount(),
+	       100.0 * Packer.GetUsed() / ((uint64_t)Packer.GetWidth() * Packer.GetHeight()));
+	return Handles;
+}
+
+// Files sharing a size go in to one texture array each, as long as there's at least two of them
+// Returns the files left to load on their own
+std::vector<std::string> ArrayTextures(Vulkan::InstanceObject& Instance, const std::vector<std::string>& Files)
+{
+	PROFILE_SCOPE("ArrayTextures");
 
-	VkImageLayout DstLayout, SrcLayout;
+	typedef std::pair<uint32_t, uint32_t> Size;
+	std::vector<Size> Sizes(Files.size(), Size(0, 0));
+	std::map<Size, std::vector<std::string>> Groups;
+	for (uint32_t i = 0; i < Files.size(); ++i)
+	{
+		// Packed textures know their size already, otherwise only the PNG's header gets read
+		const Vulkan::AssetPack::Asset* Packed = gAssetPack ? gAssetPack->Find(Files[i]) : nullptr;
+		if (Packed && Packed->Type == Vulkan::AssetPack::AssetType::Texture)
+			Sizes[i] = Size(Packed->Width, Packed->Height);
+		else if (!PNGLoader::ReadSize(Files[i], &Sizes[i].first, &Sizes[i].second))
+			continue;
+		Groups[Sizes[i]].push_back(Files[i]);
+	}
+
+	std::vector<std::string> Remaining;
+	for (uint32_t i = 0; i < Files.size(); ++i)
+	{
+		auto Group = Groups.find(Sizes[i]);
+		if (Group == Groups.end() || Group->second.size() < 2)
+			Remaining.push_back(Files[i]);
+	}
+
+	uint32_t Arrays = 0, Layers = 0;
+	for (auto& Group : Groups)
+	{
+		const std::vector<std::string>& Grouped = Group.second;
+		if (Grouped.size() < 2)
+			continue;
+
+		auto Array = Instance.mTextureLoader->LoadArray(Instance, Grouped, VkExtent2D{Group.first.first, Group.first.second});
+		auto NewSampler = std::make_unique<Vulkan::Sampler>(Instance, std::move(Array));
+		uint32_t Index = Instance.mTextures->Add(Instance, NewSampler.get());
+		for (uint32_t Layer = 0; Layer < Grouped.size(); ++Layer)
+			gLoadedTextures[Grouped[Layer]] = {NewSampler.get(), Index, Layer};
+
+		// Draws pick the drawn texture's layer out of the array
+		auto Drawn = std::find(Grouped.begin(), Grouped.end(), gTextureFiles[0]);
+		if (Drawn != Grouped.end() && !Instance.mSampler)
+		{
+			Instance.mSampler = std::move(NewSampler);
+			Instance.mTextureIndex = Index;
+			Instance.mTextureLayer = Drawn - Grouped.begin();
+		}
+		else
+		{
+			Instance.mSamplers.push_back(std::move(NewSampler));
+		}
 
-	DstLayout = Texture->GetLayout();
-	SrcLayout = StagingTexture->GetLayout();
+		++Arrays;
+		Layers += Grouped.size();
+	}
 
-	SetImageLayout(Instance, StagingTexture->GetImage(), VK_IMAGE_ASPECT_COLOR_BIT, SrcLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-	SetImageLayout(Instance, Texture->GetImage(), VK_IMAGE_ASPECT_COLOR_BIT, DstLayout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	printf("%d textures in %d arrays, %d on their own\n", Layers, Arrays, (uint32_t)Remaining.size());
+	return Remaining;
+}
 
-	// Copy the texture from the PNG
-	StagingTexture->CopyToTexture(Instance, &Png);
+// Decodes are spread across the job system and uploaded in batches as they finish
+void GenerateTextures(Vulkan::InstanceObject& Instance)
+{
+	Instance.mTextureLoader = Vulkan::TextureBatchLoader::Create(Instance, gJobs.get());
+	Instance.mTextureLoader->SetPack(gAssetPack.get());
+	if (gTextureCachePath)
+	{
+		Instance.mTextureCache = Vulkan::TextureCache::Create(gTextureCachePath, gTextureCacheSize);
+		Instance.mTextureLoader->SetCache(Instance.mTextureCache.get());
+	}
 
-	// Copy the texture from the staging buffer
-	Texture->CopyFromTexture(Instance, StagingTexture.get());
+	std::vector<uint32_t> Atlased(gTextureFiles.size(), ~0U);
+	if (gAtlas)
+		Atlased = AtlasTextures(Instance);
 
-	SetImageLayout(Instance, Texture->GetImage(), VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, DstLayout);
+	// The first texture is the one drawn, which the descriptor set points straight at, so it never streams
+	std::vector<std::string> Loading;
+	for (uint32_t i = 0; i < gTextureFiles.size(); ++i)
+	{
+		if (Atlased[i] != ~0U)
+			continue;
+
+		const Vulkan::AssetPack::Asset* Packed = i && gStreamBudget && gAssetPack ? gAssetPack->Find(gTextureFiles[i]) : nullptr;
+		if (!Packed || Packed->Type != Vulkan::AssetPack::AssetType::Texture || Packed->Format != VK_FORMAT_B8G8R8A8_UNORM)
+		{
+			Loading.push_back(gTextureFiles[i]);
+			continue;
+		}
+
+		if (!Instance.mStreamer)
+			Instance.mStreamer = Vulkan::TextureStreamer::Create(Instance, Instance.mTextures.get(), gJobs.get(), gStreamBudget);
+		Instance.mStreamer->Add(Packed->Data, Packed->Width, Packed->Height, Packed->Levels);
+	}
+
+	// Same sized textures share an image and a table slot
+	const uint32_t Streamed = gTextureFiles.size() - Loading.size();
+	if (gTextureArrays)
+		Loading = ArrayTextures(Instance, Loading);
+
+	auto Textures = Instance.mTextureLoader->Load(Instance, Loading);
+
+	// Only the tails to start with, the rest comes in as it gets asked for
+	if (Instance.mStreamer)
+	{
+		Instance.mStreamer->Flush(Instance);
+		printf("Streaming %d textures, %.1fMB resident of %.1fMB\n", Streamed,
+		       Instance.mStreamer->GetResidency().GetCommitted() / (1024.0 * 1024.0), gStreamBudget / (1024.0 * 1024.0));
+	}
+
+	for (uint32_t i = 0; i < Textures.size(); ++i)
+	{
+		if (!Textures[i])
+			continue;
+
+		// Create sampler
+		auto NewSampler = std::make_unique<Vulkan::Sampler>(Instance, std::move(Textures[i]));
+		uint32_t Index = Instance.mTextures->Add(Instance, NewSampler.get());
+		gLoadedTextures[Loading[i]] = {NewSampler.get(), Index, 0};
+
+		if (!Instance.mSampler)
+		{
+			Instance.mSampler = std::move(NewSampler);
+			Instance.mTextureIndex = Index;
+		}
+		else
+		{
+			Instance.mSamplers.push_back(std::move(NewSampler));
+		}
+	}
+
+	// The drawn texture is in the atlas, so draws only sample its region of it
+	if (Atlased[0] != ~0U)
+	{
+		const Vulkan::TextureAtlas::Region& Region = Instance.mAtlas->GetRegion(Atlased[0]);
+		Instance.mTextureIndex = Instance.mAtlas->GetTableIndex();
+		Instance.mTextureUV[0] = Region.Scale[0];
+		Instance.mTextureUV[1] = Region.Scale[1];
+		Instance.mTextureUV[2] = Region.Offset[0];
+		Instance.mTextureUV[3] = Region.Offset[1];
+	}
+	assert(Instance.mSampler || Atlased[0] != ~0U);
+}
+
+// Textures go in decoded with their mips, in the order they get loaded
+bool BuildAssetPack(const char* Path)
+{
+	Vulkan::AssetPackWriter Writer;
+	for (auto& File : gTextureFiles)
+	{
+		PNGLoader Png(File);
+		const uint32_t Levels = Vulkan::GetMipLevels(Png.GetWidth(), Png.GetHeight());
+		std::vector<uint8_t> Pixels(Vulkan::GetMipOffset(Png.GetWidth(), Png.GetHeight(), Levels));
+		if (!Png.GetDecodedSize() || !Png.Decode(&Pixels[0], Png.GetWidth() * 4))
+		{
+			fprintf(stderr, "Couldn't pack texture '%s'\n", File.c_str());
+			return false;
+		}
+
+		Vulkan::GenerateMips(&Pixels[0], Png.GetWidth(), Png.GetHeight(), Levels);
+		Writer.AddTexture(File, Png.GetWidth(), Png.GetHeight(), Levels, VK_FORMAT_B8G8R8A8_UNORM,
+		                  Pixels.data(), Pixels.size());
+	}
 
-	// Create sampler
-	Instance.mSampler = std::make_unique<Vulkan::Sampler>(Instance, std::move(Texture));
+	Writer.AddShader(VS_PATH, LoadShaderSource(VS_PATH));
+	Writer.AddShader(FS_PATH, LoadShaderSource(FS_PATH));
+	return Writer.Write(Path);
+}
 
-	Vulkan::SubmitSetupQueue(Instance);
+void GenerateTextureTable(Vulkan::InstanceObject& Instance)
+{
+	// Textures get added as they finish uploading
+	Instance.mTextures = Vulkan::TextureTable::Create(Instance, TEXTURE_TABLE_CAPACITY);
 }
 
 void GenerateUniformBuffer(Vulkan::InstanceObject& Instance)
@@ -939,10 +1462,101 @@ void GenerateVertices(Vulkan::InstanceObject& Instance)
 	// Indices
 	const std::vector<uint32_t> IndicesBuffer =
 	{
-		0, 1, 2, 3, 4, 5, 6, 7,
+		0, 1, 2, 3,
 	};
 
-	Instance.mIndices = Vulkan::IndicesBuffer::Create(Instance, IndicesBuffer, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	Instance.mIndices = Vulkan::IndicesBuffer::Create(Instance, IndicesBuffer, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+}
+
+// Lays out Count quads on a square grid covering the original quad
+void FillInstanceGrid(Vulkan::InstanceObject& Instance, uint32_t Count)
+{
+	assert(Count <= gMaxInstances);
+
+	uint32_t Side = (uint32_t)ceilf(sqrtf((float)Count));
+	float Scale = 1.0f / Side;
+
+	// With CPU culling the instance buffer only holds what's visible
+	if (gCPUCulling)
+	{
+		gInstances.resize(Count);
+		gBounds.Resize(Count);
+	}
+
+	gTransforms.Resize(Count);
+	for (uint32_t i = 0; i < Count; ++i)
+	{
+		float x = -1.0f + Scale * (2 * (i % Side) + 1);
+		float y = -1.0f + Scale * (2 * (i / Side) + 1);
+
+		gTransforms.Set(i, glm::vec3(x, y, 0.0f), glm::quat(), glm::vec3(Scale, Scale, 1.0f));
+	}
+	UpdateInstances(Instance);
+
+	if (gCPUCulling)
+	{
+		for (uint32_t i = 0; i < Count; ++i)
+		{
+			glm::vec3 Center = gTransforms.GetPosition(i);
+			gBounds.Set(i, Center.x, Center.y, Center.z, Scale * sqrtf(2.0f));
+		}
+	}
+
+	if (Instance.mCuller)
+	{
+		// Every quad is its own object with its own draw
+		glm::vec4* Bounds = Instance.mCuller->GetBounds();
+		Vulkan::IndirectCuller::DrawRecord* Records = Instance.mCuller->GetRecords();
+		for (uint32_t i = 0; i < Count; ++i)
+		{
+			glm::vec3 Center = gTransforms.GetPosition(i);
+			Bounds[i] = glm::vec4(Center, Scale * sqrtf(2.0f));
+			Records[i] = { Instance.mIndices->GetCount(), 0, 0, i };
+		}
+		Instance.mCuller->SetObjectCount(Count);
+	}
+
+	Instance.mInstanceCount = Count;
+}
+
+void GenerateInstances(Vulkan::InstanceObject& Instance)
+{
+	Instance.mInstanceData = Vulkan::StorageBuffer::Create(Instance, gMaxInstances * sizeof(InstanceData),
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	Vulkan::VertexBuffer::AddBinding({
+		.binding = INSTANCE_BUFFER_BIND_ID,
+		.stride = sizeof(InstanceData),
+		.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE});
+
+	// A mat4 takes up four consecutive locations
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		Vulkan::VertexBuffer::AddAttribute({
+			.location = 2 + i,
+			.binding = INSTANCE_BUFFER_BIND_ID,
+			.format = VK_FORMAT_R32G32B32A32_SFLOAT,
+			.offset = (uint32_t)(offsetof(InstanceData, Model) + sizeof(glm::vec4) * i)});
+	}
+
+	gRenderQueue = std::make_unique<Vulkan::RenderQueue>(VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(DrawConstants));
+	gRecorder = Vulkan::ParallelRecorder::Create(gJobs.get(), Instance.mCommands.get());
+
+	if (gCPUCulling)
+	{
+		gCPUCuller = std::make_unique<Vulkan::CPUCuller>(SIMDLevel::Best, gJobs.get());
+		printf("CPU culling with %s on %d threads\n",
+		       SIMDName(gCPUCuller->GetKernel()), gCPUCuller->GetThreads());
+	}
+	else if (gGPUCulling)
+	{
+		if (Vulkan::IndirectCuller::IsSupported(Instance))
+			Instance.mCuller = Vulkan::IndirectCuller::Create(Instance, gMaxInstances);
+		else
+			printf("GPU culling needs drawIndirectFirstInstance, drawing everything\n");
+	}
+
+	FillInstanceGrid(Instance, gInstanceCount);
 }
 
 void GenerateDepth(Vulkan::InstanceObject& Instance)
@@ -952,45 +1566,280 @@ void GenerateDepth(Vulkan::InstanceObject& Instance)
 	printf("Generating an extent with dim %dx%d\n", gWidth, gHeight);
 
 	VkExtent2D Dim { (uint32_t)gWidth, (uint32_t)gHeight };
-	Instance.mDepth = Vulkan::Texture2D::CreateGPU(Instance, Dim,
-		1, 1, DepthFormat, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
 
-	Instance.mDepth->TransitionImageFormat(Instance, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	// Only the draw pass touches depth, it's cleared on load and never stored
+	// Memory comes once the first frame's graph shows when it's used
+	const Vulkan::TransientPool::Desc Depth =
+	{
+		.Dim = Dim,
+		.Format = DepthFormat,
+		.Usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+	};
+	gDepthTarget = gFrameGraph.AddTransient(Instance, Depth);
+}
+
+// Copies a whole mip chain in to Layer of Texture and waits for it
+// Only between frames, nothing can still be drawing with it
+void UploadTexture(Vulkan::InstanceObject& Instance, Vulkan::Texture2D* Texture, uint32_t Layer, const std::vector<uint8_t>& Chain)
+{
+	VkResult err;
+	VkBuffer Staging;
+	VkDeviceMemory StagingMemory;
+	Vulkan::Util::CreateBuffer(Instance, Chain.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&Staging, &StagingMemory);
+
+	void* Data;
+	err = vkMapMemory(*Instance.GetDevice(), StagingMemory, 0, VK_WHOLE_SIZE, 0, &Data);
+	CHECK_ERR(err);
+	memcpy(Data, Chain.data(), Chain.size());
+	vkUnmapMemory(*Instance.GetDevice(), StagingMemory);
+
+	const VkDeviceSize Offset = 0;
+	Texture->TransitionImageFormat(Instance, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	{
+		Vulkan::SetupBatch::Recording Setup(Instance);
+		Texture->CopyLayersFromBuffer(Setup.Get(), Staging, &Layer, &Offset, 1);
+	}
+	Texture->TransitionImageFormat(Instance, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	Instance.mSetup->Submit(Instance);
+
+	vkDestroyBuffer(*Instance.GetDevice(), Staging, nullptr);
+	vkFreeMemory(*Instance.GetDevice(), StagingMemory, nullptr);
+}
+
+void ApplyReload(Vulkan::InstanceObject& Instance, Reload& Finished)
+{
+	PROFILE_SCOPE("ApplyReload");
+
+	if (Finished.Shader)
+	{
+		// Draws are recorded fresh every frame, so they pick the new one up from here on
+		// One that doesn't build leaves the old one drawing until it's fixed
+		VkPipeline Old = Instance.mPipeline;
+		if (!GeneratePipeline(Instance, Finished.VS, Finished.FS))
+		{
+			printf("Couldn't reload shaders, keeping the old ones\n");
+			return;
+		}
+		vkDestroyPipeline(*Instance.GetDevice(), Old, nullptr);
+		printf("Reloaded shaders\n");
+		return;
+	}
+
+	if (!Finished.Loaded)
+	{
+		printf("Couldn't reload '%s', keeping the old one\n", Finished.File.c_str());
+		return;
+	}
+
+	const LoadedTexture& Target = gLoadedTextures[Finished.File];
+	Vulkan::Texture2D* Texture = Target.Sampler->GetTexture();
+	const VkExtent2D Dim = Texture->GetDimensions();
+
+	// Same size, the new texels go straight over the old ones
+	if (Dim.width == Finished.Width && Dim.height == Finished.Height && Texture->GetLevels() == Finished.Levels)
+	{
+		UploadTexture(Instance, Texture, Target.Layer, Finished.Chain);
+		printf("Reloaded '%s'\n", Finished.File.c_str());
+		return;
+	}
+
+	// The rest of an array is still the old size
+	if (Texture->GetLayers() > 1)
+	{
+		printf("'%s' changed size, it can't stay in its texture array\n", Finished.File.c_str());
+		return;
+	}
+
+	auto Resized = Vulkan::Texture2D::CreateGPU(Instance, VkExtent2D{Finished.Width, Finished.Height}, Finished.Levels, 1,
+		VK_FORMAT_B8G8R8A8_UNORM, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	UploadTexture(Instance, Resized.get(), 0, Finished.Chain);
+
+	auto Old = Target.Sampler->SetTexture(std::move(Resized));
+	Instance.mTextures->Replace(Instance, Target.TableIndex, Target.Sampler);
+	if (Target.Sampler == Instance.mSampler.get())
+		WriteDescriptorSet(Instance);
+	Old->Destroy(Instance);
+	printf("Reloaded '%s' at %dx%d\n", Finished.File.c_str(), Finished.Width, Finished.Height);
+}
+
+// Starts on whatever changed, and swaps in whatever's finished
+// Called between frames with the device idle, so nothing in flight uses what gets replaced
+void HotReload(Vulkan::InstanceObject& Instance)
+{
+	PROFILE_SCOPE("HotReload");
+
+	for (auto& File : gWatcher->Poll())
+	{
+		const bool Shader = File == VS_PATH || File == FS_PATH;
+		if (!Shader && !gLoadedTextures.count(File))
+			continue;
+
+		gReloads.push_back(std::make_unique<Reload>());
+		Reload* Started = gReloads.back().get();
+		Started->File = File;
+		Started->Shader = Shader;
+
+		// Both go together, the pipeline is built from the pair
+		if (Shader)
+		{
+			gJobs->Run([Started]()
+			{
+				Started->VS = LoadShaderSource(VS_PATH, false);
+				Started->FS = LoadShaderSource(FS_PATH, false);
+			}, &Started->Done);
+			continue;
+		}
+
+		gJobs->Run([Started]()
+		{
+			PROFILE_SCOPE("Decode reload");
+			Started->Loaded = false;
+
+			// Gone or not a PNG, the old one stays
+			PNGLoader Png(Started->File);
+			if (!Png.GetWidth())
+				return;
+
+			Started->Width = Png.GetWidth();
+			Started->Height = Png.GetHeight();
+			Started->Levels = Vulkan::GetMipLevels(Started->Width, Started->Height);
+
+			Started->Chain.resize(Vulkan::GetMipOffset(Started->Width, Started->Height, Started->Levels));
+			Started->Loaded = Png.Decode(Started->Chain.data(), Started->Width * 4);
+			if (Started->Loaded)
+				Vulkan::GenerateMips(Started->Chain.data(), Started->Width, Started->Height, Started->Levels);
+		}, &Started->Done);
+	}
+
+	// In order, so a file that changed twice ends up as its newest version
+	while (!gReloads.empty() && gReloads.front()->Done.Done())
+	{
+		ApplyReload(Instance, *gReloads.front());
+		gReloads.pop_front();
+	}
+}
+
+void WatchFiles()
+{
+	gWatcher = Vulkan::FileWatcher::Create();
+	gWatcher->Watch(VS_PATH);
+	gWatcher->Watch(FS_PATH);
+
+	// Atlased and streamed textures don't come back to the file they were loaded from, so
+	// they aren't watched. The atlas region is set in the UV transform once, and streamed ones read the pack
+	for (auto& Loaded : gLoadedTextures)
+		gWatcher->Watch(Loaded.first);
+
+	if (gAtlas || gStreamBudget)
+		printf("Atlased and streamed textures won't reload, they only change on a restart\n");
+
+	printf("Watching %d files for changes\n", (uint32_t)gWatcher->GetWatched());
 }
 
 void DoVulkanThings()
 {
-	GetInstanceInfo();
-	Vulkan::InstanceObject Instance(true);
+	std::unique_ptr<Vulkan::InstanceObject> InstancePtr;
+	std::string VS, FS;
+
+	// Everything that doesn't touch the device overlaps with creating it, and the
+	// pipeline only waits on what it's built from so it overlaps with the uploads
+	Vulkan::TaskGraph Startup(gJobs.get());
 
-	printf("We have %d GPUs\n", Vulkan::GetGPUCount(Instance));
-	Vulkan::UseGPU(Instance, 0); // Just use the first one
+	auto CreateInstance = Startup.Add("Instance", [&]()
+	{
+		GetInstanceInfo();
+		InstancePtr = std::make_unique<Vulkan::InstanceObject>(true);
+
+		printf("We have %d GPUs\n", Vulkan::GetGPUCount(*InstancePtr));
+		Vulkan::UseGPU(*InstancePtr, 0); // Just use the first one
 
-	//GetDeviceInfo(Instance);
+		//GetDeviceInfo(*InstancePtr);
+	});
 
-	GenerateSwapChain(Instance);
+	auto LoadShaders = Startup.Add("Load shaders", [&]()
+	{
+		VS = LoadShaderSource(VS_PATH);
+		FS = LoadShaderSource(FS_PATH);
+	});
 
-	//GetSurfaceCapabilities(Instance);
-	GenerateDepth(Instance);
-	GenerateTexture(Instance);
-	GenerateUniformBuffer(Instance);
-	GenerateVertices(Instance);
-	GenerateDescriptorLayout(Instance);
-	GenerateRenderPass(Instance);
-	GeneratePipeline(Instance);
-	GenerateDescriptorPool(Instance);
-	GenerateDescriptorSet(Instance);
-	GenerateFramebuffers(Instance);
+	auto Device = Startup.Add("Device", [&]()
+	{
+		if (!GenerateSwapChain(*InstancePtr))
+			Startup.Cancel();
+	}, {CreateInstance});
+	//GetSurfaceCapabilities(*InstancePtr);
+
+	auto Depth = Startup.Add("Depth", [&]() { GenerateDepth(*InstancePtr); }, {Device});
+	auto Table = Startup.Add("Texture table", [&]() { GenerateTextureTable(*InstancePtr); }, {Device});
+
+	// Loads and uploads on its own, so the rest carries on while it goes
+	// Nothing else submits during startup, so it can have the queue to itself
+	auto Texture = Startup.Add("Textures", [&]() { GenerateTextures(*InstancePtr); }, {Device, Table});
+
+	auto Uniforms = Startup.Add("Uniform buffer", [&]() { GenerateUniformBuffer(*InstancePtr); }, {Device});
+	auto Vertices = Startup.Add("Vertices", [&]() { GenerateVertices(*InstancePtr); }, {Device});
+
+	// Vertex layouts are shared between all vertex buffers, so this can't run alongside Vertices
+	auto Instances = Startup.Add("Instances", [&]() { GenerateInstances(*InstancePtr); }, {Vertices});
+
+	auto DescriptorLayout = Startup.Add("Descriptor layout", [&]() { GenerateDescriptorLayout(*InstancePtr); }, {Table});
+	auto RenderPass = Startup.Add("Render pass", [&]() { GenerateRenderPass(*InstancePtr); }, {Depth});
+	Startup.Add("Pipeline", [&]()
+	{
+		if (!GeneratePipeline(*InstancePtr, VS, FS))
+			Startup.Cancel();
+	}, {LoadShaders, Table, DescriptorLayout, RenderPass, Vertices, Instances});
+
+	auto DescriptorPool = Startup.Add("Descriptor pool", [&]() { GenerateDescriptorPool(*InstancePtr); }, {Device});
+	Startup.Add("Descriptor set", [&]() { GenerateDescriptorSet(*InstancePtr); },
+		{DescriptorPool, DescriptorLayout, Uniforms, Texture});
+
+	const bool Started = Startup.Run(gSerialStartup);
+	Startup.PrintTimings("Startup");
+	if (!Started)
+	{
+		fprintf(stderr, "Startup failed\n");
+		return;
+	}
+
+	Vulkan::InstanceObject& Instance = *InstancePtr;
+
+	// Anything recorded while starting up
+	Instance.mSetup->Submit(Instance);
+	printf("Setup: %d command buffers in %d submits\n",
+	       Instance.mSetup->GetCommandsSubmitted(), Instance.mSetup->GetSubmits());
+
+	if (gHotReload)
+		WatchFiles();
 
 	// Run loop
 	uint32_t iter = 0;
 	auto start = std::chrono::high_resolution_clock::now();
+	bool FirstFrame = true;
 	while (!glfwWindowShouldClose(gWin))
 	{
 		glfwPollEvents();
-		RenderVulkan(Instance);
-		vkDeviceWaitIdle(*Instance.GetDevice());
+		{
+			// Only the first frame is part of the load path, a null name isn't recorded
+			Profiler::Scope Frame(FirstFrame ? "First frame" : nullptr);
+			RenderVulkan(Instance);
+			vkDeviceWaitIdle(*Instance.GetDevice());
+
+			// Nothing's in flight, so this is where streamed textures get swapped
+			// Requests for them came from this frame's draws
+			if (Instance.mStreamer)
+				Instance.mStreamer->Update(Instance);
+
+			if (gWatcher)
+				HotReload(Instance);
+		}
+
+		if (FirstFrame && Profiler::IsEnabled())
+			printf("Time to first frame: %.2fms\n", Profiler::GetElapsed());
+		FirstFrame = false;
 
 		UpdateUniformBuffer(Instance);
 //		rotation.y += 0.01f;
@@ -1001,9 +1850,36 @@ void DoVulkanThings()
 		{
 			start = std::chrono::high_resolution_clock::now();
 			printf("%d loops in 1s\n", iter);
+
+			if (gBenchInstances)
+			{
+				auto RecordUS = std::chrono::duration_cast<std::chrono::microseconds>(gRecordTime).count();
+				printf("Bench: %d instances, %d frames/s, %.2fus recording per frame\n",
+				       Instance.mInstanceCount, iter, (double)RecordUS / iter);
+
+				const auto& Stats = gRenderQueue->GetStats();
+				printf("Bench: %d draws, binds %d pipeline %d set %d vertex %d constant, %d redundant skipped\n",
+				       Stats.Draws, Stats.PipelineBinds, Stats.SetBinds, Stats.VertexBinds,
+				       Stats.ConstantPushes, Stats.Skipped);
+
+				const auto& Graph = gFrameGraph.GetStats();
+				printf("Bench: %d passes, %d culled, %d barriers in %d calls\n",
+				       Graph.Passes, Graph.Culled, Graph.Barriers, Graph.BarrierCalls);
+
+				// Step up an order of magnitude each second
+				if (Instance.mInstanceCount >= BENCH_MAX_INSTANCES)
+					break;
+				FillInstanceGrid(Instance, std::min(Instance.mInstanceCount * 10, BENCH_MAX_INSTANCES));
+			}
+
+			gRecordTime = {};
 			iter = 0;
 		}
 	}
+
+	// Reloads still decoding would be writing in to freed memory
+	for (auto& Pending : gReloads)
+		gJobs->Wait(&Pending->Done);
 }
 
 std::atomic<bool> mResized{false};
@@ -1015,19 +1891,178 @@ static void ResizeCallback(GLFWwindow* window, int width, int height)
 		mResized = true;
 }
 
-int main()
+int main(int argc, char** argv)
 {
-	if (!Context::Init())
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--instances") && i + 1 < argc)
+		{
+			gInstanceCount = std::max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--instances-per-draw") && i + 1 < argc)
+		{
+			gInstancesPerDraw = std::max(0, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+		{
+			gThreads = std::max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--pin-threads"))
+		{
+			gPinThreads = true;
+		}
+		else if (!strcmp(argv[i], "--serial-startup"))
+		{
+			gSerialStartup = true;
+		}
+		else if (!strcmp(argv[i], "--profile") && i + 1 < argc)
+		{
+			gTracePath = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--texture") && i + 1 < argc)
+		{
+			gTextureFiles.push_back(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--texture-cache") && i + 1 < argc)
+		{
+			gTextureCachePath = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--texture-cache-size") && i + 1 < argc)
+		{
+			// In MB
+			gTextureCacheSize = (uint64_t)std::max(0, atoi(argv[++i])) * 1024 * 1024;
+		}
+		else if (!strcmp(argv[i], "--no-texture-cache"))
+		{
+			gTextureCachePath = nullptr;
+		}
+		else if (!strcmp(argv[i], "--pack") && i + 1 < argc)
+		{
+			gAssetPack = Vulkan::AssetPack::Create(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--build-pack") && i + 1 < argc)
+		{
+			gBuildPackPath = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--atlas"))
+		{
+			gAtlas = true;
+		}
+		else if (!strcmp(argv[i], "--texture-arrays"))
+		{
+			gTextureArrays = true;
+		}
+		else if (!strcmp(argv[i], "--hot-reload"))
+		{
+			gHotReload = true;
+		}
+		else if (!strcmp(argv[i], "--stream-budget") && i + 1 < argc)
+		{
+			// In MB
+			gStreamBudget = (uint64_t)std::max(1, atoi(argv[++i])) * 1024 * 1024;
+		}
+		else if (!strcmp(argv[i], "--gpu-culling"))
+		{
+			gGPUCulling = true;
+		}
+		else if (!strcmp(argv[i], "--cpu-culling"))
+		{
+			gCPUCulling = true;
+		}
+		else if (!strcmp(argv[i], "--bench-cull"))
+		{
+			Bench::CPUCulling();
+			return 0;
+		}
+		else if (!strcmp(argv[i], "--spin"))
+		{
+			gSpin = true;
+		}
+		else if (!strcmp(argv[i], "--bench-jobs"))
+		{
+			Bench::Jobs();
+			return 0;
+		}
+		else if (!strcmp(argv[i], "--bench-transforms"))
+		{
+			Bench::Transforms();
+			return 0;
+		}
+		else if (!strcmp(argv[i], "--bench-pixels"))
+		{
+			Bench::PixelConversion();
+			return 0;
+		}
+		else if (!strcmp(argv[i], "--bench-png"))
+		{
+			Bench::PNGDecode();
+			return 0;
+		}
+		else if (!strcmp(argv[i], "--bench-texture-cache"))
+		{
+			Bench::TextureCache();
+			return 0;
+		}
+		else if (!strcmp(argv[i], "--bench-streaming"))
+		{
+			Bench::Streaming();
+			return 0;
+		}
+		else if (!strcmp(argv[i], "--bench-atlas"))
+		{
+			Bench::Atlas();
+			return 0;
+		}
+		else if (!strcmp(argv[i], "--bench-transients"))
+		{
+			Bench::Transients();
+			return 0;
+		}
+		else if (!strcmp(argv[i], "--bench-instances"))
+		{
+			gBenchInstances = true;
+			gInstanceCount = 1;
+		}
+		else
+		{
+			fprintf(stderr, "Unknown argument '%s'\n", argv[i]);
+			return -1;
+		}
+	}
+	gMaxInstances = gBenchInstances ? BENCH_MAX_INSTANCES : gInstanceCount;
+
+	if (gTextureFiles.empty())
+		gTextureFiles.push_back("../Data/Texture.png");
+
+	if (gBuildPackPath)
+		return BuildAssetPack(gBuildPackPath) ? 0 : -1;
+
+	if (gTracePath)
+		Profiler::Start();
+
+	gJobs = Vulkan::JobSystem::Create(gThreads, gPinThreads);
+
+	bool Init;
+	{
+		PROFILE_SCOPE("Context::Init");
+		Init = Context::Init();
+	}
+	if (!Init)
 		return -1;
 
 	gWidth = 640;
 	gHeight = 480;
-	gWin = Context::CreateWindow(gWidth, gHeight, "VulkanTest");
+	{
+		PROFILE_SCOPE("CreateWindow");
+		gWin = Context::CreateWindow(gWidth, gHeight, "VulkanTest");
+	}
 	glfwSetFramebufferSizeCallback(gWin, ResizeCallback);
 
 //	while (!mResized.load()) { glfwPollEvents(); }
 	DoVulkanThings();
 
+	Profiler::Stop(gTracePath);
+
 	Context::DestroyWindow(gWin);
 	Context::Shutdown();
 	return 0;